@@ -0,0 +1,267 @@
+#include "bench.hpp"
+#include <tuki/render/gl/null_gl.hpp>
+
+#include <tuki/util/profiler.hpp>
+#include <tuki/util/mallocr/mallocr_arena.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+#ifdef _WIN32
+	#include <direct.h>
+	#define chdir _chdir
+#else
+	#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char* USAGE =
+	"usage: tuki_bench [--filter <text>] [--reps <n>] [--warmup <n>] [--min-time <ms>]\n"
+	"                  [--quick] [--json <file>] [--assets <dir>] [--list]\n"
+	"  --filter: only run the benchmarks whose name contains the text\n"
+	"  --reps: measured repetitions of each benchmark (default 10)\n"
+	"  --warmup: repetitions discarded before measuring (default 2)\n"
+	"  --min-time: minimum duration of a repetition (default 20 ms)\n"
+	"  --quick: few short repetitions, for checking that everything runs\n"
+	"  --json: also write the results to a file\n"
+	"  --assets: directory with the test assets (default: the test_tuki sources)\n"
+	"  --list: print the names of the benchmarks\n";
+
+vector<BenchRegistration>& getBenchRegistry()
+{
+	static vector<BenchRegistration> registry;
+	return registry;
+}
+
+string benchTempPath(const char* name)
+{
+	const char* tmp = getenv("TMPDIR");
+	return string(tmp && tmp[0] ? tmp : "/tmp") + "/" + name;
+}
+
+Bench::Bench(const string& name, const BenchOptions& options)
+	: name(name), options(options), itemsPerIteration(0), iterations(0)
+{}
+
+void Bench::setCounter(const string& name, double value)
+{
+	for (auto& counter : counters)
+	{
+		if (counter.first == name)
+		{
+			counter.second = value;
+			return;
+		}
+	}
+	counters.push_back(make_pair(name, value));
+}
+
+BenchResult Bench::getResult()const
+{
+	vector<double> s = samples;
+	sort(s.begin(), s.end());
+	const size_t n = s.size();
+	double sum = 0;
+	for (double x : s) sum += x;
+	const double mean = sum / n;
+	double var = 0;
+	for (double x : s) var += (x - mean) * (x - mean);
+
+	BenchResult res;
+	res.name = name;
+	res.iterations = iterations;
+	res.reps = (unsigned)n;
+	res.minNs = s.front();
+	res.maxNs = s.back();
+	res.medianNs = n % 2 ? s[n / 2] : 0.5 * (s[n / 2 - 1] + s[n / 2]);
+	res.meanNs = mean;
+	res.stddevNs = n > 1 ? sqrt(var / (n - 1)) : 0;
+	res.p90Ns = s[std::min(n - 1, (size_t)(0.9 * n))];
+	res.itemsPerIteration = itemsPerIteration;
+	res.itemsPerSecond = itemsPerIteration > 0 ? itemsPerIteration * 1e9 / res.medianNs : 0;
+	res.counters = counters;
+	return res;
+}
+
+static string formatTime(double ns)
+{
+	stringstream ss;
+	ss << fixed << setprecision(2);
+	if (ns < 1e3) ss << ns << " ns";
+	else if (ns < 1e6) ss << ns * 1e-3 << " us";
+	else ss << ns * 1e-6 << " ms";
+	return ss.str();
+}
+
+static void printHeader()
+{
+	cout << setw(36) << left << "benchmark" << right
+		<< setw(12) << "median" << setw(12) << "mean" << setw(9) << "stddev"
+		<< setw(12) << "p90" << setw(12) << "min" << setw(14) << "items/s" << endl;
+}
+
+static void printResult(const BenchResult& r)
+{
+	stringstream rel;
+	rel << fixed << setprecision(1) << (r.meanNs > 0 ? 100 * r.stddevNs / r.meanNs : 0) << "%";
+	cout << setw(36) << left << r.name << right
+		<< setw(12) << formatTime(r.medianNs) << setw(12) << formatTime(r.meanNs)
+		<< setw(9) << rel.str() << setw(12) << formatTime(r.p90Ns) << setw(12) << formatTime(r.minNs);
+	if (r.itemsPerSecond > 0) cout << setw(14) << setprecision(3) << scientific << r.itemsPerSecond << fixed;
+	cout << endl;
+	for (const auto& counter : r.counters)
+		cout << "    " << counter.first << ": " << defaultfloat << setprecision(6) << counter.second << fixed << endl;
+}
+
+static void writeJson(ostream& out, const vector<BenchResult>& results, const BenchOptions& options)
+{
+	using namespace rapidjson;
+	StringBuffer sb;
+	PrettyWriter<StringBuffer> writer(sb);
+	writer.StartObject();
+	writer.Key("context");
+	writer.StartObject();
+#ifdef NDEBUG
+	writer.Key("build"); writer.String("release");
+#else
+	writer.Key("build"); writer.String("debug");
+#endif
+	writer.Key("profiler"); writer.Bool(Profiler::isEnabled());
+	writer.Key("hardwareThreads"); writer.Uint(thread::hardware_concurrency());
+	writer.Key("warmupReps"); writer.Uint(options.warmupReps);
+	writer.Key("reps"); writer.Uint(options.reps);
+	writer.Key("minRepTimeMs"); writer.Double(options.minRepTimeMs);
+	writer.EndObject();
+
+	writer.Key("benchmarks");
+	writer.StartArray();
+	for (const BenchResult& r : results)
+	{
+		writer.StartObject();
+		writer.Key("name"); writer.String(r.name.c_str());
+		writer.Key("iterations"); writer.Uint64(r.iterations);
+		writer.Key("reps"); writer.Uint(r.reps);
+		writer.Key("minNs"); writer.Double(r.minNs);
+		writer.Key("medianNs"); writer.Double(r.medianNs);
+		writer.Key("meanNs"); writer.Double(r.meanNs);
+		writer.Key("stddevNs"); writer.Double(r.stddevNs);
+		writer.Key("p90Ns"); writer.Double(r.p90Ns);
+		writer.Key("maxNs"); writer.Double(r.maxNs);
+		if (r.itemsPerIteration > 0)
+		{
+			writer.Key("itemsPerIteration"); writer.Double(r.itemsPerIteration);
+			writer.Key("itemsPerSecond"); writer.Double(r.itemsPerSecond);
+		}
+		if (!r.counters.empty())
+		{
+			writer.Key("counters");
+			writer.StartObject();
+			for (const auto& counter : r.counters)
+			{
+				writer.Key(counter.first.c_str()); writer.Double(counter.second);
+			}
+			writer.EndObject();
+		}
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	out << sb.GetString() << endl;
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	string filter;
+	string jsonFile;
+	string assetsDir = TUKI_BENCH_ASSETS_DIR;
+	bool list = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--filter") == 0 && hasValue) filter = argv[++i];
+		else if (strcmp(argv[i], "--reps") == 0 && hasValue) options.reps = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue) options.warmupReps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--min-time") == 0 && hasValue) options.minRepTimeMs = atof(argv[++i]);
+		else if (strcmp(argv[i], "--json") == 0 && hasValue) jsonFile = argv[++i];
+		else if (strcmp(argv[i], "--assets") == 0 && hasValue) assetsDir = argv[++i];
+		else if (strcmp(argv[i], "--list") == 0) list = true;
+		else if (strcmp(argv[i], "--quick") == 0)
+		{
+			options.warmupReps = 1;
+			options.reps = 3;
+			options.minRepTimeMs = 2;
+		}
+		else
+		{
+			cout << USAGE;
+			return 1;
+		}
+	}
+
+	// the benchmarks are sorted so the order doesn't depend on the link order
+	vector<BenchRegistration> benchmarks = getBenchRegistry();
+	sort(benchmarks.begin(), benchmarks.end(), [](const BenchRegistration& a, const BenchRegistration& b)
+	{
+		return strcmp(a.name, b.name) < 0;
+	});
+	if (list)
+	{
+		for (const BenchRegistration& reg : benchmarks) cout << reg.name << endl;
+		return 0;
+	}
+
+	// opened before changing the working directory, the path is relative to the caller's
+	ofstream jsonOut;
+	if (!jsonFile.empty())
+	{
+		jsonOut.open(jsonFile);
+		if (!jsonOut)
+		{
+			cerr << "could not open " << jsonFile << endl;
+			return 1;
+		}
+	}
+
+	// the assets are loaded with paths relative to the test directory
+	if (chdir(assetsDir.c_str()) != 0)
+	{
+		cerr << "could not open the assets directory: " << assetsDir << endl;
+		return 1;
+	}
+	NullGl::install();
+
+	vector<BenchResult> results;
+	printHeader();
+	for (const BenchRegistration& reg : benchmarks)
+	{
+		if (!filter.empty() && string(reg.name).find(filter) == string::npos) continue;
+		Bench b(reg.name, options);
+		try
+		{
+			reg.func(b);
+		}
+		catch (const exception& e)
+		{
+			cerr << reg.name << " failed: " << e.what() << endl;
+			return 1;
+		}
+		LinearArena::beginFrame();
+		if (!b.hasRun()) continue;
+		results.push_back(b.getResult());
+		printResult(results.back());
+	}
+
+	if (jsonOut.is_open()) writeJson(jsonOut, results, options);
+	return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstdint>
+
+/*
+Minimal microbenchmark harness.
+A benchmark is a function that prepares its data and then calls Bench::run with the
+code to measure. run() calibrates the number of iterations so each repetition lasts at
+least minRepTime, discards the warmup repetitions and keeps the time per iteration of
+each of the others, from which the statistics are computed.
+The data of the benchmarks must be generated with fixed seeds so the runs are comparable.
+*/
+
+struct BenchOptions
+{
+	unsigned warmupReps = 2;
+	unsigned reps = 10;
+	double minRepTimeMs = 20;
+};
+
+struct BenchResult
+{
+	std::string name;
+	std::uint64_t iterations;	// per repetition
+	unsigned reps;
+	double minNs, medianNs, meanNs, stddevNs, p90Ns, maxNs;	// per iteration
+	double itemsPerIteration;	// 0 if not specified
+	double itemsPerSecond;		// using the median
+	std::vector<std::pair<std::string, double> > counters;
+};
+
+class Bench
+{
+public:
+	Bench(const std::string& name, const BenchOptions& options);
+
+	// number of items processed in each iteration, for reporting throughput
+	void setItemsPerIteration(double items) { itemsPerIteration = items; }
+	// other results of the benchmark that are reported with the times, like a ratio of culled objects
+	void setCounter(const std::string& name, double value);
+
+	// measures f(), which is called many times
+	template <typename F>
+	void run(const F& f);
+
+	bool hasRun()const { return !samples.empty(); }
+	BenchResult getResult()const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	std::string name;
+	BenchOptions options;
+	double itemsPerIteration;
+	std::uint64_t iterations;
+	std::vector<double> samples;	// ns per iteration
+	std::vector<std::pair<std::string, double> > counters;
+};
+
+// path of a file in the temp dir ($TMPDIR or /tmp), for the data generated by the benchmarks
+std::string benchTempPath(const char* name);
+
+// prevents the compiler from removing the computation of a value that is not used
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+template <typename F>
+void Bench::run(const F& f)
+{
+	// calibration: the iterations are doubled until a repetition is long enough
+	const double minRepNs = options.minRepTimeMs * 1e6;
+	iterations = 1;
+	for (;;)
+	{
+		const Clock::time_point t0 = Clock::now();
+		for (std::uint64_t i = 0; i < iterations; i++) f();
+		const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+		if (ns >= minRepNs || iterations >= (1ull << 40)) break;
+		// jump close to the target when the estimate is reliable
+		if (ns > minRepNs / 16) iterations = (std::uint64_t)(iterations * 1.2 * minRepNs / ns) + 1;
+		else iterations *= 2;
+	}
+
+	samples.clear();
+	for (unsigned r = 0; r < options.warmupReps + options.reps; r++)
+	{
+		const Clock::time_point t0 = Clock::now();
+		for (std::uint64_t i = 0; i < iterations; i++) f();
+		const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+		if (r >= options.warmupReps) samples.push_back(ns / iterations);
+	}
+}
+
+typedef void (*BenchFunc)(Bench& b);
+
+struct BenchRegistration
+{
+	const char* name;
+	BenchFunc func;
+};
+
+std::vector<BenchRegistration>& getBenchRegistry();
+
+struct BenchRegistrar
+{
+	BenchRegistrar(const char* name, BenchFunc func) { getBenchRegistry().push_back({ name, func }); }
+};
+
+// defines and registers a benchmark: TUKI_BENCH(material_load) { ... b.run(...); }
+#define TUKI_BENCH(name) \
+	static void bench_##name(Bench& b); \
+	static BenchRegistrar benchRegistrar_##name(#name, bench_##name); \
+	static void bench_##name(Bench& b)
@@ -0,0 +1,285 @@
+#include "bench.hpp"
+
+#include <tuki/scene/bvh.hpp>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+static const unsigned NUM_QUERIES = 256;
+
+// small boxes scattered in a cube, with the density of a big open world
+struct BvhWorld
+{
+	vector<AABB> boxes;
+	float size;
+	Bvh bvh;		// built with rebuild()
+	vector<int> proxies;
+};
+
+static void makeBoxes(unsigned n, vector<AABB>& boxes, float& size)
+{
+	size = 10 * cbrt((float)n);
+	mt19937 rng(1);
+	uniform_real_distribution<float> pos(0, size);
+	uniform_real_distribution<float> ext(0.2f, 2.f);
+	boxes.resize(n);
+	for (AABB& box : boxes)
+	{
+		const glm::vec3 c(pos(rng), pos(rng), pos(rng));
+		const glm::vec3 e(ext(rng), ext(rng), ext(rng));
+		box = AABB(c - e, c + e);
+	}
+}
+
+static void buildBvh(Bvh& bvh, const vector<AABB>& boxes, vector<int>& proxies, bool sah)
+{
+	bvh.clear();
+	proxies.resize(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) proxies[i] = bvh.createProxy(boxes[i], nullptr);
+	if (sah) bvh.rebuild();
+}
+
+// generated once for each size, they are big
+static BvhWorld& getBvhWorld(unsigned n)
+{
+	static unique_ptr<BvhWorld> worlds[2];
+	unique_ptr<BvhWorld>& world = worlds[n > 100000];
+	if (!world || world->boxes.size() != n)
+	{
+		world.reset(new BvhWorld);
+		makeBoxes(n, world->boxes, world->size);
+		buildBvh(world->bvh, world->boxes, world->proxies, true);
+	}
+	return *world;
+}
+
+// inserting one by one, like when the objects are spawned
+static void benchBuildIncremental(Bench& b, unsigned n)
+{
+	vector<AABB> boxes;
+	float size;
+	makeBoxes(n, boxes, size);
+	Bvh bvh;
+	vector<int> proxies;
+	b.setItemsPerIteration(n);
+	b.run([&]
+	{
+		buildBvh(bvh, boxes, proxies, false);
+		doNotOptimize(bvh.getHeight());
+	});
+}
+
+// only the top-down binned SAH build, the proxies are already created
+static void benchBuildSah(Bench& b, unsigned n)
+{
+	vector<AABB> boxes;
+	float size;
+	makeBoxes(n, boxes, size);
+	Bvh bvh;
+	vector<int> proxies;
+	buildBvh(bvh, boxes, proxies, false);
+	b.setItemsPerIteration(n);
+	b.run([&]
+	{
+		bvh.rebuild();
+		doNotOptimize(bvh.getHeight());
+	});
+}
+
+TUKI_BENCH(bvh_build_incremental_100k) { benchBuildIncremental(b, 100000); }
+TUKI_BENCH(bvh_build_incremental_1m) { benchBuildIncremental(b, 1000000); }
+TUKI_BENCH(bvh_build_sah_100k) { benchBuildSah(b, 100000); }
+TUKI_BENCH(bvh_build_sah_1m) { benchBuildSah(b, 1000000); }
+
+// cameras inside the world looking in random directions
+static vector<Frustum> makeFrustums(const BvhWorld& world)
+{
+	mt19937 rng(2);
+	uniform_real_distribution<float> pos(0, world.size);
+	uniform_real_distribution<float> dir(-1, 1);
+	const glm::mat4 proj = glm::perspective(glm::radians(60.f), 16.f / 9, 0.1f, 200.f);
+	vector<Frustum> frustums(NUM_QUERIES);
+	for (Frustum& f : frustums)
+	{
+		const glm::vec3 eye(pos(rng), pos(rng), pos(rng));
+		const glm::vec3 d(dir(rng), dir(rng) * 0.2f, dir(rng));
+		f = Frustum::fromMatrix(proj * glm::lookAt(eye, eye + d, glm::vec3(0, 1, 0)));
+	}
+	return frustums;
+}
+
+static void benchFrustum(Bench& b, unsigned n)
+{
+	const BvhWorld& world = getBvhWorld(n);
+	const vector<Frustum> frustums = makeFrustums(world);
+
+	// the results must be the same as testing all the boxes
+	vector<int> found;
+	for (unsigned q = 0; q < 4; q++)
+	{
+		found.clear();
+		world.bvh.queryFrustum(frustums[q], found);
+		size_t expected = 0;
+		for (int proxy : world.proxies)
+			expected += testFrustum(frustums[q], world.bvh.getFatAABB(proxy)) != FrustumTest::OUTSIDE;
+		if (found.size() != expected) throw runtime_error("the frustum query doesn't match the brute force");
+	}
+
+	unsigned q = 0;
+	b.setItemsPerIteration(1);
+	b.run([&]
+	{
+		size_t count = 0;
+		world.bvh.queryFrustum(frustums[q++ % NUM_QUERIES], [&](int) { count++; return true; });
+		doNotOptimize(count);
+	});
+}
+
+TUKI_BENCH(bvh_query_frustum_100k) { benchFrustum(b, 100000); }
+TUKI_BENCH(bvh_query_frustum_1m) { benchFrustum(b, 1000000); }
+
+// closest hit, NULL_NODE if there is none
+static int raycastClosest(const Bvh& bvh, const Ray& ray, float tMax)
+{
+	const glm::vec3 invDir = 1.f / ray.dir;
+	int hit = Bvh::NULL_NODE;
+	bvh.raycast(ray, tMax, [&](int proxy, float t) -> float
+	{
+		float tHit;
+		if (!intersects(ray, invDir, bvh.getFatAABB(proxy), t, tHit)) return t;
+		hit = proxy;
+		return tHit;
+	});
+	return hit;
+}
+
+static void benchRay(Bench& b, unsigned n)
+{
+	const BvhWorld& world = getBvhWorld(n);
+	mt19937 rng(3);
+	uniform_real_distribution<float> pos(0, world.size);
+	uniform_real_distribution<float> dir(-1, 1);
+	vector<Ray> rays(NUM_QUERIES);
+	for (Ray& ray : rays)
+	{
+		ray.origin = glm::vec3(pos(rng), pos(rng), pos(rng));
+		ray.dir = glm::normalize(glm::vec3(dir(rng), dir(rng), dir(rng)) + glm::vec3(1e-3f));
+	}
+	const float tMax = world.size;
+
+	// the closest hit must be the same as testing all the boxes
+	for (unsigned q = 0; q < 4; q++)
+	{
+		const Ray& ray = rays[q];
+		const glm::vec3 invDir = 1.f / ray.dir;
+		float bestT = tMax;
+		for (int proxy : world.proxies)
+		{
+			float t;
+			if (intersects(ray, invDir, world.bvh.getFatAABB(proxy), bestT, t) && t < bestT) bestT = t;
+		}
+		const int hit = raycastClosest(world.bvh, ray, tMax);
+		float hitT = tMax;
+		if (hit != Bvh::NULL_NODE) intersects(ray, invDir, world.bvh.getFatAABB(hit), tMax, hitT);
+		if (hitT != bestT) throw runtime_error("the raycast doesn't match the brute force");
+	}
+
+	unsigned q = 0;
+	b.setItemsPerIteration(1);
+	b.run([&]
+	{
+		doNotOptimize(raycastClosest(world.bvh, rays[q++ % NUM_QUERIES], tMax));
+	});
+}
+
+TUKI_BENCH(bvh_query_ray_100k) { benchRay(b, 100000); }
+TUKI_BENCH(bvh_query_ray_1m) { benchRay(b, 1000000); }
+
+static void benchAABB(Bench& b, unsigned n)
+{
+	const BvhWorld& world = getBvhWorld(n);
+	mt19937 rng(4);
+	uniform_real_distribution<float> pos(0, world.size);
+	vector<AABB> queries(NUM_QUERIES);
+	for (AABB& box : queries)
+	{
+		const glm::vec3 c(pos(rng), pos(rng), pos(rng));
+		box = AABB(c - glm::vec3(8), c + glm::vec3(8));
+	}
+
+	vector<int> found;
+	for (unsigned q = 0; q < 4; q++)
+	{
+		found.clear();
+		world.bvh.queryAABB(queries[q], found);
+		size_t expected = 0;
+		for (int proxy : world.proxies) expected += intersects(queries[q], world.bvh.getFatAABB(proxy));
+		if (found.size() != expected) throw runtime_error("the AABB query doesn't match the brute force");
+	}
+
+	unsigned q = 0;
+	b.setItemsPerIteration(1);
+	b.run([&]
+	{
+		size_t count = 0;
+		world.bvh.queryAABB(queries[q++ % NUM_QUERIES], [&](int) { count++; return true; });
+		doNotOptimize(count);
+	});
+}
+
+TUKI_BENCH(bvh_query_aabb_100k) { benchAABB(b, 100000); }
+TUKI_BENCH(bvh_query_aabb_1m) { benchAABB(b, 1000000); }
+
+// a tenth of the objects move every frame. Most stay in their fat boxes, the fast ones are reinserted
+static void benchMove(Bench& b, unsigned n)
+{
+	vector<AABB> boxes;
+	float size;
+	makeBoxes(n, boxes, size);
+	Bvh bvh;
+	vector<int> proxies;
+	buildBvh(bvh, boxes, proxies, true);
+
+	const unsigned numMoving = n / 10;
+	vector<glm::vec3> velocities(numMoving);
+	mt19937 rng(5);
+	uniform_real_distribution<float> slow(-0.02f, 0.02f);
+	uniform_real_distribution<float> fast(-0.5f, 0.5f);
+	for (unsigned i = 0; i < numMoving; i++)
+	{
+		uniform_real_distribution<float>& dist = i % 8 == 0 ? fast : slow;
+		velocities[i] = glm::vec3(dist(rng), dist(rng), dist(rng));
+	}
+
+	b.setItemsPerIteration(numMoving);
+	b.run([&]
+	{
+		unsigned reinserted = 0;
+		for (unsigned i = 0; i < numMoving; i++)
+		{
+			AABB& box = boxes[i * 10];
+			box.min += velocities[i];
+			box.max += velocities[i];
+			reinserted += bvh.moveProxy(proxies[i * 10], box);
+		}
+		doNotOptimize(reinserted);
+	});
+
+	// the tree must still find every object
+	vector<int> found;
+	for (unsigned i = 0; i < numMoving; i += 997)
+	{
+		found.clear();
+		bvh.queryAABB(boxes[i * 10], found);
+		if (find(found.begin(), found.end(), proxies[i * 10]) == found.end())
+			throw runtime_error("a moved proxy is not found in the tree");
+	}
+}
+
+TUKI_BENCH(bvh_move_refit_100k) { benchMove(b, 100000); }
+TUKI_BENCH(bvh_move_refit_1m) { benchMove(b, 1000000); }
@@ -0,0 +1,140 @@
+#include "bench.hpp"
+
+#include <tuki/render/culling/occlusion_culler.hpp>
+#include <tuki/render/mesh/mesh.hpp>
+#include <random>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+// unit cube in [0, 1], scaled with the model matrix to make the buildings
+class CubeMesh : public IMesh
+{
+public:
+	GeomType getGeomType()const { return GeomType::TRIANGLES; }
+	const unsigned* getIndices()const { return INDICES; }
+	const float* getAttribData(AttribLocation index)const
+	{
+		return index == AttribLocation::POS ? POSITIONS : nullptr;
+	}
+	unsigned getNumVertices()const { return 8; }
+	unsigned getNumIndices()const { return 36; }
+
+private:
+	static const float POSITIONS[8 * 3];
+	static const unsigned INDICES[36];
+};
+
+const float CubeMesh::POSITIONS[8 * 3] =
+{
+	0, 0, 0,  1, 0, 0,  1, 1, 0,  0, 1, 0,
+	0, 0, 1,  1, 0, 1,  1, 1, 1,  0, 1, 1,
+};
+
+// counter clockwise seen from outside
+const unsigned CubeMesh::INDICES[36] =
+{
+	0, 2, 1,  0, 3, 2,	// -z
+	4, 5, 6,  4, 6, 7,	// +z
+	0, 4, 7,  0, 7, 3,	// -x
+	1, 2, 6,  1, 6, 5,	// +x
+	0, 1, 5,  0, 5, 4,	// -y
+	3, 7, 6,  3, 6, 2,	// +y
+};
+
+static const unsigned CITY_BLOCKS = 32;		// per side
+static const float BLOCK_SIZE = 20;
+static const float STREET_WIDTH = 8;
+static const unsigned NUM_CANDIDATES = 20000;
+
+// a grid of buildings with streets in between, and small objects (props, cars, people) everywhere.
+// The camera is at street level, so most of the city is hidden behind the closest buildings
+struct City
+{
+	vector<glm::mat4> buildings;
+	vector<AABB> candidates;
+	glm::mat4 viewProj;
+};
+
+static const City& getCity()
+{
+	static City city;
+	if (!city.buildings.empty()) return city;
+	mt19937 rng(1);
+	uniform_real_distribution<float> height(10, 60);
+	const float pitch = BLOCK_SIZE + STREET_WIDTH;
+	for (unsigned z = 0; z < CITY_BLOCKS; z++)
+	for (unsigned x = 0; x < CITY_BLOCKS; x++)
+	{
+		const glm::vec3 pos(x * pitch, 0, z * pitch);
+		glm::mat4 m = glm::translate(glm::mat4(1), pos);
+		city.buildings.push_back(glm::scale(m, glm::vec3(BLOCK_SIZE, height(rng), BLOCK_SIZE)));
+	}
+
+	const float citySize = CITY_BLOCKS * pitch;
+	uniform_real_distribution<float> pos(0, citySize);
+	uniform_real_distribution<float> ext(0.3f, 1.5f);
+	for (unsigned i = 0; i < NUM_CANDIDATES; i++)
+	{
+		const glm::vec3 c(pos(rng), ext(rng), pos(rng));
+		const glm::vec3 e(ext(rng));
+		city.candidates.push_back(AABB(c - e, c + e));
+	}
+
+	// in a street near the corner, looking along the diagonal
+	const glm::vec3 eye(BLOCK_SIZE + STREET_WIDTH / 2, 1.8f, BLOCK_SIZE + STREET_WIDTH / 2);
+	const glm::mat4 view = glm::lookAt(eye, glm::vec3(citySize, 1.8f, citySize * 0.8f), glm::vec3(0, 1, 0));
+	city.viewProj = glm::perspective(glm::radians(70.f), 16.f / 9, 0.5f, 2000.f) * view;
+	return city;
+}
+
+static void rasterizeCity(OcclusionCuller& culler, const City& city, const CubeMesh& cube)
+{
+	culler.beginFrame(city.viewProj);
+	for (const glm::mat4& m : city.buildings) culler.addOccluder(cube, m);
+	culler.rasterizeOccluders();
+}
+
+TUKI_BENCH(occlusion_city_rasterize)
+{
+	const City& city = getCity();
+	CubeMesh cube;
+	OcclusionCuller culler;
+	b.setItemsPerIteration((double)city.buildings.size());
+	b.run([&]
+	{
+		rasterizeCity(culler, city, cube);
+		doNotOptimize(culler.getTileDepthBuffer()[0]);
+	});
+	b.setCounter("rasterized triangles", culler.getNumRasterizedTriangles());
+}
+
+TUKI_BENCH(occlusion_city_test)
+{
+	const City& city = getCity();
+	CubeMesh cube;
+	OcclusionCuller culler;
+	rasterizeCity(culler, city, cube);
+
+	// the objects that are in front of everything can't be culled
+	const Frustum frustum = Frustum::fromMatrix(city.viewProj);
+	unsigned inFrustum = 0, culled = 0;
+	for (const AABB& box : city.candidates)
+	{
+		if (testFrustum(frustum, box) == FrustumTest::OUTSIDE) continue;
+		inFrustum++;
+		culled += !culler.isVisible(box);
+	}
+	if (culled == 0) throw runtime_error("nothing was culled by the buildings");
+
+	b.setItemsPerIteration(NUM_CANDIDATES);
+	b.run([&]
+	{
+		unsigned visible = 0;
+		for (const AABB& box : city.candidates) visible += culler.isVisible(box);
+		doNotOptimize(visible);
+	});
+	b.setCounter("candidates in the frustum", inFrustum);
+	b.setCounter("culled fraction (in the frustum)", (double)culled / inFrustum);
+}
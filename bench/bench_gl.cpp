@@ -0,0 +1,86 @@
+#include "bench.hpp"
+
+#include <tuki/render/gl/gl_trace.hpp>
+#include <tuki/render/gl/render.hpp>
+#include <tuki/render/gl/render_capture.hpp>
+#include <tuki/render/gl/render_replayer.hpp>
+#include <tuki/render/gl/texture.hpp>
+#include <tuki/render/gl/mesh_gpu.hpp>
+#include <glad/glad.h>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
+
+using namespace std;
+
+// cost of a GL call that doesn't do anything, without and with the tracing wrapper
+TUKI_BENCH(gl_call)
+{
+	b.run([&]
+	{
+		glUniform1f(0, 1.f);
+	});
+}
+
+TUKI_BENCH(gl_call_traced)
+{
+	GlTrace::install();
+	b.run([&]
+	{
+		glUniform1f(0, 1.f);
+	});
+	GlTrace::endFrame();
+	GlTrace::uninstall();
+}
+
+// replays a capture several times, like render_replay --repeat. The second frame frees the texture
+// and creates it again, so the first one is created again at the beginning of each pass
+TUKI_BENCH(render_replay_repeat)
+{
+	const string path = benchTempPath("tuki_bench_replay.tkrc");
+	RenderCapture::begin(path);
+	Image image = Image::createEmpty(4, 4, PixelFormat::RGBA8);
+	Texture tex = Texture::createFromImage(image);
+	UvPlaneMeshGpu mesh;
+	mesh.load();
+	for (unsigned frame = 0; frame < 3; frame++)
+	{
+		if (frame == 1)
+		{
+			tex.free();
+			tex = Texture::createFromImage(image);
+		}
+		tex.bindToUnit(0u);
+		mesh.bind();
+		RenderApi::draw(mesh);
+		RenderCapture::endFrame();
+	}
+	tex.free();
+	mesh.free();
+	image.free();
+	RenderCapture::end();
+
+	ifstream in(path, ios::binary);
+	const vector<char> file((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	in.close();
+	remove(path.c_str());
+	const vector<CaptureRecord> records = parseRenderCapture(file);
+	// the frees at the end are not part of the replayed frames
+	size_t framesEnd = 0;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (records[i].cmd == CaptureCmd::FRAME_END) framesEnd = i + 1;
+	}
+
+	RenderReplayer replayer;
+	for (size_t i = 0; i < framesEnd; i++) replayer.execute(records[i]);
+	unsigned passes = 1;
+	b.run([&]
+	{
+		replayer.beginRepeat();
+		for (size_t i = 0; i < framesEnd; i++) replayer.execute(records[i]);
+		passes++;
+	});
+	replayer.freeAll();
+	if (replayer.numDraws != 3 * passes) throw runtime_error("render_replay_repeat: wrong number of draws");
+}
@@ -0,0 +1,490 @@
+#include "bench.hpp"
+
+#include <tuki/render/material/material.hpp>
+#include <tuki/render/material/material_pack.hpp>
+#include <tuki/render/material/material_instance_buffer.hpp>
+#include <tuki/util/flat_hash_map.hpp>
+#include <tuki/util/job_system.hpp>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <fstream>
+#include <glm/vec3.hpp>
+
+using namespace std;
+
+static const char* TEMPLATE_PATH = "material_templates/flat.json";
+static const char* MATERIAL_PATH = "materials/red_material.json";
+
+// reads and parses the json file every time, the template is already loaded
+TUKI_BENCH(material_load)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	man->releaseMaterial(man->loadMaterial(MATERIAL_PATH));
+	b.run([&]
+	{
+		Material mat = man->loadMaterial(MATERIAL_PATH);
+		doNotOptimize(mat);
+		man->releaseMaterial(mat);
+	});
+}
+
+TUKI_BENCH(material_make_unique)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	b.run([&]
+	{
+		Material mat = man->createMaterial(templ);
+		man->makeUnique(mat);
+		doNotOptimize(mat);
+		man->releaseMaterial(mat);
+	});
+}
+
+// uploading the uniforms of many materials of the same template
+TUKI_BENCH(material_use_batched)
+{
+	const unsigned NUM_MATERIALS = 256;
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+
+	mt19937 rng(1);
+	uniform_real_distribution<float> dist(0, 1);
+	vector<Material> materials(NUM_MATERIALS);
+	for (Material& mat : materials)
+	{
+		mat = man->createMaterial(templ);
+		man->makeUnique(mat);
+		man->setMaterialValueUnsafe(mat, colorSlot, glm::vec3(dist(rng), dist(rng), dist(rng)));
+	}
+
+	man->bindMaterialTemplateProgram(templ);
+	b.setItemsPerIteration(NUM_MATERIALS);
+	b.run([&]
+	{
+		for (const Material& mat : materials) man->useMaterialBatched(mat);
+	});
+
+	for (const Material& mat : materials) man->releaseMaterial(mat);
+}
+
+// the name is hashed at compile time, the lookup is a binary search of integers
+TUKI_BENCH(material_slot_lookup)
+{
+	static constexpr NameId COLOR("color");
+	const unsigned N = 1000;
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	b.setItemsPerIteration(N);
+	b.run([&]
+	{
+		int sum = 0;
+		for (unsigned i = 0; i < N; i++) sum += man->getSlotIndex(templ, COLOR);
+		doNotOptimize(sum);
+	});
+}
+
+// creating, modifying and releasing materials from the job system threads
+TUKI_BENCH(material_create_mt)
+{
+	const unsigned N = 4096;
+	MaterialManager* man = MaterialManager::getSingleton();
+	JobSystem* js = JobSystem::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	b.setItemsPerIteration(N);
+	b.run([&]
+	{
+		js->parallelFor(N, [man, templ, colorSlot](unsigned i)
+		{
+			Material mat = man->createMaterial(templ);
+			man->setMaterialValue(mat, colorSlot, glm::vec3((float)i));
+			man->releaseMaterial(mat);
+		}, 64);
+	});
+}
+
+/* Stress test of the thread safety of the MaterialManager, it fails if a material doesn't have the
+ value it's expected to have. Each thread creates, shares, modifies and releases its materials, and
+ gives shared references to the other threads, that modify (make unique) and release them while
+ the original owner does the same */
+namespace
+{
+
+struct StressMaterial
+{
+	Material mat;
+	float val;
+};
+
+struct StressExchange
+{
+	mutex m;
+	vector<StressMaterial> materials;
+};
+
+void materialStressThread(unsigned threadId, unsigned iterations, unsigned colorSlot,
+	MaterialTemplate templ, StressExchange& exchange, atomic<unsigned>& errors)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	mt19937 rng(threadId);
+	vector<StressMaterial> live;
+	auto check = [&](const StressMaterial& x)
+	{
+		if (man->getMaterialValue<glm::vec3>(x.mat, colorSlot) != glm::vec3(x.val)) errors++;
+	};
+	for (unsigned it = 0; it < iterations; it++)
+	{
+		const float newVal = (float)(threadId * iterations + it);
+		const unsigned op = live.empty() ? 0 : rng() % 6;
+		const unsigned i = live.empty() ? 0 : rng() % live.size();
+		if (op == 0)
+		{
+			StressMaterial x = { man->createMaterial(templ), newVal };
+			man->setMaterialValue(x.mat, colorSlot, glm::vec3(newVal));
+			live.push_back(x);
+		}
+		else if (op == 1)
+		{
+			StressMaterial x = { man->shareMaterial(live[i].mat), live[i].val };
+			live.push_back(x);
+		}
+		else if (op == 2)
+		{
+			// makes it unique if it's shared
+			man->setMaterialValue(live[i].mat, colorSlot, glm::vec3(newVal));
+			live[i].val = newVal;
+		}
+		else if (op == 3)
+		{
+			check(live[i]);
+			man->releaseMaterial(live[i].mat);
+			live[i] = live.back();
+			live.pop_back();
+		}
+		else if (op == 4)
+		{
+			StressMaterial x = { man->shareMaterial(live[i].mat), live[i].val };
+			lock_guard<mutex> lock(exchange.m);
+			exchange.materials.push_back(x);
+		}
+		else
+		{
+			lock_guard<mutex> lock(exchange.m);
+			if (!exchange.materials.empty())
+			{
+				live.push_back(exchange.materials.back());
+				exchange.materials.pop_back();
+			}
+		}
+		if (!live.empty()) check(live[rng() % live.size()]);
+	}
+	for (const StressMaterial& x : live)
+	{
+		check(x);
+		man->releaseMaterial(x.mat);
+	}
+}
+
+}
+
+TUKI_BENCH(material_stress_mt)
+{
+	const unsigned NUM_THREADS = max(4u, thread::hardware_concurrency());
+	const unsigned ITERATIONS = 2000;
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	b.setItemsPerIteration(NUM_THREADS * ITERATIONS);
+	b.run([&]
+	{
+		StressExchange exchange;
+		atomic<unsigned> errors(0);
+		vector<thread> threads;
+		for (unsigned t = 0; t < NUM_THREADS; t++)
+		{
+			threads.emplace_back(materialStressThread, t, ITERATIONS, colorSlot,
+				templ, ref(exchange), ref(errors));
+		}
+		for (thread& t : threads) t.join();
+		for (const StressMaterial& x : exchange.materials)
+		{
+			if (man->getMaterialValue<glm::vec3>(x.mat, colorSlot) != glm::vec3(x.val)) errors++;
+			man->releaseMaterial(x.mat);
+		}
+		if (errors) throw runtime_error(to_string(errors.load()) + " materials had wrong values");
+	});
+}
+
+// startup of a library of 5k materials: one JSON file for each vs a cooked pack
+static const unsigned LIBRARY_SIZE = 5000;
+
+struct MaterialLibrary
+{
+	vector<string> paths;
+	string packPath;
+};
+
+// the files are generated in the temp dir once
+static const MaterialLibrary& getMaterialLibrary()
+{
+	static MaterialLibrary lib;
+	if (!lib.paths.empty()) return lib;
+	const string dir = benchTempPath("tuki_bench_material_");
+	mt19937 rng(1);
+	uniform_real_distribution<float> dist(0, 1);
+	for (unsigned i = 0; i < LIBRARY_SIZE; i++)
+	{
+		const string path = dir + to_string(i) + ".json";
+		ofstream file(path);
+		file << "{ \"template\": \"" << TEMPLATE_PATH << "\", \"slots\": { \"color\": ["
+			<< dist(rng) << ", " << dist(rng) << ", " << dist(rng) << "] } }";
+		if (!file) throw runtime_error("could not write " + path);
+		lib.paths.push_back(path);
+	}
+	lib.packPath = dir + "library.tkmp";
+	MaterialPack::cook(lib.paths, lib.packPath);
+	return lib;
+}
+
+TUKI_BENCH(material_library_json_5k)
+{
+	const MaterialLibrary& lib = getMaterialLibrary();
+	MaterialManager* man = MaterialManager::getSingleton();
+	vector<Material> materials;
+	materials.reserve(LIBRARY_SIZE);
+	b.setItemsPerIteration(LIBRARY_SIZE);
+	b.run([&]
+	{
+		for (const string& path : lib.paths)
+			materials.push_back(man->loadMaterial(path));
+		for (const Material& mat : materials) man->releaseMaterial(mat);
+		materials.clear();
+	});
+}
+
+TUKI_BENCH(material_library_pack_5k)
+{
+	const MaterialLibrary& lib = getMaterialLibrary();
+	MaterialManager* man = MaterialManager::getSingleton();
+
+	// the values must be the same as loading the JSON files
+	{
+		MaterialPack pack(lib.packPath);
+		const unsigned colorSlot = man->getSlotIndex(pack.getTemplates()[0], "color");
+		// flat.json doesn't have "pipeline", drawing with it must not change the GL state
+		if (pack.getTemplates()[0].getPipelineState() != PIPELINE_STATE_INHERIT)
+			throw runtime_error("the template without pipeline state doesn't inherit it");
+		for (const string& path : lib.paths)
+		{
+			Material a = man->loadMaterial(path);
+			Material b = pack.getMaterial(NameId(path));
+			if (a.getValue<glm::vec3>(colorSlot) != b.getValue<glm::vec3>(colorSlot))
+				throw runtime_error(path + ": the pack has a different value");
+			man->releaseMaterial(a);
+		}
+		pack.free();
+	}
+
+	b.setItemsPerIteration(LIBRARY_SIZE);
+	b.run([&]
+	{
+		MaterialPack pack(lib.packPath);
+		doNotOptimize(pack);
+		pack.free();
+	});
+}
+
+// runtime variations with few distinct values share the data after deduplicating
+TUKI_BENCH(material_deduplicate)
+{
+	const unsigned NUM_MATERIALS = 4096;
+	const unsigned NUM_COLORS = 16;
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	const bool prevDedup = man->getDeduplication(templ);
+	man->setDeduplication(templ, true);
+
+	vector<Material> materials(NUM_MATERIALS);
+	b.setItemsPerIteration(NUM_MATERIALS);
+	b.run([&]
+	{
+		for (unsigned i = 0; i < NUM_MATERIALS; i++)
+		{
+			Material& mat = materials[i];
+			mat = man->createMaterial(templ);
+			mat.setValue(colorSlot, glm::vec3((float)(i % NUM_COLORS) / NUM_COLORS, 0, 1));
+			man->deduplicateMaterial(mat);
+		}
+
+		FlatHashMap<uint32_t, unsigned> distinct;
+		for (unsigned i = 0; i < NUM_MATERIALS; i++)
+		{
+			const glm::vec3 expected((float)(i % NUM_COLORS) / NUM_COLORS, 0, 1);
+			if (materials[i].getValue<glm::vec3>(colorSlot) != expected) throw runtime_error("wrong deduplicated value");
+			distinct[materials[i].getId()]++;
+		}
+		if (distinct.size() != NUM_COLORS) throw runtime_error("the materials were not deduplicated");
+		for (const Material& mat : materials) man->releaseMaterial(mat);
+	});
+	man->setDeduplication(templ, prevDedup);
+}
+
+// per-instance colors of a crowd, one material at a time vs the bulk API
+static const unsigned NUM_VARIANTS = 4096;
+
+struct CrowdMember
+{
+	glm::vec3 position;
+	glm::vec3 color;
+};
+
+static vector<CrowdMember> makeCrowd()
+{
+	mt19937 rng(1);
+	uniform_real_distribution<float> dist(0, 1);
+	vector<CrowdMember> crowd(NUM_VARIANTS);
+	for (CrowdMember& x : crowd)
+	{
+		x.position = glm::vec3(dist(rng), dist(rng), dist(rng));
+		x.color = glm::vec3(dist(rng), dist(rng), dist(rng));
+	}
+	return crowd;
+}
+
+TUKI_BENCH(material_variants_set_value)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	const vector<CrowdMember> crowd = makeCrowd();
+	vector<Material> materials(NUM_VARIANTS);
+	b.setItemsPerIteration(NUM_VARIANTS);
+	b.run([&]
+	{
+		for (unsigned i = 0; i < NUM_VARIANTS; i++)
+		{
+			materials[i] = man->createMaterial(templ);
+			materials[i].setValue(colorSlot, crowd[i].color);
+		}
+		for (const Material& mat : materials) man->releaseMaterial(mat);
+	});
+}
+
+TUKI_BENCH(material_variants_bulk)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	const vector<CrowdMember> crowd = makeCrowd();
+	vector<Material> materials(NUM_VARIANTS);
+
+	man->createMaterials(templ, NUM_VARIANTS, materials.data());
+	man->setMaterialValues(materials.data(), NUM_VARIANTS, colorSlot, &crowd[0].color, sizeof(CrowdMember));
+	for (unsigned i = 0; i < NUM_VARIANTS; i++)
+	{
+		if (man->getMaterialValue<glm::vec3>(materials[i], colorSlot) != crowd[i].color)
+			throw runtime_error("wrong bulk value");
+	}
+	man->releaseMaterials(materials.data(), NUM_VARIANTS);
+
+	b.setItemsPerIteration(NUM_VARIANTS);
+	b.run([&]
+	{
+		man->createMaterials(templ, NUM_VARIANTS, materials.data());
+		man->setMaterialValues(materials.data(), NUM_VARIANTS, colorSlot, &crowd[0].color, sizeof(CrowdMember));
+		man->releaseMaterials(materials.data(), NUM_VARIANTS);
+	});
+}
+
+// the color of the crowd template is per-instance, generated in the temp dir once
+static const string& getInstancedTemplatePath()
+{
+	static string path;
+	if (!path.empty()) return path;
+	path = benchTempPath("tuki_bench_material_instanced.json");
+	ofstream file(path);
+	file << "{ \"shaders\": { \"vert\": \"shaders/simple.vs\", \"frag\": \"shaders/flat.fs\" },"
+		" \"slots\": {"
+		" \"color\": { \"type\": \"vec3\", \"default\": [1, 1, 1], \"perInstance\": true },"
+		" \"roughness\": { \"type\": \"float\" } } }";
+	file.close();
+	if (!file) throw runtime_error("could not write " + path);
+	return path;
+}
+
+// a material for each member of the crowd, one draw each
+TUKI_BENCH(material_crowd_draw_unique)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(TEMPLATE_PATH);
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	const vector<CrowdMember> crowd = makeCrowd();
+	vector<Material> materials(NUM_VARIANTS);
+	man->createMaterials(templ, NUM_VARIANTS, materials.data());
+	UvPlaneMeshGpu mesh;
+	mesh.load();
+
+	b.setItemsPerIteration(NUM_VARIANTS);
+	b.run([&]
+	{
+		man->setMaterialValues(materials.data(), NUM_VARIANTS, colorSlot, &crowd[0].color, sizeof(CrowdMember));
+		man->bindMaterialTemplateProgram(templ);
+		mesh.bind();
+		for (const Material& mat : materials)
+		{
+			man->useMaterialBatched(mat);
+			RenderApi::draw(mesh);
+		}
+	});
+	man->releaseMaterials(materials.data(), NUM_VARIANTS);
+	mesh.free();
+}
+
+// one material, the colors are per-instance and the crowd is a single instanced draw
+TUKI_BENCH(material_crowd_draw_instanced)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(getInstancedTemplatePath());
+	const unsigned colorSlot = man->getSlotIndex(templ, "color");
+	if (!man->isPerInstanceSlot(templ, colorSlot) || man->isPerInstanceSlot(templ, man->getSlotIndex(templ, "roughness")) ||
+		man->getInstanceSize(templ) != sizeof(glm::vec3))
+	{
+		throw runtime_error("wrong per-instance slots");
+	}
+	const vector<CrowdMember> crowd = makeCrowd();
+	Material mat = man->createMaterial(templ);
+	MaterialInstanceBuffer instances(mat);
+	instances.resize(NUM_VARIANTS);
+	if (instances.getValue<glm::vec3>(NUM_VARIANTS - 1, colorSlot) != glm::vec3(1))
+		throw runtime_error("the new instances don't have the value of the material");
+	UvPlaneMeshGpu mesh;
+	mesh.load();
+
+	// the per-instance flag survives the pack: loading it checks the layout of the loaded template
+	const string packPath = benchTempPath("tuki_bench_material_instanced.tkmp");
+	MaterialPack::cook(vector<string>(1, getInstancedTemplatePath()), packPath);
+	MaterialPack pack(packPath);
+	pack.free();
+
+	b.setItemsPerIteration(NUM_VARIANTS);
+	b.run([&]
+	{
+		instances.setValues(0, NUM_VARIANTS, colorSlot, &crowd[0].color, sizeof(CrowdMember));
+		man->useMaterial(mat);
+		instances.draw(mesh);
+	});
+	for (unsigned i = 0; i < NUM_VARIANTS; i += 97)
+	{
+		if (instances.getValue<glm::vec3>(i, colorSlot) != crowd[i].color)
+			throw runtime_error("wrong per-instance value");
+	}
+	instances.free();
+	man->releaseMaterial(mat);
+	mesh.free();
+}
@@ -0,0 +1,83 @@
+#include "bench.hpp"
+
+#include <tuki/render/mesh/mesh.hpp>
+#include <tuki/render/gl/mesh_gpu.hpp>
+#include <tuki/render/gl/texture.hpp>
+#include <tuki/util/multi_sort.hpp>
+#include <random>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+static const char* MESH_PATH = "mesh/monkey.obj";
+
+// the copy of the unsorted data is included in the time, it's small compared to the sort
+TUKI_BENCH(multi_sort_3x64k)
+{
+	const unsigned N = 64 * 1024;
+	mt19937 rng(1);
+	vector<uint32_t> keys(N), a(N), c(N);
+	for (unsigned i = 0; i < N; i++)
+	{
+		keys[i] = rng();
+		a[i] = i;
+		c[i] = rng();
+	}
+	vector<uint32_t> k1, a1, c1;
+	b.setItemsPerIteration(N);
+	b.run([&]
+	{
+		k1 = keys;
+		a1 = a;
+		c1 = c;
+		sortVectors(k1, less<uint32_t>(), k1, a1, c1);
+		doNotOptimize(a1[0]);
+	});
+}
+
+TUKI_BENCH(image_flip_y_1024)
+{
+	Image image = Image::createEmpty(1024, 1024, PixelFormat::RGBA8);
+	b.setItemsPerIteration(1024 * 1024);
+	b.run([&]
+	{
+		image.flipY();
+		doNotOptimize(image.getData());
+	});
+	image.free();
+}
+
+TUKI_BENCH(mesh_import)
+{
+	b.run([&]
+	{
+		Mesh mesh = Mesh::load(MESH_PATH, false);
+		doNotOptimize(mesh.getNumVertices());
+		mesh.free();
+	});
+}
+
+TUKI_BENCH(mesh_import_optimized)
+{
+	b.run([&]
+	{
+		Mesh mesh = Mesh::load(MESH_PATH, true);
+		doNotOptimize(mesh.getNumVertices());
+		mesh.free();
+	});
+}
+
+// only the CPU side of the upload, the GL calls don't do anything
+TUKI_BENCH(mesh_upload)
+{
+	Mesh mesh = Mesh::load(MESH_PATH);
+	b.run([&]
+	{
+		MeshGpuGeneric gpu;
+		gpu.load(mesh);
+		doNotOptimize(gpu);
+		gpu.free();
+	});
+	mesh.free();
+}
@@ -0,0 +1,150 @@
+#include "bench.hpp"
+
+#include <tuki/render/queue/render_queue.hpp>
+#include <random>
+#include <fstream>
+#include <stdexcept>
+#include <glm/vec3.hpp>
+
+using namespace std;
+
+static const unsigned NUM_ITEMS = 4096;
+static const unsigned NUM_MESHES = 32;
+static const unsigned MATERIALS_PER_TEMPLATE = 16;
+
+// only the draw count matters, the GL calls don't do anything
+class BenchMesh : public IMeshGpu
+{
+public:
+	BenchMesh(int vao) { this->vao = vao; }
+	bool hasIndices()const { return true; }
+	GeomType getGeomType()const { return GeomType::TRIANGLES; }
+	AttribBitMask getAttribBitMask()const { return AttribBitMask::POS; }
+	unsigned getNumElements()const { return 36; }
+	void free() {}
+};
+
+// two shader programs and four pipeline states, one of them translucent
+struct QueueScene
+{
+	vector<Material> materials;
+	vector<BenchMesh> meshes;
+	vector<unsigned> itemMesh;
+	vector<unsigned> itemMaterial;
+	vector<float> itemDepth;
+};
+
+static const QueueScene& getQueueScene()
+{
+	static QueueScene scene;
+	if (!scene.materials.empty()) return scene;
+	const string dir = benchTempPath("tuki_bench_queue_");
+	const char* templates[][2] =
+	{
+		{ "flat.fs", "{}" },
+		{ "flat.fs", "{ \"cull\": \"none\" }" },
+		{ "uv_quad.fs", "{}" },
+		{ "uv_quad.fs", "{ \"blend\": \"alpha\", \"depthWrite\": false }" },
+	};
+
+	MaterialManager* man = MaterialManager::getSingleton();
+	mt19937 rng(1234);
+	uniform_real_distribution<float> dist(0, 1);
+	for (unsigned t = 0; t < 4; t++)
+	{
+		const string path = dir + to_string(t) + ".json";
+		ofstream file(path);
+		file << "{ \"shaders\": { \"vert\": \"shaders/simple.vs\", \"frag\": \"shaders/" << templates[t][0] << "\" },"
+			" \"pipeline\": " << templates[t][1] << ","
+			" \"slots\": { \"color\": { \"type\": \"vec3\", \"default\": [1, 1, 1] } } }";
+		file.close();
+		if (!file) throw runtime_error("could not write " + path);
+
+		MaterialTemplate templ = man->loadMaterialTemplate(path);
+		for (unsigned i = 0; i < MATERIALS_PER_TEMPLATE; i++)
+		{
+			Material mat = man->createMaterial(templ);
+			mat.setValue(0, glm::vec3(dist(rng), dist(rng), dist(rng)));
+			scene.materials.push_back(mat);
+		}
+	}
+	for (unsigned i = 0; i < NUM_MESHES; i++)
+		scene.meshes.push_back(BenchMesh(i + 1));
+
+	for (unsigned i = 0; i < NUM_ITEMS; i++)
+	{
+		scene.itemMesh.push_back(rng() % NUM_MESHES);
+		scene.itemMaterial.push_back(rng() % scene.materials.size());
+		scene.itemDepth.push_back(dist(rng));
+	}
+	return scene;
+}
+
+static void fillQueue(RenderQueue& queue, const QueueScene& scene)
+{
+	queue.clear();
+	for (unsigned i = 0; i < NUM_ITEMS; i++)
+	{
+		queue.push(scene.meshes[scene.itemMesh[i]], scene.materials[scene.itemMaterial[i]],
+			scene.itemDepth[i], 0, i);
+	}
+}
+
+// in submission order, almost every draw changes the state
+TUKI_BENCH(render_queue_unsorted)
+{
+	const QueueScene& scene = getQueueScene();
+	RenderQueue queue;
+	queue.reserve(NUM_ITEMS);
+	b.setItemsPerIteration(NUM_ITEMS);
+	b.run([&]
+	{
+		fillQueue(queue, scene);
+		queue.draw([](const RenderItem& item) { doNotOptimize(item.userData); });
+	});
+}
+
+// the sort is included. Checks that the state changes are grouped and the translucent order
+TUKI_BENCH(render_queue_sorted)
+{
+	const QueueScene& scene = getQueueScene();
+	RenderQueue queue;
+	queue.reserve(NUM_ITEMS);
+	fillQueue(queue, scene);
+	queue.draw([](const RenderItem&) {});
+	const RenderQueue::Stats unsorted = queue.getStats();
+
+	b.setItemsPerIteration(NUM_ITEMS);
+	b.run([&]
+	{
+		fillQueue(queue, scene);
+		queue.sort();
+		queue.draw([](const RenderItem& item) { doNotOptimize(item.userData); });
+	});
+
+	const RenderQueue::Stats& sorted = queue.getStats();
+	if (sorted.numDraws != NUM_ITEMS) throw runtime_error("the number of draws changed");
+	if (sorted.numMaterialChanges * 4 > unsorted.numMaterialChanges ||
+		sorted.numPipelineChanges * 4 > unsorted.numPipelineChanges ||
+		sorted.numProgramChanges * 4 > unsorted.numProgramChanges)
+	{
+		throw runtime_error("sorting didn't reduce the state changes");
+	}
+
+	// the opaque draws first, then the translucent ones back to front
+	const vector<RenderItem>& items = queue.getItems();
+	bool translucent = false;
+	float prevDepth = 2;
+	for (const RenderItem& item : items)
+	{
+		const bool itemTranslucent = PipelineState::getState(item.material.getPipelineState()).isTranslucent();
+		if (translucent && !itemTranslucent) throw runtime_error("an opaque draw after a translucent one");
+		translucent = itemTranslucent;
+		if (translucent)
+		{
+			const float depth = scene.itemDepth[item.userData];
+			if (depth > prevDepth + 1.f / (1 << RenderQueue::DEPTH_BITS)) throw runtime_error("the translucent draws are not sorted back to front");
+			prevDepth = depth;
+		}
+	}
+}
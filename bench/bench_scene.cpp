@@ -0,0 +1,51 @@
+#include "bench.hpp"
+
+#include <tuki/scene/scene.hpp>
+#include <tuki/scene/scene_node.hpp>
+#include <string>
+#include <glm/vec3.hpp>
+
+using namespace std;
+
+static const unsigned CHAIN_DEPTH = 32;
+
+static SceneNode* createChain(Scene& scene, SceneNode** top)
+{
+	SceneNode* node = nullptr;
+	for (unsigned i = 0; i < CHAIN_DEPTH; i++)
+	{
+		node = scene.createNode("n" + to_string(i), node);
+		node->setPosition(glm::vec3(1, 0, 0));
+		if (i == 0) *top = node;
+	}
+	return node;
+}
+
+// the matrices are already computed
+TUKI_BENCH(scene_global_transform_cached)
+{
+	Scene scene;
+	SceneNode* top;
+	SceneNode* leaf = createChain(scene, &top);
+	leaf->getGlobalTransformMatrix();
+	b.run([&]
+	{
+		doNotOptimize(leaf->getGlobalTransformMatrix());
+	});
+}
+
+// moving the top of the chain forces recomputing all the matrices down to the leaf
+TUKI_BENCH(scene_global_transform_dirty)
+{
+	Scene scene;
+	SceneNode* top;
+	SceneNode* leaf = createChain(scene, &top);
+	float x = 0;
+	b.setItemsPerIteration(CHAIN_DEPTH);
+	b.run([&]
+	{
+		x += 1;
+		top->setPosition(glm::vec3(x, 0, 0));
+		doNotOptimize(leaf->getGlobalTransformMatrix());
+	});
+}
@@ -0,0 +1,110 @@
+#include "bench.hpp"
+
+#include <tuki/render/material/material.hpp>
+#include <tuki/render/texture/texture_manager.hpp>
+#include <tuki/render/gl/texture.hpp>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+static const unsigned NUM_TEXTURES = 64;
+static const unsigned TEXTURE_SIZE = 256;
+
+// PNG files and a template with texture slots, generated in the temp dir once
+struct TextureAssets
+{
+	vector<string> texturePaths;
+	string templatePath;
+};
+
+static const TextureAssets& getTextureAssets()
+{
+	static TextureAssets assets;
+	if (!assets.texturePaths.empty()) return assets;
+	const string dir = benchTempPath("tuki_bench_texture_");
+
+	// with NullGl the saved images are black
+	Texture tex = Texture::createEmpty(TEXTURE_SIZE, TEXTURE_SIZE);
+	for (unsigned i = 0; i < NUM_TEXTURES; i++)
+	{
+		const string path = dir + to_string(i) + ".png";
+		tex.save(path.c_str(), false, false);
+		assets.texturePaths.push_back(path);
+	}
+	tex.free();
+
+	assets.templatePath = dir + "template.json";
+	ofstream file(assets.templatePath);
+	file << "{ \"shaders\": { \"vert\": \"shaders/simple.vs\", \"frag\": \"shaders/uv_quad.fs\" },"
+		" \"slots\": {"
+		" \"albedo\": { \"type\": \"sampler2D\", \"default\": \"" << assets.texturePaths[0] << "\" },"
+		" \"normalMap\": { \"type\": \"sampler2D\", \"default\": \"black\" },"
+		" \"color\": { \"type\": \"vec3\", \"default\": [1, 1, 1] } } }";
+	if (!file) throw runtime_error("could not write " + assets.templatePath);
+	return assets;
+}
+
+// the textures are resident, the samplers already have their units
+TUKI_BENCH(texture_material_use)
+{
+	const TextureAssets& assets = getTextureAssets();
+	MaterialManager* man = MaterialManager::getSingleton();
+	TextureManager* texMan = TextureManager::getSingleton();
+	MaterialTemplate templ = man->loadMaterialTemplate(assets.templatePath);
+	Material mat = man->createMaterial(templ);
+	man->useMaterial(mat);
+	// without workers nothing decodes the textures in the background, the first bind loads them
+	const TextureHandle albedo = texMan->getTexture(NameId(assets.texturePaths[0]));
+	if (JobSystem::getSingleton()->getNumThreads() == 1 && !texMan->isResident(albedo))
+		throw runtime_error("the texture wasn't loaded by the first bind without workers");
+	texMan->waitLoads();
+	man->useMaterial(mat);
+	b.run([&]
+	{
+		man->useMaterialBatched(mat);
+	});
+}
+
+// drops mips of the unused textures until they fit in the budget, then loads them again
+TUKI_BENCH(texture_residency_cycle)
+{
+	const unsigned NUM_USED = 8;
+	const TextureAssets& assets = getTextureAssets();
+	TextureManager* texMan = TextureManager::getSingleton();
+	vector<TextureHandle> handles;
+	for (const string& path : assets.texturePaths)
+		handles.push_back(texMan->loadTexture(path));
+
+	auto bindAll = [&]
+	{
+		for (unsigned i = 0; i < handles.size(); i++)
+			texMan->bind(handles[i], i % 16);
+	};
+	const size_t prevBudget = texMan->getVramBudget();
+	b.setItemsPerIteration(NUM_TEXTURES - NUM_USED);
+	b.run([&]
+	{
+		// everything at full resolution
+		texMan->setVramBudget((size_t)-1);
+		bindAll();
+		texMan->waitLoads();
+		bindAll();
+		texMan->update();
+		texMan->update();
+
+		const size_t budget = texMan->getResidentVram() / 4;
+		texMan->setVramBudget(budget);
+		for (unsigned i = 0; i < NUM_USED; i++)
+			texMan->bind(handles[i], i);
+		texMan->update();
+
+		if (texMan->getResidentVram() > budget) throw runtime_error("the textures don't fit in the budget");
+		for (unsigned i = 0; i < NUM_USED; i++)
+		{
+			if (texMan->getDroppedMips(handles[i]) != 0) throw runtime_error("a used texture was evicted");
+		}
+		if (texMan->getDroppedMips(handles[NUM_TEXTURES - 1]) == 0) throw runtime_error("an unused texture wasn't evicted");
+	});
+	texMan->setVramBudget(prevBudget);
+}
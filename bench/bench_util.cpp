@@ -0,0 +1,259 @@
+#include "bench.hpp"
+
+#include <tuki/util/job_system.hpp>
+#include <tuki/util/mallocr/mallocr_arena.hpp>
+#include <tuki/util/flat_hash_map.hpp>
+#include <tuki/util/multi_sort.hpp>
+#include <tuki/util/util.hpp>
+#include <tuki/util/mallocr/alloc_counter.hpp>
+#include <tuki/scene/scene.hpp>
+#include <tuki/scene/scene_node.hpp>
+#include <tuki/render/material/material.hpp>
+#include <rapidjson/document.h>
+#include <random>
+#include <vector>
+#include <stdexcept>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <string>
+
+using namespace std;
+
+TUKI_BENCH(job_system_run_wait)
+{
+	const unsigned NUM_JOBS = 1000;
+	JobSystem* js = JobSystem::getSingleton();
+	b.setItemsPerIteration(NUM_JOBS);
+	b.run([&]
+	{
+		JobCounter counter;
+		for (unsigned i = 0; i < NUM_JOBS; i++) js->run([]{}, &counter);
+		js->wait(counter);
+	});
+}
+
+TUKI_BENCH(job_system_parallel_for)
+{
+	const unsigned N = 256 * 1024;
+	vector<float> data(N);
+	for (unsigned i = 0; i < N; i++) data[i] = (float)i;
+	JobSystem* js = JobSystem::getSingleton();
+	b.setItemsPerIteration(N);
+	b.run([&]
+	{
+		float* d = &data[0];
+		js->parallelFor(N, [d](unsigned i) { d[i] = sqrt(d[i] + 1); }, 1024);
+		doNotOptimize(data[0]);
+	});
+}
+
+// more jobs than fit in a queue, with workers stealing them while the main thread keeps spawning.
+// The slots of the stolen jobs that are still running must not be reused, every job must run once
+TUKI_BENCH(job_system_overflow)
+{
+	const unsigned NUM_JOBS = 3 * JobSystem::MAX_JOBS_PER_THREAD + 100;
+	JobSystem* js = JobSystem::getSingleton();
+	// there must be thieves even with one hardware thread
+	js->init(3);
+	vector<atomic<unsigned> > runs(NUM_JOBS);
+	atomic<unsigned>* r = &runs[0];
+	auto spawnAll = [&]
+	{
+		for (unsigned i = 0; i < NUM_JOBS; i++) runs[i].store(0, memory_order_relaxed);
+		JobCounter counter;
+		for (unsigned i = 0; i < NUM_JOBS; i++)
+		{
+			js->run([r, i]
+			{
+				// uneven work, so some slots are held for a while by the thieves
+				volatile unsigned x = 0;
+				for (unsigned k = (i % 7) * 50; k; k--) x = x + k;
+				r[i].fetch_add(1, memory_order_relaxed);
+			}, &counter);
+		}
+		js->wait(counter);
+	};
+
+	for (unsigned rep = 0; rep < 8; rep++)
+	{
+		spawnAll();
+		for (unsigned i = 0; i < NUM_JOBS; i++)
+		{
+			if (runs[i].load() != 1)
+			{
+				js->init();
+				throw runtime_error("job " + to_string(i) + " ran " + to_string(runs[i].load()) + " times");
+			}
+		}
+	}
+	b.setItemsPerIteration(NUM_JOBS);
+	b.run(spawnAll);
+	js->init();
+}
+
+// the same pattern with the heap and with the scratch arena
+TUKI_BENCH(vector_push_heap)
+{
+	const unsigned N = 1000;
+	b.setItemsPerIteration(N);
+	b.run([&]
+	{
+		vector<unsigned> v;
+		for (unsigned i = 0; i < N; i++) v.push_back(i);
+		doNotOptimize(v[0]);
+	});
+}
+
+TUKI_BENCH(vector_push_scratch)
+{
+	const unsigned N = 1000;
+	b.setItemsPerIteration(N);
+	b.run([&]
+	{
+		ScratchScope scratch;
+		ScratchVector<unsigned> v(scratch);
+		for (unsigned i = 0; i < N; i++) v.push_back(i);
+		doNotOptimize(v[0]);
+	});
+}
+
+// the per-frame hot paths that use the scratch arena must not touch the heap after the first frame:
+// the global matrices of a deep chain, sortVectors and loading a material from its JSON document.
+// With TUKI_COUNT_ALLOCATIONS it fails if a frame allocates
+TUKI_BENCH(frame_allocations)
+{
+	const unsigned CHAIN_DEPTH = 50;
+	const unsigned NUM_SORTED = 4096;
+
+	Scene scene;
+	SceneNode* top = nullptr;
+	SceneNode* leaf = nullptr;
+	for (unsigned i = 0; i < CHAIN_DEPTH; i++)
+	{
+		leaf = scene.createNode("n" + to_string(i), leaf);
+		leaf->setPosition(glm::vec3(1, 0, 0));
+		if (i == 0) top = leaf;
+	}
+
+	mt19937 rng(1);
+	vector<uint32_t> keys(NUM_SORTED), values(NUM_SORTED), sortedKeys, sortedValues;
+	for (unsigned i = 0; i < NUM_SORTED; i++)
+	{
+		keys[i] = rng();
+		values[i] = i;
+	}
+	sortedKeys = keys;
+	sortedValues = values;
+
+	MaterialManager* man = MaterialManager::getSingleton();
+	const string txt = loadStringFromFile("materials/red_material.json");
+	rapidjson::Document doc;
+	doc.Parse(txt.c_str());
+
+	float x = 0;
+	// moving the top is not part of the frame: the Scene keeps the dirty nodes in a std::set
+	auto moveTop = [&]
+	{
+		x += 1;
+		top->setPosition(glm::vec3(x, 0, 0));
+	};
+	auto frame = [&]
+	{
+		LinearArena::beginFrame();
+		doNotOptimize(leaf->getGlobalTransformMatrix());
+
+		std::copy(keys.begin(), keys.end(), sortedKeys.begin());
+		std::copy(values.begin(), values.end(), sortedValues.begin());
+		sortVectors(sortedKeys, less<uint32_t>(), sortedKeys, sortedValues);
+		doNotOptimize(sortedValues[0]);
+
+		Material mat = man->loadMaterial(doc);
+		doNotOptimize(mat);
+		man->releaseMaterial(mat);
+	};
+
+	// the first frame grows the arenas and loads the template
+	moveTop();
+	frame();
+	const unsigned NUM_CHECKED = 16;
+	uint64_t allocs = 0;
+	for (unsigned i = 0; i < NUM_CHECKED; i++)
+	{
+		moveTop();
+		const uint64_t before = AllocCounter::getThreadCount();
+		frame();
+		allocs += AllocCounter::getThreadCount() - before;
+	}
+	if (AllocCounter::isEnabled())
+	{
+		b.setCounter("allocations per frame", (double)allocs / NUM_CHECKED);
+		if (allocs) throw runtime_error(to_string(allocs) + " heap allocations in " + to_string(NUM_CHECKED) + " frames");
+	}
+
+	b.run([&]
+	{
+		moveTop();
+		frame();
+	});
+}
+
+// lookups of paths like the ones of the shader and material registries, with const char* keys
+namespace
+{
+
+vector<string> makeHashMapKeys(unsigned n)
+{
+	vector<string> keys;
+	for (unsigned i = 0; i < n; i++)
+		keys.push_back("shaders/material_template_" + to_string(i * 7919) + ".json");
+	return keys;
+}
+
+const unsigned HASH_MAP_KEYS = 256;
+const unsigned HASH_MAP_LOOKUPS = 4096;
+
+}
+
+TUKI_BENCH(std_map_lookup)
+{
+	const vector<string> keys = makeHashMapKeys(HASH_MAP_KEYS);
+	map<string, int> m;
+	for (unsigned i = 0; i < keys.size(); i++) m[keys[i]] = i;
+	b.setItemsPerIteration(HASH_MAP_LOOKUPS);
+	b.run([&]
+	{
+		int sum = 0;
+		for (unsigned i = 0; i < HASH_MAP_LOOKUPS; i++)
+			sum += m.find(keys[(i * 31) % HASH_MAP_KEYS].c_str())->second;
+		doNotOptimize(sum);
+	});
+}
+
+TUKI_BENCH(flat_hash_map_lookup)
+{
+	const vector<string> keys = makeHashMapKeys(HASH_MAP_KEYS);
+	FlatHashMap<string, int> m;
+	for (unsigned i = 0; i < keys.size(); i++) m[keys[i]] = i;
+	b.setItemsPerIteration(HASH_MAP_LOOKUPS);
+	b.run([&]
+	{
+		int sum = 0;
+		for (unsigned i = 0; i < HASH_MAP_LOOKUPS; i++)
+			sum += m.find(keys[(i * 31) % HASH_MAP_KEYS].c_str())->second;
+		doNotOptimize(sum);
+	});
+}
+
+TUKI_BENCH(flat_hash_map_insert_erase)
+{
+	const vector<string> keys = makeHashMapKeys(HASH_MAP_KEYS);
+	b.setItemsPerIteration(HASH_MAP_KEYS);
+	b.run([&]
+	{
+		FlatHashMap<string, int> m;
+		for (unsigned i = 0; i < keys.size(); i++) m[keys[i]] = i;
+		for (unsigned i = 0; i < keys.size(); i += 2) m.erase(keys[i]);
+		doNotOptimize(m.size());
+	});
+}
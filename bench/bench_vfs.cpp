@@ -0,0 +1,164 @@
+#include "bench.hpp"
+
+#include <tuki/util/vfs.hpp>
+#include <tuki/util/asset_pack.hpp>
+#include <random>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <iterator>
+
+using namespace std;
+
+static const unsigned NUM_FILES = 4096;
+
+struct VfsLibrary
+{
+	string dir;
+	vector<string> paths;	// relative to dir
+	string packPath, compressedPackPath;
+};
+
+// many small text files, like the materials and shaders of a game. Generated in the temp dir once
+static const VfsLibrary& getVfsLibrary()
+{
+	static VfsLibrary lib;
+	if (!lib.paths.empty()) return lib;
+	lib.dir = benchTempPath("");
+	mt19937 rng(1);
+	uniform_int_distribution<unsigned> numLines(4, 64);
+	uniform_real_distribution<float> dist(-1, 1);
+	vector<string> files;
+	for (unsigned i = 0; i < NUM_FILES; i++)
+	{
+		const string path = "tuki_bench_vfs_" + to_string(i) + ".txt";
+		ofstream file(lib.dir + path, ios::binary);
+		for (unsigned n = numLines(rng); n; n--)
+			file << "v " << dist(rng) << " " << dist(rng) << " " << dist(rng) << "\n";
+		if (!file) throw runtime_error("could not write " + lib.dir + path);
+		lib.paths.push_back(path);
+		files.push_back(lib.dir + path);
+	}
+	lib.packPath = lib.dir + "tuki_bench_vfs.tkap";
+	lib.compressedPackPath = lib.dir + "tuki_bench_vfs_z.tkap";
+	AssetPack::cook(lib.paths, files, lib.packPath, false);
+	AssetPack::cook(lib.paths, files, lib.compressedPackPath, true);
+	return lib;
+}
+
+static size_t readAll(const VfsLibrary& lib, const string& mountPoint)
+{
+	Vfs* vfs = Vfs::getSingleton();
+	size_t total = 0;
+	for (const string& path : lib.paths)
+	{
+		VfsFile f = vfs->read(mountPoint + path);
+		total += f.getSize();
+		doNotOptimize(f.getData()[0]);
+	}
+	return total;
+}
+
+// the contents must be the same as the loose files
+static void checkPack(const VfsLibrary& lib, const string& packPath)
+{
+	Vfs* vfs = Vfs::getSingleton();
+	vfs->mountPack("vfs_check/", packPath);
+	for (const string& path : lib.paths)
+	{
+		VfsFile a = vfs->read(lib.dir + path);
+		VfsFile b = vfs->read("vfs_check/" + path);
+		if (a.getSize() != b.getSize() || memcmp(a.getData(), b.getData(), a.getSize()) != 0)
+			throw runtime_error(packPath + ": " + path + " is different");
+	}
+	vfs->unmount("vfs_check/");
+}
+
+static vector<char> readBytes(const string& fileName)
+{
+	ifstream file(fileName, ios::binary);
+	return vector<char>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static void writeBytes(const string& fileName, const vector<char>& bytes)
+{
+	ofstream file(fileName, ios::binary);
+	file.write(bytes.data(), bytes.size());
+	if (!file) throw runtime_error("could not write " + fileName);
+}
+
+// packs patched to have paths with the same hash. A lookup must never return another file
+static void checkHashCollisions(const VfsLibrary& lib)
+{
+	const vector<char> bytes = readBytes(lib.packPath);
+	AssetPackHeader header;
+	memcpy(&header, bytes.data(), sizeof(header));
+	AssetPackEntry* entries = (AssetPackEntry*)(const_cast<char*>(bytes.data()) + header.entriesOffset);
+	const string patchedPath = lib.dir + "tuki_bench_vfs_patched.tkap";
+
+	// the second entry with the hash of the first
+	vector<char> dup = bytes;
+	AssetPackEntry* dupEntries = (AssetPackEntry*)(dup.data() + header.entriesOffset);
+	dupEntries[1].path = dupEntries[0].path;
+	writeBytes(patchedPath, dup);
+	bool rejected = false;
+	try { AssetPack pack(patchedPath); }
+	catch (const runtime_error&) { rejected = true; }
+	if (!rejected) throw runtime_error("a pack with a repeated path hash was mounted");
+
+	// the string of the first entry changed, its hash is the one of the original path
+	vector<char> renamed = bytes;
+	renamed[header.stringsOffset + entries[0].pathString] ^= 1;
+	writeBytes(patchedPath, renamed);
+	Vfs* vfs = Vfs::getSingleton();
+	vfs->mountPack("vfs_collision/", patchedPath);
+	const bool found = vfs->exists("vfs_collision/" + lib.paths[0]);
+	vfs->unmount("vfs_collision/");
+	remove(patchedPath.c_str());
+	if (found) throw runtime_error("a path was found by the hash of another one");
+}
+
+// the page cache is warm after the first run: it measures the cost of the calls to the OS, not the disk
+TUKI_BENCH(vfs_loose_files_4k)
+{
+	const VfsLibrary& lib = getVfsLibrary();
+	Vfs* vfs = Vfs::getSingleton();
+	vfs->mountDirectory("vfs_loose/", lib.dir);
+	b.setItemsPerIteration(NUM_FILES);
+	b.run([&]
+	{
+		doNotOptimize(readAll(lib, "vfs_loose/"));
+	});
+	vfs->unmount("vfs_loose/");
+}
+
+// mounting is included, like in a cold start
+TUKI_BENCH(vfs_pack_4k)
+{
+	const VfsLibrary& lib = getVfsLibrary();
+	checkPack(lib, lib.packPath);
+	checkHashCollisions(lib);
+	Vfs* vfs = Vfs::getSingleton();
+	b.setItemsPerIteration(NUM_FILES);
+	b.run([&]
+	{
+		vfs->mountPack("vfs_pack/", lib.packPath);
+		doNotOptimize(readAll(lib, "vfs_pack/"));
+		vfs->unmount("vfs_pack/");
+	});
+}
+
+TUKI_BENCH(vfs_pack_compressed_4k)
+{
+	const VfsLibrary& lib = getVfsLibrary();
+	checkPack(lib, lib.compressedPackPath);
+	Vfs* vfs = Vfs::getSingleton();
+	b.setItemsPerIteration(NUM_FILES);
+	b.run([&]
+	{
+		vfs->mountPack("vfs_pack_z/", lib.compressedPackPath);
+		doNotOptimize(readAll(lib, "vfs_pack_z/"));
+		vfs->unmount("vfs_pack_z/");
+	});
+}
@@ -0,0 +1,126 @@
+#include "geometry.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// PLANE
+
+float Plane::distance(const vec3& p)const
+{
+	return dot(normal, p) + d;
+}
+
+// FRUSTUM
+
+Frustum Frustum::fromMatrix(const mat4& m)
+{
+	// Gribb & Hartmann: combinations of the rows of the matrix
+	// glm matrices are column major: m[col][row]
+	vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	const vec4 eqs[NUM_PLANES] =
+	{
+		row3 + row0,	// left
+		row3 - row0,	// right
+		row3 + row1,	// bottom
+		row3 - row1,	// top
+		row3 + row2,	// near
+		row3 - row2,	// far
+	};
+
+	Frustum f;
+	for (int i = 0; i < NUM_PLANES; i++)
+	{
+		vec3 n(eqs[i]);
+		float invLen = 1.f / length(n);
+		f.planes[i].normal = n * invLen;
+		f.planes[i].d = eqs[i].w * invLen;
+	}
+	return f;
+}
+
+// FUNCTIONS
+
+AABB transformAABB(const AABB& box, const mat4& m)
+{
+	// Arvo's method: project the extent onto the absolute value of the rotation
+	const vec3 c = box.getCenter();
+	const vec3 e = box.getExtent();
+	vec3 newC = vec3(m * vec4(c, 1));
+	vec3 newE;
+	for (int i = 0; i < 3; i++)
+	{
+		newE[i] =
+			abs(m[0][i]) * e.x +
+			abs(m[1][i]) * e.y +
+			abs(m[2][i]) * e.z;
+	}
+	return AABB(newC - newE, newC + newE);
+}
+
+bool intersects(const AABB& a, const AABB& b)
+{
+	return
+		a.min.x <= b.max.x && b.min.x <= a.max.x &&
+		a.min.y <= b.max.y && b.min.y <= a.max.y &&
+		a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+bool intersects(const Sphere& s, const AABB& b)
+{
+	vec3 closest = clamp(s.center, b.min, b.max);
+	vec3 d = s.center - closest;
+	return dot(d, d) <= s.radius * s.radius;
+}
+
+bool intersects(const Sphere& s, const Frustum& f)
+{
+	for (int i = 0; i < Frustum::NUM_PLANES; i++)
+	{
+		if (f.planes[i].distance(s.center) < -s.radius) return false;
+	}
+	return true;
+}
+
+bool intersects(const Ray& ray, const vec3& invDir, const AABB& b, float tMax, float& tHit)
+{
+	vec3 t0 = (b.min - ray.origin) * invDir;
+	vec3 t1 = (b.max - ray.origin) * invDir;
+	vec3 tNear = glm::min(t0, t1);
+	vec3 tFar = glm::max(t0, t1);
+	float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+	float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+	tHit = tEnter;
+	return tEnter <= tExit;
+}
+
+FrustumTest testFrustum(const Frustum& f, const AABB& b)
+{
+	unsigned mask = (1 << Frustum::NUM_PLANES) - 1;
+	return testFrustumMasked(f, b, mask);
+}
+
+FrustumTest testFrustumMasked(const Frustum& f, const AABB& b, unsigned& planeMask)
+{
+	const vec3 c = b.getCenter();
+	const vec3 e = b.getExtent();
+	for (int i = 0; i < Frustum::NUM_PLANES; i++)
+	{
+		const unsigned bit = 1 << i;
+		if (!(planeMask & bit)) continue;
+
+		const Plane& p = f.planes[i];
+		const float dist = p.distance(c);
+		const float r = dot(e, abs(p.normal));
+		if (dist < -r) return FrustumTest::OUTSIDE;
+		if (dist >= r) planeMask &= ~bit;	// fully in the positive side of this plane
+	}
+	return planeMask ? FrustumTest::INTERSECT : FrustumTest::INSIDE;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+#include <limits>
+
+// AXIS ALIGNED BOUNDING BOX
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB() {}
+	AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	glm::vec3 getCenter()const { return 0.5f * (min + max); }
+	glm::vec3 getExtent()const { return 0.5f * (max - min); }
+	float getSurfaceArea()const
+	{
+		glm::vec3 d = max - min;
+		return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+	bool contains(const AABB& o)const
+	{
+		return
+			min.x <= o.min.x && min.y <= o.min.y && min.z <= o.min.z &&
+			o.max.x <= max.x && o.max.y <= max.y && o.max.z <= max.z;
+	}
+
+	// an "empty" box that can be grown with merge()
+	static AABB makeEmpty()
+	{
+		const float inf = std::numeric_limits<float>::infinity();
+		return AABB(glm::vec3(+inf), glm::vec3(-inf));
+	}
+	static AABB merge(const AABB& a, const AABB& b)
+	{
+		return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+	static AABB merge(const AABB& a, const glm::vec3& p)
+	{
+		return AABB(glm::min(a.min, p), glm::max(a.max, p));
+	}
+};
+
+struct Sphere
+{
+	glm::vec3 center;
+	float radius;
+
+	Sphere() {}
+	Sphere(const glm::vec3& center, float radius) : center(center), radius(radius) {}
+};
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 dir;
+
+	Ray() {}
+	Ray(const glm::vec3& origin, const glm::vec3& dir) : origin(origin), dir(dir) {}
+};
+
+// points p with dot(normal, p) + d >= 0 are in the positive side
+struct Plane
+{
+	glm::vec3 normal;
+	float d;
+
+	float distance(const glm::vec3& p)const;
+};
+
+enum class FrustumTest
+{
+	OUTSIDE,
+	INTERSECT,
+	INSIDE
+};
+
+// the planes point inwards
+struct Frustum
+{
+	enum { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, NUM_PLANES };
+	Plane planes[NUM_PLANES];
+
+	// extract the planes from an OpenGL style projection (or view-projection) matrix
+	static Frustum fromMatrix(const glm::mat4& viewProj);
+};
+
+// bounding box of a box transformed by an affine matrix
+AABB transformAABB(const AABB& box, const glm::mat4& m);
+
+bool intersects(const AABB& a, const AABB& b);
+bool intersects(const Sphere& s, const AABB& b);
+bool intersects(const Sphere& s, const Frustum& f);
+
+// slab test, invDir = 1 / ray.dir. On hit, tHit is the entry distance (clamped to 0)
+bool intersects(const Ray& ray, const glm::vec3& invDir, const AABB& b, float tMax, float& tHit);
+
+FrustumTest testFrustum(const Frustum& f, const AABB& b);
+
+// same as testFrustum but only checks the planes set in planeMask.
+// The planes that fully contain the box are removed from the mask, so
+// hierarchical traversals don't need to test them again for the children
+FrustumTest testFrustumMasked(const Frustum& f, const AABB& b, unsigned& planeMask);
@@ -0,0 +1,409 @@
+#include "occlusion_culler.hpp"
+
+#include "../mesh/mesh.hpp"
+#include "../../util/job_system.hpp"
+#include "../../util/mallocr/mem_tracker.hpp"
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TUKI_OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// rows of each band of the depth buffer, bands are the unit of work for the threads
+static const unsigned BAND_HEIGHT = 2 * OcclusionCuller::TILE_SIZE;
+
+// floor of a screen coordinate, clamped to [-1, size] before converting it, a float out of
+// the range of int is UB. NaN gives -1
+static int floorToPixel(float x, unsigned size)
+{
+	if (!(x >= 0.f)) return -1;
+	if (x >= (float)size) return (int)size;
+	return (int)x;
+}
+
+OcclusionCuller::OcclusionCuller(unsigned width, unsigned height)
+	: width(0), height(0), parallel(true), viewProj(1)
+{
+	resize(width, height);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	MemTracker::trackFree(MemTag::RENDER, getDepthBuffersSize());
+}
+
+size_t OcclusionCuller::getDepthBuffersSize()const
+{
+	return (depth.size() + tileDepth.size()) * sizeof(float);
+}
+
+void OcclusionCuller::resize(unsigned w, unsigned h)
+{
+	if (!depth.empty()) MemTracker::trackFree(MemTag::RENDER, getDepthBuffersSize());
+	const unsigned ts = TILE_SIZE;
+	tilesX = std::max(1u, (w + ts - 1) / ts);
+	tilesY = std::max(1u, (h + ts - 1) / ts);
+	width = tilesX * ts;
+	height = tilesY * ts;
+	depth.assign(width * height, 1.f);
+	tileDepth.assign(tilesX * tilesY, 1.f);
+	bandBins.resize(getNumBands());
+	MemTracker::trackAlloc(MemTag::RENDER, getDepthBuffersSize());
+}
+
+void OcclusionCuller::setParallel(bool parallel)
+{
+	this->parallel = parallel;
+}
+
+template <typename Func>
+void OcclusionCuller::forEach(unsigned n, const Func& func)const
+{
+	if (parallel) JobSystem::getSingleton()->parallelFor(n, func);
+	else for (unsigned i = 0; i < n; i++) func(i);
+}
+
+unsigned OcclusionCuller::getNumBands()const
+{
+	return (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+}
+
+void OcclusionCuller::beginFrame(const mat4& viewProj)
+{
+	this->viewProj = viewProj;
+	occluders.clear();
+	triangles.clear();
+	fill(depth.begin(), depth.end(), 1.f);
+	fill(tileDepth.begin(), tileDepth.end(), 1.f);
+}
+
+void OcclusionCuller::addOccluder(const IMesh& mesh, const mat4& modelMat, bool twoSided)
+{
+	assert(mesh.getGeomType() == GeomType::TRIANGLES && "only triangle meshes can be occluders");
+	if (!mesh.hasAttribData(AttribLocation::POS)) return;
+
+	Occluder occluder;
+	occluder.positions = mesh.getAttribData(AttribLocation::POS);
+	occluder.indices = mesh.getIndices();
+	occluder.numIndices = mesh.hasIndices() ? mesh.getNumIndices() : mesh.getNumVertices();
+	occluder.mvp = viewProj * modelMat;
+	occluder.twoSided = twoSided;
+	occluders.push_back(occluder);
+}
+
+void OcclusionCuller::rasterizeOccluders()
+{
+	// transform, clip and project the triangles of each occluder
+	const unsigned no = occluders.size();
+	if (occluderTriangles.size() < no) occluderTriangles.resize(no);
+	forEach(no,
+		[&](unsigned i) { setupOccluder(occluders[i], occluderTriangles[i]); });
+
+	triangles.clear();
+	for (unsigned i = 0; i < no; i++)
+	{
+		triangles.insert(triangles.end(), occluderTriangles[i].begin(), occluderTriangles[i].end());
+	}
+
+	// bin the triangles in the bands they touch
+	const unsigned nb = getNumBands();
+	for (vector<unsigned>& bin : bandBins) bin.clear();
+	for (unsigned i = 0; i < triangles.size(); i++)
+	{
+		const ScreenTriangle& tri = triangles[i];
+		const float minY = std::min(tri.v[0].y, std::min(tri.v[1].y, tri.v[2].y));
+		const float maxY = std::max(tri.v[0].y, std::max(tri.v[1].y, tri.v[2].y));
+		const int y1 = floorToPixel(maxY, height);
+		if (y1 < 0) continue;
+		const int b0 = std::max(0, floorToPixel(minY, height)) / (int)BAND_HEIGHT;
+		const int b1 = std::min((int)nb - 1, y1 / (int)BAND_HEIGHT);
+		for (int b = b0; b <= b1; b++) bandBins[b].push_back(i);
+	}
+
+	forEach(nb,
+		[&](unsigned band)
+		{
+			rasterizeBand(band);
+			buildTileDepth(band);
+		});
+}
+
+void OcclusionCuller::setupOccluder(const Occluder& occluder, vector<ScreenTriangle>& out)const
+{
+	out.clear();
+	const float w = (float)width;
+	const float h = (float)height;
+	const float* positions = occluder.positions;
+
+	auto toWindow = [&](const vec4& c)
+	{
+		const float invW = 1.f / c.w;
+		return vec3(
+			(c.x * invW * 0.5f + 0.5f) * w,
+			(c.y * invW * 0.5f + 0.5f) * h,
+			c.z * invW * 0.5f + 0.5f);
+	};
+
+	auto emit = [&](const vec3& a, vec3 b, vec3 c)
+	{
+		// trivial reject outside the screen
+		if (std::max(a.x, std::max(b.x, c.x)) < 0 || std::min(a.x, std::min(b.x, c.x)) > w) return;
+		if (std::max(a.y, std::max(b.y, c.y)) < 0 || std::min(a.y, std::min(b.y, c.y)) > h) return;
+
+		const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (area == 0) return;
+		if (area < 0)
+		{
+			if (!occluder.twoSided) return;	// back facing
+			std::swap(b, c);
+		}
+		ScreenTriangle tri;
+		tri.v[0] = a;
+		tri.v[1] = b;
+		tri.v[2] = c;
+		out.push_back(tri);
+	};
+
+	const unsigned nt = occluder.numIndices / 3;
+	for (unsigned t = 0; t < nt; t++)
+	{
+		vec4 clip[3];
+		for (int k = 0; k < 3; k++)
+		{
+			const unsigned i = occluder.indices ? occluder.indices[3 * t + k] : 3 * t + k;
+			const float* p = &positions[3 * i];
+			clip[k] = occluder.mvp * vec4(p[0], p[1], p[2], 1);
+		}
+
+		// distances to the near plane (z = -w)
+		float d[3];
+		int numInside = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			d[k] = clip[k].z + clip[k].w;
+			if (d[k] >= 0) numInside++;
+		}
+
+		if (numInside == 3)
+		{
+			emit(toWindow(clip[0]), toWindow(clip[1]), toWindow(clip[2]));
+		}
+		else if (numInside > 0)
+		{
+			// clip the polygon against the near plane (Sutherland-Hodgman)
+			vec4 poly[4];
+			int n = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const int k1 = (k + 1) % 3;
+				if (d[k] >= 0) poly[n++] = clip[k];
+				if ((d[k] >= 0) != (d[k1] >= 0))
+				{
+					const float s = d[k] / (d[k] - d[k1]);
+					poly[n++] = clip[k] + s * (clip[k1] - clip[k]);
+				}
+			}
+			const vec3 p0 = toWindow(poly[0]);
+			for (int k = 1; k + 1 < n; k++)
+			{
+				emit(p0, toWindow(poly[k]), toWindow(poly[k + 1]));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::rasterizeBand(unsigned band)
+{
+	const int bandY0 = band * BAND_HEIGHT;
+	const int bandY1 = std::min(height, (band + 1) * BAND_HEIGHT) - 1;
+
+	for (unsigned ti : bandBins[band])
+	{
+		const ScreenTriangle& tri = triangles[ti];
+		const vec3& v0 = tri.v[0];
+		const vec3& v1 = tri.v[1];
+		const vec3& v2 = tri.v[2];
+
+		// bounding rect of the triangle clipped to the band, x aligned to 4 pixels
+		int x0 = floorToPixel(std::min(v0.x, std::min(v1.x, v2.x)), width);
+		int x1 = floorToPixel(std::max(v0.x, std::max(v1.x, v2.x)), width);
+		int y0 = floorToPixel(std::min(v0.y, std::min(v1.y, v2.y)), height);
+		int y1 = floorToPixel(std::max(v0.y, std::max(v1.y, v2.y)), height);
+		x0 = std::max(x0, 0) & ~3;
+		x1 = std::min(x1, (int)width - 1);
+		y0 = std::max(y0, bandY0);
+		y1 = std::min(y1, bandY1);
+		if (x0 > x1 || y0 > y1) continue;
+
+		// edge functions: E(x, y) = A*x + B*y + C, positive inside for counter clockwise triangles
+		// edge i is the one opposite to vertex i
+		const vec3* v[3] = { &v0, &v1, &v2 };
+		float A[3], B[3], C[3];
+		for (int i = 0; i < 3; i++)
+		{
+			const vec3& a = *v[(i + 1) % 3];
+			const vec3& b = *v[(i + 2) % 3];
+			A[i] = a.y - b.y;
+			B[i] = b.x - a.x;
+			C[i] = a.x * b.y - a.y * b.x;
+		}
+		const float area = C[0] + C[1] + C[2];
+		const float invArea = 1.f / area;
+
+		// depth plane: z(x, y) = zA*x + zB*y + zC
+		const float zA = (A[0] * v0.z + A[1] * v1.z + A[2] * v2.z) * invArea;
+		const float zB = (B[0] * v0.z + B[1] * v1.z + B[2] * v2.z) * invArea;
+		const float zC = (C[0] * v0.z + C[1] * v1.z + C[2] * v2.z) * invArea;
+
+#ifdef TUKI_OCCLUSION_SSE
+		const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+		const __m128 za = _mm_set1_ps(zA);
+		const __m128 step4 = _mm_set1_ps(4.f);
+		for (int y = y0; y <= y1; y++)
+		{
+			const float py = y + 0.5f;
+			float* row = &depth[y * width];
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x0), offsets);
+			const __m128 r0 = _mm_set1_ps(B[0] * py + C[0]);
+			const __m128 r1 = _mm_set1_ps(B[1] * py + C[1]);
+			const __m128 r2 = _mm_set1_ps(B[2] * py + C[2]);
+			const __m128 rz = _mm_set1_ps(zB * py + zC);
+			for (int x = x0; x <= x1; x += 4)
+			{
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+				const __m128 inside = _mm_and_ps(
+					_mm_cmpge_ps(e0, zero),
+					_mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+				if (_mm_movemask_ps(inside))
+				{
+					const __m128 z = _mm_add_ps(_mm_mul_ps(za, px), rz);
+					const __m128 old = _mm_loadu_ps(&row[x]);
+					const __m128 nearest = _mm_min_ps(old, z);
+					_mm_storeu_ps(&row[x],
+						_mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+				}
+				px = _mm_add_ps(px, step4);
+			}
+		}
+#else
+		for (int y = y0; y <= y1; y++)
+		{
+			const float py = y + 0.5f;
+			float* row = &depth[y * width];
+			for (int x = x0; x <= x1; x++)
+			{
+				const float px = x + 0.5f;
+				const float e0 = A[0] * px + B[0] * py + C[0];
+				const float e1 = A[1] * px + B[1] * py + C[1];
+				const float e2 = A[2] * px + B[2] * py + C[2];
+				if (e0 >= 0 && e1 >= 0 && e2 >= 0)
+				{
+					const float z = zA * px + zB * py + zC;
+					row[x] = std::min(row[x], z);
+				}
+			}
+		}
+#endif
+	}
+}
+
+void OcclusionCuller::buildTileDepth(unsigned band)
+{
+	const unsigned ts = TILE_SIZE;
+	const unsigned ty0 = band * BAND_HEIGHT / ts;
+	const unsigned ty1 = std::min(tilesY, (band + 1) * BAND_HEIGHT / ts);
+	for (unsigned ty = ty0; ty < ty1; ty++)
+	for (unsigned tx = 0; tx < tilesX; tx++)
+	{
+#ifdef TUKI_OCCLUSION_SSE
+		__m128 m = _mm_setzero_ps();
+		for (unsigned y = 0; y < ts; y++)
+		{
+			const float* row = &depth[(ty * ts + y) * width + tx * ts];
+			for (unsigned x = 0; x < ts; x += 4) m = _mm_max_ps(m, _mm_loadu_ps(&row[x]));
+		}
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		tileDepth[ty * tilesX + tx] = _mm_cvtss_f32(m);
+#else
+		float m = 0;
+		for (unsigned y = 0; y < ts; y++)
+		{
+			const float* row = &depth[(ty * ts + y) * width + tx * ts];
+			for (unsigned x = 0; x < ts; x++) m = std::max(m, row[x]);
+		}
+		tileDepth[ty * tilesX + tx] = m;
+#endif
+	}
+}
+
+bool OcclusionCuller::isVisible(const AABB& box)const
+{
+	// project the corners of the box
+	vec3 smin(numeric_limits<float>::max());
+	vec3 smax(-numeric_limits<float>::max());
+	for (int i = 0; i < 8; i++)
+	{
+		const vec3 p(
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z);
+		const vec4 c = viewProj * vec4(p, 1);
+		// crosses the near plane, we can't say anything
+		if (c.z + c.w <= 0 || c.w <= 0) return true;
+		const float invW = 1.f / c.w;
+		const vec3 s(
+			(c.x * invW * 0.5f + 0.5f) * width,
+			(c.y * invW * 0.5f + 0.5f) * height,
+			c.z * invW * 0.5f + 0.5f);
+		smin = glm::min(smin, s);
+		smax = glm::max(smax, s);
+	}
+
+	// outside of the screen
+	if (smax.x < 0 || smax.y < 0 || smin.x >= width || smin.y >= height) return false;
+	if (smin.z > 1) return false;
+
+	const int x0 = std::max(0, floorToPixel(smin.x, width));
+	const int y0 = std::max(0, floorToPixel(smin.y, height));
+	const int x1 = std::min((int)width - 1, floorToPixel(smax.x, width));
+	const int y1 = std::min((int)height - 1, floorToPixel(smax.y, height));
+	// NaN coordinates, we can't say anything
+	if (x0 > x1 || y0 > y1) return true;
+	const float nearestZ = smin.z;
+	const int ts = TILE_SIZE;
+
+	for (int ty = y0 / ts; ty <= y1 / ts; ty++)
+	for (int tx = x0 / ts; tx <= x1 / ts; tx++)
+	{
+		// all the tile is in front of the box
+		if (nearestZ >= tileDepth[ty * tilesX + tx]) continue;
+
+		// the tile is inconclusive, check the pixels covered by the box
+		const int px0 = std::max(x0, tx * ts);
+		const int px1 = std::min(x1, tx * ts + ts - 1);
+		const int py0 = std::max(y0, ty * ts);
+		const int py1 = std::min(y1, ty * ts + ts - 1);
+		for (int y = py0; y <= py1; y++)
+		{
+			const float* row = &depth[y * width];
+			for (int x = px0; x <= px1; x++)
+			{
+				if (nearestZ < row[x]) return true;
+			}
+		}
+	}
+	return false;
+}
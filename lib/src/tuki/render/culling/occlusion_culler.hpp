@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../../math/geometry.hpp"
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+class IMesh;
+
+/*
+Software occlusion culling.
+The occluders are rasterized in the CPU into a small depth buffer. Then we build
+a hierarchical representation with the farthest depth of each tile. The bounding
+boxes of the candidate objects are projected to the screen and their nearest depth
+is compared against the tiles, and only where that is inconclusive against the pixels.
+The depth buffer is split in horizontal bands that are rasterized in parallel,
+and the inner loops process 4 pixels at once with SSE when it's available.
+Depth is stored as window z in [0, 1] (0 is near), the usual OpenGL projections work.
+*/
+class OcclusionCuller
+{
+public:
+	static const unsigned TILE_SIZE = 8;	// side of the tiles of the hierarchical depth, in pixels
+
+	// the size is rounded up to multiples of TILE_SIZE
+	OcclusionCuller(unsigned width = 256, unsigned height = 128);
+	~OcclusionCuller();
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+	void resize(unsigned width, unsigned height);
+	unsigned getWidth()const { return width; }
+	unsigned getHeight()const { return height; }
+
+	// distribute the rasterization among the threads of the JobSystem, true by default
+	void setParallel(bool parallel);
+
+	// clears the depth buffer and the occluders of the previous frame
+	void beginFrame(const glm::mat4& viewProj);
+
+	// only triangle meshes are supported
+	// the mesh data must be alive until rasterizeOccluders() has been called
+	void addOccluder(const IMesh& mesh, const glm::mat4& modelMat, bool twoSided = false);
+
+	// rasterize the occluders and build the hierarchical depth buffer
+	void rasterizeOccluders();
+
+	// returns false if the box (in world space) is completely hidden by the occluders
+	bool isVisible(const AABB& box)const;
+
+	const float* getDepthBuffer()const { return &depth[0]; }
+	const float* getTileDepthBuffer()const { return &tileDepth[0]; }
+	unsigned getNumRasterizedTriangles()const { return (unsigned)triangles.size(); }
+
+private:
+
+	struct Occluder
+	{
+		const float* positions;
+		const unsigned* indices;	// can be null
+		unsigned numIndices;
+		glm::mat4 mvp;
+		bool twoSided;
+	};
+
+	// triangle in window coordinates, counter clockwise
+	struct ScreenTriangle
+	{
+		glm::vec3 v[3];
+	};
+
+	// DATA
+	unsigned width, height;
+	unsigned tilesX, tilesY;
+	bool parallel;
+	glm::mat4 viewProj;
+	std::vector<float> depth;		// width * height
+	std::vector<float> tileDepth;	// farthest depth of each tile
+	std::vector<Occluder> occluders;
+	std::vector<std::vector<ScreenTriangle> > occluderTriangles;	// setup result of each occluder
+	std::vector<ScreenTriangle> triangles;
+	std::vector<std::vector<unsigned> > bandBins;	// triangles that touch each band
+
+	// FUNCTIONS
+	unsigned getNumBands()const;
+	size_t getDepthBuffersSize()const;
+	void setupOccluder(const Occluder& occluder, std::vector<ScreenTriangle>& out)const;
+	void rasterizeBand(unsigned band);
+	void buildTileDepth(unsigned band);
+	template <typename Func>
+	void forEach(unsigned n, const Func& func)const;
+};
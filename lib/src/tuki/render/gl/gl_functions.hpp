@@ -0,0 +1,103 @@
+#pragma once
+
+#include <glad/glad.h>
+
+/*
+X-macro with all the GL functions used by the library, for the tools that need to
+wrap or replace them (tracing, null GL for benchmarks...).
+X(f) is invoked for each function: f expands to the glad function pointer and #f
+is the name of the GL function. Add the new functions here when they are used.
+*/
+#define TUKI_GL_FUNCTIONS(X) \
+	X(glActiveTexture) \
+	X(glAttachShader) \
+	X(glBindAttribLocation) \
+	X(glBindBuffer) \
+	X(glBindFramebuffer) \
+	X(glBindTexture) \
+	X(glBindVertexArray) \
+	X(glBlendFunc) \
+	X(glBufferData) \
+	X(glCheckFramebufferStatus) \
+	X(glClear) \
+	X(glClearColor) \
+	X(glClearDepth) \
+	X(glCompileShader) \
+	X(glCreateProgram) \
+	X(glCreateShader) \
+	X(glCullFace) \
+	X(glDeleteBuffers) \
+	X(glDeleteFramebuffers) \
+	X(glDeleteProgram) \
+	X(glDeleteQueries) \
+	X(glDeleteShader) \
+	X(glDeleteTextures) \
+	X(glDeleteVertexArrays) \
+	X(glDepthMask) \
+	X(glDisable) \
+	X(glDisableVertexAttribArray) \
+	X(glDrawArrays) \
+	X(glDrawArraysInstanced) \
+	X(glDrawBuffers) \
+	X(glDrawElements) \
+	X(glDrawElementsInstanced) \
+	X(glEnable) \
+	X(glEnableVertexAttribArray) \
+	X(glFinish) \
+	X(glFramebufferTexture2D) \
+	X(glGenBuffers) \
+	X(glGenFramebuffers) \
+	X(glGenQueries) \
+	X(glGenTextures) \
+	X(glGenVertexArrays) \
+	X(glGenerateMipmap) \
+	X(glGetActiveUniform) \
+	X(glGetAttribLocation) \
+	X(glGetError) \
+	X(glGetInteger64v) \
+	X(glGetProgramInfoLog) \
+	X(glGetProgramiv) \
+	X(glGetQueryObjectiv) \
+	X(glGetQueryObjectui64v) \
+	X(glGetShaderInfoLog) \
+	X(glGetShaderiv) \
+	X(glGetString) \
+	X(glGetTexImage) \
+	X(glGetUniformLocation) \
+	X(glLinkProgram) \
+	X(glMultiDrawArrays) \
+	X(glMultiDrawElements) \
+	X(glPixelStorei) \
+	X(glPolygonMode) \
+	X(glQueryCounter) \
+	X(glShaderSource) \
+	X(glTexImage2D) \
+	X(glTexParameteri) \
+	X(glUniform1f) \
+	X(glUniform1i) \
+	X(glUniform1ui) \
+	X(glUniform2fv) \
+	X(glUniform2iv) \
+	X(glUniform2uiv) \
+	X(glUniform3fv) \
+	X(glUniform3iv) \
+	X(glUniform3uiv) \
+	X(glUniform4fv) \
+	X(glUniform4iv) \
+	X(glUniform4uiv) \
+	X(glUniformMatrix2fv) \
+	X(glUniformMatrix2x3fv) \
+	X(glUniformMatrix2x4fv) \
+	X(glUniformMatrix3fv) \
+	X(glUniformMatrix3x2fv) \
+	X(glUniformMatrix3x4fv) \
+	X(glUniformMatrix4fv) \
+	X(glUniformMatrix4x2fv) \
+	X(glUniformMatrix4x3fv) \
+	X(glUseProgram) \
+	X(glVertexAttrib4fv) \
+	X(glVertexAttribDivisor) \
+	X(glVertexAttribI4iv) \
+	X(glVertexAttribI4uiv) \
+	X(glVertexAttribIPointer) \
+	X(glVertexAttribPointer)
@@ -0,0 +1,282 @@
+#include "gl_trace.hpp"
+
+#include "gl_functions.hpp"
+#include "../../util/profiler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+
+enum GlFunctionIndex
+{
+#define TUKI_GL_INDEX(f) GL_FUNC_##f,
+	TUKI_GL_FUNCTIONS(TUKI_GL_INDEX)
+#undef TUKI_GL_INDEX
+	NUM_GL_FUNCTIONS
+};
+
+const char* const FUNCTION_NAMES[] =
+{
+#define TUKI_GL_NAME(f) #f,
+	TUKI_GL_FUNCTIONS(TUKI_GL_NAME)
+#undef TUKI_GL_NAME
+};
+
+const size_t FLUSH_SIZE = 16 * 1024 * 1024;
+const unsigned MAX_ARGS_SIZE = 128;
+
+bool installed = false;
+uint64_t calls[NUM_GL_FUNCTIONS];
+uint64_t ns[NUM_GL_FUNCTIONS];
+vector<GlCallStats> lastFrameStats;
+uint64_t lastFrameCalls = 0;
+double lastFrameDriverMs = 0;
+uint64_t frameNumber = 0;
+
+// recording
+FILE* file = nullptr;
+vector<char> buffer;	// records waiting to be written
+char args[MAX_ARGS_SIZE];	// args of the call in progress
+unsigned argsSize = 0;
+
+template <typename T>
+void append(vector<char>& out, const T& val)
+{
+	const char* p = (const char*)&val;
+	out.insert(out.end(), p, p + sizeof(T));
+}
+
+void appendRecord(uint16_t func, uint64_t begin, uint64_t end, const char* data, unsigned size)
+{
+	append(buffer, func);
+	append(buffer, (uint16_t)size);
+	append(buffer, begin);
+	append(buffer, (uint32_t)(end - begin));
+	buffer.insert(buffer.end(), data, data + size);
+}
+
+void flush()
+{
+	if (!buffer.empty()) fwrite(&buffer[0], 1, buffer.size(), file);
+	buffer.clear();
+}
+
+template <typename T>
+void writeArg(T val)
+{
+	assert(argsSize + sizeof(T) <= MAX_ARGS_SIZE);
+	memcpy(&args[argsSize], &val, sizeof(T));
+	argsSize += sizeof(T);
+}
+template <typename T>
+void writeArg(T* ptr)
+{
+	writeArg((uint64_t)(uintptr_t)ptr);
+}
+
+void writeArgs() {}
+template <typename T, typename... Rest>
+void writeArgs(T val, Rest... rest)
+{
+	writeArg(val);
+	writeArgs(rest...);
+}
+
+class CallTimer
+{
+public:
+	CallTimer(unsigned func) : func(func), begin(Profiler::now()) {}
+	~CallTimer()
+	{
+		const uint64_t end = Profiler::now();
+		calls[func]++;
+		ns[func] += end - begin;
+		if (file) appendRecord((uint16_t)func, begin, end, args, argsSize);
+	}
+private:
+	unsigned func;
+	uint64_t begin;
+};
+
+template <unsigned I, typename R, typename... Args>
+struct Tracer
+{
+	static R (APIENTRYP original)(Args...);
+
+	static R APIENTRY call(Args... a)
+	{
+		if (file)
+		{
+			argsSize = 0;
+			writeArgs(a...);
+		}
+		CallTimer timer(I);
+		return original(a...);
+	}
+};
+template <unsigned I, typename R, typename... Args>
+R (APIENTRYP Tracer<I, R, Args...>::original)(Args...) = nullptr;
+
+template <unsigned I, typename R, typename... Args>
+void wrap(R (APIENTRYP& func)(Args...))
+{
+	// the functions not supported by the context stay null
+	if (!func) return;
+	Tracer<I, R, Args...>::original = func;
+	func = &Tracer<I, R, Args...>::call;
+}
+
+template <unsigned I, typename R, typename... Args>
+void unwrap(R (APIENTRYP& func)(Args...))
+{
+	if (func == &Tracer<I, R, Args...>::call) func = Tracer<I, R, Args...>::original;
+}
+
+}
+
+namespace GlTrace
+{
+
+void install()
+{
+	if (installed) return;
+#define TUKI_GL_WRAP(f) wrap<GL_FUNC_##f>(f);
+	TUKI_GL_FUNCTIONS(TUKI_GL_WRAP)
+#undef TUKI_GL_WRAP
+	memset(calls, 0, sizeof(calls));
+	memset(ns, 0, sizeof(ns));
+	installed = true;
+}
+
+void uninstall()
+{
+	if (!installed) return;
+	stopRecording();
+#define TUKI_GL_UNWRAP(f) unwrap<GL_FUNC_##f>(f);
+	TUKI_GL_FUNCTIONS(TUKI_GL_UNWRAP)
+#undef TUKI_GL_UNWRAP
+	installed = false;
+}
+
+bool isInstalled()
+{
+	return installed;
+}
+
+void endFrame()
+{
+	if (!installed) return;
+	lastFrameStats.clear();
+	lastFrameCalls = 0;
+	uint64_t totalNs = 0;
+	for (unsigned i = 0; i < NUM_GL_FUNCTIONS; i++)
+	{
+		if (calls[i] == 0) continue;
+		GlCallStats s;
+		s.name = FUNCTION_NAMES[i];
+		s.calls = calls[i];
+		s.ns = ns[i];
+		lastFrameStats.push_back(s);
+		lastFrameCalls += calls[i];
+		totalNs += ns[i];
+	}
+	sort(lastFrameStats.begin(), lastFrameStats.end(), [](const GlCallStats& a, const GlCallStats& b)
+	{
+		return a.calls > b.calls;
+	});
+	lastFrameDriverMs = totalNs * 1e-6;
+	memset(calls, 0, sizeof(calls));
+	memset(ns, 0, sizeof(ns));
+
+	if (file)
+	{
+		const uint64_t t = Profiler::now();
+		appendRecord(FRAME_END, t, t, (const char*)&frameNumber, sizeof(frameNumber));
+		if (buffer.size() >= FLUSH_SIZE) flush();
+	}
+	frameNumber++;
+}
+
+const vector<GlCallStats>& getLastFrameStats()
+{
+	return lastFrameStats;
+}
+
+uint64_t getLastFrameCalls()
+{
+	return lastFrameCalls;
+}
+
+double getLastFrameDriverMs()
+{
+	return lastFrameDriverMs;
+}
+
+string statsToString(const vector<GlCallStats>& stats)
+{
+	stringstream ss;
+	ss << fixed << setprecision(3);
+	ss << setw(28) << left << "function" << right
+		<< setw(10) << "calls" << setw(12) << "total ms" << setw(12) << "avg us" << "\n";
+	for (const GlCallStats& s : stats)
+	{
+		ss << setw(28) << left << s.name << right
+			<< setw(10) << s.calls << setw(12) << s.ns * 1e-6
+			<< setw(12) << (double)s.ns / s.calls * 1e-3 << "\n";
+	}
+	return ss.str();
+}
+
+const char* getFunctionName(unsigned index)
+{
+	assert(index < NUM_GL_FUNCTIONS);
+	return FUNCTION_NAMES[index];
+}
+
+unsigned getNumFunctions()
+{
+	return NUM_GL_FUNCTIONS;
+}
+
+void startRecording(const string& fileName)
+{
+	stopRecording();
+	install();
+	file = fopen(fileName.c_str(), "wb");
+	if (!file) throw runtime_error("could not open " + fileName);
+
+	buffer.clear();
+	buffer.insert(buffer.end(), { 'T', 'K', 'G', 'L' });
+	append(buffer, FILE_VERSION);
+	append(buffer, (uint32_t)NUM_GL_FUNCTIONS);
+	for (const char* name : FUNCTION_NAMES)
+	{
+		const uint8_t len = (uint8_t)strlen(name);
+		append(buffer, len);
+		buffer.insert(buffer.end(), name, name + len);
+	}
+	flush();
+}
+
+void stopRecording()
+{
+	if (!file) return;
+	flush();
+	fclose(file);
+	file = nullptr;
+}
+
+bool isRecording()
+{
+	return file != nullptr;
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Opt-in instrumentation of the GL calls.
+install() wraps the glad function pointers of TUKI_GL_FUNCTIONS (gl_functions.hpp) with
+functions that count the calls and measure the time spent in the driver, until uninstall().
+When it's not installed the GL calls are not affected at all.
+The stats are accumulated until endFrame(), which makes them available as the last frame.
+Optionally, the command stream can be recorded to a binary file:
+	header: "TKGL", uint32 version, uint32 numFunctions, numFunctions x (uint8 length, name)
+	records: uint16 function, uint16 argsSize, uint64 beginNs, uint32 durationNs, args
+	The args are stored by value in declaration order; pointers are stored as uint64
+	addresses, not the data they point to. The end of a frame is a record with function
+	FRAME_END and the frame number (uint64) as args.
+All the functions must be called from the thread of the GL context, after gladLoadGL.
+*/
+
+struct GlCallStats
+{
+	const char* name;
+	std::uint64_t calls;
+	std::uint64_t ns;	// time spent in the driver
+};
+
+namespace GlTrace
+{
+
+static const std::uint32_t FILE_VERSION = 1;
+static const std::uint16_t FRAME_END = 0xFFFF;
+
+void install();
+void uninstall();
+bool isInstalled();
+
+void endFrame();
+
+// functions called in the last frame, sorted by number of calls
+const std::vector<GlCallStats>& getLastFrameStats();
+std::uint64_t getLastFrameCalls();
+double getLastFrameDriverMs();
+std::string statsToString(const std::vector<GlCallStats>& stats);
+
+// name of the function with that index in the recordings
+const char* getFunctionName(unsigned index);
+unsigned getNumFunctions();
+
+void startRecording(const std::string& fileName);
+void stopRecording();
+bool isRecording();
+
+}
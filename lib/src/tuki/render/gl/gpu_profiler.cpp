@@ -0,0 +1,154 @@
+#include "gpu_profiler.hpp"
+
+#include <glad/glad.h>
+#include <cassert>
+
+using namespace std;
+
+GpuProfiler::GpuProfiler()
+	: enabled(Profiler::isEnabled()), initialized(false), inFrame(false),
+	track(0), frameIndex(0), passScope(-1), numDroppedFrames(0)
+{
+	for (Frame& frame : frames)
+	{
+		frame.numQueries = 0;
+		frame.clockOffset = 0;
+		frame.pending = false;
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	// the GL context is probably gone at this point, the queries die with it
+}
+
+unsigned GpuProfiler::issueTimestamp()
+{
+	Frame& frame = frames[frameIndex];
+	if (frame.numQueries == MAX_QUERIES_PER_FRAME) return INVALID_QUERY;
+	const unsigned q = frameIndex * MAX_QUERIES_PER_FRAME + frame.numQueries++;
+	glQueryCounter(queries[q], GL_TIMESTAMP);
+	return q;
+}
+
+bool GpuProfiler::isAvailable(const Frame& frame, unsigned fi)const
+{
+	// the queries finish in order, so checking the last one is enough
+	if (frame.numQueries == 0) return true;
+	GLint available = 0;
+	glGetQueryObjectiv(queries[fi * MAX_QUERIES_PER_FRAME + frame.numQueries - 1],
+		GL_QUERY_RESULT_AVAILABLE, &available);
+	return available != 0;
+}
+
+void GpuProfiler::collect(Frame& frame)
+{
+	lastResults.clear();
+	for (const Scope& scope : frame.scopes)
+	{
+		if (scope.beginQuery == INVALID_QUERY || scope.endQuery == INVALID_QUERY) continue;
+		GLuint64 begin, end;
+		glGetQueryObjectui64v(queries[scope.beginQuery], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(queries[scope.endQuery], GL_QUERY_RESULT, &end);
+
+		ScopeResult res;
+		res.name = scope.name;
+		res.depth = scope.depth;
+		res.gpuMs = (end - begin) * 1e-6;
+		lastResults.push_back(res);
+
+		const int64_t cpuBegin = (int64_t)begin + frame.clockOffset;
+		const int64_t cpuEnd = (int64_t)end + frame.clockOffset;
+		if (cpuBegin >= 0) Profiler::recordTrackEvent(track, scope.name, cpuBegin, cpuEnd);
+	}
+	frame.pending = false;
+}
+
+void GpuProfiler::beginFrame()
+{
+	if (!enabled) return;
+	assert(!inFrame);
+	if (!initialized)
+	{
+		queries.resize(NUM_FRAMES * MAX_QUERIES_PER_FRAME);
+		glGenQueries((GLsizei)queries.size(), &queries[0]);
+		track = Profiler::createTrack("gpu");
+		initialized = true;
+	}
+
+	// collect the finished frames, oldest first
+	for (unsigned i = 1; i <= NUM_FRAMES; i++)
+	{
+		const unsigned fi = (frameIndex + i) % NUM_FRAMES;
+		Frame& frame = frames[fi];
+		if (frame.pending && isAvailable(frame, fi)) collect(frame);
+	}
+
+	frameIndex = (frameIndex + 1) % NUM_FRAMES;
+	Frame& frame = frames[frameIndex];
+	if (frame.pending)
+	{
+		// the GPU is more than NUM_FRAMES behind, we don't wait for it
+		numDroppedFrames++;
+		frame.pending = false;
+	}
+	frame.scopes.clear();
+	frame.numQueries = 0;
+
+	// sync the clocks: the timestamp of the GL server is taken now
+	GLint64 gpuNow;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	frame.clockOffset = (int64_t)Profiler::now() - gpuNow;
+
+	inFrame = true;
+	passScope = -1;
+	openScopes.clear();
+	beginScope("frame");
+}
+
+void GpuProfiler::endFrame()
+{
+	if (!enabled) return;
+	assert(inFrame);
+	if (passScope >= 0) endScope();
+	endScope();	// frame
+	assert(openScopes.empty() && "GPU profile scopes not closed");
+	frames[frameIndex].pending = true;
+	inFrame = false;
+}
+
+void GpuProfiler::beginScope(const char* name)
+{
+	if (!inFrame) return;
+	Frame& frame = frames[frameIndex];
+	Scope scope;
+	scope.name = name;
+	scope.depth = (unsigned)openScopes.size();
+	scope.beginQuery = issueTimestamp();
+	scope.endQuery = INVALID_QUERY;
+	openScopes.push_back((unsigned)frame.scopes.size());
+	frame.scopes.push_back(scope);
+}
+
+void GpuProfiler::endScope()
+{
+	if (!inFrame) return;
+	assert(!openScopes.empty());
+	const unsigned s = openScopes.back();
+	openScopes.pop_back();
+	if ((int)s == passScope) passScope = -1;
+	frames[frameIndex].scopes[s].endQuery = issueTimestamp();
+}
+
+void GpuProfiler::beginPass(const char* name)
+{
+	if (!inFrame) return;
+	if (passScope >= 0)
+	{
+		// the scopes opened inside the previous pass must be closed
+		assert(openScopes.back() == (unsigned)passScope && "a pass can't begin inside a scope of the previous pass");
+		endScope();
+	}
+	passScope = (int)frames[frameIndex].scopes.size();
+	beginScope(name);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "../../util/singleton.hpp"
+#include "../../util/profiler.hpp"
+
+/*
+Measures the GPU time of render passes with timestamp queries.
+Timestamps are used instead of GL_TIME_ELAPSED because they can be nested.
+The queries of each frame come from a ring of NUM_FRAMES pools. The results are read
+a few frames later, only when they are available, so the CPU never waits for the GPU;
+if a pool is still busy when it has to be reused its results are dropped.
+The results are converted to the CPU clock and recorded in the "gpu" track of the
+Profiler, so they appear in the same trace as the CPU scopes.
+It only works when the library is built with TUKI_PROFILE, otherwise it does nothing.
+All the functions must be called from the thread of the GL context.
+*/
+class GpuProfiler : public Singleton<GpuProfiler>
+{
+	friend class Singleton<GpuProfiler>;
+public:
+	static const unsigned NUM_FRAMES = 4;
+	static const unsigned MAX_QUERIES_PER_FRAME = 512;
+
+	struct ScopeResult
+	{
+		const char* name;
+		unsigned depth;		// 0 is the whole frame
+		double gpuMs;
+	};
+
+	void beginFrame();
+	void endFrame();
+
+	// the scopes can be nested, the names must be literals
+	void beginScope(const char* name);
+	void endScope();
+
+	// ends the current pass (if any) and begins a new one, the last pass ends with the frame
+	void beginPass(const char* name);
+
+	// scopes of the last frame whose results have arrived
+	const std::vector<ScopeResult>& getLastResults()const { return lastResults; }
+	double getLastFrameGpuTime()const { return lastResults.empty() ? 0 : lastResults[0].gpuMs; }
+	unsigned getNumDroppedFrames()const { return numDroppedFrames; }
+
+private:
+	GpuProfiler();
+	~GpuProfiler();
+
+	static const unsigned INVALID_QUERY = (unsigned)-1;
+
+	struct Scope
+	{
+		const char* name;
+		unsigned depth;
+		unsigned beginQuery, endQuery;
+	};
+
+	struct Frame
+	{
+		std::vector<Scope> scopes;
+		unsigned numQueries;
+		std::int64_t clockOffset;	// CPU time - GPU time, in nanoseconds
+		bool pending;				// waiting for the results
+	};
+
+	// DATA
+	bool enabled;
+	bool initialized;
+	bool inFrame;
+	unsigned track;
+	unsigned frameIndex;
+	Frame frames[NUM_FRAMES];
+	std::vector<unsigned> queries;	// NUM_FRAMES * MAX_QUERIES_PER_FRAME
+	std::vector<unsigned> openScopes;
+	int passScope;
+	std::vector<ScopeResult> lastResults;
+	unsigned numDroppedFrames;
+
+	// FUNCTIONS
+	unsigned issueTimestamp();
+	bool isAvailable(const Frame& frame, unsigned frameIndex)const;
+	void collect(Frame& frame);
+};
+
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(const char* name) { GpuProfiler::getSingleton()->beginScope(name); }
+	~GpuProfileScope() { GpuProfiler::getSingleton()->endScope(); }
+	GpuProfileScope(const GpuProfileScope&) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+};
+
+#ifdef TUKI_PROFILE
+	#define TUKI_GPU_PROFILE_SCOPE(name) GpuProfileScope TUKI_PROFILE_CONCAT(gpuProfileScope_, __LINE__)(name)
+	#define TUKI_GPU_PROFILE_PASS(name) GpuProfiler::getSingleton()->beginPass(name)
+#else
+	#define TUKI_GPU_PROFILE_SCOPE(name)
+	#define TUKI_GPU_PROFILE_PASS(name)
+#endif
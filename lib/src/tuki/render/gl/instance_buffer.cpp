@@ -0,0 +1,100 @@
+#include "instance_buffer.hpp"
+
+#include <glad/glad.h>
+#include <cassert>
+#include "render_capture.hpp"
+#include "../../util/mallocr/mem_tracker.hpp"
+
+using namespace std;
+
+bool isInstanceAttribType(UnifType type)
+{
+	return type < UnifType::MATRIX_2;
+}
+
+void InstanceBuffer::upload(const void* data, size_t size)
+{
+	if (vbo == -1) glGenBuffers(1, (GLuint*)&vbo);
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::INSTANCE_BUFFER_UPLOAD) << (uint32_t)vbo << RenderCapture::Data(data, size);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+	MemTracker::trackVramFree(VramType::BUFFER, this->size);
+	MemTracker::trackVramAlloc(VramType::BUFFER, size);
+	this->size = size;
+}
+
+void InstanceBuffer::free()
+{
+	if (vbo == -1) return;
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::INSTANCE_BUFFER_FREE) << (uint32_t)vbo;
+	glDeleteBuffers(1, (GLuint*)&vbo);
+	MemTracker::trackVramFree(VramType::BUFFER, size);
+	vbo = -1;
+	size = 0;
+}
+
+void InstanceBuffer::bindAttribs(unsigned stride, const InstanceAttrib* attribs, unsigned numAttribs)const
+{
+	assert(vbo != -1);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	for (unsigned i = 0; i < numAttribs; i++)
+	{
+		const InstanceAttrib& attrib = attribs[i];
+		assert(isInstanceAttribType(attrib.type));
+		if (attrib.location < 0) continue;
+		const GLint numComps = getUnifNumElems(attrib.type);
+		const void* offset = (const void*)(size_t)attrib.offset;
+		const UnifType basicType = getUnifBasicType(attrib.type);
+		if (basicType == UnifType::FLOAT)
+			glVertexAttribPointer(attrib.location, numComps, GL_FLOAT, GL_FALSE, stride, offset);
+		else
+			glVertexAttribIPointer(attrib.location, numComps,
+				basicType == UnifType::INT ? GL_INT : GL_UNSIGNED_INT, stride, offset);
+		glVertexAttribDivisor(attrib.location, 1);
+		glEnableVertexAttribArray(attrib.location);
+	}
+}
+
+void InstanceBuffer::unbindAttribs(const InstanceAttrib* attribs, unsigned numAttribs)
+{
+	for (unsigned i = 0; i < numAttribs; i++)
+	{
+		if (attribs[i].location < 0) continue;
+		glDisableVertexAttribArray(attribs[i].location);
+		glVertexAttribDivisor(attribs[i].location, 0);
+	}
+}
+
+void InstanceBuffer::setConstant(int location, UnifType type, const void* value)
+{
+	assert(isInstanceAttribType(type));
+	if (location < 0) return;
+	if (RenderCapture::isCapturing())
+	{
+		RenderCapture::Record(CaptureCmd::ATTRIB_CONSTANT) << (int32_t)location << type
+			<< RenderCapture::Data(value, getUnifSize(type));
+	}
+	// the missing components are (0, 0, 0, 1)
+	const unsigned n = getUnifNumElems(type);
+	const UnifType basicType = getUnifBasicType(type);
+	if (basicType == UnifType::FLOAT)
+	{
+		float v[4] = { 0, 0, 0, 1 };
+		for (unsigned i = 0; i < n; i++) v[i] = ((const float*)value)[i];
+		glVertexAttrib4fv(location, v);
+	}
+	else if (basicType == UnifType::INT)
+	{
+		GLint v[4] = { 0, 0, 0, 1 };
+		for (unsigned i = 0; i < n; i++) v[i] = ((const GLint*)value)[i];
+		glVertexAttribI4iv(location, v);
+	}
+	else
+	{
+		GLuint v[4] = { 0, 0, 0, 1 };
+		for (unsigned i = 0; i < n; i++) v[i] = ((const GLuint*)value)[i];
+		glVertexAttribI4uiv(location, v);
+	}
+}
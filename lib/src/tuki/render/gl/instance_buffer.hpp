@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "shader.hpp"
+
+// vertex attribute read once per instance (divisor 1)
+struct InstanceAttrib
+{
+	int location;
+	UnifType type;			// only scalars and vectors, see isInstanceAttribType
+	std::uint16_t offset;	// within the values of an instance
+};
+
+// the types that can be instance attributes
+bool isInstanceAttribType(UnifType type);
+
+/* Vertex buffer with the values of the instances for RenderApi::drawInstanced
+ The values of each instance are contiguous, the layout is described by the InstanceAttribs.
+ The attributes are only enabled during the instanced draws, the rest of the time they have
+ the constant value of setConstant */
+class InstanceBuffer
+{
+public:
+	InstanceBuffer() : vbo(-1), size(0) {}
+
+	// the buffer is created in the first upload, the previous contents are orphaned
+	void upload(const void* data, std::size_t size);
+	void free();
+
+	int getId()const { return vbo; }
+	std::size_t getSize()const { return size; }
+
+	// for the vertex array that is bound
+	void bindAttribs(unsigned stride, const InstanceAttrib* attribs, unsigned numAttribs)const;
+	static void unbindAttribs(const InstanceAttrib* attribs, unsigned numAttribs);
+
+	// the value of the attribute when the array is not enabled, for the draws without instancing
+	static void setConstant(int location, UnifType type, const void* value);
+
+private:
+	int vbo;
+	std::size_t size;
+};
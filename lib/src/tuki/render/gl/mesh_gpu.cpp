@@ -4,6 +4,9 @@
 #include <cassert>
 
 #include "../mesh/mesh.hpp"
+#include "../../util/mallocr/mem_tracker.hpp"
+#include "../../util/profiler.hpp"
+#include "render_capture.hpp"
 
 // upload vertex attrib data and set the pointer
 inline void setVertexAttrib(
@@ -32,6 +35,8 @@ inline void setVertexIndices(Vbo vbo, unsigned numInds, const void* data)
 
 void IMeshGpu::bind()const
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::MESH_BIND) << (uint32_t)vao;
 	glBindVertexArray(vao);
 }
 
@@ -42,6 +47,7 @@ unsigned MeshGpuGeneric::getNumElements()const
 
 void MeshGpuGeneric::load(const IMesh& mesh)
 {
+	TUKI_PROFILE_SCOPE("MeshGpuGeneric::load");
 	glGenVertexArrays(1, (GLuint*)&vao);
 	glBindVertexArray(vao);
 
@@ -49,6 +55,7 @@ void MeshGpuGeneric::load(const IMesh& mesh)
 	const unsigned ni = mesh.getNumIndices();
 
 	attribBitMask = AttribBitMask::NONE;
+	vramSize = 0;
 
 	// vertex attributes
 	for (unsigned i = 0; i < (unsigned)AttribLocation::NUM_ATTRIBS; i++)
@@ -61,6 +68,7 @@ void MeshGpuGeneric::load(const IMesh& mesh)
 			const void* data = mesh.getAttribData(curAttrib);
 			glGenBuffers(1, (GLuint*)&vboSet.attribs[i]);
 			setVertexAttrib(i, vboSet.attribs[i], nv, numComp, data);
+			vramSize += nv * numComp * sizeof(float);
 		}
 		else
 		{
@@ -75,6 +83,7 @@ void MeshGpuGeneric::load(const IMesh& mesh)
 	{
 		glGenBuffers(1, (GLuint*)&vboSet.indices);
 		setVertexIndices(vboSet.indices, ni, (void*)mesh.getIndices());
+		vramSize += ni * sizeof(unsigned);
 		numElements = mesh.getNumIndices();
 	}
 	else
@@ -84,12 +93,61 @@ void MeshGpuGeneric::load(const IMesh& mesh)
 		vboSet.indices = 0;
 		numElements = mesh.getNumVertices();
 	}
+	MemTracker::trackVramAlloc(VramType::BUFFER, vramSize);
+
+	if (RenderCapture::isCapturing())
+	{
+		const unsigned numIndices = mesh.hasIndices() ? ni : 0;
+		RenderCapture::Record rec(CaptureCmd::MESH_LOAD);
+		rec << (uint32_t)vao << (uint32_t)nv << (uint32_t)numIndices << (uint32_t)attribBitMask;
+		for (unsigned i = 0; i < (unsigned)AttribLocation::NUM_ATTRIBS; i++)
+		{
+			if (mesh.hasAttribData((AttribLocation)i))
+				rec << RenderCapture::Data(mesh.getAttribData((AttribLocation)i), nv * ATTRIB_NUM_COMPONENTS[i] * sizeof(float));
+		}
+		if (numIndices) rec << RenderCapture::Data(mesh.getIndices(), numIndices * sizeof(unsigned));
+	}
 }
 
 void MeshGpuGeneric::free()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::MESH_FREE) << (uint32_t)vao;
 	freeVao(vao);
 	freeVboSet(vboSet);
+	MemTracker::trackVramFree(VramType::BUFFER, vramSize);
+	vramSize = 0;
+}
+
+void MeshGpuLod::load(const IMesh& mesh)
+{
+	MeshGpuGeneric::load(mesh);
+	levels.clear();
+	lod = 0;
+}
+
+void MeshGpuLod::load(const IMesh& mesh, const MeshLodChain& chain)
+{
+	assert(!chain.levels.empty());
+	MeshGpuGeneric::load(IndexedMeshView(mesh, chain.indices.data(), (unsigned)chain.indices.size()));
+	levels = chain.levels;
+	lod = 0;
+}
+
+unsigned MeshGpuLod::getNumElements()const
+{
+	return levels.empty() ? numElements : levels[lod].numIndices;
+}
+
+unsigned MeshGpuLod::getFirstElement()const
+{
+	return levels.empty() ? 0 : levels[lod].firstIndex;
+}
+
+void MeshGpuLod::setLod(unsigned lod)
+{
+	assert(lod < levels.size());
+	this->lod = lod;
 }
 
 void UvPlaneMeshGpu::load()
@@ -113,12 +171,18 @@ void UvPlaneMeshGpu::load()
 	glBufferData(GL_ARRAY_BUFFER, sizeof(uvCoords), (void*)uvCoords, GL_STATIC_DRAW);
 	glVertexAttribPointer(loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableVertexAttribArray(loc);
+	MemTracker::trackVramAlloc(VramType::BUFFER, sizeof(uvCoords));
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::MESH_LOAD_UV_PLANE) << (uint32_t)vao;
 }
 
 void UvPlaneMeshGpu::free()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::MESH_FREE) << (uint32_t)vao;
 	freeVao(vao);
 	freeVbo(vbo);
+	MemTracker::trackVramFree(VramType::BUFFER, 2 * 4 * sizeof(float));
 }
 
 void freeVao(Vao vao)
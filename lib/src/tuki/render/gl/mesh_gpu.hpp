@@ -3,6 +3,7 @@
 #include "attribs.hpp"
 #include "attrib_initializers.hpp"
 #include "../mesh/mesh.hpp"
+#include "../mesh/mesh_lod.hpp"
 
 typedef int Vao;
 typedef int Vbo;
@@ -26,6 +27,8 @@ public:
 	virtual AttribInitilizer getAttribInitializer()const { return AttribInitilizers::generic; }
 
 	virtual unsigned getNumElements()const = 0;
+	// first index (or vertex if there are no indices) to draw
+	virtual unsigned getFirstElement()const { return 0; }
 
 	void bind()const;
 
@@ -57,6 +60,30 @@ protected:
 	VboSetFull vboSet;
 	AttribBitMask attribBitMask;
 	unsigned numElements;
+	size_t vramSize;	// bytes of the buffers
+};
+
+// all the lods share the same vertex and index buffers,
+// a lod is just a range of the index buffer
+class MeshGpuLod : public MeshGpuGeneric
+{
+public:
+	MeshGpuLod() : lod(0) {}
+
+	// a single lod with all the indices
+	void load(const IMesh& mesh);
+	void load(const IMesh& mesh, const MeshLodChain& chain);
+
+	unsigned getNumElements()const;
+	unsigned getFirstElement()const;
+
+	void setLod(unsigned lod);
+	unsigned getLod()const { return lod; }
+	unsigned getNumLods()const { return (unsigned)levels.size(); }
+
+protected:
+	std::vector<MeshLodLevel> levels;
+	unsigned lod;
 };
 
 class UvPlaneMeshGpu : public IMeshGpu
@@ -0,0 +1,64 @@
+#include "null_gl.hpp"
+
+#include "gl_functions.hpp"
+
+namespace
+{
+
+GLuint nextId = 1;
+
+template <typename R, typename... Args>
+R APIENTRY nullFunc(Args...) { return R(); }
+
+template <typename R, typename... Args>
+void setNull(R (APIENTRYP& func)(Args...))
+{
+	func = &nullFunc<R, Args...>;
+}
+
+void APIENTRY nullGen(GLsizei n, GLuint* ids)
+{
+	for (GLsizei i = 0; i < n; i++) ids[i] = nextId++;
+}
+GLuint APIENTRY nullCreateShader(GLenum) { return nextId++; }
+GLuint APIENTRY nullCreateProgram() { return nextId++; }
+void APIENTRY nullGetiv(GLuint, GLenum pname, GLint* params)
+{
+	*params = pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS ? GL_TRUE : 0;
+}
+GLenum APIENTRY nullCheckFramebufferStatus(GLenum) { return GL_FRAMEBUFFER_COMPLETE; }
+const GLubyte* APIENTRY nullGetString(GLenum) { return (const GLubyte*)"null"; }
+void APIENTRY nullGetQueryObjectiv(GLuint, GLenum, GLint* params) { *params = 1; }
+void APIENTRY nullGetQueryObjectui64v(GLuint, GLenum, GLuint64* params) { *params = 0; }
+void APIENTRY nullGetInteger64v(GLenum, GLint64* data) { *data = 0; }
+
+}
+
+namespace NullGl
+{
+
+void install()
+{
+	// first all of them do nothing and return 0
+#define TUKI_NULL_GL(f) setNull(f);
+	TUKI_GL_FUNCTIONS(TUKI_NULL_GL)
+#undef TUKI_NULL_GL
+
+	// functions that return something
+	glGenBuffers = nullGen;
+	glGenFramebuffers = nullGen;
+	glGenQueries = nullGen;
+	glGenTextures = nullGen;
+	glGenVertexArrays = nullGen;
+	glCreateShader = nullCreateShader;
+	glCreateProgram = nullCreateProgram;
+	glGetShaderiv = nullGetiv;
+	glGetProgramiv = nullGetiv;
+	glCheckFramebufferStatus = nullCheckFramebufferStatus;
+	glGetString = nullGetString;
+	glGetQueryObjectiv = nullGetQueryObjectiv;
+	glGetQueryObjectui64v = nullGetQueryObjectui64v;
+	glGetInteger64v = nullGetInteger64v;
+}
+
+}
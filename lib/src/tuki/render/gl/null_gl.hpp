@@ -0,0 +1,12 @@
+#pragma once
+
+// Replaces the GL functions used by the library with functions that don't do anything,
+// so the code that issues GL calls can be benchmarked or replayed without a context.
+// The generated ids are unique, the shaders always compile and link and the uniform
+// locations are 0. It must not be used together with a real context.
+namespace NullGl
+{
+
+void install();
+
+}
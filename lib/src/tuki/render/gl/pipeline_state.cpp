@@ -0,0 +1,217 @@
+#include "pipeline_state.hpp"
+
+#include <glad/glad.h>
+#include <rapidjson/document.h>
+#include <atomic>
+#include <mutex>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "render_capture.hpp"
+#include "../../util/flat_hash_map.hpp"
+
+using namespace std;
+using namespace rapidjson;
+
+const GLenum TO_GL_BLEND_SRC[(int)BlendMode::COUNT] =
+{
+	GL_ONE,			// NONE (not used)
+	GL_SRC_ALPHA,	// ALPHA
+	GL_ONE,			// PREMULTIPLIED
+	GL_SRC_ALPHA,	// ADDITIVE
+};
+
+const GLenum TO_GL_BLEND_DST[(int)BlendMode::COUNT] =
+{
+	GL_ZERO,
+	GL_ONE_MINUS_SRC_ALPHA,
+	GL_ONE_MINUS_SRC_ALPHA,
+	GL_ONE,
+};
+
+const GLenum TO_GL_POLYGON_MODE[3] =
+{
+	GL_POINT,
+	GL_LINE,
+	GL_FILL,
+};
+
+static const char* const BLEND_MODE_NAMES[(int)BlendMode::COUNT] =
+{
+	"none", "alpha", "premultiplied", "additive"
+};
+
+static const char* const CULL_MODE_NAMES[(int)CullMode::COUNT] =
+{
+	"none", "back", "front"
+};
+
+static const char* const POLYGON_MODE_NAMES[3] =
+{
+	"point", "line", "fill"
+};
+
+// registered states, they never move so they are read without locking
+static PipelineState registeredStates[PipelineState::MAX_STATES];
+static atomic<unsigned> numRegisteredStates(1);	// 0 is PIPELINE_STATE_INHERIT
+static mutex registerMutex;
+static FlatHashMap<uint32_t, PipelineStateId> packedToId;
+
+// the state of the GL context
+static PipelineState applied;
+static bool appliedValid = false;
+
+PipelineState::PipelineState()
+	: blend(BlendMode::NONE)
+	, cull(CullMode::BACK)
+	, polygonMode(PolygonDrawMode::FILL)
+	, depthTest(true)
+	, depthWrite(true)
+{}
+
+uint32_t PipelineState::pack()const
+{
+	return
+		(uint32_t)blend |
+		(uint32_t)cull << 3 |
+		(uint32_t)polygonMode << 5 |
+		(uint32_t)depthTest << 7 |
+		(uint32_t)depthWrite << 8;
+}
+
+PipelineState PipelineState::unpack(uint32_t bits)
+{
+	PipelineState state;
+	state.blend = (BlendMode)(bits & 7);
+	state.cull = (CullMode)(bits >> 3 & 3);
+	state.polygonMode = (PolygonDrawMode)(bits >> 5 & 3);
+	state.depthTest = (bits >> 7 & 1) != 0;
+	state.depthWrite = (bits >> 8 & 1) != 0;
+	if (state.blend >= BlendMode::COUNT || state.cull >= CullMode::COUNT || (unsigned)state.polygonMode > 2)
+	{
+		throw runtime_error("invalid packed pipeline state");
+	}
+	return state;
+}
+
+// index of the name in the table
+template <unsigned N>
+static unsigned parseEnum(const Value& val, const char* member, const char* const (&names)[N])
+{
+	if (!val.IsString()) throw runtime_error(string("pipeline/") + member + " must be a string");
+	for (unsigned i = 0; i < N; i++)
+	{
+		if (strcmp(val.GetString(), names[i]) == 0) return i;
+	}
+	throw runtime_error(string("pipeline/") + member + ": unknown value " + val.GetString());
+}
+
+static bool parseBool(const Value& val, const char* member)
+{
+	if (!val.IsBool()) throw runtime_error(string("pipeline/") + member + " must be bool");
+	return val.GetBool();
+}
+
+PipelineState PipelineState::parse(const Value& val)
+{
+	if (!val.IsObject()) throw runtime_error("'pipeline' must be an object");
+	PipelineState state;
+	for (Value::ConstMemberIterator it = val.MemberBegin(); it != val.MemberEnd(); ++it)
+	{
+		const char* name = it->name.GetString();
+		if (strcmp(name, "blend") == 0)
+			state.blend = (BlendMode)parseEnum(it->value, name, BLEND_MODE_NAMES);
+		else if (strcmp(name, "cull") == 0)
+			state.cull = (CullMode)parseEnum(it->value, name, CULL_MODE_NAMES);
+		else if (strcmp(name, "polygon") == 0)
+			state.polygonMode = (PolygonDrawMode)parseEnum(it->value, name, POLYGON_MODE_NAMES);
+		else if (strcmp(name, "depthTest") == 0)
+			state.depthTest = parseBool(it->value, name);
+		else if (strcmp(name, "depthWrite") == 0)
+			state.depthWrite = parseBool(it->value, name);
+		else
+			throw runtime_error(string("pipeline: unknown member ") + name);
+	}
+	return state;
+}
+
+PipelineStateId PipelineState::registerState(const PipelineState& state)
+{
+	const uint32_t packed = state.pack();
+	lock_guard<mutex> lock(registerMutex);
+	const auto it = packedToId.find(packed);
+	if (it != packedToId.end()) return it->second;
+
+	const unsigned id = numRegisteredStates.load(memory_order_relaxed);
+	if (id >= MAX_STATES) throw runtime_error("too many pipeline states");
+	registeredStates[id] = state;
+	packedToId[packed] = (PipelineStateId)id;
+	numRegisteredStates.store(id + 1, memory_order_release);
+	return (PipelineStateId)id;
+}
+
+const PipelineState& PipelineState::getState(PipelineStateId id)
+{
+	assert(id < numRegisteredStates.load(memory_order_acquire));
+	return registeredStates[id];
+}
+
+void PipelineState::apply(PipelineStateId id)
+{
+	if (id == PIPELINE_STATE_INHERIT) return;
+	apply(getState(id));
+}
+
+void PipelineState::apply(const PipelineState& state)
+{
+	const bool all = !appliedValid;
+	if (!all && state == applied) return;
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PIPELINE_STATE) << state.pack();
+
+	if (all || state.blend != applied.blend)
+	{
+		if (state.blend == BlendMode::NONE)
+		{
+			glDisable(GL_BLEND);
+		}
+		else
+		{
+			if (all || applied.blend == BlendMode::NONE) glEnable(GL_BLEND);
+			glBlendFunc(TO_GL_BLEND_SRC[(int)state.blend], TO_GL_BLEND_DST[(int)state.blend]);
+		}
+	}
+	if (all || state.cull != applied.cull)
+	{
+		if (state.cull == CullMode::NONE)
+		{
+			glDisable(GL_CULL_FACE);
+		}
+		else
+		{
+			if (all || applied.cull == CullMode::NONE) glEnable(GL_CULL_FACE);
+			glCullFace(state.cull == CullMode::BACK ? GL_BACK : GL_FRONT);
+		}
+	}
+	if (all || state.polygonMode != applied.polygonMode)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, TO_GL_POLYGON_MODE[(int)state.polygonMode]);
+	}
+	if (all || state.depthTest != applied.depthTest)
+	{
+		if (state.depthTest) glEnable(GL_DEPTH_TEST);
+		else				 glDisable(GL_DEPTH_TEST);
+	}
+	if (all || state.depthWrite != applied.depthWrite)
+	{
+		glDepthMask(state.depthWrite ? GL_TRUE : GL_FALSE);
+	}
+	applied = state;
+	appliedValid = true;
+}
+
+void PipelineState::invalidateApplied()
+{
+	appliedValid = false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <rapidjson/fwd.h>
+#include "render.hpp"
+
+enum class BlendMode : std::uint8_t
+{
+	NONE = 0,		// no blending
+	ALPHA,			// src * a + dst * (1 - a)
+	PREMULTIPLIED,	// src + dst * (1 - a)
+	ADDITIVE,		// src * a + dst
+
+	COUNT
+};
+
+enum class CullMode : std::uint8_t
+{
+	NONE = 0,
+	BACK,
+	FRONT,
+
+	COUNT
+};
+
+// small id of a registered PipelineState
+typedef std::uint8_t PipelineStateId;
+// the templates without "pipeline": the GL state is left as the application set it
+const PipelineStateId PIPELINE_STATE_INHERIT = 0;
+
+/* Fixed function state of a material template, it doesn't change after the template is created
+ The distinct states are registered and get a small id that goes in the sort keys of the
+ RenderQueue, so the draws with the same state are together.
+ apply only issues the GL calls of the state that differs from the last applied one. The
+ RenderApi functions that change the same state invalidate it */
+struct PipelineState
+{
+	BlendMode blend;
+	CullMode cull;
+	PolygonDrawMode polygonMode;
+	bool depthTest;
+	bool depthWrite;
+
+	// no blending, back face culling, fill, depth test and write
+	PipelineState();
+
+	bool operator==(const PipelineState& o)const { return pack() == o.pack(); }
+	bool operator!=(const PipelineState& o)const { return pack() != o.pack(); }
+	bool isTranslucent()const { return blend != BlendMode::NONE; }
+
+	// 9 bits, it's what is stored in the material packs and the captures
+	std::uint32_t pack()const;
+	static PipelineState unpack(std::uint32_t bits);
+
+	// { "blend": "alpha", "cull": "none", "polygon": "line", "depthTest": true, "depthWrite": false }
+	// the missing members have the default value. Throws runtime_error
+	static PipelineState parse(const rapidjson::Value& val);
+
+	static const unsigned MAX_STATES = 256;
+
+	// returns the id of the state, it's registered if it's new. Can be called from any thread
+	static PipelineStateId registerState(const PipelineState& state);
+	// PIPELINE_STATE_INHERIT gives the default state, it's treated as opaque
+	static const PipelineState& getState(PipelineStateId id);
+
+	// PIPELINE_STATE_INHERIT does nothing
+	static void apply(PipelineStateId id);
+	static void apply(const PipelineState& state);
+	// the next apply will set everything, for when the GL state is changed by other means
+	static void invalidateApplied();
+};
@@ -4,7 +4,11 @@
 
 #include "../mesh/mesh.hpp"
 #include "mesh_gpu.hpp"
+#include "../../util/profiler.hpp"
+#include "render_capture.hpp"
+#include "pipeline_state.hpp"
 #include <iostream>
+#include <vector>
 #include <SDL.h>
 
 using namespace std;
@@ -66,8 +70,15 @@ void init()
 
 void draw(const IMeshGpu& mesh)
 {
+	TUKI_PROFILE_SCOPE("RenderApi::draw");
 	const unsigned numElements = mesh.getNumElements();
+	const unsigned firstElement = mesh.getFirstElement();
 	GeomType geomType = mesh.getGeomType();
+	if (RenderCapture::isCapturing())
+	{
+		RenderCapture::Record(CaptureCmd::DRAW) << (uint8_t)geomType << (uint8_t)mesh.hasIndices()
+			<< (uint32_t)firstElement << (uint32_t)numElements;
+	}
 	if (mesh.hasIndices())
 	{
 		glDrawElements
@@ -75,7 +86,7 @@ void draw(const IMeshGpu& mesh)
 			TO_GL_GEOM_TYPE[(int)geomType],
 			numElements,
 			GL_UNSIGNED_INT,
-			0
+			(void*)(size_t)(firstElement * sizeof(unsigned))
 		);
 	}
 	else
@@ -83,41 +94,138 @@ void draw(const IMeshGpu& mesh)
 		glDrawArrays
 		(
 			TO_GL_GEOM_TYPE[(int)geomType],
-			0,
+			firstElement,
 			numElements
 		);
 	}
 }
 
+void drawMulti(const IMeshGpu& mesh,
+	const unsigned* firstElements, const unsigned* numElements, unsigned numRanges)
+{
+	TUKI_PROFILE_SCOPE("RenderApi::drawMulti");
+	if (numRanges == 0) return;
+	GeomType geomType = mesh.getGeomType();
+	if (RenderCapture::isCapturing())
+	{
+		RenderCapture::Record(CaptureCmd::DRAW_MULTI) << (uint8_t)geomType << (uint8_t)mesh.hasIndices()
+			<< (uint32_t)numRanges
+			<< RenderCapture::Data(firstElements, numRanges * sizeof(unsigned))
+			<< RenderCapture::Data(numElements, numRanges * sizeof(unsigned));
+	}
+	if (mesh.hasIndices())
+	{
+		static vector<const void*> offsets;
+		offsets.resize(numRanges);
+		for (unsigned i = 0; i < numRanges; i++)
+		{
+			offsets[i] = (const void*)(size_t)(firstElements[i] * sizeof(unsigned));
+		}
+		glMultiDrawElements
+		(
+			TO_GL_GEOM_TYPE[(int)geomType],
+			(const GLsizei*)numElements,
+			GL_UNSIGNED_INT,
+			&offsets[0],
+			numRanges
+		);
+	}
+	else
+	{
+		glMultiDrawArrays
+		(
+			TO_GL_GEOM_TYPE[(int)geomType],
+			(const GLint*)firstElements,
+			(const GLsizei*)numElements,
+			numRanges
+		);
+	}
+}
+
+void drawInstanced(const IMeshGpu& mesh, unsigned numInstances,
+	const InstanceBuffer& buffer, unsigned stride, const InstanceAttrib* attribs, unsigned numAttribs)
+{
+	TUKI_PROFILE_SCOPE("RenderApi::drawInstanced");
+	if (numInstances == 0) return;
+	const unsigned numElements = mesh.getNumElements();
+	const unsigned firstElement = mesh.getFirstElement();
+	GeomType geomType = mesh.getGeomType();
+	if (RenderCapture::isCapturing())
+	{
+		RenderCapture::Record rec(CaptureCmd::DRAW_INSTANCED);
+		rec << (uint8_t)geomType << (uint8_t)mesh.hasIndices()
+			<< (uint32_t)firstElement << (uint32_t)numElements << (uint32_t)numInstances
+			<< (uint32_t)buffer.getId() << (uint32_t)stride << (uint32_t)numAttribs;
+		for (unsigned i = 0; i < numAttribs; i++)
+			rec << (int32_t)attribs[i].location << attribs[i].type << attribs[i].offset;
+	}
+	buffer.bindAttribs(stride, attribs, numAttribs);
+	if (mesh.hasIndices())
+	{
+		glDrawElementsInstanced
+		(
+			TO_GL_GEOM_TYPE[(int)geomType],
+			numElements,
+			GL_UNSIGNED_INT,
+			(void*)(size_t)(firstElement * sizeof(unsigned)),
+			numInstances
+		);
+	}
+	else
+	{
+		glDrawArraysInstanced
+		(
+			TO_GL_GEOM_TYPE[(int)geomType],
+			firstElement,
+			numElements,
+			numInstances
+		);
+	}
+	InstanceBuffer::unbindAttribs(attribs, numAttribs);
+}
+
 void setClearColor(float r, float g, float b)
 {
-	glClearColor(r, g, b, 0.f);
+	setClearColor(r, g, b, 0.f);
 }
 
 void setClearColor(float r, float g, float b, float a)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::CLEAR_COLOR) << r << g << b << a;
 	glClearColor(r, g, b, a);
 }
 
 void setClearDepth(float depth)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::CLEAR_DEPTH) << depth;
 	glClearDepth(depth);
 }
 
 void enableDepthTest(bool yes)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::DEPTH_TEST) << (uint8_t)yes;
+	PipelineState::invalidateApplied();
 	if (yes) glEnable(GL_DEPTH_TEST);
 	else	 glDisable(GL_DEPTH_TEST);
 }
 
 void enableFaceCulling(bool yes)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::FACE_CULLING) << (uint8_t)yes;
+	PipelineState::invalidateApplied();
 	if (yes) glEnable(GL_CULL_FACE);
 	else	 glDisable(GL_CULL_FACE);
 }
 
 void setPolygonDrawMode(PolygonDrawMode mode)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::POLYGON_MODE) << (uint8_t)mode;
+	PipelineState::invalidateApplied();
 	switch (mode)
 	{
 	case PolygonDrawMode::POINT:
@@ -137,6 +245,7 @@ void setPolygonDrawMode(PolygonDrawMode mode)
 
 void swap(SDL_Window* window)
 {
+	RenderCapture::endFrame();
 	SDL_GL_SwapWindow(window);
 }
 
@@ -5,6 +5,7 @@
 #include "render_target.hpp"
 #include "texture.hpp"
 #include "shader.hpp"
+#include "instance_buffer.hpp"
 
 enum class PolygonDrawMode
 {
@@ -23,6 +24,13 @@ namespace RenderApi
 		unsigned width, unsigned height);
 
 	void draw(const IMeshGpu& mesh);
+	// draw several element ranges of the mesh in one call
+	void drawMulti(const IMeshGpu& mesh,
+		const unsigned* firstElements, const unsigned* numElements, unsigned numRanges);
+	// draw numInstances of the mesh in one call, the attribs of each instance are read from the
+	// buffer (stride bytes per instance). They're enabled only during the draw
+	void drawInstanced(const IMeshGpu& mesh, unsigned numInstances,
+		const InstanceBuffer& buffer, unsigned stride, const InstanceAttrib* attribs, unsigned numAttribs);
 
 	void setClearColor(float r, float g, float b);
 	void setClearColor(float r, float g, float b, float a);
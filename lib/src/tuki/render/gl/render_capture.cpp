@@ -0,0 +1,140 @@
+#include "render_capture.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+
+const size_t FLUSH_SIZE = 16 * 1024 * 1024;
+
+FILE* file = nullptr;
+vector<char> buffer;	// records waiting to be written
+uint64_t frameNumber = 0;
+
+void flush()
+{
+	if (!buffer.empty()) fwrite(&buffer[0], 1, buffer.size(), file);
+	buffer.clear();
+}
+
+const char* const CMD_NAMES[(int)CaptureCmd::COUNT] =
+{
+	"FRAME_END",
+	"SHADER_CREATE",
+	"SHADER_SOURCE",
+	"SHADER_COMPILE",
+	"SHADER_DESTROY",
+	"PROGRAM_CREATE",
+	"PROGRAM_ATTACH",
+	"PROGRAM_BIND_ATTRIB",
+	"PROGRAM_LINK",
+	"PROGRAM_USE",
+	"PROGRAM_FREE",
+	"UNIFORM_LOCATION",
+	"UNIFORM",
+	"TEXTURE_CREATE",
+	"TEXTURE_CREATE_FROM_IMAGE",
+	"TEXTURE_BIND",
+	"TEXTURE_WRAP",
+	"TEXTURE_FILTER",
+	"TEXTURE_MIPMAPS",
+	"TEXTURE_RESIZE",
+	"TEXTURE_FREE",
+	"MESH_LOAD",
+	"MESH_LOAD_UV_PLANE",
+	"MESH_BIND",
+	"MESH_FREE",
+	"DRAW",
+	"DRAW_MULTI",
+	"CLEAR_COLOR",
+	"CLEAR_DEPTH",
+	"DEPTH_TEST",
+	"FACE_CULLING",
+	"POLYGON_MODE",
+	"MATERIAL_USE",
+	"PIPELINE_STATE",
+	"INSTANCE_BUFFER_UPLOAD",
+	"INSTANCE_BUFFER_FREE",
+	"ATTRIB_CONSTANT",
+	"DRAW_INSTANCED",
+};
+
+}
+
+namespace RenderCapture
+{
+
+bool active = false;
+
+void begin(const string& fileName)
+{
+	end();
+	file = fopen(fileName.c_str(), "wb");
+	if (!file) throw runtime_error("could not open " + fileName);
+	buffer.clear();
+	buffer.insert(buffer.end(), { 'T', 'K', 'R', 'C' });
+	const uint32_t version = FILE_VERSION;
+	const char* p = (const char*)&version;
+	buffer.insert(buffer.end(), p, p + sizeof(version));
+	flush();
+	frameNumber = 0;
+	active = true;
+}
+
+void end()
+{
+	if (!file) return;
+	flush();
+	fclose(file);
+	file = nullptr;
+	active = false;
+}
+
+void endFrame()
+{
+	if (!active) return;
+	Record(CaptureCmd::FRAME_END) << frameNumber;
+	frameNumber++;
+	if (buffer.size() >= FLUSH_SIZE) flush();
+}
+
+const char* getCmdName(CaptureCmd cmd)
+{
+	assert(cmd < CaptureCmd::COUNT);
+	return CMD_NAMES[(int)cmd];
+}
+
+Record::Record(CaptureCmd cmd)
+{
+	begin = buffer.size();
+	buffer.push_back((char)cmd);
+	buffer.resize(buffer.size() + sizeof(uint32_t));
+}
+
+Record::~Record()
+{
+	const uint32_t size = (uint32_t)(buffer.size() - begin - 1 - sizeof(uint32_t));
+	memcpy(&buffer[begin + 1], &size, sizeof(size));
+}
+
+Record& Record::write(const void* data, size_t size)
+{
+	const char* p = (const char*)data;
+	buffer.insert(buffer.end(), p, p + size);
+	return *this;
+}
+
+Record& Record::operator<<(Str str)
+{
+	const uint32_t len = (uint32_t)strlen(str.s);
+	*this << len;
+	return write(str.s, len);
+}
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+Capture of the render calls for replaying them without the application (tools/render_replay).
+While capturing, the calls to RenderApi, ShaderObject, ShaderProgram, Texture and the meshes
+in GPU are written to a binary file, with the data they upload (shader sources, pixels,
+vertices). MaterialManager::useMaterial is written as a marker; the program and uniforms it
+uses are written by ShaderProgram.
+The objects are identified by their GL ids at capture time, so the capture must begin before
+creating the resources that are used in it.
+File: "TKRC", uint32 version, records: uint8 CaptureCmd, uint32 payload size, payload.
+All the functions must be called from the thread of the GL context.
+*/
+
+enum class CaptureCmd : std::uint8_t
+{
+	FRAME_END,			// uint64 frame
+
+	// ShaderObject
+	SHADER_CREATE,		// uint32 id, uint8 ShaderType
+	SHADER_SOURCE,		// uint32 id, string src
+	SHADER_COMPILE,		// uint32 id
+	SHADER_DESTROY,		// uint32 id
+
+	// ShaderProgram
+	PROGRAM_CREATE,		// uint32 id
+	PROGRAM_ATTACH,		// uint32 id, uint32 shader
+	PROGRAM_BIND_ATTRIB,// uint32 id, int32 loc, string name
+	PROGRAM_LINK,		// uint32 id
+	PROGRAM_USE,		// uint32 id
+	PROGRAM_FREE,		// uint32 id
+	UNIFORM_LOCATION,	// uint32 id, int32 loc, string name
+	UNIFORM,			// uint16 UnifType, int32 loc, data (size of the type)
+
+	// Texture
+	TEXTURE_CREATE,		// uint32 id, uint32 width, uint32 height, uint8 TexelFormat
+	TEXTURE_CREATE_FROM_IMAGE,	// uint32 id, uint32 width, uint32 height, uint8 PixelFormat, uint8 TexelFormat, pixels
+	TEXTURE_BIND,		// uint32 id, uint32 unit
+	TEXTURE_WRAP,		// uint32 id, uint8 axes (1: U, 2: V), uint8 modeU, uint8 modeV
+	TEXTURE_FILTER,		// uint32 id, uint8 TextureFilterMode
+	TEXTURE_MIPMAPS,	// uint32 id
+	TEXTURE_RESIZE,		// uint32 id, uint32 width, uint32 height
+	TEXTURE_FREE,		// uint32 id
+
+	// meshes in GPU
+	MESH_LOAD,			// uint32 vao, uint32 numVertices, uint32 numIndices, uint32 AttribBitMask, attribs..., indices
+	MESH_LOAD_UV_PLANE,	// uint32 vao
+	MESH_BIND,			// uint32 vao
+	MESH_FREE,			// uint32 vao
+
+	// RenderApi
+	DRAW,				// uint8 GeomType, uint8 hasIndices, uint32 first, uint32 count
+	DRAW_MULTI,			// uint8 GeomType, uint8 hasIndices, uint32 numRanges, firsts, counts
+	CLEAR_COLOR,		// float r, g, b, a
+	CLEAR_DEPTH,		// float depth
+	DEPTH_TEST,			// uint8 enable
+	FACE_CULLING,		// uint8 enable
+	POLYGON_MODE,		// uint8 PolygonDrawMode
+
+	// MaterialManager
+	MATERIAL_USE,		// uint32 material id, uint8 batched
+
+	// PipelineState
+	PIPELINE_STATE,		// uint32 packed PipelineState, only when something changes
+
+	// InstanceBuffer
+	INSTANCE_BUFFER_UPLOAD,	// uint32 id, data (the rest of the record)
+	INSTANCE_BUFFER_FREE,	// uint32 id
+	ATTRIB_CONSTANT,	// int32 loc, uint16 UnifType, data (size of the type)
+	DRAW_INSTANCED,		// uint8 GeomType, uint8 hasIndices, uint32 first, uint32 count, uint32 numInstances,
+						// uint32 buffer, uint32 stride, uint32 numAttribs, attribs (int32 loc, uint16 UnifType, uint16 offset)
+
+	COUNT
+};
+
+namespace RenderCapture
+{
+
+static const std::uint32_t FILE_VERSION = 1;
+
+// true while capturing, outside of a ScopedPause. Don't modify it
+extern bool active;
+
+inline bool isCapturing() { return active; }
+
+void begin(const std::string& fileName);
+void end();
+
+// RenderApi::swap calls it, call it if the application swaps by itself
+void endFrame();
+
+const char* getCmdName(CaptureCmd cmd);
+
+// strings are written as uint32 length and the characters
+struct Str
+{
+	explicit Str(const char* s) : s(s) {}
+	const char* s;
+};
+
+// raw bytes, with no size
+struct Data
+{
+	Data(const void* data, std::size_t size) : data(data), size(size) {}
+	const void* data;
+	std::size_t size;
+};
+
+// a record is written when it's destroyed
+class Record
+{
+public:
+	Record(CaptureCmd cmd);
+	~Record();
+	Record(const Record&) = delete;
+	Record& operator=(const Record&) = delete;
+
+	template <typename T>
+	Record& operator<<(const T& val) { return write(&val, sizeof(T)); }
+	Record& operator<<(Str str);
+	Record& operator<<(Data data) { return write(data.data, data.size); }
+
+private:
+	std::size_t begin;
+
+	Record& write(const void* data, std::size_t size);
+};
+
+// the calls made inside a call that is captured must not be captured again
+class ScopedPause
+{
+public:
+	ScopedPause() : prev(active) { active = false; }
+	~ScopedPause() { active = prev; }
+	ScopedPause(const ScopedPause&) = delete;
+	ScopedPause& operator=(const ScopedPause&) = delete;
+private:
+	bool prev;
+};
+
+}
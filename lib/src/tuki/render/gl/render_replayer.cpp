@@ -0,0 +1,526 @@
+#include "render_replayer.hpp"
+
+#include "render.hpp"
+#include "pipeline_state.hpp"
+#include "../mesh/mesh.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+
+// reads the payload of a record in order
+class RecordReader
+{
+public:
+	RecordReader(const CaptureRecord& rec) : p(rec.data), end(rec.data + rec.size) {}
+
+	template <typename T>
+	T get()
+	{
+		T val;
+		read(&val, sizeof(T));
+		return val;
+	}
+	string getString()
+	{
+		const uint32_t len = get<uint32_t>();
+		string str(len, ' ');
+		read(&str[0], len);
+		return str;
+	}
+	void read(void* out, size_t size)
+	{
+		if (p + size > end) throw runtime_error("corrupted capture record");
+		memcpy(out, p, size);
+		p += size;
+	}
+	template <typename T>
+	vector<T> getArray(size_t count)
+	{
+		vector<T> v(count);
+		if (count) read(&v[0], count * sizeof(T));
+		return v;
+	}
+	const char* getRest(size_t& size)
+	{
+		size = end - p;
+		const char* rest = p;
+		p = end;
+		return rest;
+	}
+
+private:
+	const char* p;
+	const char* end;
+};
+
+class CapturedMesh : public IMesh
+{
+public:
+	vector<float> attribs[(int)AttribLocation::NUM_ATTRIBS];
+	vector<unsigned> indices;
+	unsigned numVertices;
+
+	GeomType getGeomType()const { return GeomType::TRIANGLES; }
+	const unsigned* getIndices()const { return indices.empty() ? nullptr : &indices[0]; }
+	const float* getAttribData(AttribLocation i)const
+	{
+		return attribs[(int)i].empty() ? nullptr : &attribs[(int)i][0];
+	}
+	unsigned getNumVertices()const { return numVertices; }
+	unsigned getNumIndices()const { return (unsigned)indices.size(); }
+};
+
+// the draw calls only use the description of the ranges, the mesh is already bound
+class DrawDesc : public IMeshGpu
+{
+public:
+	bool indices;
+	GeomType geomType;
+	unsigned first, count;
+
+	bool hasIndices()const { return indices; }
+	GeomType getGeomType()const { return geomType; }
+	AttribBitMask getAttribBitMask()const { return AttribBitMask::NONE; }
+	unsigned getNumElements()const { return count; }
+	unsigned getFirstElement()const { return first; }
+	void free() {}
+};
+
+// the records that create, set up and free the objects, by the kind of object
+enum ResourceKind : unsigned
+{
+	NOT_RESOURCE,
+	SHADER,
+	PROGRAM,
+	TEXTURE,
+	MESH,
+};
+
+enum ResourceOp
+{
+	CREATE,
+	SETUP,
+	FREE,
+};
+
+ResourceKind getResourceKind(CaptureCmd cmd, ResourceOp& op)
+{
+	switch (cmd)
+	{
+	case CaptureCmd::SHADER_CREATE:				op = CREATE; return SHADER;
+	case CaptureCmd::SHADER_SOURCE:
+	case CaptureCmd::SHADER_COMPILE:			op = SETUP; return SHADER;
+	case CaptureCmd::SHADER_DESTROY:			op = FREE; return SHADER;
+	case CaptureCmd::PROGRAM_CREATE:			op = CREATE; return PROGRAM;
+	case CaptureCmd::PROGRAM_ATTACH:
+	case CaptureCmd::PROGRAM_BIND_ATTRIB:
+	case CaptureCmd::PROGRAM_LINK:
+	case CaptureCmd::UNIFORM_LOCATION:			op = SETUP; return PROGRAM;
+	case CaptureCmd::PROGRAM_FREE:				op = FREE; return PROGRAM;
+	case CaptureCmd::TEXTURE_CREATE:
+	case CaptureCmd::TEXTURE_CREATE_FROM_IMAGE:	op = CREATE; return TEXTURE;
+	case CaptureCmd::TEXTURE_FREE:				op = FREE; return TEXTURE;
+	case CaptureCmd::MESH_LOAD:
+	case CaptureCmd::MESH_LOAD_UV_PLANE:		op = CREATE; return MESH;
+	case CaptureCmd::MESH_FREE:					op = FREE; return MESH;
+	default:									return NOT_RESOURCE;
+	}
+}
+
+}
+
+ShaderObject& RenderReplayer::ReplayShader::get()
+{
+	if (type == ShaderType::VERTEX) return vert;
+	if (type == ShaderType::FRAGMENT) return frag;
+	return geom;
+}
+
+template <typename T>
+T& RenderReplayer::find(map<uint32_t, T>& m, uint32_t id)
+{
+	auto it = m.find(id);
+	if (it == m.end()) throw runtime_error("the capture uses an object that was not captured");
+	return it->second;
+}
+
+int RenderReplayer::mapLocation(uint32_t program, int loc)const
+{
+	auto it = uniformLocations.find((uint64_t)program << 32 | (uint32_t)loc);
+	return it == uniformLocations.end() ? loc : it->second;
+}
+
+bool RenderReplayer::isAlive(unsigned kind, uint32_t id)const
+{
+	switch (kind)
+	{
+	case SHADER:	return shaders.count(id) != 0;
+	case PROGRAM:	return programs.count(id) != 0;
+	case TEXTURE:	return textures.count(id) != 0;
+	default:		return meshes.count(id) != 0;
+	}
+}
+
+void RenderReplayer::beginRepeat()
+{
+	repeating = true;
+	kept.clear();
+}
+
+// the objects that are alive are kept, with their setup. The ones that were freed are created again
+bool RenderReplayer::skipRepeated(const CaptureRecord& rec)
+{
+	ResourceOp op;
+	const ResourceKind kind = getResourceKind(rec.cmd, op);
+	if (kind == NOT_RESOURCE) return false;
+	const uint32_t id = RecordReader(rec).get<uint32_t>();	// all of them begin with the id
+	const uint64_t key = (uint64_t)kind << 32 | id;
+	switch (op)
+	{
+	case CREATE:
+		if (!isAlive(kind, id)) return false;
+		kept.insert(key);
+		return true;
+	case SETUP:
+		return kept.count(key) != 0;
+	default:
+		kept.erase(key);
+		return false;
+	}
+}
+
+void RenderReplayer::execute(const CaptureRecord& rec)
+{
+	if (repeating && skipRepeated(rec)) return;
+	RecordReader r(rec);
+	switch (rec.cmd)
+	{
+	case CaptureCmd::FRAME_END:
+		break;
+
+	// SHADERS
+	case CaptureCmd::SHADER_CREATE:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		ReplayShader& shader = shaders[id];
+		shader.type = (ShaderType)r.get<uint8_t>();
+		if (shader.type == ShaderType::VERTEX) shader.vert.create();
+		else if (shader.type == ShaderType::FRAGMENT) shader.frag.create();
+		else shader.geom.create();
+		break;
+	}
+	case CaptureCmd::SHADER_SOURCE:
+	{
+		ReplayShader& shader = find(shaders, r.get<uint32_t>());
+		shader.get().loadFromString(r.getString().c_str());
+		break;
+	}
+	case CaptureCmd::SHADER_COMPILE:
+		find(shaders, r.get<uint32_t>()).get().compile();
+		break;
+	case CaptureCmd::SHADER_DESTROY:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		find(shaders, id).get().destroy();
+		shaders.erase(id);
+		break;
+	}
+	case CaptureCmd::PROGRAM_CREATE:
+		programs[r.get<uint32_t>()].create();
+		break;
+	case CaptureCmd::PROGRAM_ATTACH:
+	{
+		ShaderProgram& prog = find(programs, r.get<uint32_t>());
+		ReplayShader& shader = find(shaders, r.get<uint32_t>());
+		if (shader.type == ShaderType::VERTEX) prog.setVertexShader(shader.vert);
+		else if (shader.type == ShaderType::FRAGMENT) prog.setFragmentShader(shader.frag);
+		else prog.setGeometryShader(shader.geom);
+		break;
+	}
+	case CaptureCmd::PROGRAM_BIND_ATTRIB:
+	{
+		ShaderProgram& prog = find(programs, r.get<uint32_t>());
+		const int loc = r.get<int32_t>();
+		prog.bindAttrib(r.getString().c_str(), loc);
+		break;
+	}
+	case CaptureCmd::PROGRAM_LINK:
+		find(programs, r.get<uint32_t>()).link();
+		break;
+	case CaptureCmd::PROGRAM_USE:
+		curProgram = r.get<uint32_t>();
+		find(programs, curProgram).use();
+		break;
+	case CaptureCmd::PROGRAM_FREE:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		find(programs, id).free();
+		programs.erase(id);
+		break;
+	}
+	case CaptureCmd::UNIFORM_LOCATION:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		const int capturedLoc = r.get<int32_t>();
+		const int loc = find(programs, id).getUniformLocation(r.getString().c_str());
+		uniformLocations[(uint64_t)id << 32 | (uint32_t)capturedLoc] = loc;
+		break;
+	}
+	case CaptureCmd::UNIFORM:
+	{
+		const UnifType type = r.get<UnifType>();
+		const int loc = mapLocation(curProgram, r.get<int32_t>());
+		// aligned copy of the value
+		float value[16];
+		r.read(value, getUnifSize(type));
+		ShaderProgram::uploadUniformData(type, loc, (const char*)value);
+		break;
+	}
+
+	// TEXTURES
+	case CaptureCmd::TEXTURE_CREATE:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		const unsigned w = r.get<uint32_t>();
+		const unsigned h = r.get<uint32_t>();
+		textures[id] = Texture::createEmpty(w, h, (TexelFormat)r.get<uint8_t>());
+		break;
+	}
+	case CaptureCmd::TEXTURE_CREATE_FROM_IMAGE:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		const unsigned w = r.get<uint32_t>();
+		const unsigned h = r.get<uint32_t>();
+		const PixelFormat pixelFormat = (PixelFormat)r.get<uint8_t>();
+		const TexelFormat texelFormat = (TexelFormat)r.get<uint8_t>();
+		Image image = Image::createEmpty(w, h, pixelFormat);
+		r.read(image.getData(), (size_t)w * h * image.getPerPixelSize());
+		textures[id] = Texture::createFromImage(image, texelFormat);
+		image.free();
+		break;
+	}
+	case CaptureCmd::TEXTURE_BIND:
+	{
+		Texture& tex = find(textures, r.get<uint32_t>());
+		tex.bindToUnit(r.get<uint32_t>());
+		break;
+	}
+	case CaptureCmd::TEXTURE_WRAP:
+	{
+		Texture& tex = find(textures, r.get<uint32_t>());
+		const uint8_t axes = r.get<uint8_t>();
+		const TextureWrapMode u = (TextureWrapMode)r.get<uint8_t>();
+		const TextureWrapMode v = (TextureWrapMode)r.get<uint8_t>();
+		if (axes == 3) tex.setWrapModeUv(u, v);
+		else if (axes == 1) tex.setWrapModeU(u);
+		else tex.setWRapModeV(v);
+		break;
+	}
+	case CaptureCmd::TEXTURE_FILTER:
+	{
+		Texture& tex = find(textures, r.get<uint32_t>());
+		tex.setFilterMode((TextureFilterMode)r.get<uint8_t>());
+		break;
+	}
+	case CaptureCmd::TEXTURE_MIPMAPS:
+		find(textures, r.get<uint32_t>()).generateMipmaps();
+		break;
+	case CaptureCmd::TEXTURE_RESIZE:
+	{
+		Texture& tex = find(textures, r.get<uint32_t>());
+		const unsigned w = r.get<uint32_t>();
+		tex.resize(w, r.get<uint32_t>());
+		break;
+	}
+	case CaptureCmd::TEXTURE_FREE:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		find(textures, id).free();
+		textures.erase(id);
+		break;
+	}
+
+	// MESHES
+	case CaptureCmd::MESH_LOAD:
+	{
+		const uint32_t vao = r.get<uint32_t>();
+		CapturedMesh mesh;
+		mesh.numVertices = r.get<uint32_t>();
+		const unsigned numIndices = r.get<uint32_t>();
+		const unsigned mask = r.get<uint32_t>();
+		for (unsigned i = 0; i < (unsigned)AttribLocation::NUM_ATTRIBS; i++)
+		{
+			if (mask & (1 << i))
+				mesh.attribs[i] = r.getArray<float>(mesh.numVertices * ATTRIB_NUM_COMPONENTS[i]);
+		}
+		mesh.indices = r.getArray<unsigned>(numIndices);
+		MeshGpuGeneric* gpu = new MeshGpuGeneric;
+		gpu->load(mesh);
+		meshes[vao].reset(gpu);
+		break;
+	}
+	case CaptureCmd::MESH_LOAD_UV_PLANE:
+	{
+		UvPlaneMeshGpu* gpu = new UvPlaneMeshGpu;
+		gpu->load();
+		meshes[r.get<uint32_t>()].reset(gpu);
+		break;
+	}
+	case CaptureCmd::MESH_BIND:
+		find(meshes, r.get<uint32_t>())->bind();
+		break;
+	case CaptureCmd::MESH_FREE:
+	{
+		const uint32_t vao = r.get<uint32_t>();
+		find(meshes, vao)->free();
+		meshes.erase(vao);
+		break;
+	}
+
+	// RENDER API
+	case CaptureCmd::DRAW:
+	{
+		DrawDesc desc;
+		desc.geomType = (GeomType)r.get<uint8_t>();
+		desc.indices = r.get<uint8_t>() != 0;
+		desc.first = r.get<uint32_t>();
+		desc.count = r.get<uint32_t>();
+		RenderApi::draw(desc);
+		numDraws++;
+		break;
+	}
+	case CaptureCmd::DRAW_MULTI:
+	{
+		DrawDesc desc;
+		desc.geomType = (GeomType)r.get<uint8_t>();
+		desc.indices = r.get<uint8_t>() != 0;
+		const unsigned n = r.get<uint32_t>();
+		vector<unsigned> firsts = r.getArray<unsigned>(n);
+		vector<unsigned> counts = r.getArray<unsigned>(n);
+		RenderApi::drawMulti(desc, &firsts[0], &counts[0], n);
+		numDraws++;
+		break;
+	}
+	case CaptureCmd::DRAW_INSTANCED:
+	{
+		DrawDesc desc;
+		desc.geomType = (GeomType)r.get<uint8_t>();
+		desc.indices = r.get<uint8_t>() != 0;
+		desc.first = r.get<uint32_t>();
+		desc.count = r.get<uint32_t>();
+		const unsigned numInstances = r.get<uint32_t>();
+		const InstanceBuffer& buffer = find(instanceBuffers, r.get<uint32_t>());
+		const unsigned stride = r.get<uint32_t>();
+		vector<InstanceAttrib> attribs(r.get<uint32_t>());
+		for (InstanceAttrib& attrib : attribs)
+		{
+			attrib.location = r.get<int32_t>();
+			attrib.type = r.get<UnifType>();
+			attrib.offset = r.get<uint16_t>();
+		}
+		RenderApi::drawInstanced(desc, numInstances, buffer, stride, attribs.data(), (unsigned)attribs.size());
+		numDraws++;
+		break;
+	}
+	case CaptureCmd::INSTANCE_BUFFER_UPLOAD:
+	{
+		InstanceBuffer& buffer = instanceBuffers[r.get<uint32_t>()];
+		size_t size;
+		const char* data = r.getRest(size);
+		buffer.upload(data, size);
+		break;
+	}
+	case CaptureCmd::INSTANCE_BUFFER_FREE:
+	{
+		const uint32_t id = r.get<uint32_t>();
+		find(instanceBuffers, id).free();
+		instanceBuffers.erase(id);
+		break;
+	}
+	case CaptureCmd::ATTRIB_CONSTANT:
+	{
+		const int loc = r.get<int32_t>();
+		const UnifType type = r.get<UnifType>();
+		if (!isInstanceAttribType(type)) throw runtime_error("corrupted capture record");
+		char value[16];
+		r.read(value, getUnifSize(type));
+		InstanceBuffer::setConstant(loc, type, value);
+		break;
+	}
+	case CaptureCmd::CLEAR_COLOR:
+	{
+		float c[4];
+		r.read(c, sizeof(c));
+		RenderApi::setClearColor(c[0], c[1], c[2], c[3]);
+		break;
+	}
+	case CaptureCmd::CLEAR_DEPTH:
+		RenderApi::setClearDepth(r.get<float>());
+		break;
+	case CaptureCmd::DEPTH_TEST:
+		RenderApi::enableDepthTest(r.get<uint8_t>() != 0);
+		break;
+	case CaptureCmd::FACE_CULLING:
+		RenderApi::enableFaceCulling(r.get<uint8_t>() != 0);
+		break;
+	case CaptureCmd::POLYGON_MODE:
+		RenderApi::setPolygonDrawMode((PolygonDrawMode)r.get<uint8_t>());
+		break;
+	case CaptureCmd::PIPELINE_STATE:
+		PipelineState::apply(PipelineState::unpack(r.get<uint32_t>()));
+		break;
+
+	// the uniforms of the materials are in the stream, the markers are only counted
+	case CaptureCmd::MATERIAL_USE:
+		numMaterials++;
+		break;
+
+	default:
+		throw runtime_error("unknown capture command");
+	}
+}
+
+void RenderReplayer::freeAll()
+{
+	for (auto& it : meshes) it.second->free();
+	for (auto& it : instanceBuffers) it.second.free();
+	for (auto& it : textures) it.second.free();
+	for (auto& it : programs) it.second.free();
+	for (auto& it : shaders) it.second.get().destroy();
+	meshes.clear();
+	instanceBuffers.clear();
+	textures.clear();
+	programs.clear();
+	shaders.clear();
+}
+
+vector<CaptureRecord> parseRenderCapture(const vector<char>& file)
+{
+	const size_t headerSize = 4 + sizeof(uint32_t);
+	if (file.size() < headerSize || memcmp(&file[0], "TKRC", 4) != 0)
+		throw runtime_error("not a render capture");
+	uint32_t version;
+	memcpy(&version, &file[4], sizeof(version));
+	if (version != RenderCapture::FILE_VERSION) throw runtime_error("unsupported capture version");
+
+	vector<CaptureRecord> records;
+	size_t p = headerSize;
+	while (p < file.size())
+	{
+		if (p + 1 + sizeof(uint32_t) > file.size()) throw runtime_error("truncated capture");
+		CaptureRecord rec;
+		rec.cmd = (CaptureCmd)file[p];
+		memcpy(&rec.size, &file[p + 1], sizeof(uint32_t));
+		p += 1 + sizeof(uint32_t);
+		if (rec.cmd >= CaptureCmd::COUNT || p + rec.size > file.size()) throw runtime_error("corrupted capture");
+		rec.data = &file[p];
+		p += rec.size;
+		records.push_back(rec);
+	}
+	return records;
+}
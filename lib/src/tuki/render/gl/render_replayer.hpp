@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include "render_capture.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+#include "mesh_gpu.hpp"
+#include "instance_buffer.hpp"
+
+/*
+Replays the records of a render capture (render_capture.hpp), used by tools/render_replay.
+The objects are created with new GL ids, the captured ids are mapped to them.
+The frames can be replayed several times: the objects that are alive when a pass ends are kept
+for the next one, their creation and setup records are skipped. The ones that are freed during
+the frames (like a texture that is created again with less mips) are created again.
+All the functions must be called from the thread of the GL context.
+*/
+
+struct CaptureRecord
+{
+	CaptureCmd cmd;
+	const char* data;	// payload, it points to the file buffer
+	std::uint32_t size;
+};
+
+// throws runtime_error if it's not a valid capture
+std::vector<CaptureRecord> parseRenderCapture(const std::vector<char>& file);
+
+class RenderReplayer
+{
+public:
+	RenderReplayer() : numDraws(0), numMaterials(0), curProgram(0), repeating(false) {}
+
+	// throws runtime_error if the record is corrupted or uses objects that don't exist
+	void execute(const CaptureRecord& rec);
+	// call it before replaying the frames again
+	void beginRepeat();
+	void freeAll();
+
+	unsigned numDraws, numMaterials;
+
+private:
+	struct ReplayShader
+	{
+		ShaderType type;
+		VertexShaderObject vert;
+		FragmentShaderObject frag;
+		GeometryShaderObject geom;
+
+		ShaderObject& get();
+	};
+
+	std::map<std::uint32_t, ReplayShader> shaders;
+	std::map<std::uint32_t, ShaderProgram> programs;
+	std::map<std::uint64_t, int> uniformLocations;	// (captured program, captured location) -> location
+	std::map<std::uint32_t, Texture> textures;
+	std::map<std::uint32_t, std::unique_ptr<IMeshGpu> > meshes;
+	std::map<std::uint32_t, InstanceBuffer> instanceBuffers;
+	std::uint32_t curProgram;
+	bool repeating;
+	std::set<std::uint64_t> kept;	// (kind, captured id) of the objects whose creation was skipped in this pass
+
+	template <typename T>
+	static T& find(std::map<std::uint32_t, T>& m, std::uint32_t id);
+	int mapLocation(std::uint32_t program, int loc)const;
+	bool isAlive(unsigned kind, std::uint32_t id)const;
+	bool skipRepeated(const CaptureRecord& rec);
+};
@@ -4,6 +4,7 @@
 #include <cassert>
 #include "tuki/util/util.hpp"
 #include "util.hpp"
+#include "gpu_profiler.hpp"
 #include <iostream>
 
 using namespace std;
@@ -144,11 +145,13 @@ void RenderTarget::resize(unsigned w, unsigned h)
 
 void RenderTarget::bind()
 {
+	TUKI_GPU_PROFILE_PASS("RenderTarget");
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 }
 
 void RenderTarget::clear()
 {
+	TUKI_GPU_PROFILE_SCOPE("RenderTarget::clear");
 	glClear(
 		GL_COLOR_BUFFER_BIT |
 		(GL_DEPTH_BUFFER_BIT * hasDepthTexture())
@@ -157,11 +160,13 @@ void RenderTarget::clear()
 
 void RenderTarget::bindDefault()
 {
+	TUKI_GPU_PROFILE_PASS("default framebuffer");
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void RenderTarget::clearDefault()
 {
+	TUKI_GPU_PROFILE_SCOPE("RenderTarget::clearDefault");
 	glClear(
 		GL_COLOR_BUFFER_BIT |
 		GL_DEPTH_BUFFER_BIT
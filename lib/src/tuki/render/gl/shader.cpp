@@ -7,12 +7,18 @@
 #include <iostream>
 #include <glm/gtc/type_ptr.hpp>
 #include "texture.hpp"
-#include <map>
+#include "render_capture.hpp"
+#include "../../util/flat_hash_map.hpp"
 #include <exception>
+#include <vector>
+#include <cstring>
 
 using namespace std;
 using namespace glm;
 
+// uniform locations of each program
+static FlatHashMap<int, FlatHashMap<NameId, int> > uniformLocations;
+
 unsigned getUnifSize(UnifType ut)
 {
 	const unsigned n = (unsigned)UnifType::COUNT;
@@ -25,6 +31,7 @@ unsigned getUnifSize(UnifType ut)
 		2*3 * sizeof(float), 3*2 * sizeof(float),
 		2*4 * sizeof(float), 4*2 * sizeof(float),
 		3*4 * sizeof(float), 4*3 * sizeof(float),
+		sizeof(uint32_t),
 	};
 	unsigned i = (unsigned)ut;
 	assert(i >= 0 && i < n);
@@ -43,6 +50,7 @@ unsigned getUnifNumElems(UnifType ut)
 		2 * 3, 3 * 2,
 		2 * 4, 4 * 2,
 		3 * 4, 4 * 3,
+		1,
 	};
 	unsigned i = (unsigned)ut;
 	assert(i >= 0 && i < n);
@@ -60,6 +68,7 @@ UnifType getUnifBasicType(UnifType ut)
 	assert(i >= 0 && i < n);
 	if (i1 <= i && i <= i2) return UnifType::INT;
 	if (u1 <= i && i <= u2) return UnifType::UINT;
+	if (ut == UnifType::TEXTURE) return UnifType::TEXTURE;
 	return UnifType::FLOAT;
 }
 
@@ -75,6 +84,7 @@ const char* getUnifTypeName(UnifType ut)
 		"mat2x3", "mat2x4",
 		"mat2x4", "mat4x2",
 		"mat3x4", "mat4x3",
+		"sampler2D",
 	};
 	unsigned i = (unsigned)ut;
 	assert(i >= 0 && i < n);
@@ -83,7 +93,8 @@ const char* getUnifTypeName(UnifType ut)
 
 UnifType getUnifTypeFromName(const char* name)
 {
-	const map<string, UnifType> lookUp =
+	// built once, the lookup doesn't construct a string
+	static const FlatHashMap<string, UnifType> lookUp =
 	{
 		{ "float", UnifType::FLOAT },
 		{ "vec2", UnifType::VEC2 },
@@ -105,10 +116,11 @@ UnifType getUnifTypeFromName(const char* name)
 		{ "mat2x4", UnifType::MATRIX_2x4 },
 		{ "mat4x2", UnifType::MATRIX_4x2 },
 		{ "mat3x4", UnifType::MATRIX_3x4 },
-		{ "mat4x3", UnifType::MATRIX_4x3 }
+		{ "mat4x3", UnifType::MATRIX_4x3 },
+		{ "sampler2D", UnifType::TEXTURE }
 	};
 
-	map<string, UnifType>::const_iterator it = lookUp.find(name);
+	auto it = lookUp.find(name);
 	if (it == lookUp.end())
 	{
 		throw runtime_error("not recognized unif name type: " + string(name));
@@ -124,6 +136,8 @@ void ShaderObject::loadFromString(const char* src)
 	// the shader has to be loaded only once, otherwise there will be memory leaks
 	assert(shaderId >= 0 && "The shader has been already loaded");
 
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::SHADER_SOURCE) << (uint32_t)shaderId << RenderCapture::Str(src);
 	glShaderSource(shaderId, 1, &src, 0);
 }
 
@@ -135,6 +149,8 @@ void ShaderObject::loadFromFile(const char* fileName)
 
 void ShaderObject::compile()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::SHADER_COMPILE) << (uint32_t)shaderId;
 	glCompileShader(shaderId);
 
 	GLint compiled;
@@ -153,44 +169,79 @@ void ShaderObject::compile()
 void ShaderObject::destroy()
 {
 	assert(shaderId >= 0 && "Attempted to destroy shader before creating it");
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::SHADER_DESTROY) << (uint32_t)shaderId;
 
 	glDeleteShader(shaderId);
 }
 
-void VertexShaderObject::create() { shaderId = glCreateShader(GL_VERTEX_SHADER); }
-void FragmentShaderObject::create() { shaderId = glCreateShader(GL_FRAGMENT_SHADER); }
-void GeometryShaderObject::create() { shaderId = glCreateShader(GL_GEOMETRY_SHADER); }
+static void captureShaderCreate(ShaderId id, ShaderType type)
+{
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::SHADER_CREATE) << (uint32_t)id << (uint8_t)type;
+}
+
+void VertexShaderObject::create()
+{
+	shaderId = glCreateShader(GL_VERTEX_SHADER);
+	captureShaderCreate(shaderId, ShaderType::VERTEX);
+}
+void FragmentShaderObject::create()
+{
+	shaderId = glCreateShader(GL_FRAGMENT_SHADER);
+	captureShaderCreate(shaderId, ShaderType::FRAGMENT);
+}
+void GeometryShaderObject::create()
+{
+	shaderId = glCreateShader(GL_GEOMETRY_SHADER);
+	captureShaderCreate(shaderId, ShaderType::GEOMETRY);
+}
 
 
 // SHADER PROGRAM
 
+static void captureAttach(int program, ShaderId shader)
+{
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PROGRAM_ATTACH) << (uint32_t)program << (uint32_t)shader;
+}
+
 void ShaderProgram::create()
 {
 	program = glCreateProgram();
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PROGRAM_CREATE) << (uint32_t)program;
 }
 
 void ShaderProgram::bindAttrib(const char* name, int loc)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PROGRAM_BIND_ATTRIB) << (uint32_t)program << (int32_t)loc << RenderCapture::Str(name);
 	glBindAttribLocation(program, loc, name);
 }
 
 void ShaderProgram::setVertexShader(VertexShaderObject vertShad)
 {
+	captureAttach(program, vertShad.getId());
 	glAttachShader(program, vertShad.getId());
 }
 
 void ShaderProgram::setFragmentShader(FragmentShaderObject fragShad)
 {
+	captureAttach(program, fragShad.getId());
 	glAttachShader(program, fragShad.getId());
 }
 
 void ShaderProgram::setGeometryShader(GeometryShaderObject geomShad)
 {
+	captureAttach(program, geomShad.getId());
 	glAttachShader(program, geomShad.getId());
 }
 
 void ShaderProgram::link()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PROGRAM_LINK) << (uint32_t)program;
 	glLinkProgram(program);
 
 	// check if the linking failed
@@ -204,139 +255,231 @@ void ShaderProgram::link()
 		glGetProgramInfoLog(program, len, NULL, &str[0]);
 		throw str;
 	}
+
+	// cache the locations of the active uniforms, the arrays also by the name without [0]
+	FlatHashMap<NameId, int>& locs = uniformLocations[program];
+	locs.clear();
+	GLint numUniforms = 0, maxLen = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLen);
+	vector<char> name(maxLen + 1);
+	for (GLint i = 0; i < numUniforms; i++)
+	{
+		GLsizei len = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, i, maxLen + 1, &len, &size, &type, &name[0]);
+		name[len] = 0;
+		const int loc = glGetUniformLocation(program, &name[0]);
+		if (loc < 0) continue;	// uniform blocks
+		locs[NameId::intern(&name[0])] = loc;
+		if (len > 3 && strcmp(&name[len - 3], "[0]") == 0)
+		{
+			name[len - 3] = 0;
+			locs[NameId::intern(&name[0])] = loc;
+		}
+	}
 }
 
 void ShaderProgram::use()
 {
 	assert(program >= 0 && "Attempted to use an invalid shader program");
 
-	glUseProgram(program);
+	useProgram();
 }
 
 void ShaderProgram::useProgram()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PROGRAM_USE) << (uint32_t)program;
 	glUseProgram(program);
 }
 
 void ShaderProgram::free()
 {
 	assert(program >= 0 && "Attempted to free an invalid shader program");
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::PROGRAM_FREE) << (uint32_t)program;
 
 	glDeleteProgram(program);
+	uniformLocations.erase(program);
+}
+
+int ShaderProgram::getUniformLocation(NameId name)const
+{
+	FlatHashMap<NameId, int>& locs = uniformLocations[program];
+	auto it = locs.find(name);
+	const char* str = nullptr;
+	int loc = -1;
+	if (it != locs.end())
+	{
+		loc = it->second;
+	}
+	else
+	{
+		// not active, or the uniforms couldn't be listed: ask GL if the name is known
+		str = name.getString();
+		if (str)
+		{
+			loc = glGetUniformLocation(program, str);
+			locs[name] = loc;
+		}
+	}
+	if (RenderCapture::isCapturing())
+	{
+		if (!str) str = name.getString();
+		if (str) RenderCapture::Record(CaptureCmd::UNIFORM_LOCATION) << (uint32_t)program << (int32_t)loc << RenderCapture::Str(str);
+	}
+	return loc;
 }
 
 int ShaderProgram::getUniformLocation(const char* name)const
 {
-	return glGetUniformLocation(program, name);
+	return getUniformLocation(NameId::intern(name));
+}
+
+int ShaderProgram::getAttribLocation(NameId name)const
+{
+	const char* str = name.getString();
+	return str ? glGetAttribLocation(program, str) : -1;
 }
 // UNIFORM UPLOADERS
+template <typename T>
+static void captureUniform(int location, const T& value)
+{
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::UNIFORM) << getUnifType(value) << (int32_t)location << value;
+}
+
 void ShaderProgram::uploadUniform(int location, float value)
 {
+	captureUniform(location, value);
 	glUniform1f(location, value);
 }
 
 void ShaderProgram::uploadUniform(int location, const vec2& value)
 {
+	captureUniform(location, value);
 	glUniform2fv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const vec3& value)
 {
+	captureUniform(location, value);
 	glUniform3fv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const vec4& value)
 {
+	captureUniform(location, value);
 	glUniform4fv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, int value)
 {
+	captureUniform(location, value);
 	glUniform1i(location, value);
 }
 
 void ShaderProgram::uploadUniform(int location, const ivec2& value)
 {
+	captureUniform(location, value);
 	glUniform2iv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const ivec3& value)
 {
+	captureUniform(location, value);
 	glUniform3iv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const ivec4& value)
 {
+	captureUniform(location, value);
 	glUniform4iv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, unsigned value)
 {
+	captureUniform(location, value);
 	glUniform1ui(location, value);
 }
 
 void ShaderProgram::uploadUniform(int location, const glm::uvec2& value)
 {
+	captureUniform(location, value);
 	glUniform2uiv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const glm::uvec3& value)
 {
+	captureUniform(location, value);
 	glUniform3uiv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const glm::uvec4& value)
 {
+	captureUniform(location, value);
 	glUniform4uiv(location, 1, &value[0]);
 }
 
 void ShaderProgram::uploadUniform(int location, const mat2& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix2fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat3& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix3fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat4& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat2x3& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix2x3fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat3x2& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix3x2fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat2x4& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix2x4fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat4x2& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix4x2fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat3x4& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix3x4fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, const mat4x3& value)
 {
+	captureUniform(location, value);
 	glUniformMatrix4x3fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void ShaderProgram::uploadUniform(int location, TextureUnit value)
 {
+	captureUniform(location, (int)value);
 	glUniform1i(location, (int)value);
 }
 
@@ -478,6 +621,16 @@ void ShaderProgram::uploadUniformData(UnifType type, int loc, const char* data)
 		break;
 	}
 
+	case UnifType::TEXTURE:
+	{
+		// the value of a sampler is its texture unit (int). The material slots of this type store a
+		// TextureHandle instead, useMaterial binds it through the TextureManager to the unit of the
+		// slot, which is uploaded only once when the template is created
+		const int* x = (int*)data;
+		uploadUniform(loc, *x);
+		break;
+	}
+
 	default:
 		throw runtime_error("UnifType not recognized");
 
@@ -6,6 +6,7 @@
 #include <glm/matrix.hpp>
 #include <string>
 #include <numeric>
+#include "../../util/name_id.hpp"
 
 enum class TextureUnit;
 
@@ -27,10 +28,9 @@ enum class UnifType : std::uint16_t
 	MATRIX_2x3, MATRIX_3x2,
 	MATRIX_2x4, MATRIX_4x2,
 	MATRIX_3x4, MATRIX_4x3,
+	TEXTURE,	// sampler2D. Materials store a TextureHandle, the uploaded value is the texture unit
 
-	COUNT,
-
-	TEXTURE = INT,
+	COUNT
 };
 
 unsigned getUnifSize(UnifType ut);
@@ -105,8 +105,14 @@ public:
 	void link();
 	void use();
 	void free();
+	int getId()const { return program; }
 
+	// the locations of the active uniforms are cached when linking
+	int getUniformLocation(NameId name)const;
+	// interns the name
 	int getUniformLocation(const char* name)const;
+	// -1 if the program doesn't have an active attribute with that name
+	int getAttribLocation(NameId name)const;
 	// uniform uploaders
 	static void uploadUniform(int location, float value);
 	static void uploadUniform(int location, const glm::vec2& value);
@@ -131,7 +137,7 @@ public:
 	static void uploadUniform(int location, const glm::mat4x3& value);
 	static void uploadUniform(int location, TextureUnit value);
 	template <typename T>
-	void uploadUniform(const char* name, const T& value)
+	void uploadUniform(NameId name, const T& value)
 	{
 		int loc = getUniformLocation(name);
 		useProgram();
@@ -12,7 +12,14 @@
 #include <algorithm>
 #include <glm/gtc/integer.hpp>
 #include <cassert>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
 #include "util.hpp"
+#include "../../util/mallocr/mem_tracker.hpp"
+#include "../../util/profiler.hpp"
+#include "../../util/vfs.hpp"
+#include "render_capture.hpp"
 
 using namespace std;
 
@@ -39,6 +46,26 @@ const unsigned TEXEL_NUM_CHANNELS[(int)TexelFormat::COUNT] =
 	2,		// DEPTH24_STENCIL8
 };
 
+// bytes per texel, estimation for the VRAM tracking
+const unsigned TEXEL_SIZE[(int)TexelFormat::COUNT] =
+{
+	3,		// RGB8
+	4,		// RGBA8
+	2,		// DEPTH16
+	3,		// DEPTH24
+	4,		// DEPTH32
+	4,		// DEPTH_AUTO
+	4,		// DEPTH24_STENCIL8
+};
+
+static size_t estimateVramSize(int width, int height, TexelFormat format, bool mipmaps)
+{
+	size_t size = (size_t)width * height * TEXEL_SIZE[(int)format];
+	// the mip chain adds a third
+	if (mipmaps) size += size / 3;
+	return size;
+}
+
 const GLuint TO_GL_WRAP_MODE[(int)TextureWrapMode::COUNT] =
 {
 	GL_REPEAT,
@@ -133,7 +160,10 @@ void Image::free()
 {
 	assert(data != nullptr);
 
-	delete[] data;
+	// allocated with malloc, like stbi does
+	MemTracker::trackFree(MemTag::TEXTURE, (size_t)width * height * getPerPixelSize());
+	std::free(data);
+	data = nullptr;
 }
 
 Image Image::createEmpty(unsigned width, unsigned height, PixelFormat format)
@@ -142,7 +172,8 @@ Image Image::createEmpty(unsigned width, unsigned height, PixelFormat format)
 	image.format = format;
 	unsigned pixSize = PIXEL_FORMAT_SIZE[(int)format];
 	unsigned imageSize = pixSize * width * height;
-	image.data = new char[imageSize];
+	image.data = malloc(imageSize);
+	MemTracker::trackAlloc(MemTag::TEXTURE, imageSize);
 	image.width = width;
 	image.height = height;
 	memset(image.data, 0, imageSize);
@@ -153,9 +184,13 @@ Image Image::loadFromFile(const char* fileName)
 {
 	Image image;
 	int channels;
-	image.data = stbi_load(fileName, &image.width, &image.height, &channels, 0);
-
-	assert(image.data != nullptr);
+	const VfsFile file = Vfs::getSingleton()->read(fileName);
+	image.data = stbi_load_from_memory(file.getData(), (int)file.getSize(), &image.width, &image.height, &channels, 0);
+	if (image.data == nullptr)
+	{
+		throw runtime_error("Error loading image: " + string(fileName));
+	}
+	MemTracker::trackAlloc(MemTag::TEXTURE, (size_t)image.width * image.height * channels);
 
 	if (channels == 3)
 	{
@@ -175,8 +210,16 @@ Image Image::loadFromFile(const char* fileName)
 }
 
 // TEXTURE
+static void captureWrap(TextureId id, uint8_t axes, TextureWrapMode modeU, TextureWrapMode modeV)
+{
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::TEXTURE_WRAP) << (uint32_t)id << axes << (uint8_t)modeU << (uint8_t)modeV;
+}
+
 void Texture::bindToUnit(unsigned unit)const
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::TEXTURE_BIND) << (uint32_t)id << (uint32_t)unit;
 	glActiveTexture(GL_TEXTURE0 + unit);
 	glBindTexture(GL_TEXTURE_2D, id);
 }
@@ -190,8 +233,14 @@ unsigned Texture::getNumChannels()const
 	return TEXEL_NUM_CHANNELS[(int)texelFormat];
 }
 
+size_t Texture::getVramSize()const
+{
+	return estimateVramSize(width, height, texelFormat, hasMipmaps());
+}
+
 void Texture::setWrapModeUv(TextureWrapMode wrapModeU, TextureWrapMode wrapModeV)
 {
+	captureWrap(id, 3, wrapModeU, wrapModeV);
 	glBindTexture(GL_TEXTURE_2D, id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, TO_GL_WRAP_MODE[(int)wrapModeU]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, TO_GL_WRAP_MODE[(int)wrapModeV]);
@@ -199,18 +248,22 @@ void Texture::setWrapModeUv(TextureWrapMode wrapModeU, TextureWrapMode wrapModeV
 
 void Texture::setWrapModeU(TextureWrapMode wrapMode)
 {
+	captureWrap(id, 1, wrapMode, wrapMode);
 	glBindTexture(GL_TEXTURE_2D, id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, TO_GL_WRAP_MODE[(int)wrapMode]);
 }
 
 void Texture::setWRapModeV(TextureWrapMode wrapMode)
 {
+	captureWrap(id, 2, wrapMode, wrapMode);
 	glBindTexture(GL_TEXTURE_2D, id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, TO_GL_WRAP_MODE[(int)wrapMode]);
 }
 
 void Texture::setFilterMode(TextureFilterMode filterMode)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::TEXTURE_FILTER) << (uint32_t)id << (uint8_t)filterMode;
 	this->filterMode = filterMode;
 	resetFilterMode();
 }
@@ -255,6 +308,13 @@ void Texture::resetFilterMode()
 
 void Texture::generateMipmaps()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::TEXTURE_MIPMAPS) << (uint32_t)id;
+	if (mipmapLevels == 0)
+	{
+		MemTracker::trackVramFree(VramType::TEXTURE, estimateVramSize(width, height, texelFormat, false));
+		MemTracker::trackVramAlloc(VramType::TEXTURE, estimateVramSize(width, height, texelFormat, true));
+	}
 	mipmapLevels = 1 + glm::log2(max(width, height));
 	glBindTexture(GL_TEXTURE_2D, id);
 	glGenerateMipmap(GL_TEXTURE_2D);
@@ -263,6 +323,8 @@ void Texture::generateMipmaps()
 
 void Texture::resize(unsigned width, unsigned height)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::TEXTURE_RESIZE) << (uint32_t)id << (uint32_t)width << (uint32_t)height;
 	glBindTexture(GL_TEXTURE_2D, id);
 
 	resetFilterMode();
@@ -273,10 +335,32 @@ void Texture::resize(unsigned width, unsigned height)
 		(void*)0
 	);
 
+	// the mipmaps are lost
+	MemTracker::trackVramFree(VramType::TEXTURE, estimateVramSize(this->width, this->height, texelFormat, hasMipmaps()));
+	MemTracker::trackVramAlloc(VramType::TEXTURE, estimateVramSize(width, height, texelFormat, false));
+	mipmapLevels = 0;
+
 	this->width = width;
 	this->height = height;
 }
 
+Image Texture::downloadImage(unsigned level)const
+{
+	assert((texelFormat == TexelFormat::RGB8 || texelFormat == TexelFormat::RGBA8) &&
+		"only color textures can be downloaded");
+	const PixelFormat pixFormat = texelFormat == TexelFormat::RGB8 ? PixelFormat::RGB8 : PixelFormat::RGBA8;
+	const unsigned w = max(1, width >> level);
+	const unsigned h = max(1, height >> level);
+	Image image = Image::createEmpty(w, h, pixFormat);
+
+	// the rows of RGB8 are not multiple of 4
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glGetTexImage(GL_TEXTURE_2D, level, TO_GL_PIXEL_FORMAT[(int)pixFormat], GL_UNSIGNED_BYTE, image.getData());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	return image;
+}
+
 void Texture::save(const char* fileName, bool async, bool transparency)
 {
 	// create an empty image
@@ -310,11 +394,17 @@ void Texture::save(const char* fileName, bool async, bool transparency)
 
 void Texture::free()
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::TEXTURE_FREE) << (uint32_t)id;
 	glDeleteTextures(1, (GLuint*)&id);
+	MemTracker::trackVramFree(VramType::TEXTURE, estimateVramSize(width, height, texelFormat, hasMipmaps()));
 }
 
 Texture Texture::createEmpty(unsigned width, unsigned height, TexelFormat texelFormat)
 {
+	TUKI_PROFILE_SCOPE("Texture::createEmpty");
+	const bool capture = RenderCapture::isCapturing();
+	RenderCapture::ScopedPause capturePause;
 	Texture texture;
 	glGenTextures(1, (GLuint*)&texture.id);
 	glBindTexture(GL_TEXTURE_2D, texture.id);
@@ -333,19 +423,31 @@ Texture Texture::createEmpty(unsigned width, unsigned height, TexelFormat texelF
 		(void*)0
 	);
 	assert(!checkGlErrors());
+	MemTracker::trackVramAlloc(VramType::TEXTURE, estimateVramSize(width, height, texelFormat, false));
+	if (capture)
+	{
+		RenderCapture::Record(CaptureCmd::TEXTURE_CREATE) << (uint32_t)texture.id
+			<< (uint32_t)width << (uint32_t)height << (uint8_t)texelFormat;
+	}
 	return texture;
 }
 
 Texture Texture::loadFromFile(const char* fileName, TexelFormat internalFormat)
 {
+	TUKI_PROFILE_SCOPE("Texture::loadFromFile");
 	// load from file
 	Image img = Image::loadFromFile(fileName);
 
-	return createFromImage(img, internalFormat);
+	Texture texture = createFromImage(img, internalFormat);
+	img.free();
+	return texture;
 }
 
 Texture Texture::createFromImage(const Image& img, TexelFormat internalFormat)
 {
+	TUKI_PROFILE_SCOPE("Texture::createFromImage");
+	const bool capture = RenderCapture::isCapturing();
+	RenderCapture::ScopedPause capturePause;
 	Texture texture;
 	glGenTextures(1, (GLuint*)&texture.id);
 	glBindTexture(GL_TEXTURE_2D, texture.id);
@@ -369,5 +471,14 @@ Texture Texture::createFromImage(const Image& img, TexelFormat internalFormat)
 	texture.height = img.getHeight();
 	texture.setWrapMode(TextureWrapMode::REPEAT);
 	texture.setFilterMode(TextureFilterMode::NEAREST);
+	MemTracker::trackVramAlloc(VramType::TEXTURE,
+		estimateVramSize(texture.width, texture.height, internalFormat, false));
+	if (capture)
+	{
+		RenderCapture::Record(CaptureCmd::TEXTURE_CREATE_FROM_IMAGE) << (uint32_t)texture.id
+			<< (uint32_t)texture.width << (uint32_t)texture.height
+			<< (uint8_t)img.getPixelFormat() << (uint8_t)internalFormat
+			<< RenderCapture::Data(img.getData(), (size_t)texture.width * texture.height * img.getPerPixelSize());
+	}
 	return texture;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 typedef int TextureId;
 
 // pixel format for images (CPU)
@@ -83,6 +85,7 @@ private:
 
 public:
 	static Image createEmpty(unsigned width, unsigned height, PixelFormat format);
+	// throws runtime_error if the file can't be loaded
 	static Image loadFromFile(const char* fileName);
 };
 
@@ -101,6 +104,11 @@ public:
 	TexelFormat getTexelFormat()const { return texelFormat; }
 	unsigned getNumChannels()const;
 
+	int getWidth()const { return width; }
+	int getHeight()const { return height; }
+	// estimation of the VRAM used, including the mipmaps
+	std::size_t getVramSize()const;
+
 	void setWrapMode(TextureWrapMode wrapMode) { setWrapModeUv(wrapMode, wrapMode); }
 	void setWrapModeUv(TextureWrapMode wrapMode) { setWrapModeUv(wrapMode, wrapMode); }
 	void setWrapModeUv(TextureWrapMode wrapModeU, TextureWrapMode wrapModeV);
@@ -116,6 +124,9 @@ public:
 
 	void resize(unsigned width, unsigned height);
 
+	// copies a mip level to a new image, only for RGB8 and RGBA8 textures
+	Image downloadImage(unsigned level = 0)const;
+
 	// writes the texture to a file (for debugging purposes)
 	void save(const char* fileName, bool async=false, bool transparency=true);
 
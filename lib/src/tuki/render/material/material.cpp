@@ -7,8 +7,16 @@
 #include <exception>
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <new>
 #include "shader_pool.hpp"
+#include "../texture/texture_manager.hpp"
 #include "../../util/multi_sort.hpp"
+#include "../../util/mallocr/mallocr_arena.hpp"
+#include "../../util/mallocr/mem_tracker.hpp"
+#include "../../util/profiler.hpp"
+#include "../gl/render_capture.hpp"
+#include "../gl/instance_buffer.hpp"
 #include <glm/common.hpp>
 
 using namespace std;
@@ -34,6 +42,12 @@ ShaderProgram MaterialTemplate::getShaderProg()const
 	return man->getMaterialTemplateShaderProgram(*this);
 }
 
+PipelineStateId MaterialTemplate::getPipelineState()const
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	return man->getMaterialTemplatePipelineState(*this);
+}
+
 void MaterialTemplate::bindProgram()
 {
 	MaterialManager* man = MaterialManager::getSingleton();
@@ -55,6 +69,12 @@ ShaderProgram Material::getShaderProg()const
 	return man->getMaterialShaderProgram(*this);
 }
 
+PipelineStateId Material::getPipelineState()const
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	return man->getMaterialPipelineState(*this);
+}
+
 void Material::use()
 {
 	MaterialManager* man = MaterialManager::getSingleton();
@@ -83,11 +103,29 @@ void Material::modifyNotification()
 
 MaterialManager::MaterialManager()
 {
+	materialTemplateOffsets.reserve(MAX_MATERIAL_TEMPLATES);
+	materialTemplateDataChunks.reserve(MAX_MATERIAL_TEMPLATE_CHUNKS);
+	materialInstances.reserve(MAX_MATERIAL_TEMPLATES);
+
 	// fist allocation
 	allocateNewMaterialTemplateChunk();
 	nextMaterialTemplateOffset = 0;
 }
 
+MaterialManager::~MaterialManager()
+{
+	for (unsigned mtid = 0; mtid < materialInstances.size(); mtid++)
+	{
+		const unsigned chunkSize = accessMaterialTemplate(mtid)->materialSize * MATERIAL_CHUNK_LENGTH;
+		MaterialInstances* instances = materialInstances[mtid];
+		for (unsigned i = 0; i < instances->numChunks; i++)
+			MemTracker::deleteArray(MemTag::MATERIAL, (char*)instances->chunks[i], chunkSize);
+		delete instances;
+	}
+	for (void* chunk : materialTemplateDataChunks)
+		MemTracker::deleteArray(MemTag::MATERIAL, (char*)chunk, MATERIAL_TEMPLATE_CHUNK_SIZE);
+}
+
 ShaderProgram MaterialManager::getMaterialTemplateShaderProgram(uint16_t mtid)const
 {
 	const MaterialTemplateEntryHeader* head = accessMaterialTemplate(mtid);
@@ -104,23 +142,41 @@ ShaderProgram MaterialManager::getMaterialShaderProgram(Material material)const
 	return getMaterialTemplateShaderProgram(material.getTemplateId());
 }
 
+PipelineStateId MaterialManager::getMaterialTemplatePipelineState(MaterialTemplate materialTemplate)const
+{
+	return accessMaterialTemplate(materialTemplate.getId())->pipelineState;
+}
+
+PipelineStateId MaterialManager::getMaterialPipelineState(Material material)const
+{
+	return accessMaterialTemplate(material.getTemplateId())->pipelineState;
+}
+
 MaterialTemplate MaterialManager::loadMaterialTemplate(const string& path)
 {
-	MaterialTemplate existing = getMaterialTemplate(path);
-	if (existing.id != 0xFFFF) return existing;
+	lock_guard<mutex> lock(templatesMutex);
+	const auto it = materialTemplateNameToId.find(NameId(path));
+	if (it != materialTemplateNameToId.end())
+	{
+		MaterialTemplate existing;
+		existing.id = it->second;
+		return existing;
+	}
 
 	string txt = loadStringFromFile(path.c_str());
 	Document doc;
 	doc.Parse(txt.c_str());
 	MaterialTemplate res = loadMaterialTemplate(doc);
-	materialTemplateNameToId[path] = res.id;
+	materialTemplateNameToId[NameId::intern(path)] = res.id;
+	if (materialTemplateIdToName.size() <= res.id) materialTemplateIdToName.resize(res.id + 1);
 	materialTemplateIdToName[res.id] = path;
 
 	return res;
 }
 
-MaterialTemplate MaterialManager::getMaterialTemplate(const string& path)const
+MaterialTemplate MaterialManager::getMaterialTemplate(NameId path)const
 {
+	lock_guard<mutex> lock(templatesMutex);
 	const auto it = materialTemplateNameToId.find(path);
 	MaterialTemplate res;
 	if (it == materialTemplateNameToId.end())
@@ -136,9 +192,6 @@ MaterialTemplate MaterialManager::getMaterialTemplate(const string& path)const
 
 MaterialTemplate MaterialManager::loadMaterialTemplate(rapidjson::Document& doc)
 {
-	ShaderPool* shaderPool = ShaderPool::getSingleton();
-	const unsigned maxSlotNameSize = sizeof(MaterialTemplateEntrySlot::name);
-
 	Value::MemberIterator shadersIt = doc.FindMember("shaders");
 	if (shadersIt == doc.MemberEnd()) throw runtime_error("missing 'shaders' member");
 	Value::MemberIterator slotsIt = doc.FindMember("slots");
@@ -164,24 +217,17 @@ MaterialTemplate MaterialManager::loadMaterialTemplate(rapidjson::Document& doc)
 		geomShadName = geomIt->value.GetString();
 	}
 
-	vector<string> slotNames;
-	vector<UnifType> types;
-	vector<Value::MemberIterator> sortedIts;
+	ScratchScope scratch;
+	ScratchVector<NameId> slotNames(scratch);
+	ScratchVector<UnifType> types(scratch);
+	ScratchVector<uint8_t> perInstance(scratch);
+	ScratchVector<Value::MemberIterator> sortedIts(scratch);
 	for (Value::MemberIterator it = slotsIt->value.MemberBegin();
 		it != slotsIt->value.MemberEnd();
 		it++)
 	{
 		if (!it->name.IsString()) throw runtime_error("slot names must be strings");
-		string name = it->name.GetString();
-
-		if (name.size() >= maxSlotNameSize)
-		{
-			stringstream ss;
-			ss << maxSlotNameSize - 1;
-			throw runtime_error("attrib name is longer than " + ss.str() + " characters");
-		}
-
-		slotNames.push_back(name);
+		slotNames.push_back(NameId::intern(it->name.GetString()));
 
 		Value::MemberIterator typeIt = it->value.FindMember("type");
 		if (typeIt == it->value.MemberEnd()) throw runtime_error("type is mandatory for slots");
@@ -189,14 +235,76 @@ MaterialTemplate MaterialManager::loadMaterialTemplate(rapidjson::Document& doc)
 		UnifType type = getUnifTypeFromName(typeIt->value.GetString());
 		types.push_back(type);
 
+		bool slotPerInstance = false;
+		Value::MemberIterator perInstanceIt = it->value.FindMember("perInstance");
+		if (perInstanceIt != it->value.MemberEnd())
+		{
+			if (!perInstanceIt->value.IsBool()) throw runtime_error("'perInstance' must be bool");
+			slotPerInstance = perInstanceIt->value.GetBool();
+			if (slotPerInstance && !isInstanceAttribType(type))
+				throw runtime_error(string("the type of the per-instance slot ") + it->name.GetString() + " must be a scalar or a vector");
+		}
+		perInstance.push_back(slotPerInstance);
+
 		sortedIts.push_back(it);
 	}
 
-	sortVectorsAscending(slotNames, slotNames, types, sortedIts);
+	sortVectors(slotNames,
+		[](NameId a, NameId b) { return a < b; },
+		slotNames, types, perInstance, sortedIts);
+
+	PipelineStateId pipelineState = PIPELINE_STATE_INHERIT;
+	Value::MemberIterator pipelineIt = doc.FindMember("pipeline");
+	if (pipelineIt != doc.MemberEnd())
+		pipelineState = PipelineState::registerState(PipelineState::parse(pipelineIt->value));
+
+	bool deduplicate = false;
+	Value::MemberIterator dedupIt = doc.FindMember("deduplicate");
+	if (dedupIt != doc.MemberEnd())
+	{
+		if (!dedupIt->value.IsBool()) throw runtime_error("'deduplicate' must be bool");
+		deduplicate = dedupIt->value.GetBool();
+	}
+
+	const uint16_t mtid = createMaterialTemplate(vertShadName, fragShadName, geomShadName,
+		slotNames.size(), slotNames.data(), types.data(), perInstance.data());
+	MaterialTemplateEntryHeader* head = accessMaterialTemplate(mtid);
+	if (deduplicate) head->flags |= DEDUPLICATE;
+	head->pipelineState = pipelineState;
+	MaterialEntryHeader* matHead = accessMaterialData(((uint32_t)mtid) << 16);
+
+	// the slots without a specified default are zero
+	for (unsigned i = 0; i < slotNames.size(); i++)
+	{
+		Value::MemberIterator it = sortedIts[i];
+		Value::MemberIterator defIt = it->value.FindMember("default");
+		if (defIt != it->value.MemberEnd())
+			parseJsonValueAndSet(defIt->value, i, matHead, head);
+	}
+	MaterialTemplate templ;
+	templ.id = mtid;
+	return templ;
+}
+
+uint16_t MaterialManager::createMaterialTemplate(
+	const string& vertShadName, const string& fragShadName, const string& geomShadName,
+	unsigned numSlots, const NameId* slotNames, const UnifType* types, const uint8_t* perInstance)
+{
+	ShaderPool* shaderPool = ShaderPool::getSingleton();
 
-	const unsigned numSlots = slotNames.size();
 	unsigned materialSize = 0;
-	for (UnifType type : types) materialSize += getUnifSize(type);
+	unsigned numTextures = 0;
+	for (unsigned i = 0; i < numSlots; i++)
+	{
+		materialSize += getUnifSize(types[i]);
+		if (types[i] == UnifType::TEXTURE) numTextures++;
+		if (perInstance && perInstance[i] && !isInstanceAttribType(types[i]))
+			throw runtime_error("the per-instance slots must be scalars or vectors");
+	}
+	if (numTextures > MAX_MATERIAL_TEXTURE_UNITS) throw runtime_error("too many texture slots for material template");
+
+	// before allocating, it can throw
+	ShaderProgram shaderProgram = shaderPool->getShaderProgram(vertShadName, fragShadName, geomShadName);
 
 	uint16_t mtid = materialTemplateOffsets.size();
 	allocateMaterialTemplate(numSlots);
@@ -204,61 +312,62 @@ MaterialTemplate MaterialManager::loadMaterialTemplate(rapidjson::Document& doc)
 	// fill header
 	MaterialTemplateEntryHeader* head = accessMaterialTemplate(mtid);
 	head->numSlots = numSlots;
-	head->materialSize = materialSize + sizeof(MaterialEntryHeader::header);
-	ShaderProgram shaderProgram =
-		head->shaderProgram =
-		shaderPool->getShaderProgram(vertShadName, fragShadName, geomShadName);
-	head->flags; // TODO
+	head->materialSize = materialSize + sizeof(MaterialEntryHeader);
+	head->shaderProgram = shaderProgram;
+	head->flags = 0;
+	head->pipelineState = PIPELINE_STATE_INHERIT;
+	head->instanceSize = 0;
+	head->shaders[0] = NameId::intern(vertShadName);
+	head->shaders[1] = NameId::intern(fragShadName);
+	head->shaders[2] = NameId::intern(geomShadName);
 	
 	// fill slots
 	MaterialTemplateEntrySlot* slots = (MaterialTemplateEntrySlot*)(head + 1);
 	unsigned offset = 0;
+	unsigned texUnit = 0;
 	for (unsigned i = 0; i < numSlots; i++)
 	{
-		const string& name = slotNames[i];
-		
-		strncpy(slots[i].name, slotNames[i].c_str(), maxSlotNameSize);
+		const NameId name = slotNames[i];
 
+		slots[i].name = name;
 		slots[i].type = types[i];
 		slots[i].offset = offset;
-		slots[i].unifLoc = shaderProgram.getUniformLocation(name.c_str());
-
-		offset += getUnifSize(types[i]);
-	}
-
-	// default values
-	nextMaterialFreeSlot.push_back(MATERIAL_CHUNK_LENGTH);
-	materialDataChunks.push_back(vector<void*>());
-	allocateNewMaterialChunk(mtid);
+		slots[i].unifLoc = shaderProgram.getUniformLocation(name);
+		slots[i].texUnit = 0;
+		slots[i].instanceOffset = NOT_PER_INSTANCE;
 
-	MaterialEntryHeader* matHead = accessMaterialData(((uint32_t)mtid) << 16);
-	matHead->header.sharedCount = -1;
-
-	for (unsigned i = 0; i < numSlots; i++)
-	{
-		Value::MemberIterator it = sortedIts[i];
-		Value::MemberIterator defIt = it->value.FindMember("default");
-		if (defIt != it->value.MemberEnd())
+		if (perInstance && perInstance[i])
 		{
-			// parse specified default
-			parseJsonValueAndSet(defIt->value, i, matHead, head);
+			slots[i].unifLoc = shaderProgram.getAttribLocation(name);
+			slots[i].instanceOffset = head->instanceSize;
+			head->instanceSize += getUnifSize(types[i]);
 		}
-		else
+
+		// the samplers always use the same unit, it's uploaded only once
+		if (types[i] == UnifType::TEXTURE)
 		{
-			// use the default default: just zero
-			const unsigned size = getUnifSize(types[i]);
-			MaterialTemplateEntrySlot* templSlots = (MaterialTemplateEntrySlot*)&head[1];
-			unsigned offset = templSlots[i].offset;
-			char* data = (char*)&matHead[1];
-			data = data + offset;
-			memset(data, 0, size);
+			if (texUnit == 0) shaderProgram.use();
+			slots[i].texUnit = texUnit;
+			ShaderProgram::uploadUniform(slots[i].unifLoc, (int)texUnit);
+			texUnit++;
 		}
+
+		offset += getUnifSize(types[i]);
 	}
-	nextMaterialFreeSlot[mtid] = 1;
 
-	MaterialTemplate templ;
-	templ.id = mtid;
-	return templ;
+	// default values, zero
+	MaterialInstances* instances = new MaterialInstances;
+	instances->nextFree = 0;
+	instances->numChunks = 0;
+	allocateNewMaterialChunk(*instances, head->materialSize);
+	instances->nextFree = 1;	// the first slot is the default value
+	materialInstances.push_back(instances);
+
+	MaterialEntryHeader* matHead = accessMaterialData(((uint32_t)mtid) << 16);
+	matHead->header.sharedCount.store(0xFFFFFFFF, memory_order_relaxed);
+	memset((char*)&matHead[1], 0, materialSize);
+
+	return mtid;
 }
 
 Material MaterialManager::loadMaterial(rapidjson::Document& doc)
@@ -268,9 +377,11 @@ Material MaterialManager::loadMaterial(rapidjson::Document& doc)
 	if (templateIt == doc.MemberEnd()) throw runtime_error("missing 'template' member");
 
 	if (!templateIt->value.IsString()) throw runtime_error("'template' must be string");
-	string templatePath = templateIt->value.GetString();
+	const char* templatePath = templateIt->value.GetString();
 
-	MaterialTemplate templ = loadMaterialTemplate(templatePath);
+	// the path is only copied to a string when the template has to be loaded
+	MaterialTemplate templ = getMaterialTemplate(templatePath);
+	if (templ.id == 0xFFFF) templ = loadMaterialTemplate(templatePath);
 	MaterialTemplateEntryHeader* templHead = accessMaterialTemplate(templ.id);
 	
 	Material mat;
@@ -293,10 +404,10 @@ Material MaterialManager::loadMaterial(rapidjson::Document& doc)
 		++it)
 	{
 		if (!it->name.IsString()) throw runtime_error("slot names must be string");
-		string slotName = it->name.GetString();
-		uint16_t slot = nameToSlot(slotName, templHead);
+		uint16_t slot = nameToSlot(NameId(it->name.GetString()), templHead);
 		parseJsonValueAndSet(it->value, slot, matHead, templHead);
 	}
+	if (templHead->flags & DEDUPLICATE) deduplicateMaterial(mat);
 	return mat;
 }
 
@@ -308,6 +419,46 @@ Material MaterialManager::createMaterial(MaterialTemplate materialTemplate)
 	return material;
 }
 
+void MaterialManager::createMaterials(MaterialTemplate materialTemplate, unsigned count, Material* materials)
+{
+	const uint16_t mtid = materialTemplate.getId();
+	const unsigned materialSize = accessMaterialTemplate(mtid)->materialSize;
+	const unsigned headerSize = sizeof(MaterialEntryHeader);
+	const char* defaultValues = (const char*)accessMaterialData(mtid, 0) + headerSize;
+	MaterialInstances& instances = *materialInstances[mtid];
+
+	lock_guard<mutex> lock(instances.mutex);
+	unsigned i = 0;
+	try
+	{
+		for (; i < count; i++)
+		{
+			const uint16_t mid = popFreeMaterialSlot(mtid, instances);
+			MaterialEntryHeader* matHead = accessMaterialData(mtid, mid);
+			memcpy((char*)matHead + headerSize, defaultValues, materialSize - headerSize);
+			matHead->header.sharedCount.store(1, memory_order_relaxed);
+			materials[i].id = ((uint32_t)mtid) << 16 | mid;
+		}
+	}
+	catch (const runtime_error&)
+	{
+		// out of slots, the ones taken are put back
+		while (i--)
+		{
+			const uint16_t mid = materials[i].getInstanceId();
+			accessMaterialData(mtid, mid)->nextFree = instances.nextFree;
+			instances.nextFree = (mid / MATERIAL_CHUNK_LENGTH) << 16 | (mid % MATERIAL_CHUNK_LENGTH);
+		}
+		throw;
+	}
+}
+
+void MaterialManager::releaseMaterials(const Material* materials, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++)
+		releaseMaterial(materials[i]);
+}
+
 Material MaterialManager::loadMaterial(const string& path)
 {
 	string txt = loadStringFromFile(path.c_str());
@@ -322,92 +473,135 @@ Material MaterialManager::loadMaterial(const string& path)
 	return res;
 }
 
+Material MaterialManager::shareMaterial(const Material& material)
+{
+	// the default value of the template is not reference counted
+	if (material.getInstanceId() != 0)
+		accessMaterialData(material.id)->header.sharedCount.fetch_add(1, memory_order_relaxed);
+	return material;
+}
+
 void MaterialManager::releaseMaterial(Material material)
 {
 	const uint32_t id = material.getId();
 	const uint16_t mtid = id >> 16;
 	const uint16_t mid = id & 0xFFFF;
-	const unsigned slotId = mid % MATERIAL_CHUNK_LENGTH;
-	const unsigned chunkId = mid / MATERIAL_CHUNK_LENGTH;
 	if (mid == 0)
 	{
 		// 0 corresponds tho the template default value which mustn not be released
 		return;
 	}
 
-	MaterialTemplateEntryHeader* templHead =  accessMaterialTemplate(mtid);
-	const unsigned materialSize = templHead->materialSize;
-
-	// insert in the free slot chain, last realeased -> fist reused
+	// the last reference frees the slot. acq_rel: the writes of the other owners happen before
 	MaterialEntryHeader* matHead = accessMaterialData(material.id);
-	uint32_t nextFree = matHead->nextFree;
-	matHead->nextFree = nextMaterialFreeSlot[mtid];
-	nextMaterialFreeSlot[mtid] = nextFree;
+	if (matHead->header.sharedCount.fetch_sub(1, memory_order_acq_rel) > 1) return;
+	freeMaterialSlot(mtid, mid);
 }
 
-string MaterialManager::getMaterialTemplateName(MaterialTemplate materialTemplate)const
+void MaterialManager::setDeduplication(MaterialTemplate materialTemplate, bool enabled)
 {
-	auto it = materialTemplateIdToName.find(materialTemplate.getId());
-	if (it == materialTemplateIdToName.end())
+	MaterialTemplateEntryHeader* head = accessMaterialTemplate(materialTemplate.getId());
+	MaterialInstances& instances = *materialInstances[materialTemplate.getId()];
+	lock_guard<mutex> lock(instances.mutex);
+	if (enabled)
 	{
-		throw runtime_error("the material template doesn't exist");
+		head->flags |= DEDUPLICATE;
+	}
+	else
+	{
+		head->flags &= ~DEDUPLICATE;
+		instances.dedup.clear();
 	}
-	return it->second;
 }
 
-bool MaterialManager::isUnique(const Material& mat)const
+bool MaterialManager::getDeduplication(MaterialTemplate materialTemplate)const
 {
-	const MaterialEntryHeader* matHead = accessMaterialData(mat.getId());
-	return matHead->header.sharedCount == 1;
+	return (accessMaterialTemplate(materialTemplate.getId())->flags & DEDUPLICATE) != 0;
 }
 
-void MaterialManager::makeUnique(Material& material)
+void MaterialManager::deduplicateMaterial(Material& material)
 {
-	uint32_t id = material.id;
-	uint16_t mtid = id >> 16;
-	uint16_t mid = id;
+	const uint16_t mtid = material.getTemplateId();
+	const uint16_t mid = material.getInstanceId();
+	if (mid == 0) return;	// the default value is already shared
 
-	MaterialManager::MaterialTemplateEntryHeader* header =
-		accessMaterialTemplate(mtid);
+	const unsigned valuesSize = accessMaterialTemplate(mtid)->materialSize - sizeof(MaterialEntryHeader);
+	const char* values = (const char*)&accessMaterialData(mtid, mid)[1];
+	const uint64_t hash = hashMaterialValues(mtid, mid);
+	MaterialInstances& instances = *materialInstances[mtid];
+	uint16_t sharedMid = 0;
+	{
+		lock_guard<mutex> lock(instances.mutex);
+		auto it = instances.dedup.find(hash);
+		if (it == instances.dedup.end())
+		{
+			instances.dedup.insert(make_pair(hash, mid));
+			return;
+		}
+		if (it->second == mid) return;
+
+		// the count is 0 if it's being released, then it can't be shared
+		MaterialEntryHeader* other = accessMaterialData(mtid, it->second);
+		uint32_t count = other->header.sharedCount.load(memory_order_relaxed);
+		if (memcmp(&other[1], values, valuesSize) == 0)
+		{
+			while (count != 0 &&
+				!other->header.sharedCount.compare_exchange_weak(count, count + 1, memory_order_relaxed));
+		}
+		else
+		{
+			count = 0;
+		}
+
+		if (count == 0)
+		{
+			// the registered one was modified or is being released
+			it->second = mid;
+			return;
+		}
+		sharedMid = it->second;
+	}
+	releaseMaterial(material);
+	material.id = ((uint32_t)mtid) << 16 | sharedMid;
+}
 
-	MaterialTemplateEntrySlot* slots = (MaterialTemplateEntrySlot*) &header[1];
+uint64_t MaterialManager::hashMaterialValues(uint16_t mtid, uint16_t mid)const
+{
+	const unsigned valuesSize = accessMaterialTemplate(mtid)->materialSize - sizeof(MaterialEntryHeader);
+	return fnv1a64(&accessMaterialData(mtid, mid)[1], valuesSize);
+}
 
-	const unsigned materialSize = header->materialSize;
-	vector<void*>& chunks = materialDataChunks[mtid];
+string MaterialManager::getMaterialTemplateName(MaterialTemplate materialTemplate)const
+{
+	lock_guard<mutex> lock(templatesMutex);
+	const uint16_t mtid = materialTemplate.getId();
+	if (mtid >= materialTemplateIdToName.size() || materialTemplateIdToName[mtid].empty())
+	{
+		throw runtime_error("the material template doesn't exist");
+	}
+	return materialTemplateIdToName[mtid];
+}
 
-	uint32_t srcSlotIndex = mid % MATERIAL_CHUNK_LENGTH;
-	uint32_t srcChunkIndex = mid / MATERIAL_CHUNK_LENGTH;
-	char* srcChunk = (char*)chunks[srcChunkIndex];
-	char* pSrcSlot = &srcChunk[materialSize * srcSlotIndex];
-	MaterialEntryHeader* srcSlotHeader = (MaterialEntryHeader*)pSrcSlot;
+bool MaterialManager::isUnique(const Material& mat)const
+{
+	const MaterialEntryHeader* matHead = accessMaterialData(mat.getId());
+	return matHead->header.sharedCount.load(memory_order_acquire) == 1;
+}
 
+void MaterialManager::makeUnique(Material& material)
+{
 	// the material with mid 0 is the deafult value of the template
 	// we don't want to reference count that one because it must always be there for fast copying
-	if (mid != 0 && srcSlotHeader->header.sharedCount < 2)
+	if (material.getInstanceId() != 0 && isUnique(material))
 	{
 		assert(false && "the material was already unique");
 		return;
 	}
-	
-	// we use 0 for saying "there aren't free slots" because 0 is never free
-	// 0 is reserved for the template default value and should never be realeased
-	if ((uint16_t)nextMaterialFreeSlot[mtid] == 0) allocateNewMaterialChunk(mtid);
-
-	uint32_t newMaterialSlot = nextMaterialFreeSlot[mtid];
-	uint32_t slotIndex = newMaterialSlot & 0xFFFF;
-	uint32_t chunkIndex = newMaterialSlot >> 16;
-	char* dstChunk = (char*)chunks[chunkIndex];
-	char* pDstSlot = &dstChunk[materialSize * slotIndex];
-	MaterialEntryHeader* dstSlotHeader = (MaterialEntryHeader*)pDstSlot;
-	nextMaterialFreeSlot[mtid] = dstSlotHeader->nextFree;
-
-	const unsigned headerSize = sizeof(unsigned);
-	memcpy(pDstSlot + headerSize, pSrcSlot + headerSize, materialSize - headerSize);
 
-	srcSlotHeader->header.sharedCount--;
-	dstSlotHeader->header.sharedCount = 1;
-
-	material.id = mtid | (chunkIndex * MATERIAL_CHUNK_LENGTH + slotIndex);
+	// the copy is done before releasing the reference, so the other owners can't modify the data yet
+	Material unique = duplicateMaterialAndMakeUnique(material.id);
+	releaseMaterial(material);
+	material = unique;
 }
 
 const MaterialManager::MaterialTemplateEntryHeader* MaterialManager::accessMaterialTemplate(std::uint16_t mtid)const
@@ -432,6 +626,7 @@ MaterialManager::MaterialTemplateEntryHeader* MaterialManager::allocateMaterialT
 	const unsigned requiredSpace = sizeof(MaterialTemplateEntryHeader) + numSlots * sizeof(MaterialTemplateEntrySlot);
 	const unsigned chunkSize = MATERIAL_TEMPLATE_CHUNK_SIZE;
 	if (requiredSpace > chunkSize) throw runtime_error("too many slots for material template");
+	if (materialTemplateOffsets.size() >= MAX_MATERIAL_TEMPLATES) throw runtime_error("too many material templates");
 
 	unsigned remainingSpaceInChunk = chunkSize - nextMaterialTemplateOffset;
 	if (remainingSpaceInChunk < requiredSpace)
@@ -440,19 +635,21 @@ MaterialManager::MaterialTemplateEntryHeader* MaterialManager::allocateMaterialT
 		nextMaterialTemplateOffset = (materialTemplateDataChunks.size() - 1) * chunkSize;
 	}
 
+	const uint16_t mtid = materialTemplateOffsets.size();
 	materialTemplateOffsets.push_back(nextMaterialTemplateOffset);
 
 	nextMaterialTemplateOffset += requiredSpace;
+	return accessMaterialTemplate(mtid);
 }
 
 const MaterialManager::MaterialEntryHeader* MaterialManager::accessMaterialData(uint16_t mtid, uint16_t mid)const
 {
-	const vector<void*>& v = materialDataChunks[mtid];
+	const MaterialInstances& instances = *materialInstances[mtid];
 	const unsigned n = MATERIAL_CHUNK_LENGTH;
 	const MaterialTemplateEntryHeader* tempHead = accessMaterialTemplate(mtid);
 	uint32_t materialSize = tempHead->materialSize;
 	unsigned chunkId = mid / n;
-	char* chunk = (char*)v[chunkId];
+	char* chunk = (char*)instances.chunks[chunkId];
 	unsigned index = mid % n;
 	char* data = chunk + materialSize * index;
 	return (MaterialEntryHeader*)data;
@@ -480,74 +677,93 @@ MaterialManager::MaterialEntryHeader* MaterialManager::accessMaterialData(uint16
 		);
 }
 
-void MaterialManager::allocateNewMaterialChunk(uint16_t mtid)
+void MaterialManager::allocateNewMaterialChunk(MaterialInstances& instances, uint32_t materialSize)
 {
-	assert((uint16_t)nextMaterialFreeSlot[mtid] == MATERIAL_CHUNK_LENGTH &&
+	assert(instances.nextFree == 0 &&
 		"this must be called only if we have run out of memory");
+	if (instances.numChunks == MAX_MATERIAL_CHUNKS)
+		throw runtime_error("too many materials for the material template");
 
-	MaterialManager::MaterialTemplateEntryHeader* header =
-		accessMaterialTemplate(mtid);
-
-	const unsigned materialSlotSize = header->materialSize;
-	const uint32_t chunkId = materialDataChunks[mtid].size() << 16;
+	const unsigned materialSlotSize = materialSize;
+	const uint32_t chunkId = instances.numChunks << 16;
 
-	char* data = new char[materialSlotSize * MATERIAL_CHUNK_LENGTH];
-	materialDataChunks[mtid].push_back(data);
+	char* data = MemTracker::newArray<char>(MemTag::MATERIAL, materialSlotSize * MATERIAL_CHUNK_LENGTH);
+	instances.chunks[instances.numChunks] = data;
+	instances.numChunks++;
 
-	for (unsigned i = 0; i < MATERIAL_CHUNK_LENGTH-1; i++)
-	{
-		MaterialEntryHeader* header =
-			(MaterialEntryHeader*) (&data[i * materialSlotSize]);
-		header->nextFree = chunkId | (i + 1);
-	}
+	for (unsigned i = 0; i < MATERIAL_CHUNK_LENGTH; i++)
 	{
-		MaterialEntryHeader* header =
-			(MaterialEntryHeader*)(&data[(MATERIAL_CHUNK_LENGTH-1) * materialSlotSize]);
-		header->nextFree = 0;
+		MaterialEntryHeader* header = new (&data[i * materialSlotSize]) MaterialEntryHeader;
+		header->header.sharedCount.store(0, memory_order_relaxed);
+		header->nextFree = i + 1 < MATERIAL_CHUNK_LENGTH ? chunkId | (i + 1) : 0;
 	}
 
-	nextMaterialFreeSlot[mtid] = chunkId;
+	instances.nextFree = chunkId;
 }
 
 void MaterialManager::allocateNewMaterialTemplateChunk()
 {
-	void* chunk = new char[MATERIAL_CHUNK_LENGTH];
+	if (materialTemplateDataChunks.size() == MAX_MATERIAL_TEMPLATE_CHUNKS)
+		throw runtime_error("out of memory for material templates");
+	void* chunk = MemTracker::newArray<char>(MemTag::MATERIAL, MATERIAL_TEMPLATE_CHUNK_SIZE);
 	materialTemplateDataChunks.push_back(chunk);
 }
 
-Material MaterialManager::duplicateMaterialAndMakeUnique(std::uint32_t id)
+uint16_t MaterialManager::allocateMaterialSlot(uint16_t mtid)
 {
-	const uint16_t mtid = id >> 16;
-	const uint16_t mid = id & 0xFFFF;
-
-	MaterialTemplateEntryHeader* templHead = accessMaterialTemplate(mtid);
-	const unsigned materialSize = templHead->materialSize;
-
-	vector<void*>& chunks = materialDataChunks[mtid];
-	uint32_t srcSlotIndex = mid % MATERIAL_CHUNK_LENGTH;
-	uint32_t srcChunkIndex = mid / MATERIAL_CHUNK_LENGTH;
-	char* srcChunk = (char*)chunks[srcChunkIndex];
-	char* pSrcSlot = &srcChunk[materialSize * srcSlotIndex];
-	MaterialEntryHeader* srcSlotHeader = (MaterialEntryHeader*)pSrcSlot;
+	MaterialInstances& instances = *materialInstances[mtid];
+	lock_guard<mutex> lock(instances.mutex);
+	return popFreeMaterialSlot(mtid, instances);
+}
 
+uint16_t MaterialManager::popFreeMaterialSlot(uint16_t mtid, MaterialInstances& instances)
+{
 	// we use 0 for saying "there aren't free slots" because 0 is never free
 	// 0 is reserved for the template default value and should never be realeased
-	if ((uint16_t)nextMaterialFreeSlot[mtid] == 0) allocateNewMaterialChunk(mtid);
+	if (instances.nextFree == 0)
+		allocateNewMaterialChunk(instances, accessMaterialTemplate(mtid)->materialSize);
+
+	const uint32_t slot = instances.nextFree;
+	const uint16_t mid = (slot >> 16) * MATERIAL_CHUNK_LENGTH + (slot & 0xFFFF);
+	instances.nextFree = accessMaterialData(mtid, mid)->nextFree;
+	return mid;
+}
+
+void MaterialManager::freeMaterialSlot(uint16_t mtid, uint16_t mid)
+{
+	MaterialInstances& instances = *materialInstances[mtid];
+	MaterialEntryHeader* matHead = accessMaterialData(mtid, mid);
+	const bool dedup = (accessMaterialTemplate(mtid)->flags & DEDUPLICATE) != 0;
+	const uint64_t hash = dedup ? hashMaterialValues(mtid, mid) : 0;
+	lock_guard<mutex> lock(instances.mutex);
+
+	// if it was modified after being registered the entry stays, but the values won't match
+	if (dedup)
+	{
+		auto it = instances.dedup.find(hash);
+		if (it != instances.dedup.end() && it->second == mid) instances.dedup.erase(hash);
+	}
+
+	// insert in the free slot chain, last realeased -> fist reused
+	matHead->nextFree = instances.nextFree;
+	instances.nextFree = (mid / MATERIAL_CHUNK_LENGTH) << 16 | (mid % MATERIAL_CHUNK_LENGTH);
+}
+
+Material MaterialManager::duplicateMaterialAndMakeUnique(std::uint32_t id)
+{
+	const uint16_t mtid = id >> 16;
+	const unsigned materialSize = accessMaterialTemplate(mtid)->materialSize;
 
-	uint32_t newMaterialSlot = nextMaterialFreeSlot[mtid];
-	uint32_t slotIndex = newMaterialSlot & 0xFFFF;
-	uint32_t chunkIndex = newMaterialSlot >> 16;
-	char* dstChunk = (char*)chunks[chunkIndex];
-	char* pDstSlot = &dstChunk[materialSize * slotIndex];
+	const uint16_t newMid = allocateMaterialSlot(mtid);
+	const char* pSrcSlot = (const char*)accessMaterialData(id);
+	char* pDstSlot = (char*)accessMaterialData(mtid, newMid);
 	MaterialEntryHeader* dstSlotHeader = (MaterialEntryHeader*)pDstSlot;
-	nextMaterialFreeSlot[mtid] = dstSlotHeader->nextFree;
 
-	const unsigned headerSize = sizeof(unsigned);
+	const unsigned headerSize = sizeof(MaterialEntryHeader);
 	memcpy(pDstSlot + headerSize, pSrcSlot + headerSize, materialSize - headerSize);
 
-	dstSlotHeader->header.sharedCount = 1;
+	dstSlotHeader->header.sharedCount.store(1, memory_order_relaxed);
 
-	uint32_t newMid = slotIndex + MATERIAL_CHUNK_LENGTH * chunkIndex;
 	Material material;
 	material.id = ((uint32_t)mtid) << 16 | newMid;
 	return material;
@@ -555,15 +771,21 @@ Material MaterialManager::duplicateMaterialAndMakeUnique(std::uint32_t id)
 
 void MaterialManager::useMaterial(const Material& material)
 {
+	TUKI_PROFILE_SCOPE("MaterialManager::useMaterial");
 	uint16_t mtid = material.id >> 16;
 	uint16_t mid = (uint16_t)material.id;
 	MaterialTemplateEntryHeader* head = accessMaterialTemplate(mtid);
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::MATERIAL_USE) << material.id << (uint8_t)0;
 	head->shaderProgram.use();
+	PipelineState::apply(head->pipelineState);
 	useMaterialBatched(mtid, mid);
 }
 
 void MaterialManager::useMaterialBatched(const Material& material)
 {
+	if (RenderCapture::isCapturing())
+		RenderCapture::Record(CaptureCmd::MATERIAL_USE) << material.id << (uint8_t)1;
 	uint16_t mtid = material.id >> 16;
 	uint16_t mid = (uint16_t)material.id;
 	useMaterialBatched(mtid, mid);
@@ -572,7 +794,7 @@ void MaterialManager::useMaterialBatched(const Material& material)
 void MaterialManager::useMaterialBatched(uint16_t mtid, uint16_t mid)
 {
 	MaterialTemplateEntryHeader* templHead = accessMaterialTemplate(mtid);
-	MaterialEntryHeader* matHead = accessMaterialData(mid);
+	MaterialEntryHeader* matHead = accessMaterialData(mtid, mid);
 	const unsigned n = templHead->numSlots;
 	MaterialTemplateEntrySlot* templSlots = (MaterialTemplateEntrySlot*)&templHead[1];
 	ShaderProgram& prog = templHead->shaderProgram;
@@ -585,7 +807,20 @@ void MaterialManager::useMaterialBatched(uint16_t mtid, uint16_t mid)
 		unsigned loc = templSlots[slot].unifLoc;
 		char* slotData = data + offset;
 
-		prog.uploadUniformData(type, loc, slotData);
+		if (type == UnifType::TEXTURE)
+		{
+			// the sampler already has the unit
+			TextureManager* texMan = TextureManager::getSingleton();
+			texMan->bind(*(const TextureHandle*)slotData, templSlots[slot].texUnit);
+		}
+		else if (templSlots[slot].instanceOffset != NOT_PER_INSTANCE)
+		{
+			InstanceBuffer::setConstant((int16_t)loc, type, slotData);
+		}
+		else
+		{
+			prog.uploadUniformData(type, loc, slotData);
+		}
 	}
 }
 
@@ -600,7 +835,7 @@ void parseJsonArrayAndSet(
 	const Value::ConstArray& a
 )
 {
-	static int xdata[64];
+	int xdata[64];
 
 	UnifType basicType = getUnifBasicType(type);
 	unsigned n = getUnifNumElems(type);
@@ -680,62 +915,93 @@ void MaterialManager::parseJsonValueAndSet(
 
 	if (type == UnifType::FLOAT)
 	{
-		if (!val.IsFloat()) throw runtime_error(templSlots[slot].name + string(" must be float"));
+		if (!val.IsFloat()) throw runtime_error(templSlots[slot].name.toString() + " must be float");
 
 		float x[1] = { val.GetFloat() };
 		copy(x, &x[1], data);
 	}
 	else if (type == UnifType::INT)
 	{
-		if(!val.IsInt()) throw runtime_error(templSlots[slot].name + string(" must be int"));
+		if(!val.IsInt()) throw runtime_error(templSlots[slot].name.toString() + " must be int");
 
 		int x[1] = { val.GetInt() };
 		copy(x, &x[1], data);
 	}
 	else if (type == UnifType::UINT)
 	{
-		if (!val.IsUint()) throw runtime_error(templSlots[slot].name + string(" must be unisgned"));
+		if (!val.IsUint()) throw runtime_error(templSlots[slot].name.toString() + " must be unisgned");
 
 		unsigned x[1] = { val.GetUint() };
 		copy(x, &x[1], data);
 	}
 	else if (type == UnifType::TEXTURE)
 	{
-		// TODO: texture manager
+		// path of the texture or name of a constant texture
+		if (!val.IsString()) throw runtime_error(templSlots[slot].name.toString() + " must be a texture path");
+
+		TextureManager* texMan = TextureManager::getSingleton();
+		TextureHandle x[1] = { texMan->loadTexture(val.GetString()) };
+		copy(x, &x[1], (TextureHandle*)data);
 	}
 	else	// vectors and materices
 	{
-		if (!val.IsArray()) throw runtime_error(templSlots[slot].name + string(" must be an array"));
+		if (!val.IsArray()) throw runtime_error(templSlots[slot].name.toString() + " must be an array");
 		Value::ConstArray a = val.GetArray();
 		parseJsonArrayAndSet(data, type, a);
 	}
 
 }
 
-// performs a binary search because slots are sorted by name
-uint16_t MaterialManager::nameToSlot(const string& name, MaterialTemplateEntryHeader* head)const
+// performs a binary search because slots are sorted by name id
+uint16_t MaterialManager::nameToSlot(NameId name, const MaterialTemplateEntryHeader* head)const
 {
 	const MaterialTemplateEntrySlot* slots = (const MaterialTemplateEntrySlot*)&head[1];
-	const unsigned n = head->numSlots;
-	unsigned i, j, ij;
+	const int n = head->numSlots;
+	int i, j, ij;
 	i = 0;
 	j = n - 1;
 	while (i <= j)
 	{
 		ij = (i + j) / 2;
-		string ijName = slots[ij].name;
-		if (name == ijName) return ij;
+		if (name == slots[ij].name) return ij;
 		else
 		{
-			if (name < ijName) j = ij - 1;
-			else			   i = ij + 1;
+			if (name < slots[ij].name) j = ij - 1;
+			else					   i = ij + 1;
 		}
 	}
-	throw runtime_error("slot name '" + name + "' does not exist");
+	throw runtime_error("slot name '" + name.toString() + "' does not exist");
+}
+
+bool MaterialManager::isPerInstanceSlot(MaterialTemplate materialTemplate, unsigned slot)const
+{
+	const MaterialTemplateEntryHeader* head = accessMaterialTemplate(materialTemplate.id);
+	assert(slot < head->numSlots);
+	const MaterialTemplateEntrySlot* slots = (const MaterialTemplateEntrySlot*)&head[1];
+	return slots[slot].instanceOffset != NOT_PER_INSTANCE;
+}
+
+unsigned MaterialManager::getInstanceSize(MaterialTemplate materialTemplate)const
+{
+	return accessMaterialTemplate(materialTemplate.id)->instanceSize;
+}
+
+int MaterialManager::getSlotIndex(MaterialTemplate materialTemplate, NameId slotName)const
+{
+	const MaterialTemplateEntryHeader* head = accessMaterialTemplate(materialTemplate.getId());
+	try
+	{
+		return nameToSlot(slotName, head);
+	}
+	catch (const runtime_error&)
+	{
+		return -1;
+	}
 }
 
 void MaterialManager::bindMaterialTemplateProgram(MaterialTemplate& templ)
 {
 	MaterialTemplateEntryHeader* head = accessMaterialTemplate(templ.id);
 	head->shaderProgram.use();
+	PipelineState::apply(head->pipelineState);
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <vector>
-#include <map>
 #include <string>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
@@ -9,9 +8,16 @@
 #include <stdint.h>
 #include <rapidjson/fwd.h>
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cassert>
 
 #include "../gl/shader.hpp"
+#include "../gl/pipeline_state.hpp"
 #include "../../util/singleton.hpp"
+#include "../../util/flat_hash_map.hpp"
+#include "../../util/name_id.hpp"
 
 class MaterialManager;
 
@@ -20,12 +26,14 @@ class MaterialManager;
 class MaterialTemplate
 {
 	friend class MaterialManager;
+	friend class MaterialPack;
 public:
 	MaterialTemplate() {}
 
 	std::uint16_t getId()const;
 	std::string getName()const;
 	ShaderProgram getShaderProg()const;
+	PipelineStateId getPipelineState()const;
 
 	void bindProgram();
 
@@ -42,6 +50,8 @@ private:
 class Material
 {
 	friend class MaterialManager;
+	friend class MaterialPack;
+	friend class MaterialInstanceBuffer;
 public:
 
 	Material() {}
@@ -52,11 +62,15 @@ public:
 	std::uint16_t getInstanceId()const { return id & 0x0000FFFF; }
 	std::uint32_t getId()const { return id; }
 	ShaderProgram getShaderProg()const;
+	PipelineStateId getPipelineState()const;
 
 	template <typename T>
 	void setValue(unsigned slot, T val);
 
-	// use this material for drawing, the material template program will be bound automatically
+	template <typename T>
+	T getValue(unsigned slot)const;
+
+	// use this material for drawing, the material template program and pipeline state will be set automatically
 	void use();
 
 	// use this material fro drawing, the material template program has to be bound
@@ -75,16 +89,27 @@ private:
 
 };
 
-// manages the materials, material templates and shaders, avoids duplicates
+/* manages the materials, material templates and shaders, avoids duplicates
+ Thread safety:
+ - the material templates are created in the thread of the GL context (they compile shaders),
+   their lookups by path can be done from any thread
+ - the template headers and the material data never move, so they are read without locking
+ - creating, loading (if the template is loaded), sharing, making unique and releasing
+   materials can be done from any thread. Each template has its own free list and lock
+ - a material can be modified only by the thread that owns it, the uniforms are uploaded in the
+   GL thread */
 class MaterialManager : public Singleton<MaterialManager>
 {
 public:
 	
 	ShaderProgram getMaterialTemplateShaderProgram(MaterialTemplate materialTemplate)const;
 	ShaderProgram getMaterialShaderProgram(Material material)const;
+	// the pipeline state of the template: "pipeline" in the template file, PIPELINE_STATE_INHERIT if it doesn't have it
+	PipelineStateId getMaterialTemplatePipelineState(MaterialTemplate materialTemplate)const;
+	PipelineStateId getMaterialPipelineState(Material material)const;
 
 	// get the material template if loaded, otherwise the id will be -1
-	MaterialTemplate getMaterialTemplate(const std::string& path)const;
+	MaterialTemplate getMaterialTemplate(NameId path)const;
 
 	// load the material file from a file, if has been already loaded returns the same object
 	MaterialTemplate loadMaterialTemplate(const std::string& path);
@@ -93,20 +118,58 @@ public:
 
 	Material createMaterial(MaterialTemplate materialTemplate);
 	Material loadMaterial(const std::string& path);
+	// from a parsed material file. It doesn't allocate once the template is loaded
+	Material loadMaterial(rapidjson::Document& doc);
+
+	// creates count unique materials with the default values, taking the lock of the template once
+	void createMaterials(MaterialTemplate materialTemplate, unsigned count, Material* materials);
+	void releaseMaterials(const Material* materials, unsigned count);
 
+	// another reference to the same data, it has to be released too
+	Material shareMaterial(const Material& material);
 	void releaseMaterial(Material material);
 
 	std::string getMaterialTemplateName(MaterialTemplate materialTemplate)const;
 
+	// index of the slot with that name, -1 if the template doesn't have it
+	int getSlotIndex(MaterialTemplate materialTemplate, NameId slotName)const;
+
+	/* Per-instance slots: "perInstance": true in the slot of the template file
+	 In the vertex shader they are attributes with the name of the slot instead of uniforms. When the
+	 material is used they get its value, and a MaterialInstanceBuffer gives each instance of an
+	 instanced draw its own value, so many objects can share the material and the draw call */
+	bool isPerInstanceSlot(MaterialTemplate materialTemplate, unsigned slot)const;
+	// bytes of the values of the per-instance slots of an instance, 0 if there are none
+	unsigned getInstanceSize(MaterialTemplate materialTemplate)const;
+
 	bool isUnique(const Material& mat)const;
 	void makeUnique(Material& material);
 
+	/* Deduplication of the materials of a template by the hash of their values
+	 When it's enabled the loaded materials with the same values share the data (copy on write),
+	 the materials created at runtime can be deduplicated with deduplicateMaterial after setting
+	 their values. It can be enabled in the template file too: "deduplicate": true */
+	void setDeduplication(MaterialTemplate materialTemplate, bool enabled);
+	bool getDeduplication(MaterialTemplate materialTemplate)const;
+	// if there is another material of the template with the same values, the material is
+	// released and replaced by a reference to that one. Otherwise it's registered for the next ones
+	void deduplicateMaterial(Material& material);
+
 	template <typename T>
 	void setMaterialValue(Material& material, unsigned slot, T val);
 
 	template <typename T>
 	void setMaterialValueUnsafe(const Material& material, unsigned slot, T val);
 
+	template <typename T>
+	T getMaterialValue(const Material& material, unsigned slot)const;
+
+	// sets the slot of count materials of the same template, the value of the material i is read
+	// from (const char*)values + i * stride. The shared materials are made unique
+	template <typename T>
+	void setMaterialValues(Material* materials, unsigned count, unsigned slot,
+		const T* values, std::size_t stride = sizeof(T));
+
 	void bindMaterialTemplateProgram(MaterialTemplate& templ);
 
 	void useMaterial(const Material& material);
@@ -116,17 +179,36 @@ public:
 private:
 
 	// DATA //
-	const unsigned MB = 1024 * 1024;
-	const unsigned MATERIAL_TEMPLATE_CHUNK_SIZE = 4 * MB;
-	const unsigned MATERIAL_CHUNK_LENGTH = 128;
+	static const unsigned MB = 1024 * 1024;
+	static const unsigned MATERIAL_TEMPLATE_CHUNK_SIZE = 4 * MB;
+	static const unsigned MATERIAL_CHUNK_LENGTH = 128;
+	// the storage is reserved so it never moves while other threads read it
+	static const unsigned MAX_MATERIAL_TEMPLATES = 0xFFFF;	// 0xFFFF is the invalid id
+	static const unsigned MAX_MATERIAL_TEMPLATE_CHUNKS = 64;
+	static const unsigned MAX_MATERIAL_CHUNKS = 0x10000 / MATERIAL_CHUNK_LENGTH;
+	static const unsigned MAX_MATERIAL_TEXTURE_UNITS = 16;	// the minimum that GL guarantees
+	static const std::uint16_t NOT_PER_INSTANCE = 0xFFFF;
+
+	// protects the creation of templates and the path tables
+	mutable std::mutex templatesMutex;
 
 	std::vector<void*> materialTemplateDataChunks;
 
-	/* Storage for the material values
-	 The outer vector has one entry for each material template
-	 The inner vector will have entries depending the necesary memory space
-	 The fist entry in the inner vector is the default value for the materials of the corresponding template */
-	std::vector<std::vector<void*> > materialDataChunks;
+	/* Storage for the material values of a template
+	 The chunks are allocated depending the necesary memory space and never move
+	 The fist entry of the fist chunk is the default value for the materials of the template
+	 The lock protects the free list and the allocation of chunks */
+	struct MaterialInstances
+	{
+		std::mutex mutex;
+		std::uint32_t nextFree;	// 16 most significant bits: chunkIndex, rest: chunkSlotIndex. 0: no free slots
+		unsigned numChunks;
+		void* chunks[MAX_MATERIAL_CHUNKS];
+		// hash of the values -> mid, for the deduplication. The values are compared before
+		// sharing because the owner of a unique material can modify it after it's registered
+		FlatHashMap<std::uint64_t, std::uint16_t> dedup;
+	};
+	std::vector<MaterialInstances*> materialInstances;	// one for each material template
 
 	/* Table for fast lookup of material template
 	 Given the material template id you get the offset to the first byte
@@ -136,52 +218,64 @@ private:
 	std::vector<unsigned> materialTemplateOffsets;
 	unsigned nextMaterialTemplateOffset;
 
-	std::map<std::string, std::uint16_t> materialTemplateNameToId;	// the name is actually the path
-	std::map<std::uint16_t, std::string> materialTemplateIdToName;
-
-	std::vector<std::uint32_t> nextMaterialFreeSlot;
+	FlatHashMap<NameId, std::uint16_t> materialTemplateNameToId;	// the name is actually the path
+	std::vector<std::string> materialTemplateIdToName;	// empty for the templates not loaded from a file
 
 	// TYPES //
-	struct MaterialTemplateEntryHeader
+	enum MaterialTemplateFlags : std::uint16_t
+	{
+		DEDUPLICATE = 1 << 0,
+	};
+	struct alignas(8) MaterialTemplateEntryHeader	// < the slots that follow it contain NameIds
 	{
 		ShaderProgram shaderProgram;
 		std::uint16_t numSlots;
 		std::uint16_t flags;
 		std::uint32_t materialSize;
+		PipelineStateId pipelineState;
+		std::uint16_t instanceSize;	// bytes of the per-instance slots
+		NameId shaders[3];	// paths of the vertex, fragment and geometry shaders, interned
 	};
-	struct MaterialTemplateEntrySlot	// < sorted by name!
+	struct MaterialTemplateEntrySlot	// < sorted by name id!
 	{
-		static const unsigned NAME_MAX_SIZE = 26;
 		UnifType type;		// type of the uniform
-		std::uint16_t unifLoc;	// uniform location
+		std::uint16_t unifLoc;	// uniform location, the attribute location for the per-instance slots
 		std::uint16_t offset;	// offset within the material
-		char name[NAME_MAX_SIZE];			// uniform name
+		std::uint16_t texUnit;	// texture unit of the TEXTURE slots, assigned when the template is created
+		std::uint16_t instanceOffset;	// offset within the values of an instance, NOT_PER_INSTANCE
+		NameId name;		// uniform name, interned
 	};
 
 	struct MaterialEntryHeader
 	{
-		union {
-			struct
-			{
-				//-HEADER-//
-				unsigned sharedCount;
-
-				//-BODY-//
-				// material values
-			}header;
-
-			std::uint32_t nextFree;	// 16 most significant bits: chunkIndex, rest: chunkSlotIndex
-		};
+		//-HEADER-//
+		struct
+		{
+			std::atomic<std::uint32_t> sharedCount;	// 0xFFFFFFFF for the template default value, 0 when free
+		}header;
+		// only meaningful while the slot is free. It's not in a union with sharedCount because
+		// deduplicateMaterial can read the count of a slot that has just been freed
+		std::uint32_t nextFree;	// 16 most significant bits: chunkIndex, rest: chunkSlotIndex
+
+		//-BODY-//
+		// material values
 	};
 
 	// FUNCTIONS //
 	friend class Singleton<MaterialManager>;
+	friend class MaterialPack;
+	friend class MaterialInstanceBuffer;
 	MaterialManager();
+	~MaterialManager();
 
 	ShaderProgram getMaterialTemplateShaderProgram(std::uint16_t mtid)const;
 
 	MaterialTemplate loadMaterialTemplate(rapidjson::Document& doc);
-	Material loadMaterial(rapidjson::Document& doc);
+	// the slots must be sorted by name id. The default values are zero
+	// perInstance can be null, otherwise nonzero for the per-instance slots
+	std::uint16_t createMaterialTemplate(
+		const std::string& vertShadName, const std::string& fragShadName, const std::string& geomShadName,
+		unsigned numSlots, const NameId* slotNames, const UnifType* types, const std::uint8_t* perInstance = nullptr);
 
 	Material duplicateMaterialAndMakeUnique(std::uint32_t id);
 	Material duplicateMaterialAndMakeUnique(Material material);
@@ -195,7 +289,13 @@ private:
 	const MaterialEntryHeader* accessMaterialData(std::uint16_t mtid, std::uint16_t mid)const;
 	const MaterialEntryHeader* accessMaterialData(std::uint32_t id)const;
 
-	void allocateNewMaterialChunk(std::uint16_t mtid);
+	void allocateNewMaterialChunk(MaterialInstances& instances, std::uint32_t materialSize);
+	// returns the mid of a free slot / puts it back in the free list
+	std::uint16_t allocateMaterialSlot(std::uint16_t mtid);
+	// the same with the lock of the instances already taken
+	std::uint16_t popFreeMaterialSlot(std::uint16_t mtid, MaterialInstances& instances);
+	void freeMaterialSlot(std::uint16_t mtid, std::uint16_t mid);
+	std::uint64_t hashMaterialValues(std::uint16_t mtid, std::uint16_t mid)const;
 	void allocateNewMaterialTemplateChunk();
 
 	void parseJsonValueAndSet(
@@ -205,7 +305,7 @@ private:
 		MaterialTemplateEntryHeader* templHead
 	);
 
-	uint16_t nameToSlot(const std::string& name, MaterialTemplateEntryHeader* head)const;
+	uint16_t nameToSlot(NameId name, const MaterialTemplateEntryHeader* head)const;
 
 
 };
@@ -232,11 +332,53 @@ void MaterialManager::setMaterialValueUnsafe(const Material& material, unsigned
 	uint16_t mtid = material.getTemplateId();
 	uint16_t mid = material.getInstanceId();
 	MaterialTemplateEntryHeader* tempHead = accessMaterialTemplate(mtid);
-	MaterialTemplateEntrySlot* tempSlot = (MaterialTemplateEntrySlot*)tempHead[1];
+	MaterialTemplateEntrySlot* tempSlot = (MaterialTemplateEntrySlot*)&tempHead[1];
 	tempSlot = &tempSlot[slot];
 	unsigned slotOffset = tempSlot->offset;
 	MaterialEntryHeader* matHead = accessMaterialData(mtid, mid);
 	char* data = (char*)&matHead[1];
 	data = data + slotOffset;
 	*((T*)data) = val;
-}
\ No newline at end of file
+}
+
+template <typename T>
+void MaterialManager::setMaterialValues(Material* materials, unsigned count, unsigned slot,
+	const T* values, std::size_t stride)
+{
+	if (count == 0) return;
+	const uint16_t mtid = materials[0].getTemplateId();
+	const MaterialTemplateEntryHeader* tempHead = accessMaterialTemplate(mtid);
+	const MaterialTemplateEntrySlot* tempSlot = (const MaterialTemplateEntrySlot*)&tempHead[1];
+	assert(slot < tempHead->numSlots && getUnifSize(tempSlot[slot].type) == sizeof(T));
+	const unsigned offset = sizeof(MaterialEntryHeader) + tempSlot[slot].offset;
+	const unsigned materialSize = tempHead->materialSize;
+	const MaterialInstances& instances = *materialInstances[mtid];
+
+	const char* src = (const char*)values;
+	for (unsigned i = 0; i < count; i++, src += stride)
+	{
+		Material& material = materials[i];
+		assert(material.getTemplateId() == mtid && "the materials must have the same template");
+		if (!isUnique(material)) makeUnique(material);
+		const uint16_t mid = material.getInstanceId();
+		char* data = (char*)instances.chunks[mid / MATERIAL_CHUNK_LENGTH] + (mid % MATERIAL_CHUNK_LENGTH) * materialSize;
+		memcpy(data + offset, src, sizeof(T));
+	}
+}
+
+template <typename T>
+T Material::getValue(unsigned slot)const
+{
+	const MaterialManager* man = MaterialManager::getSingleton();
+	return man->getMaterialValue<T>(*this, slot);
+}
+
+template <typename T>
+T MaterialManager::getMaterialValue(const Material& material, unsigned slot)const
+{
+	const MaterialTemplateEntryHeader* tempHead = accessMaterialTemplate(material.getTemplateId());
+	const MaterialTemplateEntrySlot* tempSlot = (const MaterialTemplateEntrySlot*)&tempHead[1];
+	const MaterialEntryHeader* matHead = accessMaterialData(material.getTemplateId(), material.getInstanceId());
+	const char* data = (const char*)&matHead[1];
+	return *((const T*)(data + tempSlot[slot].offset));
+}
@@ -0,0 +1,98 @@
+#include "material_instance_buffer.hpp"
+
+#include <stdexcept>
+#include "../gl/render.hpp"
+#include "../../util/profiler.hpp"
+
+using namespace std;
+
+MaterialInstanceBuffer::MaterialInstanceBuffer()
+	: stride(0)
+	, numInstances(0)
+	, dirty(false)
+{
+	material.id = 0xFFFFFFFF;
+}
+
+MaterialInstanceBuffer::MaterialInstanceBuffer(Material material)
+	: MaterialInstanceBuffer()
+{
+	setMaterial(material);
+}
+
+void MaterialInstanceBuffer::setMaterial(Material material)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	typedef MaterialManager::MaterialTemplateEntryHeader TemplateHeader;
+	typedef MaterialManager::MaterialTemplateEntrySlot TemplateSlot;
+
+	const uint16_t mtid = material.getTemplateId();
+	const TemplateHeader* head = man->accessMaterialTemplate(mtid);
+	if (head->instanceSize == 0) throw runtime_error("the template of the material doesn't have per-instance slots");
+	const TemplateSlot* slots = (const TemplateSlot*)&head[1];
+	const char* values = (const char*)&man->accessMaterialData(material.getId())[1];
+
+	this->material = material;
+	stride = head->instanceSize;
+	defaultValues.resize(stride);
+	slotOffsets.assign(head->numSlots, -1);
+	slotSizes.assign(head->numSlots, 0);
+	attribs.clear();
+	for (unsigned i = 0; i < head->numSlots; i++)
+	{
+		const TemplateSlot& slot = slots[i];
+		slotSizes[i] = getUnifSize(slot.type);
+		if (slot.instanceOffset == MaterialManager::NOT_PER_INSTANCE) continue;
+		slotOffsets[i] = slot.instanceOffset;
+		memcpy(&defaultValues[slot.instanceOffset], values + slot.offset, slotSizes[i]);
+
+		InstanceAttrib attrib;
+		attrib.location = (int16_t)slot.unifLoc;
+		attrib.type = slot.type;
+		attrib.offset = slot.instanceOffset;
+		attribs.push_back(attrib);
+	}
+	numInstances = 0;
+	data.clear();
+	dirty = true;
+}
+
+unsigned MaterialInstanceBuffer::addInstance()
+{
+	const unsigned instance = numInstances;
+	resize(numInstances + 1);
+	return instance;
+}
+
+void MaterialInstanceBuffer::resize(unsigned numInstances)
+{
+	assert(stride > 0 && "the material is not set");
+	const unsigned prevNumInstances = this->numInstances;
+	data.resize((size_t)numInstances * stride);
+	for (unsigned i = prevNumInstances; i < numInstances; i++)
+		memcpy(&data[(size_t)i * stride], defaultValues.data(), stride);
+	this->numInstances = numInstances;
+	dirty = true;
+}
+
+void MaterialInstanceBuffer::upload()
+{
+	if (!dirty || numInstances == 0) return;
+	TUKI_PROFILE_SCOPE("MaterialInstanceBuffer::upload");
+	buffer.upload(data.data(), (size_t)numInstances * stride);
+	dirty = false;
+}
+
+void MaterialInstanceBuffer::draw(const IMeshGpu& mesh)
+{
+	if (numInstances == 0) return;
+	upload();
+	mesh.bind();
+	RenderApi::drawInstanced(mesh, numInstances, buffer, stride, attribs.data(), (unsigned)attribs.size());
+}
+
+void MaterialInstanceBuffer::free()
+{
+	buffer.free();
+	dirty = true;
+}
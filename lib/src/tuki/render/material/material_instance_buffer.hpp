@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include "material.hpp"
+#include "../gl/instance_buffer.hpp"
+#include "../gl/mesh_gpu.hpp"
+
+/* The values of the per-instance slots of a material for many instances
+ All the instances share the material (the rest of the slots) and are drawn with one instanced draw
+ call. The new instances have the values of the material. The material must be alive while it's
+ used here, it's not shared */
+class MaterialInstanceBuffer
+{
+public:
+	MaterialInstanceBuffer();
+	explicit MaterialInstanceBuffer(Material material);
+
+	// removes the instances
+	void setMaterial(Material material);
+	Material getMaterial()const { return material; }
+
+	// returns the index of the instance
+	unsigned addInstance();
+	void resize(unsigned numInstances);
+	void clear() { resize(0); }
+	unsigned getNumInstances()const { return numInstances; }
+	// bytes of each instance
+	unsigned getStride()const { return stride; }
+	const char* getData()const { return data.data(); }
+
+	// the slot must be per-instance
+	template <typename T>
+	void setValue(unsigned instance, unsigned slot, const T& val);
+	template <typename T>
+	T getValue(unsigned instance, unsigned slot)const;
+	// sets the slot of count instances, the value of the instance i is read from
+	// (const char*)values + i * valuesStride
+	template <typename T>
+	void setValues(unsigned firstInstance, unsigned count, unsigned slot,
+		const T* values, std::size_t valuesStride = sizeof(T));
+
+	// uploads the values if they changed, draw calls it
+	void upload();
+	// draws all the instances of the mesh in one call, the material must be in use
+	void draw(const IMeshGpu& mesh);
+
+	// frees the buffer in the GPU
+	void free();
+
+private:
+	char* accessValue(unsigned instance, unsigned slot, std::size_t size);
+
+	// DATA //
+	Material material;
+	unsigned stride;
+	unsigned numInstances;
+	bool dirty;
+	std::vector<char> data;
+	std::vector<char> defaultValues;	// the values of the material, the layout of an instance
+	std::vector<int> slotOffsets;		// offset in the instance of each slot, -1 if not per-instance
+	std::vector<unsigned> slotSizes;
+	std::vector<InstanceAttrib> attribs;
+	InstanceBuffer buffer;
+};
+
+inline char* MaterialInstanceBuffer::accessValue(unsigned instance, unsigned slot, std::size_t size)
+{
+	assert(instance < numInstances && slot < slotOffsets.size());
+	assert(slotOffsets[slot] >= 0 && "the slot is not per-instance");
+	assert(size == slotSizes[slot]);
+	(void)size;
+	return &data[(std::size_t)instance * stride + slotOffsets[slot]];
+}
+
+template <typename T>
+void MaterialInstanceBuffer::setValue(unsigned instance, unsigned slot, const T& val)
+{
+	memcpy(accessValue(instance, slot, sizeof(T)), &val, sizeof(T));
+	dirty = true;
+}
+
+template <typename T>
+T MaterialInstanceBuffer::getValue(unsigned instance, unsigned slot)const
+{
+	T val;
+	memcpy(&val, const_cast<MaterialInstanceBuffer*>(this)->accessValue(instance, slot, sizeof(T)), sizeof(T));
+	return val;
+}
+
+template <typename T>
+void MaterialInstanceBuffer::setValues(unsigned firstInstance, unsigned count, unsigned slot,
+	const T* values, std::size_t valuesStride)
+{
+	if (count == 0) return;
+	assert(firstInstance + count <= numInstances);
+	char* dst = accessValue(firstInstance, slot, sizeof(T));
+	const char* src = (const char*)values;
+	for (unsigned i = 0; i < count; i++)
+	{
+		memcpy(dst, src, sizeof(T));
+		dst += stride;
+		src += valuesStride;
+	}
+	dirty = true;
+}
@@ -0,0 +1,384 @@
+#include "material_pack.hpp"
+
+#include "../texture/texture_manager.hpp"
+#include "../../util/util.hpp"
+#include "../../util/vfs.hpp"
+#include "../../util/mallocr/mallocr_arena.hpp"
+#include <rapidjson/document.h>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <mutex>
+
+using namespace std;
+using namespace rapidjson;
+
+static const char MATERIAL_PACK_MAGIC[4] = { 'T', 'K', 'M', 'P' };
+
+namespace
+{
+
+class PackWriter
+{
+public:
+	vector<char> data;
+	vector<char> strings;
+
+	void align()
+	{
+		while (data.size() % MATERIAL_PACK_ALIGNMENT) data.push_back(0);
+	}
+
+	uint64_t append(const void* p, size_t size)
+	{
+		align();
+		const uint64_t offset = data.size();
+		data.insert(data.end(), (const char*)p, (const char*)p + size);
+		return offset;
+	}
+
+	uint32_t addString(const char* str)
+	{
+		const NameId id(str);
+		auto it = stringOffsets.find(id);
+		if (it != stringOffsets.end()) return it->second;
+		const uint32_t offset = (uint32_t)strings.size();
+		strings.insert(strings.end(), str, str + strlen(str) + 1);
+		stringOffsets[id] = offset;
+		return offset;
+	}
+
+private:
+	FlatHashMap<NameId, uint32_t> stringOffsets;
+};
+
+}
+
+// MATERIAL PACK
+
+MaterialPack::MaterialPack(const string& fileName)
+{
+	load(fileName);
+}
+
+void MaterialPack::load(const string& fileName)
+{
+	free();
+	const VfsFile f = Vfs::getSingleton()->map(fileName);
+	const char* base = (const char*)f.getData();
+	const uint64_t fileSize = f.getSize();
+	const MaterialPackHeader* h = (const MaterialPackHeader*)base;
+
+	if (fileSize < sizeof(MaterialPackHeader) || memcmp(h->magic, MATERIAL_PACK_MAGIC, sizeof(h->magic)) != 0)
+	{
+		throw runtime_error(fileName + " is not a material pack");
+	}
+	if (h->version != MATERIAL_PACK_VERSION)
+	{
+		throw runtime_error(fileName + " has an unsupported material pack version");
+	}
+
+	auto checkRange = [&](uint64_t offset, uint64_t size)
+	{
+		if (offset % MATERIAL_PACK_ALIGNMENT != 0 || offset > fileSize || size > fileSize - offset)
+		{
+			throw runtime_error(fileName + " is corrupted");
+		}
+	};
+	checkRange(h->templatesOffset, (uint64_t)h->numTemplates * sizeof(MaterialPackTemplate));
+	checkRange(h->materialsOffset, (uint64_t)h->numMaterials * sizeof(MaterialPackMaterial));
+	checkRange(h->stringsOffset, h->stringsSize);
+	const char* strings = base + h->stringsOffset;
+	if (h->stringsSize == 0 || strings[h->stringsSize - 1] != 0)
+	{
+		throw runtime_error(fileName + " is corrupted");
+	}
+	auto getString = [&](uint32_t offset) -> const char*
+	{
+		if (offset >= h->stringsSize) throw runtime_error(fileName + " is corrupted");
+		return strings + offset;
+	};
+
+	MaterialManager* man = MaterialManager::getSingleton();
+	TextureManager* texMan = TextureManager::getSingleton();
+	typedef MaterialManager::MaterialTemplateEntryHeader TemplateHeader;
+	typedef MaterialManager::MaterialTemplateEntrySlot TemplateSlot;
+	typedef MaterialManager::MaterialEntryHeader MaterialHeader;
+	const unsigned headerSize = sizeof(MaterialHeader);
+
+	// the texture slots have the offset of the path in the string table
+	vector<vector<uint16_t> > textureOffsets(h->numTemplates);
+	auto resolveTextures = [&](char* matHead, unsigned templateIndex)
+	{
+		for (uint16_t offset : textureOffsets[templateIndex])
+		{
+			TextureHandle* handle = (TextureHandle*)(matHead + headerSize + offset);
+			*handle = texMan->loadTexture(getString(*handle));
+		}
+	};
+
+	// templates
+	const MaterialPackTemplate* packTemplates = (const MaterialPackTemplate*)(base + h->templatesOffset);
+	{
+		lock_guard<mutex> lock(man->templatesMutex);
+		for (unsigned i = 0; i < h->numTemplates; i++)
+		{
+			const MaterialPackTemplate& t = packTemplates[i];
+			checkRange(t.slotsOffset, (uint64_t)t.numSlots * sizeof(MaterialPackSlot));
+			checkRange(t.defaultOffset, t.materialSize);
+			const MaterialPackSlot* packSlots = (const MaterialPackSlot*)(base + t.slotsOffset);
+			const char* path = getString(t.path);
+
+			uint16_t mtid;
+			auto it = man->materialTemplateNameToId.find(NameId(path));
+			const bool create = it == man->materialTemplateNameToId.end();
+			if (create)
+			{
+				ScratchScope scratch;
+				ScratchVector<NameId> names(scratch);
+				ScratchVector<UnifType> types(scratch);
+				ScratchVector<uint8_t> perInstance(scratch);
+				for (unsigned s = 0; s < t.numSlots; s++)
+				{
+					names.push_back(NameId::intern(getString(packSlots[s].nameString)));
+					if (names.back().getHash() != packSlots[s].name || packSlots[s].type >= (uint8_t)UnifType::COUNT)
+					{
+						throw runtime_error(fileName + " is corrupted");
+					}
+					types.push_back((UnifType)packSlots[s].type);
+					perInstance.push_back((packSlots[s].flags & MATERIAL_PACK_SLOT_PER_INSTANCE) != 0);
+				}
+				mtid = man->createMaterialTemplate(
+					getString(t.shaders[0]), getString(t.shaders[1]), getString(t.shaders[2]),
+					t.numSlots, names.data(), types.data(), perInstance.data());
+				TemplateHeader* head = man->accessMaterialTemplate(mtid);
+				head->flags = (uint16_t)t.flags;
+				head->pipelineState = t.pipelineState == MATERIAL_PACK_INHERIT_PIPELINE ? PIPELINE_STATE_INHERIT :
+					PipelineState::registerState(PipelineState::unpack(t.pipelineState));
+				man->materialTemplateNameToId[NameId::intern(path)] = mtid;
+				if (man->materialTemplateIdToName.size() <= mtid) man->materialTemplateIdToName.resize(mtid + 1);
+				man->materialTemplateIdToName[mtid] = path;
+			}
+			else
+			{
+				mtid = it->second;
+			}
+
+			// the layout is computed in the same way, but the template could have been loaded from a different file
+			const TemplateHeader* head = man->accessMaterialTemplate(mtid);
+			const TemplateSlot* slots = (const TemplateSlot*)&head[1];
+			bool sameLayout = head->numSlots == t.numSlots && head->materialSize == t.materialSize;
+			for (unsigned s = 0; sameLayout && s < t.numSlots; s++)
+			{
+				sameLayout =
+					slots[s].name.getHash() == packSlots[s].name &&
+					(uint8_t)slots[s].type == packSlots[s].type &&
+					slots[s].offset == packSlots[s].offset &&
+					(slots[s].instanceOffset != MaterialManager::NOT_PER_INSTANCE) ==
+						((packSlots[s].flags & MATERIAL_PACK_SLOT_PER_INSTANCE) != 0);
+			}
+			if (!sameLayout)
+			{
+				throw runtime_error(fileName + ": the template " + path + " is loaded with a different layout");
+			}
+			for (unsigned s = 0; s < t.numSlots; s++)
+			{
+				if (slots[s].type == UnifType::TEXTURE) textureOffsets[i].push_back(slots[s].offset);
+			}
+			if (create)
+			{
+				char* dst = (char*)man->accessMaterialData(((uint32_t)mtid) << 16);
+				memcpy(dst + headerSize, base + t.defaultOffset + headerSize, t.materialSize - headerSize);
+				resolveTextures(dst, i);
+			}
+
+			MaterialTemplate templ;
+			templ.id = mtid;
+			templates.push_back(templ);
+		}
+	}
+
+	// materials, a copy of the blob into a free slot
+	const MaterialPackMaterial* packMaterials = (const MaterialPackMaterial*)(base + h->materialsOffset);
+	materials.reserve(h->numMaterials);
+	pathToMaterial.reserve(h->numMaterials);
+	for (unsigned i = 0; i < h->numMaterials; i++)
+	{
+		const MaterialPackMaterial& m = packMaterials[i];
+		if (m.templateIndex >= h->numTemplates) throw runtime_error(fileName + " is corrupted");
+		const MaterialPackTemplate& t = packTemplates[m.templateIndex];
+		const uint16_t mtid = templates[m.templateIndex].id;
+
+		Material mat;
+		if (m.dataOffset == 0)
+		{
+			mat.id = ((uint32_t)mtid) << 16;
+		}
+		else
+		{
+			checkRange(m.dataOffset, t.materialSize);
+			const uint16_t mid = man->allocateMaterialSlot(mtid);
+			MaterialHeader* dst = man->accessMaterialData(mtid, mid);
+			memcpy((char*)dst + headerSize, base + m.dataOffset + headerSize, t.materialSize - headerSize);
+			resolveTextures((char*)dst, m.templateIndex);
+			dst->header.sharedCount.store(1, memory_order_relaxed);
+			mat.id = ((uint32_t)mtid) << 16 | mid;
+			if (man->accessMaterialTemplate(mtid)->flags & MaterialManager::DEDUPLICATE) man->deduplicateMaterial(mat);
+		}
+		pathToMaterial[NameId::intern(getString(m.path))] = materials.size();
+		materials.push_back(mat);
+	}
+}
+
+void MaterialPack::free()
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	for (const Material& mat : materials) man->releaseMaterial(mat);
+	materials.clear();
+	templates.clear();
+	pathToMaterial.clear();
+}
+
+Material MaterialPack::getMaterial(NameId path)const
+{
+	Material res;
+	auto it = pathToMaterial.find(path);
+	res.id = it == pathToMaterial.end() ? 0xFFFFFFFF : materials[it->second].id;
+	return res;
+}
+
+void MaterialPack::cook(const vector<string>& paths, const string& fileName)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	typedef MaterialManager::MaterialTemplateEntryHeader TemplateHeader;
+	typedef MaterialManager::MaterialTemplateEntrySlot TemplateSlot;
+	const unsigned headerSize = sizeof(MaterialManager::MaterialEntryHeader);
+
+	// load everything with the MaterialManager, so the layout is the same
+	vector<uint16_t> templateIds;
+	FlatHashMap<uint16_t, uint32_t> templateIndices;
+	vector<pair<string, Material> > cooked;
+	auto addTemplate = [&](uint16_t mtid)
+	{
+		if (templateIndices.count(mtid)) return;
+		templateIndices[mtid] = (uint32_t)templateIds.size();
+		templateIds.push_back(mtid);
+	};
+	for (const string& path : paths)
+	{
+		try
+		{
+			const string txt = loadStringFromFile(path.c_str());
+			Document doc;
+			doc.Parse(txt.c_str());
+			if (doc.HasParseError() || !doc.IsObject()) throw runtime_error("invalid JSON");
+			if (doc.HasMember("template"))
+			{
+				Material mat = man->loadMaterial(path);
+				cooked.push_back(make_pair(path, mat));
+				addTemplate(mat.getTemplateId());
+			}
+			else
+			{
+				addTemplate(man->loadMaterialTemplate(path).getId());
+			}
+		}
+		catch (const runtime_error& e)
+		{
+			for (auto& x : cooked) man->releaseMaterial(x.second);
+			throw runtime_error(path + ": " + e.what());
+		}
+	}
+
+	PackWriter w;
+	w.addString("");	// offset 0, for the missing geometry shaders
+	MaterialPackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MATERIAL_PACK_MAGIC, sizeof(header.magic));
+	header.version = MATERIAL_PACK_VERSION;
+	header.numTemplates = (uint32_t)templateIds.size();
+	header.numMaterials = (uint32_t)cooked.size();
+	header.templatesOffset = sizeof(header);
+	header.materialsOffset = header.templatesOffset + header.numTemplates * sizeof(MaterialPackTemplate);
+	w.data.resize(header.materialsOffset + header.numMaterials * sizeof(MaterialPackMaterial));
+
+	// the blobs are stored with the material header zeroed and the paths of the textures
+	TextureManager* texMan = TextureManager::getSingleton();
+	vector<char> blob;
+	auto appendBlob = [&](const void* data, const TemplateHeader* head) -> uint64_t
+	{
+		blob.assign((const char*)data, (const char*)data + head->materialSize);
+		memset(&blob[0], 0, headerSize);
+		const TemplateSlot* slots = (const TemplateSlot*)&head[1];
+		for (unsigned s = 0; s < head->numSlots; s++)
+		{
+			if (slots[s].type != UnifType::TEXTURE) continue;
+			uint32_t* value = (uint32_t*)&blob[headerSize + slots[s].offset];
+			*value = w.addString(texMan->getTexturePath(*value));
+		}
+		return w.append(&blob[0], blob.size());
+	};
+
+	vector<MaterialPackTemplate> packTemplates(templateIds.size());
+	for (unsigned i = 0; i < templateIds.size(); i++)
+	{
+		const uint16_t mtid = templateIds[i];
+		const TemplateHeader* head = man->accessMaterialTemplate(mtid);
+		const TemplateSlot* slots = (const TemplateSlot*)&head[1];
+		MaterialPackTemplate& t = packTemplates[i];
+		t.path = w.addString(man->materialTemplateIdToName[mtid].c_str());
+		for (unsigned s = 0; s < 3; s++) t.shaders[s] = w.addString(head->shaders[s].getString());
+		t.numSlots = head->numSlots;
+		t.materialSize = head->materialSize;
+		t.flags = head->flags;
+		t.pipelineState = head->pipelineState == PIPELINE_STATE_INHERIT ? MATERIAL_PACK_INHERIT_PIPELINE :
+			PipelineState::getState(head->pipelineState).pack();
+
+		vector<MaterialPackSlot> packSlots(head->numSlots);
+		for (unsigned s = 0; s < head->numSlots; s++)
+		{
+			packSlots[s].name = slots[s].name.getHash();
+			packSlots[s].nameString = w.addString(slots[s].name.getString());
+			packSlots[s].type = (uint8_t)slots[s].type;
+			packSlots[s].flags = slots[s].instanceOffset != MaterialManager::NOT_PER_INSTANCE ?
+				MATERIAL_PACK_SLOT_PER_INSTANCE : 0;
+			packSlots[s].offset = slots[s].offset;
+		}
+		t.slotsOffset = w.append(packSlots.data(), packSlots.size() * sizeof(MaterialPackSlot));
+		t.defaultOffset = appendBlob(man->accessMaterialData(((uint32_t)mtid) << 16), head);
+	}
+
+	vector<MaterialPackMaterial> packMaterials(cooked.size());
+	for (unsigned i = 0; i < cooked.size(); i++)
+	{
+		const Material mat = cooked[i].second;
+		MaterialPackMaterial& m = packMaterials[i];
+		m.path = w.addString(cooked[i].first.c_str());
+		m.templateIndex = templateIndices.at(mat.getTemplateId());
+		m.dataOffset = mat.getInstanceId() == 0 ? 0 :
+			appendBlob(man->accessMaterialData(mat.getId()), man->accessMaterialTemplate(mat.getTemplateId()));
+		man->releaseMaterial(mat);
+	}
+
+	w.align();
+	header.stringsOffset = w.data.size();
+	header.stringsSize = w.strings.size();
+	w.data.insert(w.data.end(), w.strings.begin(), w.strings.end());
+
+	memcpy(&w.data[0], &header, sizeof(header));
+	if (!packTemplates.empty())
+		memcpy(&w.data[header.templatesOffset], &packTemplates[0], packTemplates.size() * sizeof(MaterialPackTemplate));
+	if (!packMaterials.empty())
+		memcpy(&w.data[header.materialsOffset], &packMaterials[0], packMaterials.size() * sizeof(MaterialPackMaterial));
+
+	ofstream file(fileName, ios::binary);
+	if (!file)
+	{
+		throw runtime_error("could not open " + fileName + " for writing");
+	}
+	file.write(&w.data[0], w.data.size());
+	if (!file)
+	{
+		throw runtime_error("error writing " + fileName);
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "material.hpp"
+#include "../../util/flat_hash_map.hpp"
+#include "../../util/name_id.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Cooked binary pack of material templates and materials.
+The templates are stored resolved: the slots sorted by name id with their types and offsets,
+and the default values. The materials are stored as the blobs of the MaterialManager chunks
+(material header + values), so loading them is a memcpy into a free slot; there is no JSON
+parsing. The texture slots of the blobs store the offset of the texture path in the string table
+instead of the TextureHandle, they are resolved after the copy.
+The strings (paths and slot names) are in a table at the end, null terminated.
+The file is little endian, the offsets are in bytes from the beginning of the file.
+Use MaterialPack::cook (or the material_cooker tool) to make one from the JSON files.
+*/
+
+const uint32_t MATERIAL_PACK_VERSION = 7;
+const uint32_t MATERIAL_PACK_ALIGNMENT = 8;
+const uint8_t MATERIAL_PACK_SLOT_PER_INSTANCE = 1 << 0;
+// MaterialPackTemplate::pipelineState of the templates without "pipeline"
+const uint32_t MATERIAL_PACK_INHERIT_PIPELINE = 0xFFFFFFFF;
+
+struct MaterialPackHeader
+{
+	char magic[4];	// "TKMP"
+	uint32_t version;
+	uint32_t numTemplates;
+	uint32_t numMaterials;
+	uint64_t templatesOffset;	// MaterialPackTemplate[numTemplates]
+	uint64_t materialsOffset;	// MaterialPackMaterial[numMaterials]
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+};
+static_assert(sizeof(MaterialPackHeader) == 48, "the header layout must not depend on the compiler");
+
+struct MaterialPackTemplate
+{
+	uint32_t path;			// offsets in the string table
+	uint32_t shaders[3];	// vertex, fragment, geometry ("" if none)
+	uint32_t numSlots;
+	uint32_t materialSize;	// bytes of each material blob
+	uint64_t slotsOffset;	// MaterialPackSlot[numSlots], sorted by name
+	uint64_t defaultOffset;	// blob of the default value
+	uint32_t flags;			// flags of the MaterialManager template header (deduplication)
+	uint32_t pipelineState;	// PipelineState::pack() or MATERIAL_PACK_INHERIT_PIPELINE
+};
+static_assert(sizeof(MaterialPackTemplate) == 48, "the layout must not depend on the compiler");
+
+struct MaterialPackSlot
+{
+	uint64_t name;			// NameId hash
+	uint32_t nameString;	// offset in the string table
+	uint8_t type;			// UnifType
+	uint8_t flags;			// MATERIAL_PACK_SLOT_PER_INSTANCE
+	uint16_t offset;		// within the material values
+};
+static_assert(sizeof(MaterialPackSlot) == 16, "the layout must not depend on the compiler");
+
+struct MaterialPackMaterial
+{
+	uint32_t path;
+	uint32_t templateIndex;
+	uint64_t dataOffset;	// blob of the material, 0 if it uses the default value of the template
+};
+static_assert(sizeof(MaterialPackMaterial) == 16, "the layout must not depend on the compiler");
+
+// the materials of a loaded pack, by path
+class MaterialPack
+{
+public:
+	MaterialPack() {}
+	// throws runtime_error if the file is not a valid pack
+	explicit MaterialPack(const std::string& fileName);
+
+	// the templates that are already loaded are reused, they must have the same layout
+	void load(const std::string& fileName);
+	// releases the materials
+	void free();
+
+	// the material loaded from that path. Its id is 0xFFFFFFFF if it's not in the pack
+	Material getMaterial(NameId path)const;
+	const std::vector<Material>& getMaterials()const { return materials; }
+	const std::vector<MaterialTemplate>& getTemplates()const { return templates; }
+
+	// loads the JSON files (materials or templates) with the MaterialManager and saves them in a
+	// pack, with the templates of the materials. Only the paths of the shaders are saved, the GL
+	// functions can be replaced with NullGl
+	static void cook(const std::vector<std::string>& paths, const std::string& fileName);
+
+private:
+	std::vector<MaterialTemplate> templates;
+	std::vector<Material> materials;
+	FlatHashMap<NameId, unsigned> pathToMaterial;
+};
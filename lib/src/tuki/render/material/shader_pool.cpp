@@ -1,6 +1,8 @@
 #include "shader_pool.hpp"
 
 #include "../gl/shader.hpp"
+#include "../../util/profiler.hpp"
+#include <stdexcept>
 
 using namespace std;
 
@@ -14,29 +16,28 @@ ShaderProgram ShaderPool::getShaderProgram(
 	const string& geomShadPath,
 	AttribInitilizer attribInitializer)
 {
-	auto vsIt = vertShaderNameToId.find(vertShadPath);
-	auto fsIt = fragShaderNameToId.find(fragShadPath);
-	auto gsIt = fragShaderNameToId.find(geomShadPath);
+	TUKI_PROFILE_SCOPE("ShaderPool::getShaderProgram");
+	const NameId vsName(vertShadPath), fsName(fragShadPath), gsName(geomShadPath);
+	auto vsIt = vertShaderNameToId.find(vsName);
+	auto fsIt = fragShaderNameToId.find(fsName);
+	auto gsIt = geomShaderNameToId.find(gsName);
 
 	int vs, fs, gs = -1;
 
-	if (vsIt != vertShaderNameToId.end() && fsIt != fragShaderNameToId.end())
+	if (vsIt != vertShaderNameToId.end() && fsIt != fragShaderNameToId.end() &&
+		(geomShadPath == "" || gsIt != geomShaderNameToId.end()))
 	{
 		vs = vsIt->second;
-		fs = vsIt->second;
-		if (geomShadPath == "" ||
-		   (geomShadPath != "" && gsIt != geomShaderNameToId.end()))
+		fs = fsIt->second;
+		if (geomShadPath != "") gs = gsIt->second;
+		auto progIt = shadersToProgram.find(array<int, 3>{ { vs, fs, gs } });
+		if (progIt != shadersToProgram.end())
 		{
-			gs = gsIt->second;
-			auto progIt = shadersToProgram.find({ vs, fs, gs });
-			if (progIt != shadersToProgram.end())
-			{
-				// the program is already loaded
-				return programs[progIt->second];
-			}
+			// the program is already loaded
+			return programs[progIt->second];
 		}
 	}
-	
+
 	// create vertex shader if needed
 	if (vsIt != vertShaderNameToId.end())
 	{
@@ -56,7 +57,7 @@ ShaderProgram ShaderPool::getShaderProgram(
 		vs = vertShaders.size();
 
 		vertShaders.push_back(vertShad);
-		vertShaderNameToId[vertShadPath] = vs;
+		vertShaderNameToId[NameId::intern(vertShadPath)] = vs;
 	}
 
 	// create fragment shader id needed
@@ -73,12 +74,12 @@ ShaderProgram ShaderPool::getShaderProgram(
 			fragShad.compile();
 		}
 		catch (runtime_error e) {
-			throw runtime_error(vertShadPath + ": " + e.what());
+			throw runtime_error(fragShadPath + ": " + e.what());
 		}
 		fs = fragShaders.size();
 
 		fragShaders.push_back(fragShad);
-		fragShaderNameToId[fragShadPath] = fs;
+		fragShaderNameToId[NameId::intern(fragShadPath)] = fs;
 	}
 
 	// create geometry shader id needed
@@ -102,7 +103,7 @@ ShaderProgram ShaderPool::getShaderProgram(
 			gs = geomShaders.size();
 
 			geomShaders.push_back(geomShad);
-			geomShaderNameToId[geomShadPath] = gs;
+			geomShaderNameToId[NameId::intern(geomShadPath)] = gs;
 		}
 	}
 
@@ -129,7 +130,7 @@ ShaderProgram ShaderPool::getShaderProgram(
 
 	int progId = programs.size();
 	programs.push_back(prog);
-	shadersToProgram[{vs, fs, gs}] = progId;
+	shadersToProgram[array<int, 3>{ { vs, fs, gs } }] = progId;
 	programToShaders.push_back({ vs, fs, gs });
 
 	return prog;
@@ -1,8 +1,9 @@
 #pragma once
 
 #include "../../util/singleton.hpp"
+#include "../../util/flat_hash_map.hpp"
+#include "../../util/name_id.hpp"
 #include <vector>
-#include <map>
 #include <string>
 #include <array>
 #include "../gl/attrib_initializers.hpp"
@@ -27,9 +28,9 @@ private:
 	std::vector<GeometryShaderObject> geomShaders;
 	std::vector<ShaderProgram> programs;
 
-	std::map<std::string, int> vertShaderNameToId;
-	std::map<std::string, int> fragShaderNameToId;
-	std::map<std::string, int> geomShaderNameToId;
-	std::map<std::array<int, 3>, int> shadersToProgram;
+	FlatHashMap<NameId, int> vertShaderNameToId;
+	FlatHashMap<NameId, int> fragShaderNameToId;
+	FlatHashMap<NameId, int> geomShaderNameToId;
+	FlatHashMap<std::array<int, 3>, int> shadersToProgram;
 	std::vector<std::array<int, 3> > programToShaders;
 };
\ No newline at end of file
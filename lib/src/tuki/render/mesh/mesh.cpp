@@ -1,4 +1,8 @@
 #include "mesh.hpp"
+#include "mesh_optimizer.hpp"
+#include "../../util/mallocr/mem_tracker.hpp"
+#include "../../util/profiler.hpp"
+#include "../../util/vfs_io_system.hpp"
 
 #include <stdio.h>
 #include <cstring>
@@ -6,6 +10,7 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <stdexcept>
 #include <vector>
 
 using namespace std;
@@ -23,16 +28,18 @@ void Mesh::initVertexData
 	unsigned nv = numVertices;
 	this->numVertices = nv;
 	
-	this->positions = new float[3 * nv];
-	this->normals = new float[3 * nv];
-	this->tangents = new float[3 * nv];
-	this->colors = new float[3 * nv];
-	this->texCoords = new float[2 * nv];
-	memcpy(this->positions, positions, 3 * nv * sizeof(float));
-	memcpy(this->normals, normals, 3 * nv * sizeof(float));
-	memcpy(this->tangents, tangents, 3 * nv * sizeof(float));
-	memcpy(this->colors, colors, 3 * nv * sizeof(float));
-	memcpy(this->texCoords, texCoords, 2 * nv * sizeof(float));
+	auto copyAttrib = [nv](const float* src, unsigned numComponents) -> float*
+	{
+		if (src == nullptr) return nullptr;
+		float* dst = MemTracker::newArray<float>(MemTag::MESH, numComponents * nv);
+		memcpy(dst, src, numComponents * nv * sizeof(float));
+		return dst;
+	};
+	this->positions = copyAttrib(positions, 3);
+	this->normals = copyAttrib(normals, 3);
+	this->tangents = copyAttrib(tangents, 3);
+	this->colors = copyAttrib(colors, 3);
+	this->texCoords = copyAttrib(texCoords, 2);
 }
 
 void Mesh::initTrianglesData
@@ -44,7 +51,7 @@ void Mesh::initTrianglesData
 	unsigned nt = numTriangles;
 	this->numTriangles = nt;
 
-	this->triangles = new unsigned[3 * nt];
+	this->triangles = MemTracker::newArray<unsigned>(MemTag::MESH, 3 * nt);
 	memcpy(this->triangles, triangles, 3 * nt * sizeof(unsigned));
 }
 
@@ -64,18 +71,23 @@ const float* Mesh::getAttribData(AttribLocation index)const
 
 void Mesh::free()
 {
-	delete[] positions;
-	delete[] normals;
-	delete[] tangents;
-	delete[] colors;
-	delete[] texCoords;
-	delete[] triangles;
+	const unsigned nv = numVertices;
+	MemTracker::deleteArray(MemTag::MESH, positions, 3 * nv);
+	MemTracker::deleteArray(MemTag::MESH, normals, 3 * nv);
+	MemTracker::deleteArray(MemTag::MESH, tangents, 3 * nv);
+	MemTracker::deleteArray(MemTag::MESH, colors, 3 * nv);
+	MemTracker::deleteArray(MemTag::MESH, texCoords, 2 * nv);
+	MemTracker::deleteArray(MemTag::MESH, triangles, 3 * numTriangles);
+	positions = normals = tangents = colors = texCoords = nullptr;
+	triangles = nullptr;
+	numVertices = numTriangles = 0;
 };
 
-Mesh Mesh::load(const string& fileName)
+Mesh Mesh::load(const string& fileName, bool optimize, MeshOptimizerReport* report)
 {
+	TUKI_PROFILE_SCOPE("Mesh::load");
 	Assimp::Importer importer;
-	
+	importer.SetIOHandler(new VfsIOSystem());
 	const aiScene* scene =
 		importer.ReadFile(fileName,
 			aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
@@ -90,20 +102,41 @@ Mesh Mesh::load(const string& fileName)
 		throw runtime_error("there are no meshes in " + fileName);
 	}
 
-	aiMesh* mesh = scene->mMeshes[0];
+	Mesh res = fromAssimp(scene->mMeshes[0]);
+
+	if (optimize)
+	{
+		Mesh optimized = MeshOptimizer::optimize(res, report);
+		res.free();
+		return optimized;
+	}
+
+	return res;
+}
+
+Mesh Mesh::fromAssimp(const aiMesh* mesh)
+{
 	const unsigned nv = mesh->mNumVertices;
 	const unsigned nt = mesh->mNumFaces;
 
 	if (!mesh->HasPositions())
 	{
-		throw runtime_error("the mesh doesn't have any positions (" + fileName + ")");
+		throw runtime_error("the mesh doesn't have any positions (" + string(mesh->mName.C_Str()) + ")");
+	}
+	if (!mesh->HasFaces())
+	{
+		throw runtime_error("mesh doesn't have faces(" + string(mesh->mName.C_Str()) + ")");
+	}
+	if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+	{
+		throw runtime_error("only triangle meshes are supported (" + string(mesh->mName.C_Str()) + ")");
 	}
 	
 	Mesh res;
 	res.numVertices = nv;
 	res.numTriangles = nt;
 	
-	float* positions = new float[3 * nv];
+	float* positions = MemTracker::newArray<float>(MemTag::MESH, 3 * nv);
 	for (int i = 0; i < nv; i++)
 	for (int j = 0; j < 3; j++)
 	{
@@ -113,7 +146,7 @@ Mesh Mesh::load(const string& fileName)
 	float* normals = nullptr;
 	if (mesh->HasNormals())
 	{
-		normals = new float[3 * nv];
+		normals = MemTracker::newArray<float>(MemTag::MESH, 3 * nv);
 		for (int i = 0; i < nv; i++)
 		for (int j = 0; j < 3; j++)
 		{
@@ -124,7 +157,7 @@ Mesh Mesh::load(const string& fileName)
 	float* tangents = nullptr;
 	if (mesh->HasTangentsAndBitangents())
 	{
-		tangents = new float[3 * nv];
+		tangents = MemTracker::newArray<float>(MemTag::MESH, 3 * nv);
 		for (int i = 0; i < nv; i++)
 		for (int j = 0; j < 3; j++)
 		{
@@ -135,7 +168,7 @@ Mesh Mesh::load(const string& fileName)
 	float* colors = nullptr;
 	if (mesh->HasVertexColors(0))
 	{
-		colors = new float[3 * nv];
+		colors = MemTracker::newArray<float>(MemTag::MESH, 3 * nv);
 		for (int i = 0; i < nv; i++)
 		for (int j = 0; j < 3; j++)
 		{
@@ -146,7 +179,7 @@ Mesh Mesh::load(const string& fileName)
 	float* texCoords = nullptr;
 	if (mesh->HasTextureCoords(0))
 	{
-		texCoords = new float[2 * nv];
+		texCoords = MemTracker::newArray<float>(MemTag::MESH, 2 * nv);
 		for (int i = 0; i < nv; i++)
 		for (int j = 0; j < 2; j++)
 		{
@@ -154,12 +187,7 @@ Mesh Mesh::load(const string& fileName)
 		}
 	}
 
-	unsigned* indices = nullptr;
-	if (!mesh->HasFaces())
-	{
-		throw runtime_error("mesh doesn't have faces(" + fileName + ")");
-	}
-	indices = new unsigned[3 * nt];
+	unsigned* indices = MemTracker::newArray<unsigned>(MemTag::MESH, 3 * nt);
 	for (int i = 0; i < nt; i++)
 	for (int j = 0; j < 3; j++)
 	{
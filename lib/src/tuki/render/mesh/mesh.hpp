@@ -28,11 +28,38 @@ public:
 	virtual unsigned getNumIndices()const = 0;
 };
 
+// uses the vertex data of other mesh with a different index list
+// useful for uploading reordered or simplified indices without copying the vertices
+class IndexedMeshView : public IMesh
+{
+public:
+	IndexedMeshView(const IMesh& mesh, const unsigned* indices, unsigned numIndices) :
+		mesh(mesh), indices(indices), numIndices(numIndices) {}
+
+	GeomType getGeomType()const { return mesh.getGeomType(); }
+	const unsigned* getIndices()const { return indices; }
+	const float* getAttribData(AttribLocation index)const { return mesh.getAttribData(index); }
+	unsigned getNumVertices()const { return mesh.getNumVertices(); }
+	unsigned getNumIndices()const { return numIndices; }
+
+private:
+	const IMesh& mesh;
+	const unsigned* indices;
+	unsigned numIndices;
+};
+
+struct MeshOptimizerReport;
+struct aiMesh;
+
 // COMMON STATIC TRIANGLE MESH
 class Mesh : public IMesh
 {	
 public:
-	static Mesh load(const std::string& fileName);
+	// optimize: reorder the triangles and vertices for rendering (see mesh_optimizer.hpp)
+	static Mesh load(const std::string& fileName,
+		bool optimize = true, MeshOptimizerReport* report = nullptr);
+	// copies the data of a triangulated assimp mesh
+	static Mesh fromAssimp(const aiMesh* mesh);
 
 	Mesh()
 	{
@@ -47,6 +74,7 @@ public:
 	unsigned getNumVertices()const { return numVertices; }
 	unsigned getNumIndices()const { return 3 * numTriangles; }
 	
+	// the attributes that are null are not stored
 	void initVertexData
 	(
 		unsigned numVertices,
@@ -0,0 +1,164 @@
+#include "mesh_file.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static const char MESH_FILE_MAGIC[4] = { 'T', 'K', 'M', 'S' };
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+namespace MeshFile
+{
+
+void save(const IMesh& mesh, const string& fileName, MeshFileFlags flags)
+{
+	const unsigned nv = mesh.getNumVertices();
+
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+	header.version = MESH_FILE_VERSION;
+	header.flags = (uint32_t)flags;
+	header.geomType = (uint32_t)mesh.getGeomType();
+	header.numVertices = nv;
+	header.numIndices = mesh.hasIndices() ? mesh.getNumIndices() : 0;
+
+	AABB bounds = AABB::makeEmpty();
+	const float* positions = mesh.getAttribData(AttribLocation::POS);
+	if (positions)
+	{
+		for (unsigned i = 0; i < nv; i++)
+		{
+			bounds = AABB::merge(bounds, glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
+		}
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = bounds.min[i];
+		header.boundsMax[i] = bounds.max[i];
+	}
+
+	// layout of the blobs
+	const void* blobData[(int)AttribLocation::NUM_ATTRIBS + 1];
+	MeshFileBlob* blobs[(int)AttribLocation::NUM_ATTRIBS + 1];
+	unsigned numBlobs = 0;
+	uint64_t offset = alignOffset(sizeof(header));
+	for (unsigned i = 0; i < (unsigned)AttribLocation::NUM_ATTRIBS; i++)
+	{
+		const float* data = mesh.getAttribData((AttribLocation)i);
+		if (!data) continue;
+		header.attribs[i].offset = offset;
+		header.attribs[i].size = (uint64_t)nv * ATTRIB_NUM_COMPONENTS[i] * sizeof(float);
+		offset = alignOffset(offset + header.attribs[i].size);
+		blobData[numBlobs] = data;
+		blobs[numBlobs++] = &header.attribs[i];
+	}
+	if (header.numIndices)
+	{
+		header.indices.offset = offset;
+		header.indices.size = (uint64_t)header.numIndices * sizeof(unsigned);
+		blobData[numBlobs] = mesh.getIndices();
+		blobs[numBlobs++] = &header.indices;
+	}
+
+	ofstream file(fileName, ios::binary);
+	if (!file)
+	{
+		throw runtime_error("could not open " + fileName + " for writing");
+	}
+	file.write((const char*)&header, sizeof(header));
+	uint64_t pos = sizeof(header);
+	const char zeros[MESH_FILE_ALIGNMENT] = {};
+	for (unsigned i = 0; i < numBlobs; i++)
+	{
+		file.write(zeros, blobs[i]->offset - pos);
+		file.write((const char*)blobData[i], blobs[i]->size);
+		pos = blobs[i]->offset + blobs[i]->size;
+	}
+	if (!file)
+	{
+		throw runtime_error("error writing " + fileName);
+	}
+}
+
+}
+
+// MAPPED MESH
+
+MappedMesh::MappedMesh(const string& fileName) : header(nullptr)
+{
+	load(fileName);
+}
+
+void MappedMesh::load(const string& fileName)
+{
+	free();
+	VfsFile f = Vfs::getSingleton()->map(fileName);
+	const MeshFileHeader* h = (const MeshFileHeader*)f.getData();
+	const uint64_t fileSize = f.getSize();
+
+	if (fileSize < sizeof(MeshFileHeader) || memcmp(h->magic, MESH_FILE_MAGIC, sizeof(h->magic)) != 0)
+	{
+		throw runtime_error(fileName + " is not a mesh file");
+	}
+	if (h->version != MESH_FILE_VERSION)
+	{
+		throw runtime_error(fileName + " has an unsupported mesh file version");
+	}
+	if (h->geomType >= (uint32_t)GeomType::COUNT)
+	{
+		throw runtime_error(fileName + " has an invalid geometry type");
+	}
+
+	auto checkBlob = [&](const MeshFileBlob& blob, uint64_t expectedSize)
+	{
+		if (blob.offset == 0) return;
+		if (blob.offset % MESH_FILE_ALIGNMENT != 0 || blob.size != expectedSize ||
+			blob.offset > fileSize || blob.size > fileSize - blob.offset)
+		{
+			throw runtime_error(fileName + " is corrupted");
+		}
+	};
+	for (unsigned i = 0; i < (unsigned)AttribLocation::NUM_ATTRIBS; i++)
+	{
+		checkBlob(h->attribs[i], (uint64_t)h->numVertices * ATTRIB_NUM_COMPONENTS[i] * sizeof(float));
+	}
+	checkBlob(h->indices, (uint64_t)h->numIndices * sizeof(unsigned));
+
+	file = move(f);
+	header = h;
+}
+
+void MappedMesh::free()
+{
+	file.close();
+	header = nullptr;
+}
+
+const void* MappedMesh::getBlob(const MeshFileBlob& blob)const
+{
+	return blob.offset ? file.getData() + blob.offset : nullptr;
+}
+
+const unsigned* MappedMesh::getIndices()const
+{
+	return (const unsigned*)getBlob(header->indices);
+}
+
+const float* MappedMesh::getAttribData(AttribLocation index)const
+{
+	return (const float*)getBlob(header->attribs[(int)index]);
+}
+
+AABB MappedMesh::getBounds()const
+{
+	return AABB(
+		glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]),
+		glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]));
+}
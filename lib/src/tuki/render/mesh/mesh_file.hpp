@@ -0,0 +1,81 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "../../math/geometry.hpp"
+#include "../../util/vfs.hpp"
+#include <cstdint>
+#include <string>
+
+/*
+Cooked binary mesh format.
+The file is a header followed by the blobs of the attributes and the indices,
+each one aligned to MESH_FILE_ALIGNMENT bytes. The data is stored exactly as
+the GPU wants it, so loading is mapping the file and pointing into it; there
+is no parsing. The files are little endian.
+Use MeshFile::save (or the mesh_cooker tool) to convert from any IMesh.
+*/
+
+const uint32_t MESH_FILE_VERSION = 1;
+const uint32_t MESH_FILE_ALIGNMENT = 16;
+
+enum class MeshFileFlags : uint32_t
+{
+	NONE = 0,
+	OPTIMIZED = 1 << 0,	// processed with MeshOptimizer
+};
+
+struct MeshFileBlob
+{
+	uint64_t offset;	// in bytes from the beginning of the file, 0 means not present
+	uint64_t size;		// in bytes
+};
+
+struct MeshFileHeader
+{
+	char magic[4];	// "TKMS"
+	uint32_t version;
+	uint32_t flags;
+	uint32_t geomType;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	float boundsMin[3];
+	float boundsMax[3];
+	MeshFileBlob attribs[(int)AttribLocation::NUM_ATTRIBS];
+	MeshFileBlob indices;
+};
+static_assert(sizeof(MeshFileHeader) == 208, "the header layout must not depend on the compiler");
+
+namespace MeshFile
+{
+
+// flags describe the data, use OPTIMIZED if the mesh has been through MeshOptimizer
+void save(const IMesh& mesh, const std::string& fileName, MeshFileFlags flags = MeshFileFlags::NONE);
+
+}
+
+// mesh that points to the data of a mapped cooked mesh file
+class MappedMesh : public IMesh
+{
+public:
+	MappedMesh() : header(nullptr) {}
+	// throws runtime_error if the file is not a valid mesh file
+	explicit MappedMesh(const std::string& fileName);
+
+	void load(const std::string& fileName);
+	void free();
+
+	GeomType getGeomType()const { return (GeomType)header->geomType; }
+	const unsigned* getIndices()const;
+	const float* getAttribData(AttribLocation index)const;
+	unsigned getNumVertices()const { return header->numVertices; }
+	unsigned getNumIndices()const { return header->numIndices; }
+
+	AABB getBounds()const;
+	bool isOptimized()const { return (header->flags & (uint32_t)MeshFileFlags::OPTIMIZED) != 0; }
+
+private:
+	VfsFile file;
+	const MeshFileHeader* header;
+
+	const void* getBlob(const MeshFileBlob& blob)const;
+};
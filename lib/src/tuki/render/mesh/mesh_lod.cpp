@@ -0,0 +1,374 @@
+#include "mesh_lod.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+// symmetric 4x4 matrix that gives the sum of squared distances to a set of planes
+struct Quadric
+{
+	float a00, a11, a22, a01, a02, a12;
+	float b0, b1, b2;
+	float c;
+	float w;	// accumulated weight (area)
+};
+
+Quadric makePlaneQuadric(const vec3& n, float d, float w)
+{
+	Quadric q;
+	q.a00 = w * n.x * n.x;
+	q.a11 = w * n.y * n.y;
+	q.a22 = w * n.z * n.z;
+	q.a01 = w * n.x * n.y;
+	q.a02 = w * n.x * n.z;
+	q.a12 = w * n.y * n.z;
+	q.b0 = w * n.x * d;
+	q.b1 = w * n.y * d;
+	q.b2 = w * n.z * d;
+	q.c = w * d * d;
+	q.w = w;
+	return q;
+}
+
+void quadricAdd(Quadric& q, const Quadric& r)
+{
+	q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+	q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+	q.w += r.w;
+}
+
+// mean squared distance of p to the planes of the quadric
+float quadricError(const Quadric& q, const vec3& p)
+{
+	const float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+	const float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+	const float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+	float r = rx * p.x + ry * p.y + rz * p.z;
+	r += 2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z);
+	r += q.c;
+	return q.w > 0 ? fabs(r) / q.w : 0.f;
+}
+
+struct PositionHash
+{
+	size_t operator()(const vec3& p)const
+	{
+		unsigned u[3];
+		memcpy(u, &p[0], sizeof(u));
+		return (u[0] * 73856093u) ^ (u[1] * 19349663u) ^ (u[2] * 83492791u);
+	}
+};
+
+struct Collapse
+{
+	unsigned v0, v1;	// v0 is merged into v1
+	float cost;
+	float geomError;
+};
+
+}
+
+namespace MeshLod
+{
+
+unsigned simplify(
+	const IMesh& mesh,
+	const unsigned* indices, unsigned numIndices,
+	unsigned targetNumIndices,
+	unsigned* out,
+	float& error,
+	const MeshLodSettings& settings)
+{
+	error = 0;
+	unsigned n = numIndices;
+	copy(indices, indices + numIndices, out);
+	if (n <= targetNumIndices || !mesh.hasAttribData(AttribLocation::POS)) return n;
+
+	const unsigned nv = mesh.getNumVertices();
+	const vec3* srcPositions = (const vec3*)mesh.getAttribData(AttribLocation::POS);
+	const vec3* normals = (const vec3*)mesh.getAttribData(AttribLocation::NORMAL);
+	const vec2* texCoords = (const vec2*)mesh.getAttribData(AttribLocation::TEX_COORD);
+	const vec3* colors = (const vec3*)mesh.getAttribData(AttribLocation::COLOR);
+
+	// normalize the positions so the errors are relative to the mesh size
+	vec3 pmin = srcPositions[0], pmax = srcPositions[0];
+	for (unsigned i = 1; i < nv; i++)
+	{
+		pmin = glm::min(pmin, srcPositions[i]);
+		pmax = glm::max(pmax, srcPositions[i]);
+	}
+	const vec3 ext = pmax - pmin;
+	float scale = std::max(ext.x, std::max(ext.y, ext.z));
+	if (scale == 0) scale = 1;
+	const float invScale = 1.f / scale;
+	vector<vec3> positions(nv);
+	for (unsigned i = 0; i < nv; i++) positions[i] = (srcPositions[i] - pmin) * invScale;
+
+	// vertices that share position (attribute seams) are merged in the same group
+	vector<unsigned> remap(nv);
+	vector<unsigned> groupSize(nv, 0);
+	{
+		unordered_map<vec3, unsigned, PositionHash> posToVert;
+		posToVert.reserve(nv);
+		for (unsigned i = 0; i < nv; i++)
+		{
+			auto res = posToVert.insert(make_pair(srcPositions[i], i));
+			remap[i] = res.first->second;
+			groupSize[remap[i]]++;
+		}
+	}
+
+	// border vertices: the ones in edges without the opposite edge
+	vector<bool> locked(nv, false);
+	{
+		auto edgeKey = [](unsigned a, unsigned b) { return ((uint64_t)a << 32) | b; };
+		unordered_set<uint64_t> edges;
+		edges.reserve(n);
+		for (unsigned i = 0; i < n; i += 3)
+		for (unsigned k = 0; k < 3; k++)
+		{
+			const unsigned a = remap[out[i + k]];
+			const unsigned b = remap[out[i + (k + 1) % 3]];
+			edges.insert(edgeKey(a, b));
+		}
+		vector<bool> border(nv, false);
+		for (unsigned i = 0; i < n; i += 3)
+		for (unsigned k = 0; k < 3; k++)
+		{
+			const unsigned a = remap[out[i + k]];
+			const unsigned b = remap[out[i + (k + 1) % 3]];
+			if (!edges.count(edgeKey(b, a))) border[a] = border[b] = true;
+		}
+		for (unsigned i = 0; i < nv; i++)
+		{
+			locked[i] = groupSize[remap[i]] > 1 || border[remap[i]];
+		}
+	}
+
+	// plane quadrics weighted by area, accumulated by position group
+	vector<Quadric> quadrics(nv);
+	memset(&quadrics[0], 0, nv * sizeof(Quadric));
+	for (unsigned i = 0; i < n; i += 3)
+	{
+		const vec3& p0 = positions[out[i]];
+		const vec3& p1 = positions[out[i + 1]];
+		const vec3& p2 = positions[out[i + 2]];
+		vec3 normal = cross(p1 - p0, p2 - p0);
+		const float len = length(normal);
+		if (len == 0) continue;
+		normal /= len;
+		const Quadric q = makePlaneQuadric(normal, -dot(normal, p0), 0.5f * len);
+		for (int k = 0; k < 3; k++) quadricAdd(quadrics[remap[out[i + k]]], q);
+	}
+
+	auto attribCost = [&](unsigned a, unsigned b)
+	{
+		float cost = 0;
+		if (normals)
+		{
+			const vec3 d = normals[a] - normals[b];
+			cost += settings.normalWeight * dot(d, d);
+		}
+		if (texCoords)
+		{
+			const vec2 d = texCoords[a] - texCoords[b];
+			cost += settings.texCoordWeight * dot(d, d);
+		}
+		if (colors)
+		{
+			const vec3 d = colors[a] - colors[b];
+			cost += settings.colorWeight * dot(d, d);
+		}
+		return cost;
+	};
+
+	const float maxErrorSq = settings.maxError * settings.maxError;
+	float resultError = 0;
+
+	vector<unsigned> triOffsets(nv + 1);
+	vector<unsigned> triList;
+	vector<Collapse> collapses;
+	vector<unsigned> collapseRemap(nv);
+	vector<bool> touched(nv);
+
+	while (n > targetNumIndices)
+	{
+		// vertex -> triangles adjacency
+		fill(triOffsets.begin(), triOffsets.end(), 0);
+		for (unsigned i = 0; i < n; i++) triOffsets[out[i] + 1]++;
+		for (unsigned v = 0; v < nv; v++) triOffsets[v + 1] += triOffsets[v];
+		triList.resize(n);
+		{
+			vector<unsigned> fillPos(triOffsets.begin(), triOffsets.end() - 1);
+			for (unsigned i = 0; i < n; i++) triList[fillPos[out[i]]++] = i / 3;
+		}
+
+		// collapse candidates for each edge, in both directions
+		collapses.clear();
+		for (unsigned i = 0; i < n; i += 3)
+		for (unsigned k = 0; k < 3; k++)
+		{
+			const unsigned a = out[i + k];
+			const unsigned b = out[i + (k + 1) % 3];
+			for (int dir = 0; dir < 2; dir++)
+			{
+				const unsigned v0 = dir ? b : a;
+				const unsigned v1 = dir ? a : b;
+				if (locked[v0]) continue;
+				Quadric q = quadrics[remap[v0]];
+				quadricAdd(q, quadrics[remap[v1]]);
+				Collapse c;
+				c.v0 = v0;
+				c.v1 = v1;
+				c.geomError = quadricError(q, positions[v1]);
+				c.cost = c.geomError + attribCost(v0, v1);
+				if (c.geomError <= maxErrorSq) collapses.push_back(c);
+			}
+		}
+		if (collapses.empty()) break;
+		sort(collapses.begin(), collapses.end(),
+			[](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		// perform the cheapest collapses that don't interfere with each other
+		for (unsigned v = 0; v < nv; v++) collapseRemap[v] = v;
+		fill(touched.begin(), touched.end(), false);
+		unsigned removedIndices = 0;
+		unsigned numCollapses = 0;
+		for (const Collapse& c : collapses)
+		{
+			if (n - removedIndices <= targetNumIndices) break;
+			if (touched[c.v0] || touched[c.v1]) continue;
+
+			// reject collapses that flip or degenerate the triangles that remain
+			const vec3& p0 = positions[c.v0];
+			const vec3& p1 = positions[c.v1];
+			bool flips = false;
+			unsigned numRemoved = 0;
+			for (unsigned j = triOffsets[c.v0]; j < triOffsets[c.v0 + 1] && !flips; j++)
+			{
+				const unsigned* tri = &out[3 * triList[j]];
+				if (tri[0] == c.v1 || tri[1] == c.v1 || tri[2] == c.v1)
+				{
+					numRemoved++;
+					continue;
+				}
+				const unsigned k = tri[0] == c.v0 ? 0 : (tri[1] == c.v0 ? 1 : 2);
+				const vec3& pa = positions[tri[(k + 1) % 3]];
+				const vec3& pb = positions[tri[(k + 2) % 3]];
+				const vec3 nOld = cross(pa - p0, pb - p0);
+				const vec3 nNew = cross(pa - p1, pb - p1);
+				flips = dot(nOld, nNew) <= 0.25f * length(nOld) * length(nNew);
+			}
+			if (flips) continue;
+
+			collapseRemap[c.v0] = c.v1;
+			quadricAdd(quadrics[remap[c.v1]], quadrics[remap[c.v0]]);
+			resultError = std::max(resultError, c.geomError);
+			removedIndices += 3 * numRemoved;
+			numCollapses++;
+
+			// the triangles around v0 are going to change, lock all their vertices for this pass
+			touched[c.v0] = touched[c.v1] = true;
+			for (unsigned j = triOffsets[c.v0]; j < triOffsets[c.v0 + 1]; j++)
+			{
+				const unsigned* tri = &out[3 * triList[j]];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+		}
+		if (numCollapses == 0) break;
+
+		// apply the collapses and remove the degenerated triangles
+		unsigned newN = 0;
+		for (unsigned i = 0; i < n; i += 3)
+		{
+			const unsigned a = collapseRemap[out[i]];
+			const unsigned b = collapseRemap[out[i + 1]];
+			const unsigned c = collapseRemap[out[i + 2]];
+			if (a == b || b == c || c == a) continue;
+			out[newN++] = a;
+			out[newN++] = b;
+			out[newN++] = c;
+		}
+		n = newN;
+	}
+
+	error = sqrt(resultError) * scale;
+	return n;
+}
+
+MeshLodChain generateLods(const IMesh& mesh, const MeshLodSettings& settings)
+{
+	MeshLodChain chain;
+
+	vector<unsigned> prev;
+	if (mesh.hasIndices())
+	{
+		prev.assign(mesh.getIndices(), mesh.getIndices() + mesh.getNumIndices());
+	}
+	else
+	{
+		prev.resize(mesh.getNumVertices());
+		for (unsigned i = 0; i < prev.size(); i++) prev[i] = i;
+	}
+	const unsigned n = prev.size();
+
+	MeshLodLevel lod0 = { 0, n, 0.f };
+	chain.levels.push_back(lod0);
+	chain.indices = prev;
+	// nothing to simplify
+	if (n == 0) return chain;
+
+	vector<unsigned> lod(n);
+	float prevError = 0;
+	for (float ratio : settings.ratios)
+	{
+		const unsigned target = 3 * (unsigned)(ratio * n / 3);
+		float error;
+		// simplify the previous lod, it's faster than starting from the original each time
+		const unsigned count = simplify(mesh, &prev[0], prev.size(), target, &lod[0], error, settings);
+
+		// not enough reduction, the next lods won't do better
+		if (count == 0 || count > prev.size() * 95 / 100) break;
+
+		prevError += error;
+		MeshLodLevel level = { (unsigned)chain.indices.size(), count, prevError };
+		chain.levels.push_back(level);
+		chain.indices.insert(chain.indices.end(), lod.begin(), lod.begin() + count);
+		prev.assign(lod.begin(), lod.begin() + count);
+	}
+
+	return chain;
+}
+
+float computeProjectionScale(float fovY, float viewportHeight)
+{
+	return viewportHeight / (2.f * tan(0.5f * fovY));
+}
+
+unsigned selectLod(const MeshLodChain& chain, float distance, float projectionScale,
+	float maxPixelError, float objectScale)
+{
+	distance = std::max(distance, 1e-4f);
+	for (unsigned i = chain.levels.size() - 1; i > 0; i--)
+	{
+		const float pixels = chain.levels[i].error * objectScale / distance * projectionScale;
+		if (pixels <= maxPixelError) return i;
+	}
+	return 0;
+}
+
+}
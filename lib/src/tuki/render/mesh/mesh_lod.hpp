@@ -0,0 +1,73 @@
+#pragma once
+
+#include "mesh.hpp"
+#include <vector>
+
+/*
+Level of detail generation with quadric error metrics (Garland & Heckbert).
+The simplifier only performs half edge collapses (one vertex is merged into
+one of its neighbours) so the simplified meshes use a subset of the original
+vertices. This way all the LODs can share the vertex buffer and we only need to
+store an index range for each level.
+The collapse cost is the quadric error plus the difference of the attributes
+(normals, texture coordinates and colors) that would be lost. Vertices on the
+borders and on attribute seams are never removed.
+*/
+
+struct MeshLodSettings
+{
+	// target index count of each lod relative to the original mesh
+	std::vector<float> ratios;
+	// weights for the attributes in the collapse cost
+	float normalWeight;
+	float texCoordWeight;
+	float colorWeight;
+	// maximum error, relative to the size of the mesh, the simplifier will stop before that
+	float maxError;
+
+	MeshLodSettings() :
+		ratios({ 0.5f, 0.25f, 0.125f, 0.0625f }),
+		normalWeight(0.5f), texCoordWeight(1.f), colorWeight(0.5f),
+		maxError(0.05f) {}
+};
+
+struct MeshLodLevel
+{
+	unsigned firstIndex;
+	unsigned numIndices;
+	float error;	// geometric error in mesh units
+};
+
+struct MeshLodChain
+{
+	// the indices of all the lods one after another, lod 0 is the original mesh
+	std::vector<unsigned> indices;
+	std::vector<MeshLodLevel> levels;
+};
+
+namespace MeshLod
+{
+
+// simplify the triangle list indices of the mesh trying to reach the target index count
+// returns the number of indices written in out (which must have room for numIndices)
+// error receives the geometric error in mesh units
+unsigned simplify(
+	const IMesh& mesh,
+	const unsigned* indices, unsigned numIndices,
+	unsigned targetNumIndices,
+	unsigned* out,
+	float& error,
+	const MeshLodSettings& settings = MeshLodSettings());
+
+// builds the lod chain. The lods that can't be reduced enough are skipped
+MeshLodChain generateLods(const IMesh& mesh, const MeshLodSettings& settings = MeshLodSettings());
+
+// factor to convert from view space size at distance 1 to pixels
+float computeProjectionScale(float fovY, float viewportHeight);
+
+// the coarsest lod whose projected error is below maxPixelError
+// objectScale is the scale of the object transform
+unsigned selectLod(const MeshLodChain& chain, float distance, float projectionScale,
+	float maxPixelError = 1.f, float objectScale = 1.f);
+
+}
@@ -0,0 +1,440 @@
+#include "mesh_optimizer.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+// Forsyth's scoring parameters
+const unsigned FORSYTH_CACHE_SIZE = 32;
+const unsigned FORSYTH_MAX_VALENCE = 64;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRI_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+struct ForsythScoreTables
+{
+	float cache[FORSYTH_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE];
+
+	ForsythScoreTables()
+	{
+		for (unsigned i = 0; i < FORSYTH_CACHE_SIZE; i++)
+		{
+			if (i < 3)
+			{
+				// the vertices of the last triangle, we don't want to use the same triangle again
+				cache[i] = FORSYTH_LAST_TRI_SCORE;
+			}
+			else
+			{
+				const float scaler = 1.f / (FORSYTH_CACHE_SIZE - 3);
+				cache[i] = pow(1.f - (i - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+			}
+		}
+		valence[0] = 0;
+		for (unsigned i = 1; i < FORSYTH_MAX_VALENCE; i++)
+		{
+			// boost the vertices with few triangles left so we don't leave them alone
+			valence[i] = FORSYTH_VALENCE_BOOST_SCALE * pow((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+		}
+	}
+
+	float getScore(int cachePos, unsigned remainingTris)const
+	{
+		if (remainingTris == 0) return -1;
+		float score = cachePos < 0 ? 0 : cache[cachePos];
+		return score + valence[std::min(remainingTris, FORSYTH_MAX_VALENCE - 1)];
+	}
+};
+
+// fifo cache simulation with timestamps, resetting is just advancing the time
+class FifoCache
+{
+public:
+	FifoCache(unsigned numVertices, unsigned cacheSize) :
+		cacheTime(numVertices, 0), cacheSize(cacheSize), time(cacheSize + 1) {}
+
+	unsigned access(unsigned v)
+	{
+		if (time - cacheTime[v] > cacheSize)
+		{
+			cacheTime[v] = time++;
+			return 1;
+		}
+		return 0;
+	}
+	unsigned accessTriangle(const unsigned* tri)
+	{
+		return access(tri[0]) + access(tri[1]) + access(tri[2]);
+	}
+	void reset() { time += cacheSize + 1; }
+
+private:
+	vector<unsigned> cacheTime;
+	unsigned cacheSize;
+	unsigned time;
+};
+
+}
+
+namespace MeshOptimizer
+{
+
+VertexCacheStats analyzeVertexCache(const unsigned* indices, unsigned numIndices,
+	unsigned numVertices, unsigned cacheSize)
+{
+	VertexCacheStats stats = {};
+	FifoCache cache(numVertices, cacheSize);
+	vector<bool> used(numVertices, false);
+	unsigned numUsed = 0;
+	for (unsigned i = 0; i < numIndices; i++)
+	{
+		stats.numTransforms += cache.access(indices[i]);
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = true;
+			numUsed++;
+		}
+	}
+	const unsigned nt = numIndices / 3;
+	stats.acmr = nt ? (float)stats.numTransforms / nt : 0;
+	stats.atvr = numUsed ? (float)stats.numTransforms / numUsed : 0;
+	return stats;
+}
+
+void optimizeVertexCache(const unsigned* indices, unsigned numIndices,
+	unsigned numVertices, unsigned* out)
+{
+	assert(indices != out);
+	static const ForsythScoreTables tables;
+	const unsigned nt = numIndices / 3;
+	const unsigned nv = numVertices;
+	if (nt == 0) return;
+
+	// vertex -> triangles adjacency, the first remainingTris[v] of each vertex are the live ones
+	vector<unsigned> triOffsets(nv + 1, 0);
+	for (unsigned i = 0; i < 3 * nt; i++) triOffsets[indices[i] + 1]++;
+	for (unsigned v = 0; v < nv; v++) triOffsets[v + 1] += triOffsets[v];
+	vector<unsigned> triList(3 * nt);
+	vector<unsigned> remainingTris(nv, 0);
+	for (unsigned i = 0; i < 3 * nt; i++)
+	{
+		const unsigned v = indices[i];
+		triList[triOffsets[v] + remainingTris[v]++] = i / 3;
+	}
+
+	vector<int> cachePos(nv, -1);
+	vector<float> vertexScores(nv);
+	for (unsigned v = 0; v < nv; v++) vertexScores[v] = tables.getScore(-1, remainingTris[v]);
+
+	auto triangleScore = [&](unsigned t)
+	{
+		const unsigned* tri = &indices[3 * t];
+		return vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+	};
+
+	vector<bool> emitted(nt, false);
+	unsigned best = 0;
+	float bestScore = triangleScore(0);
+	for (unsigned t = 1; t < nt; t++)
+	{
+		const float score = triangleScore(t);
+		if (score > bestScore)
+		{
+			best = t;
+			bestScore = score;
+		}
+	}
+
+	unsigned cache[FORSYTH_CACHE_SIZE + 3];
+	unsigned cacheCount = 0;
+	unsigned scan = 0;
+
+	for (unsigned numEmitted = 0; numEmitted < nt; numEmitted++)
+	{
+		if (best == nt)
+		{
+			// nothing in the cache, continue with the next triangle in the original order
+			while (emitted[scan]) scan++;
+			best = scan;
+		}
+
+		const unsigned* tri = &indices[3 * best];
+		out[3 * numEmitted + 0] = tri[0];
+		out[3 * numEmitted + 1] = tri[1];
+		out[3 * numEmitted + 2] = tri[2];
+		emitted[best] = true;
+
+		// remove the triangle from the live lists
+		for (unsigned k = 0; k < 3; k++)
+		{
+			const unsigned v = tri[k];
+			unsigned* list = &triList[triOffsets[v]];
+			const unsigned n = remainingTris[v];
+			for (unsigned j = 0; j < n; j++)
+			{
+				if (list[j] == best)
+				{
+					swap(list[j], list[n - 1]);
+					break;
+				}
+			}
+			remainingTris[v]--;
+		}
+
+		// move the triangle vertices to the front of the LRU cache
+		unsigned newCache[FORSYTH_CACHE_SIZE + 3];
+		unsigned newCount = 0;
+		for (unsigned k = 0; k < 3; k++) newCache[newCount++] = tri[k];
+		for (unsigned i = 0; i < cacheCount; i++)
+		{
+			const unsigned v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) newCache[newCount++] = v;
+		}
+
+		// update the scores of the vertices that were in the cache, the last ones are evicted
+		for (unsigned i = 0; i < newCount; i++)
+		{
+			const unsigned v = newCache[i];
+			cachePos[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+			vertexScores[v] = tables.getScore(cachePos[v], remainingTris[v]);
+		}
+		cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+		copy(newCache, newCache + cacheCount, cache);
+
+		// the next triangle is the best one that uses vertices of the cache
+		best = nt;
+		bestScore = -1;
+		for (unsigned i = 0; i < newCount; i++)
+		{
+			const unsigned v = newCache[i];
+			const unsigned* list = &triList[triOffsets[v]];
+			for (unsigned j = 0; j < remainingTris[v]; j++)
+			{
+				const unsigned t = list[j];
+				const float score = triangleScore(t);
+				if (score > bestScore)
+				{
+					best = t;
+					bestScore = score;
+				}
+			}
+		}
+	}
+}
+
+void optimizeOverdraw(const unsigned* indices, unsigned numIndices,
+	const float* positions, unsigned numVertices, unsigned* out, float threshold)
+{
+	assert(indices != out);
+	const unsigned CACHE_SIZE = 16;
+	const unsigned nt = numIndices / 3;
+	if (nt == 0) return;
+	const vec3* pos = (const vec3*)positions;
+
+	// hard boundaries: the triangles where the cache optimizer had to start again
+	vector<unsigned> hardClusters;
+	{
+		FifoCache cache(numVertices, CACHE_SIZE);
+		for (unsigned t = 0; t < nt; t++)
+		{
+			if (cache.accessTriangle(&indices[3 * t]) == 3) hardClusters.push_back(t);
+		}
+		if (hardClusters.empty() || hardClusters[0] != 0) hardClusters.insert(hardClusters.begin(), 0);
+	}
+
+	// soft boundaries: split the hard clusters when the cache efficiency
+	// so far is good enough compared with the whole cluster
+	vector<unsigned> clusters;
+	{
+		FifoCache cache(numVertices, CACHE_SIZE);
+		for (unsigned c = 0; c < hardClusters.size(); c++)
+		{
+			const unsigned begin = hardClusters[c];
+			const unsigned end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : nt;
+
+			cache.reset();
+			unsigned clusterMisses = 0;
+			for (unsigned t = begin; t < end; t++) clusterMisses += cache.accessTriangle(&indices[3 * t]);
+			const float clusterThreshold = threshold * clusterMisses / (end - begin);
+
+			cache.reset();
+			unsigned start = begin;
+			unsigned misses = 0;
+			clusters.push_back(begin);
+			for (unsigned t = begin; t + 1 < end; t++)
+			{
+				misses += cache.accessTriangle(&indices[3 * t]);
+				if (misses <= clusterThreshold * (t + 1 - start))
+				{
+					start = t + 1;
+					misses = 0;
+					cache.reset();
+					clusters.push_back(start);
+				}
+			}
+		}
+	}
+	const unsigned numClusters = clusters.size();
+
+	// clusters that face outwards and are far from the center go first
+	auto triangleData = [&](unsigned t, vec3& center, vec3& normal)
+	{
+		const vec3& p0 = pos[indices[3 * t]];
+		const vec3& p1 = pos[indices[3 * t + 1]];
+		const vec3& p2 = pos[indices[3 * t + 2]];
+		center = (p0 + p1 + p2) * (1.f / 3);
+		normal = cross(p1 - p0, p2 - p0);	// length is 2 * area
+	};
+	vec3 meshCenter(0);
+	float meshArea = 0;
+	for (unsigned t = 0; t < nt; t++)
+	{
+		vec3 c, n;
+		triangleData(t, c, n);
+		const float area = length(n);
+		meshCenter += c * area;
+		meshArea += area;
+	}
+	meshCenter = meshArea > 0 ? meshCenter / meshArea : pos[indices[0]];
+
+	vector<float> sortKeys(numClusters);
+	for (unsigned c = 0; c < numClusters; c++)
+	{
+		const unsigned begin = clusters[c];
+		const unsigned end = c + 1 < numClusters ? clusters[c + 1] : nt;
+		vec3 center(0), normal(0);
+		float area = 0;
+		for (unsigned t = begin; t < end; t++)
+		{
+			vec3 tc, tn;
+			triangleData(t, tc, tn);
+			const float a = length(tn);
+			center += tc * a;
+			normal += tn;
+			area += a;
+		}
+		if (area > 0) center /= area;
+		const float normalLen = length(normal);
+		if (normalLen > 0) normal /= normalLen;
+		sortKeys[c] = dot(center - meshCenter, normal);
+	}
+
+	vector<unsigned> order(numClusters);
+	for (unsigned c = 0; c < numClusters; c++) order[c] = c;
+	stable_sort(order.begin(), order.end(),
+		[&sortKeys](unsigned a, unsigned b) { return sortKeys[a] > sortKeys[b]; });
+
+	unsigned* dst = out;
+	for (unsigned c : order)
+	{
+		const unsigned begin = clusters[c];
+		const unsigned end = c + 1 < numClusters ? clusters[c + 1] : nt;
+		dst = copy(indices + 3 * begin, indices + 3 * end, dst);
+	}
+}
+
+unsigned optimizeVertexFetch(unsigned* indices, unsigned numIndices,
+	unsigned numVertices, unsigned* remap)
+{
+	fill(remap, remap + numVertices, INVALID_VERTEX);
+	unsigned next = 0;
+	for (unsigned i = 0; i < numIndices; i++)
+	{
+		unsigned& r = remap[indices[i]];
+		if (r == INVALID_VERTEX) r = next++;
+		indices[i] = r;
+	}
+	return next;
+}
+
+void remapVertexData(const float* src, unsigned numVertices, unsigned numComponents,
+	const unsigned* remap, float* dst)
+{
+	for (unsigned v = 0; v < numVertices; v++)
+	{
+		if (remap[v] == INVALID_VERTEX) continue;
+		copy(src + numComponents * v, src + numComponents * (v + 1), dst + numComponents * remap[v]);
+	}
+}
+
+Mesh optimize(const IMesh& mesh, MeshOptimizerReport* report)
+{
+	assert(mesh.getGeomType() == GeomType::TRIANGLES);
+	const unsigned nv = mesh.getNumVertices();
+
+	vector<unsigned> indices;
+	if (mesh.hasIndices())
+	{
+		indices.assign(mesh.getIndices(), mesh.getIndices() + mesh.getNumIndices());
+	}
+	else
+	{
+		indices.resize(nv);
+		for (unsigned i = 0; i < nv; i++) indices[i] = i;
+	}
+	const unsigned ni = indices.size();
+	if (ni < 3)
+	{
+		throw runtime_error("can't optimize a mesh without triangles");
+	}
+
+	if (report) report->before = analyzeVertexCache(&indices[0], ni, nv);
+
+	vector<unsigned> tmp(ni);
+	optimizeVertexCache(&indices[0], ni, nv, &tmp[0]);
+	if (mesh.hasAttribData(AttribLocation::POS))
+	{
+		optimizeOverdraw(&tmp[0], ni, mesh.getAttribData(AttribLocation::POS), nv, &indices[0]);
+	}
+	else
+	{
+		indices.swap(tmp);
+	}
+
+	vector<unsigned> remap(nv);
+	const unsigned newNv = optimizeVertexFetch(&indices[0], ni, nv, &remap[0]);
+
+	if (report) report->after = analyzeVertexCache(&indices[0], ni, newNv);
+
+	// the attributes that Mesh can store
+	const AttribLocation attribs[] =
+	{
+		AttribLocation::POS,
+		AttribLocation::NORMAL,
+		AttribLocation::TANGENT,
+		AttribLocation::COLOR,
+		AttribLocation::TEX_COORD
+	};
+	const unsigned numAttribs = sizeof(attribs) / sizeof(attribs[0]);
+	vector<float> data[numAttribs];
+	const float* dataPtrs[numAttribs];
+	for (unsigned i = 0; i < numAttribs; i++)
+	{
+		dataPtrs[i] = nullptr;
+		const float* src = mesh.getAttribData(attribs[i]);
+		if (!src) continue;
+		const unsigned numComp = ATTRIB_NUM_COMPONENTS[(int)attribs[i]];
+		data[i].resize(numComp * newNv);
+		remapVertexData(src, nv, numComp, &remap[0], &data[i][0]);
+		dataPtrs[i] = &data[i][0];
+	}
+
+	Mesh res;
+	res.initVertexData(newNv, dataPtrs[0], dataPtrs[1], dataPtrs[2], dataPtrs[3], dataPtrs[4]);
+	res.initTrianglesData(ni / 3, &indices[0]);
+	return res;
+}
+
+}
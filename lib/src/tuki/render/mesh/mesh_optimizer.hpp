@@ -0,0 +1,61 @@
+#pragma once
+
+#include "mesh.hpp"
+
+/*
+Reordering of the triangles and vertices of a mesh for faster rendering:
+ - vertex cache: Forsyth's algorithm reorders the triangles so the vertices
+   are reused while they are still in the post-transform cache
+ - overdraw: the cache optimized triangles are split in clusters and the
+   clusters that face outwards are drawn first, so they can occlude the rest
+ - vertex fetch: the vertices are renumbered in the order they are first
+   used, so the vertex data is read sequentially
+The standalone functions work on raw index lists so they can be used with any IMesh.
+*/
+
+struct VertexCacheStats
+{
+	unsigned numTransforms;	// number of vertex shader invocations
+	float acmr;		// average cache miss ratio: transformed vertices per triangle (0.5 is ideal)
+	float atvr;		// average transformed vertex ratio: transformed vertices per vertex (1 is ideal)
+};
+
+struct MeshOptimizerReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+namespace MeshOptimizer
+{
+
+const unsigned INVALID_VERTEX = ~0u;
+
+// simulates a FIFO post-transform cache
+VertexCacheStats analyzeVertexCache(const unsigned* indices, unsigned numIndices,
+	unsigned numVertices, unsigned cacheSize = 16);
+
+// out can't be the same as indices
+void optimizeVertexCache(const unsigned* indices, unsigned numIndices,
+	unsigned numVertices, unsigned* out);
+
+// indices should be already optimized for the vertex cache
+// threshold: how much the cache efficiency can get worse to make smaller clusters (1.05 means 5% worse)
+// positions are 3 floats per vertex. out can't be the same as indices
+void optimizeOverdraw(const unsigned* indices, unsigned numIndices,
+	const float* positions, unsigned numVertices, unsigned* out, float threshold = 1.05f);
+
+// rewrites the indices in place and fills remap (numVertices elements) with
+// the new position of each vertex, INVALID_VERTEX for the unused ones
+// returns the number of used vertices
+unsigned optimizeVertexFetch(unsigned* indices, unsigned numIndices,
+	unsigned numVertices, unsigned* remap);
+
+// dst must have room for the used vertices
+void remapVertexData(const float* src, unsigned numVertices, unsigned numComponents,
+	const unsigned* remap, float* dst);
+
+// all the steps above. Only the attributes supported by Mesh are kept
+Mesh optimize(const IMesh& mesh, MeshOptimizerReport* report = nullptr);
+
+}
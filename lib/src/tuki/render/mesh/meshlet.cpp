@@ -0,0 +1,248 @@
+#include "meshlet.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+void computeMeshletBounds(Meshlet& m, const MeshletData& data, const vec3* positions)
+{
+	const unsigned* verts = &data.vertices[m.vertexOffset];
+	const unsigned char* tris = &data.triangles[3 * m.triangleOffset];
+
+	// sphere: center of the box and the farthest vertex
+	AABB box = AABB::makeEmpty();
+	for (unsigned i = 0; i < m.vertexCount; i++) box = AABB::merge(box, positions[verts[i]]);
+	const vec3 center = box.getCenter();
+	float radius2 = 0;
+	for (unsigned i = 0; i < m.vertexCount; i++)
+	{
+		const vec3 d = positions[verts[i]] - center;
+		radius2 = std::max(radius2, dot(d, d));
+	}
+	m.bounds = Sphere(center, sqrt(radius2));
+
+	// cone: average normal and the widest angle to it
+	vector<vec3> normals;
+	normals.reserve(m.triangleCount);
+	vec3 axis(0);
+	for (unsigned i = 0; i < m.triangleCount; i++)
+	{
+		const vec3& p0 = positions[verts[tris[3 * i]]];
+		const vec3& p1 = positions[verts[tris[3 * i + 1]]];
+		const vec3& p2 = positions[verts[tris[3 * i + 2]]];
+		vec3 n = cross(p1 - p0, p2 - p0);
+		const float len = length(n);
+		if (len == 0) continue;
+		n /= len;
+		normals.push_back(n);
+		axis += n;
+	}
+	m.coneAxis = vec3(0, 0, 1);
+	m.coneCutoff = 1;
+	const float axisLen = length(axis);
+	if (axisLen < 1e-4f) return;
+	axis /= axisLen;
+	float minDot = 1;
+	for (const vec3& n : normals) minDot = std::min(minDot, dot(axis, n));
+	m.coneAxis = axis;
+	if (minDot > 0) m.coneCutoff = sqrt(1 - minDot * minDot);
+}
+
+}
+
+namespace Meshlets
+{
+
+MeshletData build(const IMesh& mesh, unsigned maxVertices, unsigned maxTriangles)
+{
+	assert(mesh.getGeomType() == GeomType::TRIANGLES);
+	assert(maxVertices >= 3 && maxVertices <= 256 && maxTriangles >= 1);
+
+	MeshletData data;
+	const unsigned nv = mesh.getNumVertices();
+	const unsigned* indices = mesh.getIndices();
+	const unsigned ni = indices ? mesh.getNumIndices() : nv;
+	const unsigned nt = ni / 3;
+	if (nt == 0) return data;
+	auto getIndex = [indices](unsigned i) { return indices ? indices[i] : i; };
+
+	// vertex -> triangles adjacency
+	vector<unsigned> triOffsets(nv + 1, 0);
+	for (unsigned i = 0; i < 3 * nt; i++) triOffsets[getIndex(i) + 1]++;
+	for (unsigned v = 0; v < nv; v++) triOffsets[v + 1] += triOffsets[v];
+	vector<unsigned> triList(3 * nt);
+	{
+		vector<unsigned> fillPos(triOffsets.begin(), triOffsets.end() - 1);
+		for (unsigned i = 0; i < 3 * nt; i++) triList[fillPos[getIndex(i)]++] = i / 3;
+	}
+
+	vector<bool> emitted(nt, false);
+	vector<int> localIndex(nv, -1);
+	vector<unsigned> candidates;	// triangles adjacent to the current meshlet
+	unsigned scan = 0;				// first triangle that could not be emitted
+	const vec3* positions = (const vec3*)mesh.getAttribData(AttribLocation::POS);
+
+	Meshlet cur = {};
+	vec3 centerSum(0);	// sum of the positions of the vertices of the current meshlet
+	auto flush = [&]()
+	{
+		for (unsigned i = 0; i < cur.vertexCount; i++)
+		{
+			localIndex[data.vertices[cur.vertexOffset + i]] = -1;
+		}
+		computeMeshletBounds(cur, data, positions);
+		data.meshlets.push_back(cur);
+
+		// start the next meshlet next to this one
+		candidates.clear();
+		for (unsigned i = 0; i < cur.vertexCount; i++)
+		{
+			const unsigned v = data.vertices[cur.vertexOffset + i];
+			for (unsigned j = triOffsets[v]; j < triOffsets[v + 1]; j++)
+			{
+				if (!emitted[triList[j]]) candidates.push_back(triList[j]);
+			}
+		}
+
+		cur = Meshlet();
+		centerSum = vec3(0);
+		cur.vertexOffset = (unsigned)data.vertices.size();
+		cur.triangleOffset = (unsigned)data.triangles.size() / 3;
+	};
+	auto getTriangleCenter = [&](unsigned t)
+	{
+		const vec3 sum = positions[getIndex(3 * t)] + positions[getIndex(3 * t + 1)] + positions[getIndex(3 * t + 2)];
+		return sum * (1.f / 3);
+	};
+	auto countNewVertices = [&](unsigned t)
+	{
+		unsigned count = 0;
+		for (unsigned k = 0; k < 3; k++) count += localIndex[getIndex(3 * t + k)] < 0;
+		return count;
+	};
+
+	for (unsigned numEmitted = 0; numEmitted < nt; )
+	{
+		// the adjacent triangle that adds less vertices, removing the already emitted ones
+		// ties are broken by the distance to the center of the meshlet so it grows round
+		unsigned best = nt;
+		unsigned bestNew = 4;
+		float bestDist = 0;
+		const vec3 center = cur.vertexCount ? centerSum / (float)cur.vertexCount : vec3(0);
+		unsigned w = 0;
+		for (unsigned i = 0; i < candidates.size(); i++)
+		{
+			const unsigned t = candidates[i];
+			if (emitted[t]) continue;
+			candidates[w++] = t;
+			const unsigned numNew = countNewVertices(t);
+			if (numNew > bestNew) continue;
+			const vec3 d = getTriangleCenter(t) - center;
+			const float dist = dot(d, d);
+			if (numNew < bestNew || dist < bestDist)
+			{
+				best = t;
+				bestNew = numNew;
+				bestDist = dist;
+			}
+		}
+		candidates.resize(w);
+
+		// disconnected: continue with the next triangle in index order
+		if (best == nt)
+		{
+			while (emitted[scan]) scan++;
+			best = scan;
+			bestNew = countNewVertices(best);
+		}
+
+		if (cur.vertexCount + bestNew > maxVertices || cur.triangleCount + 1 > maxTriangles)
+		{
+			flush();
+			continue;
+		}
+
+		for (unsigned k = 0; k < 3; k++)
+		{
+			const unsigned v = getIndex(3 * best + k);
+			if (localIndex[v] < 0)
+			{
+				localIndex[v] = cur.vertexCount++;
+				data.vertices.push_back(v);
+				centerSum += positions[v];
+				for (unsigned j = triOffsets[v]; j < triOffsets[v + 1]; j++)
+				{
+					if (!emitted[triList[j]]) candidates.push_back(triList[j]);
+				}
+			}
+			data.triangles.push_back((unsigned char)localIndex[v]);
+		}
+		cur.triangleCount++;
+		emitted[best] = true;
+		numEmitted++;
+	}
+	if (cur.triangleCount) flush();
+
+	return data;
+}
+
+vector<unsigned> buildIndices(const MeshletData& data)
+{
+	vector<unsigned> indices(data.triangles.size());
+	for (const Meshlet& m : data.meshlets)
+	{
+		const unsigned* verts = &data.vertices[m.vertexOffset];
+		const unsigned first = 3 * m.triangleOffset;
+		for (unsigned i = 0; i < 3 * m.triangleCount; i++)
+		{
+			indices[first + i] = verts[data.triangles[first + i]];
+		}
+	}
+	return indices;
+}
+
+unsigned cull(const MeshletData& data,
+	const mat4& viewProj, const mat4& modelMat, const vec3& cameraPos,
+	MeshletDrawRanges& out)
+{
+	out.clear();
+
+	// everything is tested in mesh space
+	const Frustum frustum = Frustum::fromMatrix(viewProj * modelMat);
+	const vec3 camera = vec3(inverse(modelMat) * vec4(cameraPos, 1));
+
+	unsigned numVisible = 0;
+	for (const Meshlet& m : data.meshlets)
+	{
+		if (!intersects(m.bounds, frustum)) continue;
+
+		// all the triangles are backfacing
+		const vec3 d = m.bounds.center - camera;
+		if (dot(d, m.coneAxis) >= m.coneCutoff * length(d) + m.bounds.radius) continue;
+
+		numVisible++;
+		const unsigned first = 3 * m.triangleOffset;
+		const unsigned count = 3 * m.triangleCount;
+		if (!out.firstElements.empty() &&
+			out.firstElements.back() + out.numElements.back() == first)
+		{
+			out.numElements.back() += count;
+		}
+		else
+		{
+			out.firstElements.push_back(first);
+			out.numElements.push_back(count);
+		}
+	}
+	return numVisible;
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "../../math/geometry.hpp"
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+/*
+Meshlets are small clusters of triangles of a mesh that can be culled
+independently. Each meshlet has a bounding sphere and a normal cone. When the
+camera is inside the "back side" of the cone all the triangles of the meshlet
+are backfacing and it can be skipped.
+The clusters are grown greedily from adjacent triangles, preferring the ones
+that don't add new vertices, so they are compact and the bounds are tight.
+*/
+
+const unsigned MESHLET_MAX_VERTICES = 64;
+const unsigned MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	unsigned vertexOffset;		// in MeshletData::vertices
+	unsigned triangleOffset;	// in triangles, MeshletData::triangles has 3 local indices per triangle
+	unsigned vertexCount;
+	unsigned triangleCount;
+
+	Sphere bounds;
+	glm::vec3 coneAxis;
+	// sin of the cone half angle (plus 90 deg), 1 when the cone can't be used for culling
+	float coneCutoff;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned> vertices;			// local vertex -> mesh vertex
+	std::vector<unsigned char> triangles;	// local vertex indices
+};
+
+// index ranges to be drawn with a multi draw call
+struct MeshletDrawRanges
+{
+	std::vector<unsigned> firstElements;
+	std::vector<unsigned> numElements;
+
+	unsigned getNumRanges()const { return (unsigned)firstElements.size(); }
+	void clear() { firstElements.clear(); numElements.clear(); }
+};
+
+namespace Meshlets
+{
+
+// only triangle meshes are supported
+MeshletData build(const IMesh& mesh,
+	unsigned maxVertices = MESHLET_MAX_VERTICES,
+	unsigned maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// index buffer, in mesh vertices, where meshlet i takes
+// 3 * triangleCount indices starting at 3 * triangleOffset
+std::vector<unsigned> buildIndices(const MeshletData& data);
+
+// frustum and backface cone culling. Consecutive visible meshlets are merged in one range
+// the ranges refer to the index buffer given by buildIndices()
+// returns the number of visible meshlets
+unsigned cull(const MeshletData& data,
+	const glm::mat4& viewProj, const glm::mat4& modelMat, const glm::vec3& cameraPos,
+	MeshletDrawRanges& out);
+
+}
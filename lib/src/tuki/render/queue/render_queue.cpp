@@ -0,0 +1,92 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <glm/common.hpp>
+#include "../../util/profiler.hpp"
+
+using namespace std;
+
+RenderSortKey RenderQueue::makeSortKey(unsigned layer, Material material, float depth)
+{
+	assert(layer < NUM_LAYERS);
+	MaterialManager* man = MaterialManager::getSingleton();
+	const PipelineStateId pipelineState = man->getMaterialPipelineState(material);
+	const uint64_t maxDepth = (1 << DEPTH_BITS) - 1;
+	const uint64_t qdepth = (uint64_t)(glm::clamp(depth, 0.f, 1.f) * maxDepth + 0.5f);
+	const uint64_t state = (uint64_t)pipelineState << 32 | material.getId();
+	RenderSortKey key = (uint64_t)layer << 60;
+	if (PipelineState::getState(pipelineState).isTranslucent())
+	{
+		key |= (uint64_t)1 << 59;
+		key |= (maxDepth - qdepth) << 40;
+		key |= state;
+	}
+	else
+	{
+		key |= state << DEPTH_BITS;
+		key |= qdepth;
+	}
+	return key;
+}
+
+void RenderQueue::push(const IMeshGpu& mesh, Material material, float depth, unsigned layer, uint32_t userData)
+{
+	RenderItem item;
+	item.key = makeSortKey(layer, material, depth);
+	item.mesh = &mesh;
+	item.material = material;
+	item.userData = userData;
+	items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+	TUKI_PROFILE_SCOPE("RenderQueue::sort");
+	std::sort(items.begin(), items.end(),
+		[](const RenderItem& a, const RenderItem& b)
+		{
+			return a.key < b.key;
+		});
+}
+
+void RenderQueue::beginDraw()
+{
+	stats = Stats();
+	stats.numDraws = (unsigned)items.size();
+	boundProgram = -1;
+	boundPipelineState = -1;
+	boundMaterial = 0xFFFFFFFF;
+	boundMesh = nullptr;
+}
+
+void RenderQueue::bindItem(const RenderItem& item)
+{
+	MaterialManager* man = MaterialManager::getSingleton();
+	if (item.material.getId() != boundMaterial)
+	{
+		ShaderProgram prog = man->getMaterialShaderProgram(item.material);
+		if (prog.getId() != boundProgram)
+		{
+			prog.use();
+			boundProgram = prog.getId();
+			stats.numProgramChanges++;
+		}
+		const PipelineStateId pipelineState = man->getMaterialPipelineState(item.material);
+		if (pipelineState != boundPipelineState)
+		{
+			PipelineState::apply(pipelineState);
+			boundPipelineState = pipelineState;
+			stats.numPipelineChanges++;
+		}
+		man->useMaterialBatched(item.material);
+		boundMaterial = item.material.getId();
+		stats.numMaterialChanges++;
+	}
+	if (item.mesh != boundMesh)
+	{
+		item.mesh->bind();
+		boundMesh = item.mesh;
+		stats.numMeshChanges++;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "../material/material.hpp"
+#include "../gl/mesh_gpu.hpp"
+#include "../gl/render.hpp"
+
+typedef std::uint64_t RenderSortKey;
+
+struct RenderItem
+{
+	RenderSortKey key;
+	const IMeshGpu* mesh;
+	Material material;
+	std::uint32_t userData;	// for the perDraw callback, i.e. the index of the object
+};
+
+/* Collects the draws of a frame and sorts them to minimize the state changes
+ The sort key, from the most significant bits:
+ - opaque:		[layer 4][0][pipeline state 8][template 16][instance 16][depth 19, near to far]
+ - translucent:	[layer 4][1][depth 19, far to near][pipeline state 8][template 16][instance 16]
+ The opaque draws are grouped by state, the translucent ones are drawn back to front and after the
+ opaque ones of the same layer. The pipeline state of the template decides if it's translucent */
+class RenderQueue
+{
+public:
+	static const unsigned NUM_LAYERS = 16;
+	static const unsigned DEPTH_BITS = 19;
+
+	struct Stats
+	{
+		unsigned numDraws;
+		unsigned numProgramChanges;
+		unsigned numPipelineChanges;
+		unsigned numMaterialChanges;
+		unsigned numMeshChanges;
+	};
+
+	// depth is normalized, in [0, 1] (0 is near)
+	static RenderSortKey makeSortKey(unsigned layer, Material material, float depth);
+
+	void reserve(std::size_t n) { items.reserve(n); }
+	void clear() { items.clear(); }
+	void push(const IMeshGpu& mesh, Material material, float depth, unsigned layer = 0, std::uint32_t userData = 0);
+	void sort();
+
+	// draws the items in order, only the state that differs from the previous item is set
+	// perDraw(const RenderItem&) is called before each draw, for the uniforms of the object
+	template <typename F>
+	void draw(F perDraw);
+
+	const std::vector<RenderItem>& getItems()const { return items; }
+	const Stats& getStats()const { return stats; }
+
+private:
+	void beginDraw();
+	void bindItem(const RenderItem& item);
+
+	// DATA //
+	std::vector<RenderItem> items;
+	Stats stats;
+	int boundProgram;
+	int boundPipelineState;
+	std::uint32_t boundMaterial;
+	const IMeshGpu* boundMesh;
+};
+
+template <typename F>
+void RenderQueue::draw(F perDraw)
+{
+	beginDraw();
+	for (const RenderItem& item : items)
+	{
+		bindItem(item);
+		perDraw(item);
+		RenderApi::draw(*item.mesh);
+	}
+}
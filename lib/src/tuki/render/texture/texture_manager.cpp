@@ -0,0 +1,277 @@
+#include "texture_manager.hpp"
+
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
+#include "../../util/util.hpp"
+#include "../../util/profiler.hpp"
+#include "../../util/vfs.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cassert>
+#include <glm/common.hpp>
+
+using namespace std;
+using namespace rapidjson;
+
+TextureManager::TextureManager()
+	: numEntries(0)
+	, frame(0)
+	, vramBudget((size_t)-1)
+	, residentVram(0)
+{
+	entries.reserve(MAX_TEXTURES);
+	// constructed before, so they are destroyed after waiting for the jobs in the destructor
+	JobSystem::getSingleton();
+	Vfs::getSingleton();
+
+	lock_guard<std::mutex> lock(mutex);
+	setConstantColor(addTexture("white", true), glm::vec4(1, 1, 1, 1));
+	setConstantColor(addTexture("black", true), glm::vec4(0, 0, 0, 1));
+	setConstantColor(addTexture("magenta", true), glm::vec4(1, 0, 1, 1));
+}
+
+TextureManager::~TextureManager()
+{
+	if (!loadJobs.isDone()) JobSystem::getSingleton()->wait(loadJobs);
+	// the GL textures are released with the context
+	for (Entry* entry : entries)
+	{
+		if (entry->image.getData() != nullptr) entry->image.free();
+		delete entry;
+	}
+}
+
+TextureHandle TextureManager::loadTexture(const string& path)
+{
+	lock_guard<std::mutex> lock(mutex);
+	const auto it = pathToHandle.find(NameId(path));
+	if (it != pathToHandle.end()) return it->second;
+	return addTexture(path.c_str(), false);
+}
+
+TextureHandle TextureManager::getTexture(NameId path)const
+{
+	lock_guard<std::mutex> lock(mutex);
+	const auto it = pathToHandle.find(path);
+	return it == pathToHandle.end() ? INVALID_TEXTURE : it->second;
+}
+
+const char* TextureManager::getTexturePath(TextureHandle handle)const
+{
+	assert(handle < numEntries.load(memory_order_acquire));
+	return entries[handle]->path;
+}
+
+void TextureManager::loadConstantTextures(const string& fileName)
+{
+	const string txt = loadStringFromFile(fileName.c_str());
+	Document doc;
+	doc.Parse(txt.c_str());
+	if (doc.HasParseError())
+	{
+		throw runtime_error(fileName + ": " + GetParseError_En(doc.GetParseError()));
+	}
+	if (!doc.IsObject()) throw runtime_error(fileName + ": must be an object");
+
+	for (Value::ConstMemberIterator it = doc.MemberBegin(); it != doc.MemberEnd(); ++it)
+	{
+		const string name = it->name.GetString();
+		const Value& val = it->value;
+		if (!val.IsArray() || val.Size() < 3 || val.Size() > 4)
+		{
+			throw runtime_error(fileName + ": " + name + " must be an array of 3 or 4 numbers");
+		}
+		glm::vec4 color(1);
+		for (unsigned i = 0; i < val.Size(); i++)
+		{
+			if (!val[i].IsNumber()) throw runtime_error(fileName + ": " + name + " must be an array of numbers");
+			color[i] = val[i].GetFloat();
+		}
+
+		TextureHandle handle;
+		{
+			lock_guard<std::mutex> lock(mutex);
+			const auto handleIt = pathToHandle.find(NameId(name));
+			if (handleIt == pathToHandle.end())
+			{
+				handle = addTexture(name.c_str(), true);
+			}
+			else
+			{
+				handle = handleIt->second;
+				if (!entries[handle]->constant) throw runtime_error(fileName + ": " + name + " is the path of a texture");
+			}
+		}
+		setConstantColor(handle, color);
+	}
+}
+
+void TextureManager::bind(TextureHandle handle, unsigned unit)
+{
+	assert(handle < numEntries.load(memory_order_acquire));
+	Entry& entry = *entries[handle];
+	entry.lastUsedFrame = frame;
+
+	uint8_t state = entry.state.load(memory_order_acquire);
+	if (state == UNLOADED || (state == READY && entry.droppedMips > 0))
+	{
+		// the dropped mips are loaded again from the file
+		JobSystem* js = JobSystem::getSingleton();
+		if (js->getNumThreads() > 1)
+		{
+			entry.state.store(LOADING, memory_order_relaxed);
+			js->run([this, handle] { decode(handle); }, &loadJobs);
+		}
+		else
+		{
+			// without workers the job would wait in the queue of this thread until waitLoads()
+			decode(handle);
+			state = entry.state.load(memory_order_acquire);
+		}
+	}
+	if (state == DECODED)
+	{
+		upload(entry);
+	}
+
+	if (entry.texture.getId() != -1)	entry.texture.bindToUnit(unit);
+	else if (state == FAILED)			bind(MAGENTA, unit);
+	else								bind(WHITE, unit);
+}
+
+void TextureManager::update()
+{
+	TUKI_PROFILE_SCOPE("TextureManager::update");
+	frame++;
+	if (residentVram <= vramBudget) return;
+
+	// the textures not bound in the last frame, least recently used first
+	vector<TextureHandle> candidates;
+	const unsigned n = numEntries.load(memory_order_acquire);
+	for (TextureHandle handle = 0; handle < n; handle++)
+	{
+		const Entry& entry = *entries[handle];
+		const Texture& tex = entry.texture;
+		if (!entry.constant && tex.getId() != -1 && frame - entry.lastUsedFrame > 1 &&
+			max(tex.getWidth(), tex.getHeight()) > MIN_EVICTED_SIZE)
+		{
+			candidates.push_back(handle);
+		}
+	}
+	sort(candidates.begin(), candidates.end(),
+		[this](TextureHandle a, TextureHandle b)
+		{
+			return entries[a]->lastUsedFrame < entries[b]->lastUsedFrame;
+		});
+
+	// one mip each time, so the most recently used keep more resolution
+	bool dropped = true;
+	while (dropped)
+	{
+		dropped = false;
+		for (TextureHandle handle : candidates)
+		{
+			Entry& entry = *entries[handle];
+			if (max(entry.texture.getWidth(), entry.texture.getHeight()) <= MIN_EVICTED_SIZE) continue;
+			dropTopMip(entry);
+			dropped = true;
+			if (residentVram <= vramBudget) return;
+		}
+	}
+}
+
+void TextureManager::waitLoads()
+{
+	JobSystem::getSingleton()->wait(loadJobs);
+}
+
+bool TextureManager::isResident(TextureHandle handle)const
+{
+	assert(handle < numEntries.load(memory_order_acquire));
+	return entries[handle]->texture.getId() != -1;
+}
+
+unsigned TextureManager::getDroppedMips(TextureHandle handle)const
+{
+	assert(handle < numEntries.load(memory_order_acquire));
+	return entries[handle]->droppedMips;
+}
+
+TextureHandle TextureManager::addTexture(const char* path, bool constant)
+{
+	// the mutex must be locked
+	if (entries.size() >= MAX_TEXTURES) throw runtime_error("too many textures");
+	const NameId id = NameId::intern(path);
+	Entry* entry = new Entry;
+	entry->path = id.getString();
+	entry->state.store(UNLOADED, memory_order_relaxed);
+	entry->constant = constant;
+	entry->droppedMips = 0;
+	entry->lastUsedFrame = 0;
+
+	const TextureHandle handle = entries.size();
+	entries.push_back(entry);
+	pathToHandle[id] = handle;
+	numEntries.store(entries.size(), memory_order_release);
+	return handle;
+}
+
+void TextureManager::setConstantColor(TextureHandle handle, const glm::vec4& color)
+{
+	Entry& entry = *entries[handle];
+	if (entry.image.getData() != nullptr) entry.image.free();
+	entry.image = Image::createEmpty(1, 1, PixelFormat::RGBA8);
+	unsigned char* texel = (unsigned char*)entry.image.getData();
+	for (unsigned i = 0; i < 4; i++)
+		texel[i] = (unsigned char)(glm::clamp(color[i], 0.f, 1.f) * 255 + 0.5f);
+	entry.state.store(DECODED, memory_order_release);
+}
+
+void TextureManager::decode(TextureHandle handle)
+{
+	Entry& entry = *entries[handle];
+	try
+	{
+		entry.image = Image::loadFromFile(entry.path);
+		entry.state.store(DECODED, memory_order_release);
+	}
+	catch (const runtime_error& e)
+	{
+		cerr << e.what() << endl;
+		entry.state.store(FAILED, memory_order_release);
+	}
+}
+
+void TextureManager::upload(Entry& entry)
+{
+	TUKI_PROFILE_SCOPE("TextureManager::upload");
+	if (entry.texture.getId() != -1)
+	{
+		residentVram -= entry.texture.getVramSize();
+		entry.texture.free();
+	}
+	entry.texture = Texture::createFromImage(entry.image);
+	entry.image.free();
+	entry.texture.generateMipmaps();
+	entry.texture.setFilterMode(entry.constant ? TextureFilterMode::NEAREST : TextureFilterMode::TRILINEAR);
+	residentVram += entry.texture.getVramSize();
+	entry.droppedMips = 0;
+	entry.state.store(READY, memory_order_relaxed);
+}
+
+void TextureManager::dropTopMip(Entry& entry)
+{
+	TUKI_PROFILE_SCOPE("TextureManager::dropTopMip");
+	const TextureFilterMode filterMode = entry.texture.getFilterMode();
+	Image image = entry.texture.downloadImage(1);
+	residentVram -= entry.texture.getVramSize();
+	entry.texture.free();
+
+	entry.texture = Texture::createFromImage(image);
+	image.free();
+	entry.texture.generateMipmaps();
+	entry.texture.setFilterMode(filterMode);
+	residentVram += entry.texture.getVramSize();
+	entry.droppedMips++;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include <glm/vec4.hpp>
+
+#include "../gl/texture.hpp"
+#include "../../util/singleton.hpp"
+#include "../../util/flat_hash_map.hpp"
+#include "../../util/name_id.hpp"
+#include "../../util/job_system.hpp"
+
+// index of a texture in the TextureManager, it's what the texture slots of the materials store
+typedef std::uint32_t TextureHandle;
+
+/* manages the textures used by the materials, avoids duplicates
+ - loadTexture only registers the path. The file is decoded in a job the first time the texture
+   is bound and uploaded by the next bind after it's decoded. Meanwhile a constant texture is
+   bound instead: white while loading, magenta if the file couldn't be loaded. When the
+   JobSystem has no workers the file is decoded and uploaded in the first bind
+ - the constant textures are 1x1 and are never evicted. They can be used as paths by their name
+   ("white", "black", "magenta" and the ones of loadConstantTextures). White is the handle 0 so
+   the texture slots with zeroed values are white
+ - residency: update() keeps the VRAM of the textures under the budget. The top mip of the least
+   recently used textures that weren't bound in the last frame is dropped, down to
+   MIN_EVICTED_SIZE. When they are bound again they are loaded at full resolution
+ Thread safety:
+ - loadTexture, getTexture and getTexturePath can be called from any thread
+ - the rest must be called in the thread of the GL context */
+class TextureManager : public Singleton<TextureManager>
+{
+public:
+	static const TextureHandle WHITE = 0;
+	static const TextureHandle BLACK = 1;
+	static const TextureHandle MAGENTA = 2;
+	static const TextureHandle INVALID_TEXTURE = 0xFFFFFFFF;
+
+	static const unsigned MAX_TEXTURES = 0x10000;
+	static const int MIN_EVICTED_SIZE = 16;
+
+	// the texture of that path, if it has already been loaded returns the same handle
+	TextureHandle loadTexture(const std::string& path);
+	// INVALID_TEXTURE if it hasn't been loaded
+	TextureHandle getTexture(NameId path)const;
+	const char* getTexturePath(TextureHandle handle)const;
+
+	// colors of the constant textures: { "white": [1, 1, 1], "red": [1, 0, 0, 1] ... }
+	void loadConstantTextures(const std::string& fileName);
+
+	// binds the texture (or the fallback if it's not loaded yet) and starts loading it if needed
+	void bind(TextureHandle handle, unsigned unit);
+
+	// once per frame, drops mips if the textures use more VRAM than the budget
+	void update();
+	// waits until the textures being decoded are ready for the next bind
+	void waitLoads();
+
+	void setVramBudget(std::size_t bytes) { vramBudget = bytes; }
+	std::size_t getVramBudget()const { return vramBudget; }
+	std::size_t getResidentVram()const { return residentVram; }
+
+	bool isResident(TextureHandle handle)const;
+	unsigned getDroppedMips(TextureHandle handle)const;
+	std::uint32_t getFrame()const { return frame; }
+
+private:
+	friend class Singleton<TextureManager>;
+	TextureManager();
+	~TextureManager();
+
+	enum State : std::uint8_t
+	{
+		UNLOADED,
+		LOADING,	// being decoded in a job
+		DECODED,	// the image is ready to be uploaded
+		READY,
+		FAILED,
+	};
+
+	struct Entry
+	{
+		const char* path;	// interned
+		std::atomic<std::uint8_t> state;
+		bool constant;
+		std::uint8_t droppedMips;
+		std::uint32_t lastUsedFrame;
+		Texture texture;	// id -1 if not resident
+		Image image;		// written by the decoding job
+	};
+
+	TextureHandle addTexture(const char* path, bool constant);
+	void setConstantColor(TextureHandle handle, const glm::vec4& color);
+	void decode(TextureHandle handle);
+	void upload(Entry& entry);
+	void dropTopMip(Entry& entry);
+
+	// DATA //
+	// protects the path table and the creation of entries. The entries never move
+	mutable std::mutex mutex;
+	std::vector<Entry*> entries;
+	FlatHashMap<NameId, TextureHandle> pathToHandle;
+	std::atomic<unsigned> numEntries;
+
+	JobCounter loadJobs;
+	std::uint32_t frame;
+	std::size_t vramBudget;
+	std::size_t residentVram;
+};
@@ -0,0 +1,468 @@
+#include "bvh.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <limits>
+#include <glm/common.hpp>
+
+using namespace std;
+using namespace glm;
+
+Bvh::Bvh()
+	: root(NULL_NODE), freeList(NULL_NODE), numProxies(0), margin(0.1f)
+{
+
+}
+
+int Bvh::allocateNode()
+{
+	if (freeList == NULL_NODE)
+	{
+		Node node;
+		node.next = NULL_NODE;
+		node.height = -1;
+		nodes.push_back(node);
+		freeList = nodes.size() - 1;
+	}
+	const int id = freeList;
+	Node& node = nodes[id];
+	freeList = node.next;
+	node.parent = NULL_NODE;
+	node.child1 = node.child2 = NULL_NODE;
+	node.height = 0;
+	node.userData = nullptr;
+	return id;
+}
+
+void Bvh::freeNode(int id)
+{
+	assert(0 <= id && id < (int)nodes.size());
+	nodes[id].next = freeList;
+	nodes[id].height = -1;
+	freeList = id;
+}
+
+AABB Bvh::fatten(const AABB& box)const
+{
+	const vec3 m(margin);
+	return AABB(box.min - m, box.max + m);
+}
+
+int Bvh::createProxy(const AABB& box, void* userData)
+{
+	const int id = allocateNode();
+	nodes[id].box = fatten(box);
+	nodes[id].userData = userData;
+	insertLeaf(id);
+	numProxies++;
+	return id;
+}
+
+void Bvh::destroyProxy(int proxy)
+{
+	assert(nodes[proxy].isLeaf());
+	removeLeaf(proxy);
+	freeNode(proxy);
+	numProxies--;
+}
+
+bool Bvh::moveProxy(int proxy, const AABB& box)
+{
+	assert(nodes[proxy].isLeaf());
+	if (nodes[proxy].box.contains(box)) return false;
+
+	removeLeaf(proxy);
+	nodes[proxy].box = fatten(box);
+	insertLeaf(proxy);
+	return true;
+}
+
+void Bvh::clear()
+{
+	nodes.clear();
+	root = freeList = NULL_NODE;
+	numProxies = 0;
+}
+
+void Bvh::insertLeaf(int leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	// find the best sibling descending the tree with the SAH cost
+	const AABB leafBox = nodes[leaf].box;
+	int index = root;
+	while (!nodes[index].isLeaf())
+	{
+		const Node& node = nodes[index];
+		const float area = node.box.getSurfaceArea();
+		const float combinedArea = AABB::merge(node.box, leafBox).getSurfaceArea();
+
+		// cost of making a new parent for this node and the leaf
+		const float cost = 2 * combinedArea;
+		// minimum cost of pushing the leaf further down the tree
+		const float inheritanceCost = 2 * (combinedArea - area);
+
+		float childCosts[2];
+		const int children[2] = { node.child1, node.child2 };
+		for (int i = 0; i < 2; i++)
+		{
+			const Node& child = nodes[children[i]];
+			const float newArea = AABB::merge(leafBox, child.box).getSurfaceArea();
+			if (child.isLeaf()) childCosts[i] = newArea + inheritanceCost;
+			else childCosts[i] = newArea - child.box.getSurfaceArea() + inheritanceCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1]) break;
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+	const int sibling = index;
+
+	// create a new parent
+	const int oldParent = nodes[sibling].parent;
+	const int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = AABB::merge(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != NULL_NODE)
+	{
+		if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+		else nodes[oldParent].child2 = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	refitAncestors(nodes[leaf].parent);
+}
+
+void Bvh::removeLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	const int parent = nodes[leaf].parent;
+	const int grandParent = nodes[parent].parent;
+	const int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent != NULL_NODE)
+	{
+		// connect the sibling to the grand parent and destroy the parent
+		if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+		else nodes[grandParent].child2 = sibling;
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+		refitAncestors(grandParent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		freeNode(parent);
+	}
+}
+
+void Bvh::refitAncestors(int index)
+{
+	while (index != NULL_NODE)
+	{
+		index = balance(index);
+		Node& node = nodes[index];
+		const Node& child1 = nodes[node.child1];
+		const Node& child2 = nodes[node.child2];
+		node.height = 1 + std::max(child1.height, child2.height);
+		node.box = AABB::merge(child1.box, child2.box);
+		index = node.parent;
+	}
+}
+
+// performs a left or right rotation if node A is imbalanced
+// returns the new root of the subtree
+int Bvh::balance(int iA)
+{
+	Node* A = &nodes[iA];
+	if (A->isLeaf() || A->height < 2) return iA;
+
+	const int iB = A->child1;
+	const int iC = A->child2;
+	Node* B = &nodes[iB];
+	Node* C = &nodes[iC];
+
+	const int bal = C->height - B->height;
+
+	// rotate C up
+	if (bal > 1)
+	{
+		const int iF = C->child1;
+		const int iG = C->child2;
+		Node* F = &nodes[iF];
+		Node* G = &nodes[iG];
+
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		if (C->parent != NULL_NODE)
+		{
+			if (nodes[C->parent].child1 == iA) nodes[C->parent].child1 = iC;
+			else nodes[C->parent].child2 = iC;
+		}
+		else root = iC;
+
+		if (F->height > G->height)
+		{
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+			A->box = AABB::merge(B->box, G->box);
+			C->box = AABB::merge(A->box, F->box);
+			A->height = 1 + std::max(B->height, G->height);
+			C->height = 1 + std::max(A->height, F->height);
+		}
+		else
+		{
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+			A->box = AABB::merge(B->box, F->box);
+			C->box = AABB::merge(A->box, G->box);
+			A->height = 1 + std::max(B->height, F->height);
+			C->height = 1 + std::max(A->height, G->height);
+		}
+		return iC;
+	}
+
+	// rotate B up
+	if (bal < -1)
+	{
+		const int iD = B->child1;
+		const int iE = B->child2;
+		Node* D = &nodes[iD];
+		Node* E = &nodes[iE];
+
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		if (B->parent != NULL_NODE)
+		{
+			if (nodes[B->parent].child1 == iA) nodes[B->parent].child1 = iB;
+			else nodes[B->parent].child2 = iB;
+		}
+		else root = iB;
+
+		if (D->height > E->height)
+		{
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+			A->box = AABB::merge(C->box, E->box);
+			B->box = AABB::merge(A->box, D->box);
+			A->height = 1 + std::max(C->height, E->height);
+			B->height = 1 + std::max(A->height, D->height);
+		}
+		else
+		{
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+			A->box = AABB::merge(C->box, D->box);
+			B->box = AABB::merge(A->box, E->box);
+			A->height = 1 + std::max(C->height, D->height);
+			B->height = 1 + std::max(A->height, E->height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+// BINNED SAH BUILD
+
+namespace
+{
+	const int NUM_BINS = 12;
+
+	// leaves are copied to a compact array so the partitions access memory sequentially
+	struct BuildItem
+	{
+		AABB box;
+		vec3 centroid;
+		int leaf;
+	};
+
+	struct BuildTask
+	{
+		int parent;		// node that will receive the subtree
+		int childSlot;	// 0 -> child1, 1 -> child2
+		unsigned begin, end;
+	};
+}
+
+void Bvh::rebuild()
+{
+	if (numProxies < 2) return;
+
+	// collect the leaves and release the internal nodes
+	vector<BuildItem> items;
+	items.reserve(numProxies);
+	for (unsigned i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].height < 0) continue;
+		if (nodes[i].isLeaf())
+		{
+			BuildItem item;
+			item.box = nodes[i].box;
+			item.centroid = item.box.getCenter();
+			item.leaf = i;
+			items.push_back(item);
+		}
+		else freeNode(i);
+	}
+	const unsigned n = items.size();
+
+	// internal nodes created in the order they are visited (parents before children)
+	vector<int> internalNodes;
+	internalNodes.reserve(n - 1);
+
+	vector<BuildTask> tasks;
+	tasks.push_back({ NULL_NODE, 0, 0, n });
+	while (!tasks.empty())
+	{
+		const BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		int id;
+		const unsigned count = task.end - task.begin;
+		if (count == 1)
+		{
+			id = items[task.begin].leaf;
+		}
+		else
+		{
+			// centroid bounds
+			AABB centBox = AABB::makeEmpty();
+			for (unsigned i = task.begin; i < task.end; i++)
+			{
+				centBox = AABB::merge(centBox, items[i].centroid);
+			}
+
+			int bestAxis = -1;
+			int bestSplit = 0;
+			float bestCost = numeric_limits<float>::max();
+			const vec3 ext = centBox.max - centBox.min;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (ext[axis] <= 0) continue;
+				const float scale = NUM_BINS * 0.9999f / ext[axis];
+
+				unsigned binCounts[NUM_BINS] = {};
+				AABB binBoxes[NUM_BINS];
+				for (int b = 0; b < NUM_BINS; b++) binBoxes[b] = AABB::makeEmpty();
+				for (unsigned i = task.begin; i < task.end; i++)
+				{
+					const int b = (int)((items[i].centroid[axis] - centBox.min[axis]) * scale);
+					binCounts[b]++;
+					binBoxes[b] = AABB::merge(binBoxes[b], items[i].box);
+				}
+
+				// sweep from the right to get the right side areas
+				float rightAreas[NUM_BINS];
+				unsigned rightCounts[NUM_BINS];
+				AABB acc = AABB::makeEmpty();
+				unsigned accCount = 0;
+				for (int b = NUM_BINS - 1; b > 0; b--)
+				{
+					acc = AABB::merge(acc, binBoxes[b]);
+					accCount += binCounts[b];
+					rightAreas[b] = acc.getSurfaceArea();
+					rightCounts[b] = accCount;
+				}
+				// sweep from the left evaluating the cost
+				acc = AABB::makeEmpty();
+				accCount = 0;
+				for (int b = 0; b < NUM_BINS - 1; b++)
+				{
+					acc = AABB::merge(acc, binBoxes[b]);
+					accCount += binCounts[b];
+					if (accCount == 0 || rightCounts[b + 1] == 0) continue;
+					const float cost = accCount * acc.getSurfaceArea() + rightCounts[b + 1] * rightAreas[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b + 1;
+					}
+				}
+			}
+
+			unsigned mid;
+			if (bestAxis >= 0)
+			{
+				const float scale = NUM_BINS * 0.9999f / ext[bestAxis];
+				const float minC = centBox.min[bestAxis];
+				BuildItem* midIt = partition(&items[task.begin], &items[0] + task.end,
+					[&](const BuildItem& item) {
+						return (int)((item.centroid[bestAxis] - minC) * scale) < bestSplit;
+					});
+				mid = midIt - &items[0];
+			}
+			else
+			{
+				// all the centroids are in the same point: split by count
+				mid = (task.begin + task.end) / 2;
+			}
+
+			id = allocateNode();
+			internalNodes.push_back(id);
+			tasks.push_back({ id, 0, task.begin, mid });
+			tasks.push_back({ id, 1, mid, task.end });
+		}
+
+		nodes[id].parent = task.parent;
+		if (task.parent == NULL_NODE) root = id;
+		else if (task.childSlot == 0) nodes[task.parent].child1 = id;
+		else nodes[task.parent].child2 = id;
+	}
+
+	// the children are always created after the parents, so in reverse order we can compute
+	// the boxes and heights bottom-up
+	for (int i = (int)internalNodes.size() - 1; i >= 0; i--)
+	{
+		Node& node = nodes[internalNodes[i]];
+		const Node& child1 = nodes[node.child1];
+		const Node& child2 = nodes[node.child2];
+		node.box = AABB::merge(child1.box, child2.box);
+		node.height = 1 + std::max(child1.height, child2.height);
+	}
+}
+
+// CONVENIENCE QUERIES
+
+void Bvh::queryAABB(const AABB& box, vector<int>& out)const
+{
+	queryAABB(box, [&](int proxy) { out.push_back(proxy); return true; });
+}
+
+void Bvh::querySphere(const Sphere& sphere, vector<int>& out)const
+{
+	querySphere(sphere, [&](int proxy) { out.push_back(proxy); return true; });
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, vector<int>& out)const
+{
+	queryFrustum(frustum, [&](int proxy) { out.push_back(proxy); return true; });
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "../math/geometry.hpp"
+#include <vector>
+
+/*
+Bounding volume hierarchy of AABBs.
+It's a dynamic tree: the leaves store "fat" boxes (enlarged by a margin) so
+small movements don't modify the tree at all. When a leaf escapes its fat box
+it's removed and reinserted choosing the sibling with the surface area heuristic,
+and the ancestors are refitted and rebalanced with tree rotations.
+For big static worlds rebuild() makes the whole tree again top-down with binned SAH,
+which produces better trees than incremental insertion.
+The proxy ids are stable: they don't change with moves or rebuilds.
+*/
+class Bvh
+{
+public:
+	static const int NULL_NODE = -1;
+
+	Bvh();
+
+	int createProxy(const AABB& box, void* userData);
+	void destroyProxy(int proxy);
+	// returns true if the leaf had to be reinserted
+	bool moveProxy(int proxy, const AABB& box);
+
+	void* getUserData(int proxy)const { return nodes[proxy].userData; }
+	const AABB& getFatAABB(int proxy)const { return nodes[proxy].box; }
+	unsigned getNumProxies()const { return numProxies; }
+	int getHeight()const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+	// the margin used for fattening the boxes
+	float getMargin()const { return margin; }
+	void setMargin(float margin) { this->margin = margin; }
+
+	// rebuild all the tree using binned SAH
+	void rebuild();
+
+	void clear();
+
+	// QUERIES //
+	// callback(int proxy) -> bool. Return false to stop the query
+	template <typename Callback>
+	void queryAABB(const AABB& box, Callback callback)const;
+	template <typename Callback>
+	void querySphere(const Sphere& sphere, Callback callback)const;
+	// callback(int proxy) -> bool. Return false to stop the query
+	template <typename Callback>
+	void queryFrustum(const Frustum& frustum, Callback callback)const;
+	// callback(int proxy, float tMax) -> float. Return the new tMax (for example the hit
+	// distance for closest hit queries), tMax to ignore the proxy, or 0 to stop the query
+	template <typename Callback>
+	void raycast(const Ray& ray, float tMax, Callback callback)const;
+
+	// convenience versions that collect the proxies
+	void queryAABB(const AABB& box, std::vector<int>& out)const;
+	void querySphere(const Sphere& sphere, std::vector<int>& out)const;
+	void queryFrustum(const Frustum& frustum, std::vector<int>& out)const;
+
+private:
+
+	struct Node
+	{
+		AABB box;
+		void* userData;
+		union
+		{
+			int parent;
+			int next;	// when in the free list
+		};
+		int child1, child2;
+		int height;		// 0 for leaves, -1 for free nodes
+
+		bool isLeaf()const { return child1 == NULL_NODE; }
+	};
+
+	// DATA
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	unsigned numProxies;
+	float margin;
+	mutable std::vector<int> stack;	// traversal stack, kept to avoid allocations
+
+	// FUNCTIONS
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void refitAncestors(int node);
+	AABB fatten(const AABB& box)const;
+};
+
+template <typename Callback>
+void Bvh::queryAABB(const AABB& box, Callback callback)const
+{
+	if (root == NULL_NODE) return;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const int id = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[id];
+		if (!intersects(node.box, box)) continue;
+		if (node.isLeaf())
+		{
+			if (!callback(id)) return;
+		}
+		else
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+template <typename Callback>
+void Bvh::querySphere(const Sphere& sphere, Callback callback)const
+{
+	if (root == NULL_NODE) return;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const int id = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[id];
+		if (!intersects(sphere, node.box)) continue;
+		if (node.isLeaf())
+		{
+			if (!callback(id)) return;
+		}
+		else
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+template <typename Callback>
+void Bvh::queryFrustum(const Frustum& frustum, Callback callback)const
+{
+	if (root == NULL_NODE) return;
+	// we push pairs (node, plane mask). The planes that contain a node don't
+	// need to be tested for its children. When the mask is empty the whole subtree is inside
+	const unsigned allPlanes = (1 << Frustum::NUM_PLANES) - 1;
+	stack.clear();
+	stack.push_back(root);
+	stack.push_back(allPlanes);
+	while (!stack.empty())
+	{
+		unsigned mask = stack.back();
+		stack.pop_back();
+		const int id = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[id];
+		if (mask && testFrustumMasked(frustum, node.box, mask) == FrustumTest::OUTSIDE) continue;
+		if (node.isLeaf())
+		{
+			if (!callback(id)) return;
+		}
+		else
+		{
+			stack.push_back(node.child1);
+			stack.push_back(mask);
+			stack.push_back(node.child2);
+			stack.push_back(mask);
+		}
+	}
+}
+
+template <typename Callback>
+void Bvh::raycast(const Ray& ray, float tMax, Callback callback)const
+{
+	if (root == NULL_NODE) return;
+	const glm::vec3 invDir = 1.f / ray.dir;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const int id = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[id];
+		float t;
+		if (!intersects(ray, invDir, node.box, tMax, t)) continue;
+		if (node.isLeaf())
+		{
+			tMax = callback(id, tMax);
+			if (tMax <= 0) return;
+		}
+		else
+		{
+			// visit first the closest child so tMax shrinks sooner
+			float t1, t2;
+			bool hit1 = intersects(ray, invDir, nodes[node.child1].box, tMax, t1);
+			bool hit2 = intersects(ray, invDir, nodes[node.child2].box, tMax, t2);
+			if (hit1 && hit2)
+			{
+				if (t1 < t2)
+				{
+					stack.push_back(node.child2);
+					stack.push_back(node.child1);
+				}
+				else
+				{
+					stack.push_back(node.child1);
+					stack.push_back(node.child2);
+				}
+			}
+			else if (hit1) stack.push_back(node.child1);
+			else if (hit2) stack.push_back(node.child2);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#include "scene.hpp"
+
+#include "scene_node.hpp"
+#include "../util/mallocr/mem_tracker.hpp"
+
+using namespace std;
+using namespace glm;
+
+Scene::Scene()
+{
+	root = new SceneNode;
+	MemTracker::trackAlloc(MemTag::SCENE, sizeof(SceneNode));
+	root->scene = this;
+	root->name = "root";
+}
+
+Scene::~Scene()
+{
+	destroySubtree(root);
+}
+
+SceneNode* Scene::createNode(const string& name, SceneNode* parent)
+{
+	if (!parent) parent = root;
+
+	SceneNode* node = new SceneNode;
+	MemTracker::trackAlloc(MemTag::SCENE, sizeof(SceneNode));
+	node->scene = this;
+	node->name = name;
+	node->parent = parent;
+	parent->children.push_back(node);
+	parent->nameToChild[name] = node;
+	return node;
+}
+
+void Scene::addDirty(const SceneNode* node)
+{
+	dirtyNodes.insert(const_cast<SceneNode*>(node));
+}
+
+void Scene::removeDirty(const SceneNode* node)
+{
+	dirtyNodes.erase(const_cast<SceneNode*>(node));
+}
+
+void Scene::addMoved(SceneNode* node)
+{
+	movedNodes.push_back(node);
+}
+
+void Scene::updateBvh()
+{
+	for (SceneNode* node : movedNodes)
+	{
+		// already refitted as part of the subtree of a moved ancestor
+		if (!node->movedFlag) continue;
+
+		mat4 parentMat(1);
+		if (node->parent) parentMat = node->parent->computeGlobalTransMat();
+		refitSubtree(node, parentMat);
+	}
+	movedNodes.clear();
+}
+
+void Scene::refitSubtree(SceneNode* node, const mat4& parentMat)
+{
+	mat4 m = parentMat;
+	node->recomputeTransMat();
+	m = m * node->transMat;
+	if (node->bvhProxy != -1)
+	{
+		bvh.moveProxy(node->bvhProxy, transformAABB(node->localBounds, m));
+	}
+	node->movedFlag = false;
+	for (SceneNode* child : node->children)
+	{
+		refitSubtree(child, m);
+	}
+}
+
+void Scene::destroySubtree(SceneNode* node)
+{
+	for (SceneNode* child : node->children)
+	{
+		destroySubtree(child);
+	}
+	if (node->bvhProxy != -1) bvh.destroyProxy(node->bvhProxy);
+	delete node;
+	MemTracker::trackFree(MemTag::SCENE, sizeof(SceneNode));
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <set>
+#include <vector>
+#include <string>
+#include <glm/mat4x4.hpp>
+#include "bvh.hpp"
 
 class SceneNode;
 
@@ -10,12 +14,31 @@ class Scene
 
 public:
 
+	Scene();
+	~Scene();
+
 	SceneNode* getRoot()const { return root; }
 
+	// creates a new node, if parent is null it will be a child of the root
+	SceneNode* createNode(const std::string& name, SceneNode* parent = nullptr);
+
+	// bvh of the world bounds of the nodes that have bounds
+	const Bvh& getBvh()const { return bvh; }
+	Bvh& getBvh() { return bvh; }
+
+	// refit the bvh leaves of the nodes that have been moved since the last call
+	void updateBvh();
+
 private:
 	SceneNode* root;
 	std::set<SceneNode*> dirtyNodes;	// nodes that have dirty flag set to true
+	std::vector<SceneNode*> movedNodes;	// nodes whose bvh leaves (and the ones of their children) are outdated
+	Bvh bvh;
 
 	void addDirty(const SceneNode* node);
 	void removeDirty(const SceneNode* node);
-};
\ No newline at end of file
+	void addMoved(SceneNode* node);
+
+	void refitSubtree(SceneNode* node, const glm::mat4& parentMat);
+	void destroySubtree(SceneNode* node);
+};
@@ -0,0 +1,170 @@
+#include "scene_importer.hpp"
+
+#include "scene.hpp"
+#include "scene_node.hpp"
+#include "../render/mesh/mesh_optimizer.hpp"
+#include "../util/job_system.hpp"
+#include "../util/vfs_io_system.hpp"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <glm/vec3.hpp>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+void SceneImportResult::freeMeshes()
+{
+	for (Mesh& mesh : meshes) mesh.free();
+	meshes.clear();
+}
+
+namespace
+{
+
+AABB computeMeshBounds(const IMesh& mesh)
+{
+	AABB box = AABB::makeEmpty();
+	const vec3* positions = (const vec3*)mesh.getAttribData(AttribLocation::POS);
+	for (unsigned i = 0; i < mesh.getNumVertices(); i++) box = AABB::merge(box, positions[i]);
+	return box;
+}
+
+Transform toTransform(const aiMatrix4x4& m)
+{
+	aiVector3D scale, pos;
+	aiQuaternion rot;
+	m.Decompose(scale, rot, pos);
+	Transform trans;
+	trans.pos = vec3(pos.x, pos.y, pos.z);
+	trans.rot = quat(rot.w, rot.x, rot.y, rot.z);
+	trans.scale = vec3(scale.x, scale.y, scale.z);
+	return trans;
+}
+
+void importNode(const aiNode* aNode, SceneNode* parent, Scene& scene,
+	const vector<AABB>& meshBounds, SceneImportResult& res)
+{
+	SceneNode* node = scene.createNode(aNode->mName.C_Str(), parent);
+	node->setTransform(toTransform(aNode->mTransformation));
+	if (!res.root) res.root = node;
+
+	auto addInstance = [&](SceneNode* n, unsigned aMesh)
+	{
+		SceneImportResult::Instance inst;
+		inst.node = n;
+		inst.mesh = aMesh;
+		res.instances.push_back(inst);
+		n->setLocalBounds(meshBounds[aMesh]);
+	};
+
+	if (aNode->mNumMeshes == 1)
+	{
+		addInstance(node, aNode->mMeshes[0]);
+	}
+	else
+	{
+		// one child for each mesh so each one has its own bounds
+		for (unsigned i = 0; i < aNode->mNumMeshes; i++)
+		{
+			const unsigned aMesh = aNode->mMeshes[i];
+			SceneNode* child = scene.createNode(aNode->mName.C_Str() + string("/") + to_string(i), node);
+			addInstance(child, aMesh);
+		}
+	}
+
+	for (unsigned i = 0; i < aNode->mNumChildren; i++)
+	{
+		importNode(aNode->mChildren[i], node, scene, meshBounds, res);
+	}
+}
+
+}
+
+namespace SceneImporter
+{
+
+SceneImportResult import(const string& fileName, Scene& scene,
+	SceneNode* parent, const SceneImportSettings& settings)
+{
+	Assimp::Importer importer;
+	importer.SetIOHandler(new VfsIOSystem());
+	// points and lines are split in other meshes and removed
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+	const aiScene* aScene = importer.ReadFile(fileName,
+		aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType);
+
+	if (!aScene || !aScene->mRootNode)
+	{
+		throw runtime_error("could not load " + fileName + ": " + importer.GetErrorString());
+	}
+
+	SceneImportResult res;
+	res.root = nullptr;
+
+	// meshes, in parallel
+	const unsigned numMeshes = aScene->mNumMeshes;
+	res.meshes.resize(numMeshes);
+	vector<AABB> meshBounds(numMeshes);
+	vector<string> errors(numMeshes);
+	auto convertMesh = [&](unsigned i)
+	{
+		try
+		{
+			Mesh mesh = Mesh::fromAssimp(aScene->mMeshes[i]);
+			if (settings.optimizeMeshes)
+			{
+				Mesh optimized = MeshOptimizer::optimize(mesh);
+				mesh.free();
+				mesh = optimized;
+			}
+			meshBounds[i] = computeMeshBounds(mesh);
+			res.meshes[i] = mesh;
+		}
+		catch (const exception& e)
+		{
+			errors[i] = e.what();
+		}
+	};
+	if (settings.parallel) JobSystem::getSingleton()->parallelFor(numMeshes, convertMesh);
+	else for (unsigned i = 0; i < numMeshes; i++) convertMesh(i);
+	for (unsigned i = 0; i < numMeshes; i++)
+	{
+		if (!errors[i].empty())
+		{
+			res.freeMeshes();
+			throw runtime_error(fileName + ": " + errors[i]);
+		}
+	}
+
+	res.meshMaterials.resize(numMeshes);
+	for (unsigned i = 0; i < numMeshes; i++) res.meshMaterials[i] = aScene->mMeshes[i]->mMaterialIndex;
+
+	// materials
+	if (!settings.materialTemplate.empty())
+	{
+		MaterialManager* man = MaterialManager::getSingleton();
+		MaterialTemplate templ = man->loadMaterialTemplate(settings.materialTemplate);
+		const int colorSlot = man->getSlotIndex(templ, settings.colorSlot);
+		for (unsigned i = 0; i < aScene->mNumMaterials; i++)
+		{
+			Material material = man->createMaterial(templ);
+			aiColor3D color;
+			if (colorSlot >= 0 &&
+				aScene->mMaterials[i]->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS)
+			{
+				material.setValue(colorSlot, vec3(color.r, color.g, color.b));
+			}
+			res.materials.push_back(material);
+		}
+	}
+
+	// node hierarchy
+	importNode(aScene->mRootNode, parent, scene, meshBounds, res);
+
+	return res;
+}
+
+}
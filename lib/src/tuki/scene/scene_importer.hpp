@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../render/mesh/mesh.hpp"
+#include "../render/material/material.hpp"
+
+class Scene;
+class SceneNode;
+
+struct SceneImportSettings
+{
+	// reorder the meshes for rendering (see mesh_optimizer.hpp)
+	bool optimizeMeshes;
+	// material template for the imported materials, if empty no materials are created
+	std::string materialTemplate;
+	// vec3 slot of the template that receives the diffuse color
+	std::string colorSlot;
+	// convert the meshes in the threads of the JobSystem
+	bool parallel;
+
+	SceneImportSettings() : optimizeMeshes(true), colorSlot("color"), parallel(true) {}
+};
+
+struct SceneImportResult
+{
+	struct Instance
+	{
+		SceneNode* node;
+		unsigned mesh;	// index in meshes
+	};
+
+	SceneNode* root;	// node that corresponds to the root of the file
+	std::vector<Mesh> meshes;
+	std::vector<unsigned> meshMaterials;	// index in materials of each mesh
+	std::vector<Material> materials;		// empty if there is no material template
+	std::vector<Instance> instances;		// nodes that draw a mesh
+
+	// release the RAM of the meshes
+	void freeMeshes();
+};
+
+/*
+Imports all the meshes, the node hierarchy and the materials of a file.
+The nodes are created in the scene with the bounds of their meshes, so they are
+registered in the scene bvh. When an assimp node has several meshes a child
+node is created for each one.
+The meshes are converted in parallel. The materials are created in the calling
+thread because the material templates need the GL context.
+*/
+namespace SceneImporter
+{
+
+// throws runtime_error if the file can't be imported
+// if parent is null the nodes will hang from the scene root
+SceneImportResult import(const std::string& fileName, Scene& scene,
+	SceneNode* parent = nullptr, const SceneImportSettings& settings = SceneImportSettings());
+
+}
@@ -1,6 +1,8 @@
 #include "scene_node.hpp"
 
 #include "scene.hpp"
+#include "../util/mallocr/mallocr_arena.hpp"
+#include <glm/geometric.hpp>
 
 using namespace std;
 using namespace glm;
@@ -30,7 +32,10 @@ const vec3 SceneNode::getGlobalPosition()const
 const quat SceneNode::getGlobalRotation()const
 {
 	recomputeGlobalTransMat();
-	return quat_cast(globalTransMat);
+	// remove the scale
+	mat3 m(globalTransMat);
+	for (int i = 0; i < 3; i++) m[i] = normalize(m[i]);
+	return quat_cast(m);
 }
 
 bool SceneNode::hasDirtyParent()const
@@ -53,21 +58,65 @@ void SceneNode::setDirty()
 {
 	scene->addDirty(this);
 	dirtyFlag = true;
+	if (!movedFlag)
+	{
+		movedFlag = true;
+		scene->addMoved(this);
+	}
+}
+
+static mat4 transformToMatrix(const Transform& trans)
+{
+	mat4 m = mat4_cast(trans.rot);
+	m[0] *= trans.scale.x;
+	m[1] *= trans.scale.y;
+	m[2] *= trans.scale.z;
+	m[3][0] = trans.pos.x;
+	m[3][1] = trans.pos.y;
+	m[3][2] = trans.pos.z;
+	return m;
 }
 
 void SceneNode::recomputeTransMat()const
 {
-	transMat = mat4_cast(trans.rot);
-	transMat[3][0] = trans.pos.x;
-	transMat[3][1] = trans.pos.y;
-	transMat[3][2] = trans.pos.z;
+	transMat = transformToMatrix(trans);
+}
+
+mat4 SceneNode::computeGlobalTransMat()const
+{
+	mat4 m = transformToMatrix(trans);
+	for (const SceneNode* node = parent; node; node = node->parent)
+	{
+		m = transformToMatrix(node->trans) * m;
+	}
+	return m;
+}
+
+void SceneNode::setLocalBounds(const AABB& bounds)
+{
+	localBounds = bounds;
+	if (bvhProxy == -1)
+	{
+		bvhProxy = scene->bvh.createProxy(getWorldBounds(), this);
+	}
+	else if (!movedFlag)
+	{
+		movedFlag = true;
+		scene->addMoved(this);
+	}
+}
+
+AABB SceneNode::getWorldBounds()const
+{
+	return transformAABB(localBounds, computeGlobalTransMat());
 }
 
 void SceneNode::recomputeGlobalTransMat()const
 {
 	if (hasDirtyParent())
 	{
-		vector<SceneNode*> parents;
+		ScratchScope scratch;
+		ScratchVector<SceneNode*> parents(scratch);
 		parents.reserve(32);
 		SceneNode* node = parent;
 		while (node)
@@ -82,6 +131,7 @@ void SceneNode::recomputeGlobalTransMat()const
 		// if the root is dirty recompute transf matrix
 		if (!parents[i]->parent)
 		{
+			node = parents[i];
 			node->recomputeTransMat();
 			node->globalTransMat = node->transMat;
 			i--;
@@ -106,5 +156,6 @@ void SceneNode::recomputeGlobalTransMat()const
 	}
 
 	// recompute *this globalTransMat
-	globalTransMat = parent->globalTransMat * transMat;
+	if (parent) globalTransMat = parent->globalTransMat * transMat;
+	else globalTransMat = transMat;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "../math/geometry.hpp"
 
 class IMeshGpu;
 class Scene;
@@ -13,10 +14,14 @@ struct Transform
 {
 	glm::vec3 pos;
 	glm::quat rot;
+	glm::vec3 scale;
+
+	Transform() : pos(0), rot(1, 0, 0, 0), scale(1) {}
 };
 
 class SceneNode
 {
+	friend class Scene;
 public:
 
 	SceneNode* getParent()const { return parent; }
@@ -32,6 +37,8 @@ public:
 	const glm::quat& getRotation()const { return trans.rot; }
 	void setPosition(const glm::vec3& pos) { trans.pos = pos; setDirty(); }
 	void setRotation(const glm::quat& rot) { trans.rot = rot; setDirty(); }
+	const glm::vec3& getScale()const { return trans.scale; }
+	void setScale(const glm::vec3& scale) { trans.scale = scale; setDirty(); }
 
 	const glm::mat4& getTransformMatrix()const;
 
@@ -39,9 +46,17 @@ public:
 	const glm::vec3 getGlobalPosition()const;
 	const glm::quat getGlobalRotation()const;
 
+	// bounds of the node in local space. Setting them registers the node in the scene bvh
+	const AABB& getLocalBounds()const { return localBounds; }
+	void setLocalBounds(const AABB& bounds);
+	bool hasBounds()const { return bvhProxy != -1; }
+	AABB getWorldBounds()const;
+	int getBvhProxy()const { return bvhProxy; }
+
 private:
 
-	SceneNode() : parent(nullptr), id(-1), scene(nullptr) {}
+	SceneNode() : id(-1), dirtyFlag(true), scene(nullptr), parent(nullptr),
+		meshGpu(nullptr), bvhProxy(-1), movedFlag(false) {}
 	int id;
 	std::string name;
 	Transform trans;
@@ -56,10 +71,17 @@ private:
 	// COMPONENTS
 	IMeshGpu* meshGpu;
 
+	// BOUNDS
+	AABB localBounds;
+	int bvhProxy;
+	bool movedFlag;		// true if the bvh leaf must be refitted
+
 	// set the dirty flag to true, which means that the transform matrix must be recomputed recursivelly
 	void setDirty();
 	bool isDirty()const { return dirtyFlag; }
 	bool hasDirtyParent()const;
 	void recomputeTransMat()const;
 	void recomputeGlobalTransMat()const;
+	// computes the global matrix from scratch, without using the cached matrices
+	glm::mat4 computeGlobalTransMat()const;
 };
\ No newline at end of file
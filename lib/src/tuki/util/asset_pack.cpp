@@ -0,0 +1,184 @@
+#include "asset_pack.hpp"
+
+#include "vfs.hpp"
+#include <zlib.h>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static const char ASSET_PACK_MAGIC[4] = { 'T', 'K', 'A', 'P' };
+
+AssetPack::AssetPack(const string& fileName)
+	: fileName(fileName)
+	, entries(nullptr)
+	, strings(nullptr)
+{
+	shared_ptr<MappedFile> f = make_shared<MappedFile>(fileName);
+	const char* base = (const char*)f->getData();
+	const uint64_t fileSize = f->getSize();
+	const AssetPackHeader* h = (const AssetPackHeader*)base;
+
+	if (fileSize < sizeof(AssetPackHeader) || memcmp(h->magic, ASSET_PACK_MAGIC, sizeof(h->magic)) != 0)
+	{
+		throw runtime_error(fileName + " is not an asset pack");
+	}
+	if (h->version != ASSET_PACK_VERSION)
+	{
+		throw runtime_error(fileName + " has an unsupported asset pack version");
+	}
+
+	auto checkRange = [&](uint64_t offset, uint64_t size)
+	{
+		if (offset % ASSET_PACK_ALIGNMENT != 0 || offset > fileSize || size > fileSize - offset)
+		{
+			throw runtime_error(fileName + " is corrupted");
+		}
+	};
+	checkRange(h->entriesOffset, (uint64_t)h->numEntries * sizeof(AssetPackEntry));
+	checkRange(h->stringsOffset, h->stringsSize);
+	strings = base + h->stringsOffset;
+	if (h->stringsSize == 0 || strings[h->stringsSize - 1] != 0)
+	{
+		throw runtime_error(fileName + " is corrupted");
+	}
+
+	entries = (const AssetPackEntry*)(base + h->entriesOffset);
+	index.reserve(h->numEntries);
+	for (unsigned i = 0; i < h->numEntries; i++)
+	{
+		const AssetPackEntry& e = entries[i];
+		checkRange(e.offset, e.size);
+		if (e.pathString >= h->stringsSize || (e.flags & ~ASSET_PACK_COMPRESSED) != 0 ||
+			(!(e.flags & ASSET_PACK_COMPRESSED) && e.size != e.originalSize))
+		{
+			throw runtime_error(fileName + " is corrupted");
+		}
+		const NameId path = NameId::fromHash(e.path);
+		if (index.find(path) != index.end())
+		{
+			throw runtime_error(fileName + ": " + getEntryPath(i) + " has the same hash as " +
+				getEntryPath(index[path]));
+		}
+		index[path] = i;
+	}
+	file = f;
+}
+
+int AssetPack::findEntry(NameId path)const
+{
+	auto it = index.find(path);
+	return it == index.end() ? -1 : (int)it->second;
+}
+
+const char* AssetPack::getEntryPath(unsigned i)const
+{
+	return strings + entries[i].pathString;
+}
+
+void AssetPack::readEntry(unsigned i, vector<unsigned char>& out)const
+{
+	const AssetPackEntry& e = entries[i];
+	out.resize((size_t)e.originalSize);
+	if (!(e.flags & ASSET_PACK_COMPRESSED))
+	{
+		if (e.size) memcpy(out.data(), getEntryData(i), (size_t)e.size);
+		return;
+	}
+	uLongf size = (uLongf)e.originalSize;
+	if (uncompress(out.data(), &size, getEntryData(i), (uLong)e.size) != Z_OK || size != e.originalSize)
+	{
+		throw runtime_error(fileName + ": " + getEntryPath(i) + " is corrupted");
+	}
+}
+
+void AssetPack::cook(const vector<string>& paths, const vector<string>& files,
+	const string& fileName, bool compress)
+{
+	if (paths.size() != files.size()) throw runtime_error("AssetPack::cook: a path is needed for each file");
+
+	vector<char> data(sizeof(AssetPackHeader));
+	vector<char> strings(1, 0);	// an empty string, so the table is never empty
+	auto align = [&]
+	{
+		while (data.size() % ASSET_PACK_ALIGNMENT) data.push_back(0);
+	};
+
+	vector<AssetPackEntry> entries(paths.size());
+	align();
+	const uint64_t entriesOffset = data.size();
+	data.resize(data.size() + entries.size() * sizeof(AssetPackEntry));
+
+	Vfs* vfs = Vfs::getSingleton();
+	FlatHashMap<NameId, unsigned> added;
+	vector<unsigned char> compressed;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		const NameId path(paths[i]);
+		auto it = added.find(path);
+		if (it != added.end())
+		{
+			if (paths[it->second] == paths[i]) throw runtime_error("AssetPack::cook: " + paths[i] + " is repeated");
+			throw runtime_error("AssetPack::cook: " + paths[i] + " has the same hash as " + paths[it->second]);
+		}
+		added[path] = (unsigned)i;
+
+		const VfsFile f = vfs->read(files[i]);
+		const unsigned char* src = f.getData();
+		size_t size = f.getSize();
+		AssetPackEntry& e = entries[i];
+		e.path = path.getHash();
+		e.pathString = (uint32_t)strings.size();
+		strings.insert(strings.end(), paths[i].begin(), paths[i].end());
+		strings.push_back(0);
+		e.flags = 0;
+		e.originalSize = size;
+
+		if (compress && size > 0)
+		{
+			uLongf compressedSize = compressBound((uLong)size);
+			compressed.resize(compressedSize);
+			if (compress2(compressed.data(), &compressedSize, src, (uLong)size, Z_BEST_COMPRESSION) != Z_OK)
+			{
+				throw runtime_error("could not compress " + files[i]);
+			}
+			if (compressedSize < size - size / 8)
+			{
+				e.flags |= ASSET_PACK_COMPRESSED;
+				src = compressed.data();
+				size = compressedSize;
+			}
+		}
+		align();
+		e.offset = data.size();
+		e.size = size;
+		data.insert(data.end(), (const char*)src, (const char*)src + size);
+	}
+
+	AssetPackHeader header;
+	memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+	header.version = ASSET_PACK_VERSION;
+	header.numEntries = (uint32_t)entries.size();
+	header.reserved = 0;
+	header.entriesOffset = entriesOffset;
+	align();
+	header.stringsOffset = data.size();
+	header.stringsSize = strings.size();
+	data.insert(data.end(), strings.begin(), strings.end());
+
+	memcpy(&data[0], &header, sizeof(header));
+	if (!entries.empty())
+		memcpy(&data[entriesOffset], &entries[0], entries.size() * sizeof(AssetPackEntry));
+
+	ofstream file(fileName, ios::binary);
+	if (!file)
+	{
+		throw runtime_error("could not open " + fileName + " for writing");
+	}
+	file.write(&data[0], data.size());
+	if (!file)
+	{
+		throw runtime_error("error writing " + fileName);
+	}
+}
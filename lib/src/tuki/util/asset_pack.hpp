@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "mapped_file.hpp"
+#include "flat_hash_map.hpp"
+#include "name_id.hpp"
+
+/*
+Archive of assets, mounted with Vfs::mountPack.
+An index of the entries (by the hash of their path) and their data, aligned to
+ASSET_PACK_ALIGNMENT so the cooked formats can be used in place. The file is mapped: the entries
+that are not compressed are read with no copy. The compressed ones (zlib) are inflated when read.
+The paths are in a string table at the end, null terminated.
+The file is little endian, the offsets are in bytes from the beginning of the file.
+Use AssetPack::cook (or the asset_packer tool) to make one.
+*/
+
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint32_t ASSET_PACK_ALIGNMENT = 64;
+
+enum AssetPackEntryFlags : uint32_t
+{
+	ASSET_PACK_COMPRESSED = 1 << 0,
+};
+
+struct AssetPackHeader
+{
+	char magic[4];	// "TKAP"
+	uint32_t version;
+	uint32_t numEntries;
+	uint32_t reserved;
+	uint64_t entriesOffset;	// AssetPackEntry[numEntries]
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+};
+static_assert(sizeof(AssetPackHeader) == 40, "the header layout must not depend on the compiler");
+
+struct AssetPackEntry
+{
+	uint64_t path;			// NameId hash
+	uint32_t pathString;	// offset in the string table
+	uint32_t flags;			// AssetPackEntryFlags
+	uint64_t offset;
+	uint64_t size;			// stored bytes
+	uint64_t originalSize;	// bytes when inflated
+};
+static_assert(sizeof(AssetPackEntry) == 40, "the layout must not depend on the compiler");
+
+class AssetPack
+{
+public:
+	// throws runtime_error if the file is not a valid pack or two entries have the same path hash
+	explicit AssetPack(const std::string& fileName);
+
+	// -1 if the pack doesn't have it. Only the hash is compared, check the path with getEntryPath
+	int findEntry(NameId path)const;
+	unsigned getNumEntries()const { return (unsigned)index.size(); }
+	const AssetPackEntry& getEntry(unsigned i)const { return entries[i]; }
+	const char* getEntryPath(unsigned i)const;
+	// the stored bytes of the entry
+	const unsigned char* getEntryData(unsigned i)const { return file->getData() + entries[i].offset; }
+	// the entry inflated if it's compressed
+	void readEntry(unsigned i, std::vector<unsigned char>& out)const;
+
+	const std::string& getFileName()const { return fileName; }
+	const std::shared_ptr<const MappedFile>& getMappedFile()const { return file; }
+
+	/* saves the files in a pack, with the paths of the same index
+	 When compress is true the entries are compressed with zlib, except the ones where it saves
+	 less than an eighth: they are stored as they are, so they can be read in place */
+	static void cook(const std::vector<std::string>& paths, const std::vector<std::string>& files,
+		const std::string& fileName, bool compress);
+
+private:
+	std::string fileName;
+	std::shared_ptr<const MappedFile> file;
+	const AssetPackEntry* entries;
+	const char* strings;
+	FlatHashMap<NameId, unsigned> index;
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <vector>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <tuple>
+#include <initializer_list>
+#include "hash.hpp"
+
+/*
+Open addressing hash map with linear probing, for the lookup tables of the registries.
+The entries are stored in a flat array of power of two capacity, and the hash of each entry
+is stored in a parallel array, so the probing compares the hashes and only touches the keys
+when they match. The hash can be precomputed and passed to find().
+Erasing shifts the following entries of the cluster back, so there are no tombstones.
+The interface is a subset of std::map/unordered_map. The key of the entries must not be
+modified through the iterators. Inserting and erasing invalidate the iterators.
+Keys of other types can be used for the lookups when the hash and operator== accept them
+(e.g. const char* for std::string keys).
+*/
+
+template <typename K, typename V, typename Hash = FlatHash<K> >
+class FlatHashMap
+{
+public:
+	typedef K key_type;
+	typedef V mapped_type;
+	typedef std::pair<K, V> value_type;
+	typedef std::size_t size_type;
+
+	template <typename M, typename T>
+	class Iterator
+	{
+	public:
+		Iterator() : map(nullptr), i(0) {}
+		Iterator(M* map, size_type i) : map(map), i(i) {}
+		// iterator -> const_iterator
+		template <typename M2, typename T2>
+		Iterator(const Iterator<M2, T2>& o) : map(o.map), i(o.i) {}
+
+		T& operator*()const { return map->entry(i); }
+		T* operator->()const { return &map->entry(i); }
+		Iterator& operator++() { i = map->nextUsed(i + 1); return *this; }
+		Iterator operator++(int) { Iterator prev = *this; ++*this; return prev; }
+		template <typename M2, typename T2>
+		bool operator==(const Iterator<M2, T2>& o)const { return i == o.i; }
+		template <typename M2, typename T2>
+		bool operator!=(const Iterator<M2, T2>& o)const { return i != o.i; }
+
+	private:
+		template <typename, typename, typename> friend class FlatHashMap;
+		template <typename, typename> friend class Iterator;
+		M* map;
+		size_type i;
+	};
+	typedef Iterator<FlatHashMap, value_type> iterator;
+	typedef Iterator<const FlatHashMap, const value_type> const_iterator;
+
+	FlatHashMap() : numUsed(0), mask(0) {}
+	FlatHashMap(std::initializer_list<value_type> init) : FlatHashMap()
+	{
+		reserve(init.size());
+		for (const value_type& x : init) insert(x);
+	}
+	FlatHashMap(const FlatHashMap& o) : FlatHashMap()
+	{
+		reserve(o.size());
+		for (const value_type& x : o) insert(x);
+	}
+	FlatHashMap(FlatHashMap&& o) : FlatHashMap() { swap(o); }
+	FlatHashMap& operator=(FlatHashMap o) { swap(o); return *this; }
+	~FlatHashMap() { clear(); }
+
+	void swap(FlatHashMap& o)
+	{
+		hashes.swap(o.hashes);
+		entries.swap(o.entries);
+		std::swap(numUsed, o.numUsed);
+		std::swap(mask, o.mask);
+	}
+
+	size_type size()const { return numUsed; }
+	bool empty()const { return numUsed == 0; }
+	size_type capacity()const { return hashes.size(); }
+
+	iterator begin() { return iterator(this, nextUsed(0)); }
+	iterator end() { return iterator(this, hashes.size()); }
+	const_iterator begin()const { return const_iterator(this, nextUsed(0)); }
+	const_iterator end()const { return const_iterator(this, hashes.size()); }
+
+	template <typename Q>
+	iterator find(const Q& key) { return iterator(this, findIndex(key, Hash()(key))); }
+	template <typename Q>
+	const_iterator find(const Q& key)const { return const_iterator(this, findIndex(key, Hash()(key))); }
+	// the hash must have been computed with Hash
+	template <typename Q>
+	iterator find(const Q& key, std::uint64_t hash) { return iterator(this, findIndex(key, hash)); }
+	template <typename Q>
+	const_iterator find(const Q& key, std::uint64_t hash)const { return const_iterator(this, findIndex(key, hash)); }
+
+	template <typename Q>
+	size_type count(const Q& key)const { return findIndex(key, Hash()(key)) != hashes.size(); }
+
+	std::pair<iterator, bool> insert(const value_type& x)
+	{
+		return emplace(x.first, x.second);
+	}
+
+	template <typename KK, typename... Args>
+	std::pair<iterator, bool> emplace(KK&& key, Args&&... args)
+	{
+		const std::uint64_t h = Hash()(key);
+		size_type i = findIndex(key, h);
+		if (i != hashes.size())
+			return std::make_pair(iterator(this, i), false);
+		if ((numUsed + 1) * 4 > hashes.size() * 3)
+			rehash(hashes.empty() ? MIN_CAPACITY : 2 * hashes.size());
+		i = freeIndex(h);
+		new (&entries[i]) value_type(std::piecewise_construct,
+			std::forward_as_tuple(std::forward<KK>(key)),
+			std::forward_as_tuple(std::forward<Args>(args)...));
+		hashes[i] = h | USED;
+		numUsed++;
+		return std::make_pair(iterator(this, i), true);
+	}
+
+	V& operator[](const K& key) { return emplace(key).first->second; }
+
+	template <typename Q>
+	V& at(const Q& key)
+	{
+		const size_type i = findIndex(key, Hash()(key));
+		assert(i != hashes.size());
+		return entry(i).second;
+	}
+	template <typename Q>
+	const V& at(const Q& key)const
+	{
+		const size_type i = findIndex(key, Hash()(key));
+		assert(i != hashes.size());
+		return entry(i).second;
+	}
+
+	// the entries after it can be moved, so erasing while iterating is not supported
+	void erase(const_iterator it)
+	{
+		size_type hole = it.i;
+		assert(hole < hashes.size() && hashes[hole] != EMPTY);
+		entry(hole).~value_type();
+		numUsed--;
+		// shift back the following entries of the cluster that are not in their home slot
+		size_type j = (hole + 1) & mask;
+		while (hashes[j] != EMPTY)
+		{
+			const size_type home = hashes[j] & mask;
+			if (((j - home) & mask) >= ((j - hole) & mask))
+			{
+				new (&entries[hole]) value_type(std::move(entry(j)));
+				entry(j).~value_type();
+				hashes[hole] = hashes[j];
+				hole = j;
+			}
+			j = (j + 1) & mask;
+		}
+		hashes[hole] = EMPTY;
+	}
+
+	template <typename Q>
+	size_type erase(const Q& key)
+	{
+		const size_type i = findIndex(key, Hash()(key));
+		if (i == hashes.size()) return 0;
+		erase(const_iterator(this, i));
+		return 1;
+	}
+
+	void clear()
+	{
+		for (size_type i = 0; i < hashes.size(); i++)
+		{
+			if (hashes[i] != EMPTY)
+			{
+				entry(i).~value_type();
+				hashes[i] = EMPTY;
+			}
+		}
+		numUsed = 0;
+	}
+
+	// makes room for n entries without rehashing
+	void reserve(size_type n)
+	{
+		size_type cap = MIN_CAPACITY;
+		while (n * 4 > cap * 3) cap *= 2;
+		if (cap > hashes.size()) rehash(cap);
+	}
+
+private:
+	typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Storage;
+
+	static const size_type MIN_CAPACITY = 8;
+	static const std::uint64_t EMPTY = 0;
+	static const std::uint64_t USED = 1ull << 63;	// set in the stored hashes so they are never EMPTY
+
+	std::vector<std::uint64_t> hashes;
+	std::vector<Storage> entries;
+	size_type numUsed;
+	size_type mask;
+
+	value_type& entry(size_type i) { return *reinterpret_cast<value_type*>(&entries[i]); }
+	const value_type& entry(size_type i)const { return *reinterpret_cast<const value_type*>(&entries[i]); }
+
+	size_type nextUsed(size_type i)const
+	{
+		while (i < hashes.size() && hashes[i] == EMPTY) i++;
+		return i;
+	}
+
+	// returns hashes.size() if not found
+	template <typename Q>
+	size_type findIndex(const Q& key, std::uint64_t h)const
+	{
+		if (numUsed == 0) return hashes.size();
+		h |= USED;
+		size_type i = h & mask;
+		while (hashes[i] != EMPTY)
+		{
+			if (hashes[i] == h && entry(i).first == key) return i;
+			i = (i + 1) & mask;
+		}
+		return hashes.size();
+	}
+
+	size_type freeIndex(std::uint64_t h)const
+	{
+		size_type i = (h | USED) & mask;
+		while (hashes[i] != EMPTY) i = (i + 1) & mask;
+		return i;
+	}
+
+	void rehash(size_type cap)
+	{
+		assert((cap & (cap - 1)) == 0);
+		std::vector<std::uint64_t> oldHashes(cap, (std::uint64_t)EMPTY);
+		std::vector<Storage> oldEntries(cap);
+		oldHashes.swap(hashes);
+		oldEntries.swap(entries);
+		mask = cap - 1;
+		for (size_type i = 0; i < oldHashes.size(); i++)
+		{
+			if (oldHashes[i] == EMPTY) continue;
+			value_type& x = *reinterpret_cast<value_type*>(&oldEntries[i]);
+			const size_type j = freeIndex(oldHashes[i]);
+			new (&entries[j]) value_type(std::move(x));
+			hashes[j] = oldHashes[i];
+			x.~value_type();
+		}
+	}
+};
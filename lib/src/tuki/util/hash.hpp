@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <array>
+
+static const std::uint64_t FNV1A64_OFFSET = 0xcbf29ce484222325ull;
+static const std::uint64_t FNV1A64_PRIME = 0x100000001b3ull;
+
+// FNV-1a, used for the string keys
+inline std::uint64_t fnv1a64(const void* data, std::size_t size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	std::uint64_t h = FNV1A64_OFFSET;
+	for (std::size_t i = 0; i < size; i++)
+	{
+		h ^= p[i];
+		h *= FNV1A64_PRIME;
+	}
+	return h;
+}
+
+// the same hash of a null terminated string, can be evaluated at compile time
+constexpr std::uint64_t fnv1a64Const(const char* str, std::uint64_t h = FNV1A64_OFFSET)
+{
+	return *str ? fnv1a64Const(str + 1, (h ^ (unsigned char)*str) * FNV1A64_PRIME) : h;
+}
+
+inline std::uint64_t fnv1a64(const char* str)
+{
+	return fnv1a64(str, std::strlen(str));
+}
+
+// finalizer of splitmix64, spreads the bits of integer keys so the low bits can be used as index
+inline std::uint64_t mixHash(std::uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+inline std::uint64_t combineHash(std::uint64_t seed, std::uint64_t h)
+{
+	return mixHash(seed ^ (h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+// hash functor of FlatHashMap. The string hash accepts const char* so they can be looked up
+// without constructing a std::string
+template <typename T>
+struct FlatHash
+{
+	std::uint64_t operator()(const T& x)const { return mixHash((std::uint64_t)x); }
+};
+
+template <>
+struct FlatHash<std::string>
+{
+	std::uint64_t operator()(const std::string& s)const { return fnv1a64(s.data(), s.size()); }
+	std::uint64_t operator()(const char* s)const { return fnv1a64(s); }
+};
+
+template <typename T, std::size_t N>
+struct FlatHash<std::array<T, N> >
+{
+	std::uint64_t operator()(const std::array<T, N>& a)const
+	{
+		FlatHash<T> hash;
+		std::uint64_t h = 0;
+		for (const T& x : a)
+			h = combineHash(h, hash(x));
+		return h;
+	}
+};
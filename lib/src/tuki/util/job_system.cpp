@@ -0,0 +1,238 @@
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+#include <cassert>
+
+using namespace std;
+
+// index of the calling thread in the job system, -1 for unknown threads
+static thread_local int tlThreadIndex = -1;
+
+// spins before a worker goes to sleep
+static const unsigned IDLE_SPINS = 64;
+
+// JobQueue
+
+JobSystem::JobQueue::JobQueue()
+	: top(0), bottom(0)
+{
+	for (atomic<Job*>& slot : buffer) slot.store(nullptr, memory_order_relaxed);
+}
+
+bool JobSystem::JobQueue::push(Job* job)
+{
+	const int64_t b = bottom.load(memory_order_relaxed);
+	const int64_t t = top.load(memory_order_acquire);
+	if (b - t >= (int64_t)MAX_JOBS_PER_THREAD) return false;
+	buffer[b & (MAX_JOBS_PER_THREAD - 1)].store(job, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	bottom.store(b + 1, memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::JobQueue::isFull()const
+{
+	const int64_t b = bottom.load(memory_order_relaxed);
+	const int64_t t = top.load(memory_order_acquire);
+	return b - t >= (int64_t)MAX_JOBS_PER_THREAD;
+}
+
+JobSystem::Job* JobSystem::JobQueue::pop()
+{
+	const int64_t b = bottom.load(memory_order_relaxed) - 1;
+	bottom.store(b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = top.load(memory_order_relaxed);
+	if (t > b)
+	{
+		// empty
+		bottom.store(b + 1, memory_order_relaxed);
+		return nullptr;
+	}
+	Job* job = buffer[b & (MAX_JOBS_PER_THREAD - 1)].load(memory_order_relaxed);
+	if (t == b)
+	{
+		// last job, race against the thieves
+		if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::JobQueue::steal()
+{
+	int64_t t = top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	const int64_t b = bottom.load(memory_order_acquire);
+	if (t >= b) return nullptr;
+	Job* job = buffer[t & (MAX_JOBS_PER_THREAD - 1)].load(memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+// JobSystem
+
+JobSystem::JobSystem()
+	: quit(false), numQueuedJobs(0), numSleeping(0)
+{
+	init();
+}
+
+JobSystem::~JobSystem()
+{
+	shutdown();
+}
+
+void JobSystem::init(unsigned numWorkers)
+{
+	shutdown();
+	if (numWorkers == 0)
+	{
+		const unsigned hw = thread::hardware_concurrency();
+		numWorkers = hw > 1 ? hw - 1 : 0;
+	}
+
+	// the calling thread becomes the main thread of the job system
+	tlThreadIndex = 0;
+	quit = false;
+	numQueuedJobs = 0;
+	queues.resize(numWorkers + 1);
+	for (unsigned i = 0; i < queues.size(); i++)
+	{
+		queues[i] = new ThreadData;
+		queues[i]->nextJob = 0;
+		for (Job& job : queues[i]->jobs) job.inUse.store(false, memory_order_relaxed);
+		queues[i]->randomState = 0x9E3779B9u * (i + 1);
+	}
+	workers.reserve(numWorkers);
+	for (unsigned i = 1; i <= numWorkers; i++)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+void JobSystem::shutdown()
+{
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		quit = true;
+	}
+	sleepCond.notify_all();
+	for (thread& t : workers) t.join();
+	workers.clear();
+	for (ThreadData* data : queues) delete data;
+	queues.clear();
+}
+
+int JobSystem::getThreadIndex()const
+{
+	return tlThreadIndex;
+}
+
+JobSystem::Job* JobSystem::allocateJob(unsigned threadIndex)
+{
+	ThreadData& data = *queues[threadIndex];
+	if (data.queue.isFull()) return nullptr;
+	// the oldest slot can still be running in a thief, even if it's not in the queue anymore.
+	// acquire: the thief has destroyed the previous function object
+	Job* job = &data.jobs[data.nextJob & (MAX_JOBS_PER_THREAD - 1)];
+	if (job->inUse.load(memory_order_acquire)) return nullptr;
+	job->inUse.store(true, memory_order_relaxed);
+	data.nextJob++;
+	return job;
+}
+
+void JobSystem::submit(unsigned threadIndex, Job* job)
+{
+	if (!queues[threadIndex]->queue.push(job))
+	{
+		// the queue is full, there is no point in queueing more work
+		execute(job);
+		return;
+	}
+	numQueuedJobs.fetch_add(1, memory_order_seq_cst);
+	// the lock avoids missing the wakeup of a worker that is about to sleep
+	if (numSleeping.load(memory_order_seq_cst) > 0)
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		sleepCond.notify_one();
+	}
+}
+
+JobSystem::Job* JobSystem::getJob(unsigned threadIndex)
+{
+	ThreadData& data = *queues[threadIndex];
+	Job* job = data.queue.pop();
+	if (!job)
+	{
+		// steal from the other threads, starting from a random one
+		const unsigned n = (unsigned)queues.size();
+		data.randomState ^= data.randomState << 13;
+		data.randomState ^= data.randomState >> 17;
+		data.randomState ^= data.randomState << 5;
+		const unsigned start = data.randomState % n;
+		for (unsigned i = 0; i < n && !job; i++)
+		{
+			const unsigned victim = (start + i) % n;
+			if (victim != threadIndex) job = queues[victim]->queue.steal();
+		}
+	}
+	if (job) numQueuedJobs.fetch_sub(1, memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+	JobCounter* counter = job->counter;
+	job->invoke(*job);
+	// the slot can be reused from now on, the job must not be touched
+	job->inUse.store(false, memory_order_release);
+	if (counter) counter->count.fetch_sub(1, memory_order_release);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	const int threadIndex = getThreadIndex();
+	assert(threadIndex >= 0 && "only the threads of the job system can wait for jobs");
+	while (!counter.isDone())
+	{
+		if (Job* job = getJob(threadIndex)) execute(job);
+		else this_thread::yield();
+	}
+}
+
+void JobSystem::workerLoop(unsigned threadIndex)
+{
+	tlThreadIndex = threadIndex;
+	if (Profiler::isEnabled())
+	{
+		const string name = "job worker " + to_string(threadIndex);
+		Profiler::setThreadName(name.c_str());
+	}
+	unsigned idle = 0;
+	while (!quit.load(memory_order_relaxed))
+	{
+		if (Job* job = getJob(threadIndex))
+		{
+			execute(job);
+			idle = 0;
+		}
+		else if (++idle < IDLE_SPINS)
+		{
+			this_thread::yield();
+		}
+		else
+		{
+			unique_lock<mutex> lock(sleepMutex);
+			numSleeping.fetch_add(1, memory_order_seq_cst);
+			sleepCond.wait(lock, [this]()
+			{
+				return quit.load(memory_order_relaxed) || numQueuedJobs.load(memory_order_seq_cst) > 0;
+			});
+			numSleeping.fetch_sub(1, memory_order_relaxed);
+			idle = 0;
+		}
+	}
+}
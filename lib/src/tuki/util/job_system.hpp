@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <new>
+#include "singleton.hpp"
+
+/*
+Work stealing job system.
+Each thread has a Chase-Lev deque: the owner pushes and pops jobs at the bottom
+(LIFO, good for the cache) and the other threads steal from the top when they
+run out of work. The thread that created the job system (usually the main thread)
+also has a queue and works while it waits for a counter.
+Jobs are small fixed size objects allocated from a ring buffer of the thread that
+spawns them, so spawning doesn't allocate memory. A slot is reused only when its job
+has finished. When the queue is full or the next slot is still running in other thread,
+the new job runs inline.
+Only the workers and the main thread can spawn jobs, other threads run them inline.
+*/
+
+// number of unfinished jobs of a group. Must outlive the jobs that reference it
+class JobCounter
+{
+	friend class JobSystem;
+public:
+	JobCounter() : count(0) {}
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool isDone()const { return count.load(std::memory_order_acquire) == 0; }
+
+private:
+	std::atomic<int> count;
+};
+
+class JobSystem : public Singleton<JobSystem>
+{
+	friend class Singleton<JobSystem>;
+public:
+	static const unsigned MAX_JOBS_PER_THREAD = 4096;
+	static const unsigned JOB_STORAGE_SIZE = 48;
+
+	// restarts the workers. 0 means one worker per hardware thread, except the calling thread
+	// must be called when there are no jobs running
+	void init(unsigned numWorkers = 0);
+
+	// workers + main thread
+	unsigned getNumThreads()const { return (unsigned)queues.size(); }
+
+	// the func object is copied into the job, it must fit in JOB_STORAGE_SIZE bytes
+	template <typename Func>
+	void run(const Func& func, JobCounter* counter = nullptr);
+
+	// executes other jobs until the counter is zero
+	void wait(JobCounter& counter);
+
+	// runs func(i) for i in [0, n) and waits. The range is split adaptively:
+	// each job gives away the second half of its range while it's bigger than the grain
+	template <typename Func>
+	void parallelFor(unsigned n, const Func& func, unsigned minGrain = 1);
+
+private:
+	JobSystem();
+	~JobSystem();
+
+	struct Job
+	{
+		void (*invoke)(Job& job);
+		JobCounter* counter;
+		std::atomic<bool> inUse;	// from the allocation until it has finished
+		alignas(16) unsigned char storage[JOB_STORAGE_SIZE];
+	};
+
+	// Chase-Lev deque with fixed capacity ("Correct and Efficient Work-Stealing for Weak Memory Models")
+	class JobQueue
+	{
+	public:
+		JobQueue();
+		bool push(Job* job);	// owner only, false if full
+		bool isFull()const;		// owner only
+		Job* pop();				// owner only
+		Job* steal();			// any thread
+	private:
+		std::atomic<std::int64_t> top;
+		std::atomic<std::int64_t> bottom;
+		std::atomic<Job*> buffer[MAX_JOBS_PER_THREAD];
+	};
+
+	struct ThreadData
+	{
+		JobQueue queue;
+		Job jobs[MAX_JOBS_PER_THREAD];	// ring buffer
+		unsigned nextJob;
+		unsigned randomState;
+	};
+
+	// DATA
+	std::vector<ThreadData*> queues;	// 0 is the main thread
+	std::vector<std::thread> workers;
+	std::atomic<bool> quit;
+	std::atomic<int> numQueuedJobs;		// for waking up the workers
+	std::atomic<int> numSleeping;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCond;
+
+	// FUNCTIONS
+	void shutdown();
+	void workerLoop(unsigned threadIndex);
+	int getThreadIndex()const;
+	// null if there is no free slot
+	Job* allocateJob(unsigned threadIndex);
+	void submit(unsigned threadIndex, Job* job);
+	Job* getJob(unsigned threadIndex);
+	static void execute(Job* job);
+
+	template <typename Func>
+	struct ParallelForRange
+	{
+		const Func* func;
+		JobCounter* counter;
+		unsigned begin, end, grain;
+		void operator()()const;
+	};
+};
+
+template <typename Func>
+void JobSystem::run(const Func& func, JobCounter* counter)
+{
+	static_assert(sizeof(Func) <= JOB_STORAGE_SIZE, "the job function object is too big");
+	static_assert(alignof(Func) <= 16, "the job function object is over aligned");
+
+	const int threadIndex = getThreadIndex();
+	if (threadIndex < 0)
+	{
+		// not a thread of the job system
+		func();
+		return;
+	}
+
+	Job* job = allocateJob(threadIndex);
+	if (!job)
+	{
+		func();
+		return;
+	}
+	new (job->storage) Func(func);
+	job->invoke = [](Job& j)
+	{
+		Func* f = (Func*)j.storage;
+		(*f)();
+		f->~Func();
+	};
+	job->counter = counter;
+	if (counter) counter->count.fetch_add(1, std::memory_order_relaxed);
+	submit(threadIndex, job);
+}
+
+template <typename Func>
+void JobSystem::ParallelForRange<Func>::operator()()const
+{
+	JobSystem* js = JobSystem::getSingleton();
+	unsigned e = end;
+	// split while the range is big, the halves can be stolen by idle threads
+	while (e - begin > grain)
+	{
+		const unsigned mid = begin + (e - begin) / 2;
+		ParallelForRange<Func> right = { func, counter, mid, e, grain };
+		js->run(right, counter);
+		e = mid;
+	}
+	for (unsigned i = begin; i < e; i++) (*func)(i);
+}
+
+template <typename Func>
+void JobSystem::parallelFor(unsigned n, const Func& func, unsigned minGrain)
+{
+	if (n == 0) return;
+	// a few ranges per thread is enough for load balancing
+	const unsigned grain = std::max(std::max(minGrain, 1u), n / (8 * getNumThreads()));
+	if (n <= grain || getNumThreads() == 1)
+	{
+		for (unsigned i = 0; i < n; i++) func(i);
+		return;
+	}
+	JobCounter counter;
+	ParallelForRange<Func> range = { &func, &counter, 0, n, grain };
+	run(range, &counter);
+	wait(counter);
+}
@@ -2,4 +2,5 @@
 
 // Memory Allocators
 
-#include "mallocr/mallocr_simple.hpp"
\ No newline at end of file
+#include "mallocr/mallocr_simple.hpp"
+#include "mallocr/mallocr_arena.hpp"
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+
+using namespace std;
+
+#ifdef TUKI_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t threadCount = 0;
+static atomic<uint64_t> totalCount(0);
+
+static void* countedAlloc(size_t size)
+{
+	threadCount++;
+	totalCount.fetch_add(1, memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (!p) throw bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+	try { return countedAlloc(size); }
+	catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+	try { return countedAlloc(size); }
+	catch (...) { return nullptr; }
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace AllocCounter
+{
+bool isEnabled() { return true; }
+uint64_t getThreadCount() { return threadCount; }
+uint64_t getTotalCount() { return totalCount.load(memory_order_relaxed); }
+}
+
+#else
+
+namespace AllocCounter
+{
+bool isEnabled() { return false; }
+uint64_t getThreadCount() { return 0; }
+uint64_t getTotalCount() { return 0; }
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+Counts the heap allocations, for checking that the hot paths don't allocate.
+Only works when the library is built with the TUKI_COUNT_ALLOCATIONS option,
+which replaces the global operator new. Otherwise the counts are always zero.
+*/
+namespace AllocCounter
+{
+
+bool isEnabled();
+
+// allocations made by the calling thread
+uint64_t getThreadCount();
+
+// allocations made by all the threads
+uint64_t getTotalCount();
+
+}
@@ -0,0 +1,145 @@
+#include "mallocr_arena.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <algorithm>
+
+using namespace std;
+
+static atomic<unsigned> currentFrame(0);
+
+static size_t alignUp(size_t x, size_t alignment)
+{
+	return (x + alignment - 1) & ~(alignment - 1);
+}
+
+LinearArena::LinearArena(size_t blockSize)
+	: currentBlock(0), offset(0), blockSize(blockSize), frame(0), numScopes(0)
+{}
+
+LinearArena::~LinearArena()
+{
+	for (Block& block : blocks) delete[] block.data;
+}
+
+void LinearArena::addBlock(size_t minSize)
+{
+	size_t size = blockSize;
+	if (!blocks.empty()) size = std::max(size, 2 * blocks.back().size);
+	size = std::max(size, minSize);
+	Block block;
+	block.data = new char[size];
+	block.size = size;
+	blocks.push_back(block);
+}
+
+void* LinearArena::allocate(size_t size, size_t alignment)
+{
+	assert((alignment & (alignment - 1)) == 0 && "the alignment must be a power of two");
+	if (blocks.empty()) addBlock(size + alignment);
+
+	// find a block where it fits, the blocks after the current one can be free after a rewind
+	while (true)
+	{
+		Block& block = blocks[currentBlock];
+		const size_t base = (size_t)block.data;
+		const size_t start = alignUp(base + offset, alignment) - base;
+		if (start + size <= block.size)
+		{
+			offset = start + size;
+			return block.data + start;
+		}
+		if (currentBlock + 1 == blocks.size()) addBlock(size + alignment);
+		currentBlock++;
+		offset = 0;
+	}
+}
+
+void LinearArena::free(void* p, size_t size)
+{
+	if (blocks.empty()) return;
+	char* end = (char*)p + size;
+	if (end == blocks[currentBlock].data + offset) offset = (char*)p - blocks[currentBlock].data;
+}
+
+LinearArena::Marker LinearArena::getMarker()const
+{
+	Marker marker;
+	marker.block = currentBlock;
+	marker.offset = offset;
+	return marker;
+}
+
+void LinearArena::rewind(const Marker& marker)
+{
+	assert(marker.block <= currentBlock);
+	currentBlock = marker.block;
+	offset = marker.offset;
+}
+
+void LinearArena::reset()
+{
+	if (blocks.size() > 1)
+	{
+		// merge the blocks, next time everything fits in one
+		const size_t total = getReservedSize();
+		for (Block& block : blocks) delete[] block.data;
+		blocks.clear();
+		addBlock(total);
+	}
+	currentBlock = 0;
+	offset = 0;
+}
+
+size_t LinearArena::getUsedSize()const
+{
+	size_t size = offset;
+	for (unsigned i = 0; i < currentBlock; i++) size += blocks[i].size;
+	return size;
+}
+
+size_t LinearArena::getReservedSize()const
+{
+	size_t size = 0;
+	for (const Block& block : blocks) size += block.size;
+	return size;
+}
+
+LinearArena& LinearArena::getThreadArena()
+{
+	static thread_local LinearArena arena;
+	const unsigned f = currentFrame.load(memory_order_relaxed);
+	if (arena.frame != f && arena.numScopes == 0)
+	{
+		arena.frame = f;
+		arena.reset();
+	}
+	return arena;
+}
+
+void LinearArena::beginFrame()
+{
+	currentFrame.fetch_add(1, memory_order_relaxed);
+}
+
+// ScratchScope
+
+ScratchScope::ScratchScope()
+	: arena(LinearArena::getThreadArena())
+{
+	marker = arena.getMarker();
+	arena.numScopes++;
+}
+
+ScratchScope::ScratchScope(LinearArena& arena)
+	: arena(arena)
+{
+	marker = arena.getMarker();
+	arena.numScopes++;
+}
+
+ScratchScope::~ScratchScope()
+{
+	arena.numScopes--;
+	arena.rewind(marker);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+Linear (bump) allocator.
+Allocating is just moving a pointer, the memory is released all at once with
+reset() or rewinding to a previous marker. Destructors are not called.
+When a block is full a new one is allocated; on reset the blocks are merged in a
+single one, so after a few frames the arena doesn't touch the heap anymore.
+*/
+class LinearArena
+{
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+	struct Marker
+	{
+		unsigned block;
+		size_t offset;
+	};
+
+	explicit LinearArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+	~LinearArena();
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	template <typename T>
+	T* allocateArray(size_t n) { return (T*)allocate(n * sizeof(T), alignof(T)); }
+	// only releases the memory if it was the last allocation
+	void free(void* p, size_t size);
+
+	Marker getMarker()const;
+	// frees all the allocations made after the marker
+	void rewind(const Marker& marker);
+	// frees everything, the memory is kept for reusing
+	void reset();
+
+	size_t getUsedSize()const;
+	size_t getReservedSize()const;
+
+	// arena of the calling thread for memory that only lives during the current frame
+	static LinearArena& getThreadArena();
+	// the thread arenas will be reset the next time they are accessed
+	static void beginFrame();
+
+private:
+	friend class ScratchScope;
+
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+
+	// DATA
+	std::vector<Block> blocks;
+	unsigned currentBlock;
+	size_t offset;			// in the current block
+	size_t blockSize;
+	unsigned frame;			// last frame in which the thread arena was used
+	unsigned numScopes;		// the thread arena can't be reset while there are scratch scopes
+
+	void addBlock(size_t minSize);
+};
+
+// everything allocated from the scope is freed when it's destroyed
+// by default uses the arena of the thread, so the scopes of a thread must be nested
+// and the containers of an outer scope must not grow while an inner scope is alive
+class ScratchScope
+{
+public:
+	ScratchScope();
+	explicit ScratchScope(LinearArena& arena);
+	~ScratchScope();
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	LinearArena& getArena() { return arena; }
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) { return arena.allocate(size, alignment); }
+	template <typename T>
+	T* allocateArray(size_t n) { return arena.allocateArray<T>(n); }
+
+private:
+	LinearArena& arena;
+	LinearArena::Marker marker;
+};
+
+// STL allocator that takes the memory from a LinearArena
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(LinearArena& arena) : arena(&arena) {}
+	ArenaAllocator(ScratchScope& scope) : arena(&scope.getArena()) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& o) : arena(o.getArena()) {}
+
+	T* allocate(size_t n) { return arena->allocateArray<T>(n); }
+	void deallocate(T* p, size_t n) { arena->free(p, n * sizeof(T)); }
+
+	LinearArena* getArena()const { return arena; }
+
+private:
+	LinearArena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() == b.getArena(); }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() != b.getArena(); }
+
+template <typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T> >;
@@ -0,0 +1,180 @@
+#include "mem_tracker.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+namespace
+{
+
+const char* TAG_NAMES[(int)MemTag::COUNT] =
+{
+	"render",
+	"material",
+	"mesh",
+	"scene",
+	"texture",
+};
+
+const char* VRAM_TYPE_NAMES[(int)VramType::COUNT] =
+{
+	"buffer",
+	"texture",
+};
+
+struct Counter
+{
+	atomic<int64_t> liveBytes;
+	atomic<int64_t> peakBytes;
+	atomic<int64_t> numAllocs;
+	atomic<int64_t> numFrees;
+	atomic<int64_t> budget;
+	atomic<bool> overBudget;	// the warning is reported only once until it goes under the budget
+};
+
+Counter ramCounters[(int)MemTag::COUNT];
+Counter vramCounters[(int)VramType::COUNT];
+
+void defaultBudgetCallback(const char* name, bool vram, int64_t liveBytes, int64_t budget)
+{
+	cerr << "memory budget exceeded: " << (vram ? "vram/" : "ram/") << name << " "
+		<< liveBytes << " bytes (budget " << budget << ")" << endl;
+}
+
+atomic<MemTracker::BudgetCallback> budgetCallback(defaultBudgetCallback);
+
+void onAlloc(Counter& c, size_t bytes, const char* name, bool vram)
+{
+	c.numAllocs.fetch_add(1, memory_order_relaxed);
+	const int64_t live = c.liveBytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+	int64_t peak = c.peakBytes.load(memory_order_relaxed);
+	while (live > peak && !c.peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed));
+
+	const int64_t budget = c.budget.load(memory_order_relaxed);
+	if (budget > 0 && live > budget && !c.overBudget.exchange(true))
+	{
+		budgetCallback.load()(name, vram, live, budget);
+	}
+}
+
+void onFree(Counter& c, size_t bytes)
+{
+	c.numFrees.fetch_add(1, memory_order_relaxed);
+	const int64_t live = c.liveBytes.fetch_sub(bytes, memory_order_relaxed) - bytes;
+	if (live <= c.budget.load(memory_order_relaxed)) c.overBudget.store(false, memory_order_relaxed);
+}
+
+MemStats getStats(const Counter& c)
+{
+	MemStats stats;
+	stats.liveBytes = c.liveBytes.load(memory_order_relaxed);
+	stats.peakBytes = c.peakBytes.load(memory_order_relaxed);
+	stats.numAllocs = c.numAllocs.load(memory_order_relaxed);
+	stats.numFrees = c.numFrees.load(memory_order_relaxed);
+	return stats;
+}
+
+MemStats diffStats(const MemStats& a, const MemStats& b)
+{
+	MemStats d;
+	d.liveBytes = b.liveBytes - a.liveBytes;
+	d.peakBytes = b.peakBytes;
+	d.numAllocs = b.numAllocs - a.numAllocs;
+	d.numFrees = b.numFrees - a.numFrees;
+	return d;
+}
+
+void printRow(ostream& os, const string& name, const MemStats& s)
+{
+	os << setw(18) << left << name << right
+		<< setw(14) << s.liveBytes
+		<< setw(14) << s.peakBytes
+		<< setw(10) << s.numAllocs
+		<< setw(10) << s.numFrees << "\n";
+}
+
+}
+
+MemSnapshot MemSnapshot::diff(const MemSnapshot& a, const MemSnapshot& b)
+{
+	MemSnapshot d;
+	for (int i = 0; i < (int)MemTag::COUNT; i++) d.ram[i] = diffStats(a.ram[i], b.ram[i]);
+	for (int i = 0; i < (int)VramType::COUNT; i++) d.vram[i] = diffStats(a.vram[i], b.vram[i]);
+	return d;
+}
+
+string MemSnapshot::toString()const
+{
+	stringstream ss;
+	ss << setw(18) << left << "tag" << right
+		<< setw(14) << "live" << setw(14) << "peak"
+		<< setw(10) << "allocs" << setw(10) << "frees" << "\n";
+	for (int i = 0; i < (int)MemTag::COUNT; i++)
+		printRow(ss, string("ram/") + TAG_NAMES[i], ram[i]);
+	for (int i = 0; i < (int)VramType::COUNT; i++)
+		printRow(ss, string("vram/") + VRAM_TYPE_NAMES[i], vram[i]);
+	return ss.str();
+}
+
+namespace MemTracker
+{
+
+void trackAlloc(MemTag tag, size_t bytes)
+{
+	onAlloc(ramCounters[(int)tag], bytes, TAG_NAMES[(int)tag], false);
+}
+
+void trackFree(MemTag tag, size_t bytes)
+{
+	onFree(ramCounters[(int)tag], bytes);
+}
+
+void trackVramAlloc(VramType type, size_t bytes)
+{
+	onAlloc(vramCounters[(int)type], bytes, VRAM_TYPE_NAMES[(int)type], true);
+}
+
+void trackVramFree(VramType type, size_t bytes)
+{
+	onFree(vramCounters[(int)type], bytes);
+}
+
+MemSnapshot getSnapshot()
+{
+	MemSnapshot snapshot;
+	for (int i = 0; i < (int)MemTag::COUNT; i++) snapshot.ram[i] = getStats(ramCounters[i]);
+	for (int i = 0; i < (int)VramType::COUNT; i++) snapshot.vram[i] = getStats(vramCounters[i]);
+	return snapshot;
+}
+
+void setBudget(MemTag tag, size_t bytes)
+{
+	ramCounters[(int)tag].budget = bytes;
+	ramCounters[(int)tag].overBudget = false;
+}
+
+void setVramBudget(VramType type, size_t bytes)
+{
+	vramCounters[(int)type].budget = bytes;
+	vramCounters[(int)type].overBudget = false;
+}
+
+void setBudgetCallback(BudgetCallback callback)
+{
+	budgetCallback = callback ? callback : defaultBudgetCallback;
+}
+
+const char* getTagName(MemTag tag)
+{
+	return TAG_NAMES[(int)tag];
+}
+
+const char* getVramTypeName(VramType type)
+{
+	return VRAM_TYPE_NAMES[(int)type];
+}
+
+}
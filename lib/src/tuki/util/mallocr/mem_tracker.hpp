@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+Tracks the memory used by each subsystem.
+The subsystems report their allocations with a tag, the tracker keeps the live bytes,
+the peak and the number of allocations of each tag. VRAM is tracked in the same way
+per type of GPU resource (the sizes are estimations, the driver can add padding).
+When a budget is set, a warning is reported the first time the live bytes go over it.
+All the functions are thread safe.
+*/
+
+enum class MemTag
+{
+	RENDER = 0,
+	MATERIAL,
+	MESH,
+	SCENE,
+	TEXTURE,
+
+	COUNT
+};
+
+enum class VramType
+{
+	BUFFER = 0,
+	TEXTURE,
+
+	COUNT
+};
+
+struct MemStats
+{
+	std::int64_t liveBytes;
+	std::int64_t peakBytes;
+	std::int64_t numAllocs;
+	std::int64_t numFrees;
+};
+
+struct MemSnapshot
+{
+	MemStats ram[(int)MemTag::COUNT];
+	MemStats vram[(int)VramType::COUNT];
+
+	// b - a, the peaks are the ones of b
+	static MemSnapshot diff(const MemSnapshot& a, const MemSnapshot& b);
+	// table with a row for each tag
+	std::string toString()const;
+};
+
+namespace MemTracker
+{
+
+void trackAlloc(MemTag tag, size_t bytes);
+void trackFree(MemTag tag, size_t bytes);
+void trackVramAlloc(VramType type, size_t bytes);
+void trackVramFree(VramType type, size_t bytes);
+
+// new[] and delete[] that report to the tracker
+template <typename T>
+T* newArray(MemTag tag, size_t n)
+{
+	T* p = new T[n];
+	trackAlloc(tag, n * sizeof(T));
+	return p;
+}
+template <typename T>
+void deleteArray(MemTag tag, T* p, size_t n)
+{
+	if (p == nullptr) return;
+	trackFree(tag, n * sizeof(T));
+	delete[] p;
+}
+
+MemSnapshot getSnapshot();
+
+// 0 means no budget
+void setBudget(MemTag tag, size_t bytes);
+void setVramBudget(VramType type, size_t bytes);
+
+// called when a budget is exceeded, by default the warning is printed to stderr
+typedef void (*BudgetCallback)(const char* name, bool vram, std::int64_t liveBytes, std::int64_t budget);
+void setBudgetCallback(BudgetCallback callback);
+
+const char* getTagName(MemTag tag);
+const char* getVramTypeName(VramType type);
+
+}
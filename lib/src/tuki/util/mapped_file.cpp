@@ -0,0 +1,140 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile()
+{
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	fileHandle = mappingHandle = nullptr;
+#endif
+}
+
+MappedFile::MappedFile(const string& fileName) : MappedFile()
+{
+	open(fileName);
+}
+
+MappedFile::MappedFile(MappedFile&& o) : MappedFile()
+{
+	moveFrom(o);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o)
+{
+	if (this != &o)
+	{
+		close();
+		moveFrom(o);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::moveFrom(MappedFile& o)
+{
+	data = o.data;
+	size = o.size;
+	o.data = nullptr;
+	o.size = 0;
+#ifdef _WIN32
+	fileHandle = o.fileHandle;
+	mappingHandle = o.mappingHandle;
+	o.fileHandle = o.mappingHandle = nullptr;
+#endif
+}
+
+#ifdef _WIN32
+
+void MappedFile::open(const string& fileName)
+{
+	close();
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw runtime_error("could not open " + fileName);
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		throw runtime_error("could not map empty file " + fileName);
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		throw runtime_error("could not map " + fileName);
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = (const unsigned char*)view;
+	size = (size_t)fileSize.QuadPart;
+}
+
+void MappedFile::close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle((HANDLE)mappingHandle);
+	if (fileHandle) CloseHandle((HANDLE)fileHandle);
+	data = nullptr;
+	size = 0;
+	fileHandle = mappingHandle = nullptr;
+}
+
+#else
+
+void MappedFile::open(const string& fileName)
+{
+	close();
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw runtime_error("could not open " + fileName);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		throw runtime_error("could not map empty file " + fileName);
+	}
+	void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file alive
+	::close(fd);
+	if (view == MAP_FAILED)
+	{
+		throw runtime_error("could not map " + fileName);
+	}
+	data = (const unsigned char*)view;
+	size = (size_t)st.st_size;
+}
+
+void MappedFile::close()
+{
+	if (data) munmap((void*)data, size);
+	data = nullptr;
+	size = 0;
+}
+
+#endif
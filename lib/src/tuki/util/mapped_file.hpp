@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// read only memory mapped file
+// the OS loads the pages on demand, so opening big files is almost free
+class MappedFile
+{
+public:
+	MappedFile();
+	// throws runtime_error if the file can't be mapped
+	explicit MappedFile(const std::string& fileName);
+	MappedFile(MappedFile&& o);
+	MappedFile& operator=(MappedFile&& o);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	void open(const std::string& fileName);
+	void close();
+
+	bool isOpen()const { return data != nullptr; }
+	const unsigned char* getData()const { return data; }
+	size_t getSize()const { return size; }
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+
+	void moveFrom(MappedFile& o);
+};
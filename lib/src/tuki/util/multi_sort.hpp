@@ -5,12 +5,16 @@
 #include <functional>
 #include <cassert>
 #include <numeric>
+#include <utility>
+#include "mallocr/mallocr_arena.hpp"
 
-template <typename T, typename Compare>
+// the vectors can have any allocator, the temporary memory comes from the thread scratch arena
+
+template <typename Order, typename Vec, typename Compare>
 void getSortPermutation(
-    std::vector<unsigned>& out,
-    const std::vector<T>& v,
-    Compare compare = std::less<T>())
+    Order& out,
+    const Vec& v,
+    Compare compare)
 {
     out.resize(v.size());
     std::iota(out.begin(), out.end(), 0);
@@ -19,47 +23,51 @@ void getSortPermutation(
         [&](unsigned i, unsigned j){ return compare(v[i], v[j]); });
 }
 
-template <typename T>
+template <typename Order, typename Vec>
 void applyPermutation(
-    const std::vector<unsigned>& order,
-    std::vector<T>& t)
+    const Order& order,
+    Vec& t)
 {
+    typedef typename Vec::value_type T;
     assert(order.size() == t.size());
-    std::vector<T> st(t.size());
+    ScratchScope scratch;
+    ScratchVector<T> st(scratch);
+    st.reserve(t.size());
     for(unsigned i=0; i<t.size(); i++)
     {
-        st[i] = t[order[i]];
+        st.push_back(std::move(t[order[i]]));
     }
-    t = st;
+    std::move(st.begin(), st.end(), t.begin());
 }
 
-template <typename T, typename... S>
+template <typename Order, typename Vec, typename... S>
 void applyPermutation(
-    const std::vector<unsigned>& order,
-    std::vector<T>& t,
-    std::vector<S>&... s)
+    const Order& order,
+    Vec& t,
+    S&... s)
 {
     applyPermutation(order, t);
     applyPermutation(order, s...);
 }
 
 // sort multiple vectors using the criteria of the first one
-template<typename T, typename Compare, typename... SS>
+template<typename Vec, typename Compare, typename... SS>
 void sortVectors(
-    const std::vector<T>& t,
+    const Vec& t,
     Compare comp,
-    std::vector<SS>&... ss)
+    SS&... ss)
 {
-    std::vector<unsigned> order;
+    ScratchScope scratch;
+    ScratchVector<unsigned> order(scratch);
     getSortPermutation(order, t, comp);
     applyPermutation(order, ss...);
 }
 
 // make less verbose for the usual ascending order
-template<typename T, typename... SS>
+template<typename Vec, typename... SS>
 void sortVectorsAscending(
-    const std::vector<T>& t,
-    std::vector<SS>&... ss)
+    const Vec& t,
+    SS&... ss)
 {
-    sortVectors(t, std::less<T>(), ss...);
-}
\ No newline at end of file
+    sortVectors(t, std::less<typename Vec::value_type>(), ss...);
+}
@@ -0,0 +1,56 @@
+#include "name_id.hpp"
+
+#include "flat_hash_map.hpp"
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+
+// the deque doesn't move the strings, so the pointers in the table stay valid
+mutex tableMutex;
+deque<string> strings;
+FlatHashMap<NameId, const char*> table;
+
+}
+
+NameId NameId::intern(const char* str)
+{
+	const NameId id = fromHash(fnv1a64(str));
+	lock_guard<mutex> lock(tableMutex);
+	auto it = table.find(id);
+	if (it != table.end())
+	{
+		assert(strcmp(it->second, str) == 0 && "NameId collision");
+		return id;
+	}
+	strings.emplace_back(str);
+	table[id] = strings.back().c_str();
+	return id;
+}
+
+NameId NameId::intern(const string& str)
+{
+	return intern(str.c_str());
+}
+
+const char* NameId::getString()const
+{
+	lock_guard<mutex> lock(tableMutex);
+	auto it = table.find(*this);
+	return it == table.end() ? nullptr : it->second;
+}
+
+string NameId::toString()const
+{
+	const char* str = getString();
+	if (str) return str;
+	stringstream ss;
+	ss << "#" << hex << hash;
+	return ss.str();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "hash.hpp"
+
+/*
+Identifier of a name (slot and uniform names, asset paths), the 64 bit FNV-1a hash of the
+string, so the lookups are integer compares.
+The constructor from a string is constexpr, the names known at compile time can be declared as
+	static constexpr NameId MODEL_MAT("modelMat");
+to hash them only once.
+intern() also saves the string in a global table, that is used for the reverse lookup
+(getString()) in the error messages, the debugger and the tools. In debug builds it checks
+that there are no collisions.
+The table is thread safe; the strings are never released.
+*/
+
+class NameId
+{
+public:
+	constexpr NameId() : hash(0) {}
+	constexpr NameId(const char* str) : hash(fnv1a64Const(str)) {}
+	NameId(const std::string& str) : hash(fnv1a64(str.data(), str.size())) {}
+
+	static constexpr NameId fromHash(std::uint64_t hash) { return NameId(hash, 0); }
+
+	// hashes the string and saves it for the reverse lookup
+	static NameId intern(const char* str);
+	static NameId intern(const std::string& str);
+
+	constexpr std::uint64_t getHash()const { return hash; }
+	constexpr bool isNull()const { return hash == 0; }
+
+	// the string if it was interned, otherwise nullptr
+	const char* getString()const;
+	// the string if it was interned, otherwise the hash in hexadecimal
+	std::string toString()const;
+
+	constexpr bool operator==(NameId o)const { return hash == o.hash; }
+	constexpr bool operator!=(NameId o)const { return hash != o.hash; }
+	constexpr bool operator<(NameId o)const { return hash < o.hash; }
+
+private:
+	constexpr NameId(std::uint64_t hash, int) : hash(hash) {}
+
+	std::uint64_t hash;
+};
+
+// the hash is already well distributed
+template <>
+struct FlatHash<NameId>
+{
+	std::uint64_t operator()(NameId id)const { return id.getHash(); }
+};
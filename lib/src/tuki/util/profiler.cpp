@@ -0,0 +1,265 @@
+#include "profiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+using namespace std;
+
+namespace
+{
+
+struct ThreadBuffer
+{
+	vector<ProfileEvent> events;	// ring buffer
+	atomic<uint64_t> count;			// total number of events written
+	string name;
+	unsigned index;
+	bool isTrack;
+};
+
+struct Registry
+{
+	mutex lock;
+	vector<unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& getRegistry()
+{
+	static Registry registry;
+	return registry;
+}
+
+thread_local ThreadBuffer* tlBuffer = nullptr;
+
+ThreadBuffer* createBuffer(bool isTrack)
+{
+	Registry& reg = getRegistry();
+	lock_guard<mutex> lock(reg.lock);
+	ThreadBuffer* buffer = new ThreadBuffer;
+	buffer->events.resize(Profiler::MAX_EVENTS_PER_THREAD);
+	buffer->count = 0;
+	buffer->index = (unsigned)reg.buffers.size();
+	buffer->name = "thread " + to_string(buffer->index);
+	buffer->isTrack = isTrack;
+	reg.buffers.emplace_back(buffer);
+	return buffer;
+}
+
+ThreadBuffer& getThreadBuffer()
+{
+	if (!tlBuffer) tlBuffer = createBuffer(false);
+	return *tlBuffer;
+}
+
+void writeEvent(ThreadBuffer& buffer, const char* name, uint64_t begin, uint64_t end)
+{
+	const uint64_t i = buffer.count.load(memory_order_relaxed);
+	ProfileEvent& e = buffer.events[i & (Profiler::MAX_EVENTS_PER_THREAD - 1)];
+	e.name = name;
+	e.begin = begin;
+	e.end = end;
+	buffer.count.store(i + 1, memory_order_release);
+}
+
+const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+}
+
+namespace Profiler
+{
+
+bool isEnabled()
+{
+#ifdef TUKI_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startTime).count();
+}
+
+void recordEvent(const char* name, uint64_t begin, uint64_t end)
+{
+	writeEvent(getThreadBuffer(), name, begin, end);
+}
+
+unsigned createTrack(const char* name)
+{
+	ThreadBuffer* buffer = createBuffer(true);
+	lock_guard<mutex> lock(getRegistry().lock);
+	buffer->name = name;
+	return buffer->index;
+}
+
+void recordTrackEvent(unsigned track, const char* name, uint64_t begin, uint64_t end)
+{
+	ThreadBuffer* buffer;
+	{
+		Registry& reg = getRegistry();
+		lock_guard<mutex> lock(reg.lock);
+		buffer = reg.buffers[track].get();
+	}
+	writeEvent(*buffer, name, begin, end);
+}
+
+void setThreadName(const char* name)
+{
+	ThreadBuffer& buffer = getThreadBuffer();
+	lock_guard<mutex> lock(getRegistry().lock);
+	buffer.name = name;
+}
+
+unsigned getNumThreads()
+{
+	Registry& reg = getRegistry();
+	lock_guard<mutex> lock(reg.lock);
+	return (unsigned)reg.buffers.size();
+}
+
+vector<ProfileEvent> getEvents(unsigned threadIndex)
+{
+	Registry& reg = getRegistry();
+	lock_guard<mutex> lock(reg.lock);
+	const ThreadBuffer& buffer = *reg.buffers[threadIndex];
+	const uint64_t count = buffer.count.load(memory_order_acquire);
+	const uint64_t first = count > MAX_EVENTS_PER_THREAD ? count - MAX_EVENTS_PER_THREAD : 0;
+	vector<ProfileEvent> events;
+	events.reserve(count - first);
+	for (uint64_t i = first; i < count; i++)
+		events.push_back(buffer.events[i & (MAX_EVENTS_PER_THREAD - 1)]);
+	return events;
+}
+
+void clear()
+{
+	Registry& reg = getRegistry();
+	lock_guard<mutex> lock(reg.lock);
+	for (auto& buffer : reg.buffers) buffer->count.store(0, memory_order_relaxed);
+}
+
+string getChromeTrace()
+{
+	using namespace rapidjson;
+	StringBuffer sb;
+	Writer<StringBuffer> writer(sb);
+	writer.StartObject();
+	writer.Key("displayTimeUnit");
+	writer.String("ms");
+	writer.Key("traceEvents");
+	writer.StartArray();
+	const unsigned numThreads = getNumThreads();
+	for (unsigned t = 0; t < numThreads; t++)
+	{
+		string threadName;
+		{
+			lock_guard<mutex> lock(getRegistry().lock);
+			threadName = getRegistry().buffers[t]->name;
+		}
+		writer.StartObject();
+		writer.Key("name"); writer.String("thread_name");
+		writer.Key("ph"); writer.String("M");
+		writer.Key("pid"); writer.Uint(0);
+		writer.Key("tid"); writer.Uint(t);
+		writer.Key("args");
+		writer.StartObject();
+		writer.Key("name"); writer.String(threadName.c_str());
+		writer.EndObject();
+		writer.EndObject();
+
+		// complete events, the times are in microseconds
+		for (const ProfileEvent& e : getEvents(t))
+		{
+			writer.StartObject();
+			writer.Key("name"); writer.String(e.name);
+			writer.Key("ph"); writer.String("X");
+			writer.Key("pid"); writer.Uint(0);
+			writer.Key("tid"); writer.Uint(t);
+			writer.Key("ts"); writer.Double(e.begin * 1e-3);
+			writer.Key("dur"); writer.Double((e.end - e.begin) * 1e-3);
+			writer.EndObject();
+		}
+	}
+	writer.EndArray();
+	writer.EndObject();
+	return sb.GetString();
+}
+
+void saveChromeTrace(const string& fileName)
+{
+	ofstream file(fileName);
+	if (!file) throw runtime_error("could not open " + fileName);
+	file << getChromeTrace();
+}
+
+vector<ProfileScopeStats> computeStats()
+{
+	// group by name, different literals can have the same text
+	map<string, vector<uint64_t>> durations;
+	const unsigned numThreads = getNumThreads();
+	for (unsigned t = 0; t < numThreads; t++)
+	{
+		string prefix;
+		{
+			lock_guard<mutex> lock(getRegistry().lock);
+			const ThreadBuffer& buffer = *getRegistry().buffers[t];
+			if (buffer.isTrack) prefix = buffer.name + "/";
+		}
+		for (const ProfileEvent& e : getEvents(t)) durations[prefix + e.name].push_back(e.end - e.begin);
+	}
+
+	vector<ProfileScopeStats> stats;
+	for (auto& it : durations)
+	{
+		vector<uint64_t>& d = it.second;
+		sort(d.begin(), d.end());
+		uint64_t total = 0;
+		for (uint64_t x : d) total += x;
+		const size_t p99 = std::min(d.size() - 1, (size_t)(0.99 * d.size()));
+
+		ProfileScopeStats s;
+		s.name = it.first;
+		s.count = (unsigned)d.size();
+		s.minMs = d.front() * 1e-6;
+		s.avgMs = (double)total / d.size() * 1e-6;
+		s.p99Ms = d[p99] * 1e-6;
+		s.maxMs = d.back() * 1e-6;
+		stats.push_back(s);
+	}
+	sort(stats.begin(), stats.end(), [](const ProfileScopeStats& a, const ProfileScopeStats& b)
+	{
+		return a.avgMs * a.count > b.avgMs * b.count;
+	});
+	return stats;
+}
+
+string statsToString(const vector<ProfileScopeStats>& stats)
+{
+	stringstream ss;
+	ss << fixed << setprecision(3);
+	ss << setw(32) << left << "scope" << right
+		<< setw(8) << "count" << setw(10) << "min ms" << setw(10) << "avg ms"
+		<< setw(10) << "p99 ms" << setw(10) << "max ms" << "\n";
+	for (const ProfileScopeStats& s : stats)
+	{
+		ss << setw(32) << left << s.name << right
+			<< setw(8) << s.count << setw(10) << s.minMs << setw(10) << s.avgMs
+			<< setw(10) << s.p99Ms << setw(10) << s.maxMs << "\n";
+	}
+	return ss.str();
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Scoped CPU profiler.
+TUKI_PROFILE_SCOPE("name") measures the time until the end of the enclosing scope.
+The events are written to a ring buffer of the calling thread without locks, so the
+profiler keeps the last MAX_EVENTS_PER_THREAD events of each thread.
+The names must be string literals (or live forever), only the pointer is stored.
+The macros are compiled out unless the library is built with the TUKI_PROFILE option.
+*/
+
+struct ProfileEvent
+{
+	const char* name;
+	std::uint64_t begin, end;	// nanoseconds since the profiler started
+};
+
+struct ProfileScopeStats
+{
+	std::string name;
+	unsigned count;
+	double minMs, avgMs, p99Ms, maxMs;
+};
+
+namespace Profiler
+{
+
+static const unsigned MAX_EVENTS_PER_THREAD = 1 << 16;
+
+bool isEnabled();
+
+// nanoseconds since the profiler started
+std::uint64_t now();
+
+void recordEvent(const char* name, std::uint64_t begin, std::uint64_t end);
+
+// tracks are buffers for events that are not measured by a thread (e.g. the GPU)
+// they appear as other threads in the trace and their scope names are prefixed in the stats
+// only one thread can record events in a track
+unsigned createTrack(const char* name);
+void recordTrackEvent(unsigned track, const char* name, std::uint64_t begin, std::uint64_t end);
+
+// name of the calling thread in the trace
+void setThreadName(const char* name);
+
+// the events in the buffers. It's not synchronized with the threads that are recording,
+// call it when the threads are not profiling (e.g. between frames)
+// the tracks are included in the threads
+std::vector<ProfileEvent> getEvents(unsigned threadIndex);
+unsigned getNumThreads();
+
+// removes the recorded events
+void clear();
+
+// chrome://tracing (and Perfetto) JSON format
+std::string getChromeTrace();
+void saveChromeTrace(const std::string& fileName);
+
+// statistics of each scope name over the events in the buffers, sorted by total time
+std::vector<ProfileScopeStats> computeStats();
+std::string statsToString(const std::vector<ProfileScopeStats>& stats);
+
+}
+
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name) : name(name), begin(Profiler::now()) {}
+	~ProfileScope() { Profiler::recordEvent(name, begin, Profiler::now()); }
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+	const char* name;
+	std::uint64_t begin;
+};
+
+#define TUKI_PROFILE_CONCAT_(a, b) a##b
+#define TUKI_PROFILE_CONCAT(a, b) TUKI_PROFILE_CONCAT_(a, b)
+
+#ifdef TUKI_PROFILE
+	#define TUKI_PROFILE_SCOPE(name) ProfileScope TUKI_PROFILE_CONCAT(profileScope_, __LINE__)(name)
+	#define TUKI_PROFILE_FUNCTION() TUKI_PROFILE_SCOPE(__FUNCTION__)
+#else
+	#define TUKI_PROFILE_SCOPE(name)
+	#define TUKI_PROFILE_FUNCTION()
+#endif
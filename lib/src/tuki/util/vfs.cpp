@@ -0,0 +1,204 @@
+#include "vfs.hpp"
+
+#include "asset_pack.hpp"
+#include "profiler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// VFS FILE
+
+VfsFile::VfsFile(VfsFile&& o)
+	: data(o.data)
+	, size(o.size)
+	, buffer(move(o.buffer))
+	, mapping(move(o.mapping))
+{
+	o.data = nullptr;
+	o.size = 0;
+}
+
+VfsFile& VfsFile::operator=(VfsFile&& o)
+{
+	if (this != &o)
+	{
+		data = o.data;
+		size = o.size;
+		buffer = move(o.buffer);
+		mapping = move(o.mapping);
+		o.data = nullptr;
+		o.size = 0;
+	}
+	return *this;
+}
+
+void VfsFile::close()
+{
+	data = nullptr;
+	size = 0;
+	buffer.clear();
+	buffer.shrink_to_fit();
+	mapping.reset();
+}
+
+// VFS
+
+static string withSlash(const string& dir)
+{
+	if (dir.empty() || dir.back() == '/') return dir;
+	return dir + '/';
+}
+
+Vfs::Vfs()
+	: mounts(make_shared<MountList>())
+{}
+
+void Vfs::mountDirectory(const string& mountPoint, const string& dir)
+{
+	shared_ptr<Mount> mount = make_shared<Mount>();
+	mount->point = withSlash(mountPoint);
+	mount->dir = withSlash(dir);
+	addMount(mount);
+}
+
+void Vfs::mountPack(const string& mountPoint, const string& packFile)
+{
+	TUKI_PROFILE_SCOPE("Vfs::mountPack");
+	shared_ptr<Mount> mount = make_shared<Mount>();
+	mount->point = withSlash(mountPoint);
+	mount->pack = make_shared<AssetPack>(packFile);
+	addMount(mount);
+}
+
+void Vfs::addMount(const shared_ptr<const Mount>& mount)
+{
+	lock_guard<std::mutex> lock(mutex);
+	shared_ptr<MountList> list = make_shared<MountList>(*mounts);
+	list->push_back(mount);
+	mounts = list;
+}
+
+void Vfs::unmount(const string& mountPoint)
+{
+	const string point = withSlash(mountPoint);
+	lock_guard<std::mutex> lock(mutex);
+	shared_ptr<MountList> list = make_shared<MountList>();
+	for (const shared_ptr<const Mount>& mount : *mounts)
+	{
+		if (mount->point != point) list->push_back(mount);
+	}
+	mounts = list;
+}
+
+void Vfs::unmountAll()
+{
+	lock_guard<std::mutex> lock(mutex);
+	mounts = make_shared<MountList>();
+}
+
+bool Vfs::exists(const string& path)const
+{
+	return open(path, false, nullptr);
+}
+
+VfsFile Vfs::read(const string& path)const
+{
+	VfsFile file;
+	if (!open(path, false, &file)) throw runtime_error("could not open " + path);
+	return file;
+}
+
+VfsFile Vfs::map(const string& path)const
+{
+	VfsFile file;
+	if (!open(path, true, &file)) throw runtime_error("could not open " + path);
+	return file;
+}
+
+string Vfs::readString(const string& path)const
+{
+	return read(path).toString();
+}
+
+bool Vfs::open(const string& path, bool mapLoose, VfsFile* file)const
+{
+	shared_ptr<const MountList> list;
+	{
+		lock_guard<std::mutex> lock(mutex);
+		list = mounts;
+	}
+	for (auto it = list->rbegin(); it != list->rend(); ++it)
+	{
+		const Mount& mount = **it;
+		if (path.compare(0, mount.point.size(), mount.point) != 0) continue;
+		const char* relPath = path.c_str() + mount.point.size();
+		if (mount.pack)
+		{
+			const int entry = mount.pack->findEntry(NameId(relPath));
+			// another path with the same hash
+			if (entry < 0 || strcmp(mount.pack->getEntryPath(entry), relPath) != 0) continue;
+			if (file) readPackEntry(mount.pack, entry, *file);
+			return true;
+		}
+		if (openLoose(mount.dir + relPath, mapLoose, file)) return true;
+	}
+	return openLoose(path, mapLoose, file);
+}
+
+bool Vfs::openLoose(const string& fileName, bool map, VfsFile* file)
+{
+	FILE* f = fopen(fileName.c_str(), "rb");
+	if (!f) return false;
+	if (!file)
+	{
+		fclose(f);
+		return true;
+	}
+
+	fseek(f, 0, SEEK_END);
+	const long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size < 0)
+	{
+		fclose(f);
+		throw runtime_error("could not read " + fileName);
+	}
+	file->close();
+	if (map && size > 0)
+	{
+		fclose(f);
+		shared_ptr<MappedFile> mapping = make_shared<MappedFile>(fileName);
+		file->data = mapping->getData();
+		file->size = mapping->getSize();
+		file->mapping = mapping;
+		return true;
+	}
+
+	file->buffer.resize((size_t)size);
+	const size_t numRead = size ? fread(file->buffer.data(), 1, (size_t)size, f) : 0;
+	fclose(f);
+	if (numRead != (size_t)size) throw runtime_error("could not read " + fileName);
+	file->data = file->buffer.data();
+	file->size = file->buffer.size();
+	return true;
+}
+
+void Vfs::readPackEntry(const shared_ptr<const AssetPack>& pack, unsigned entry, VfsFile& file)
+{
+	file.close();
+	if (pack->getEntry(entry).flags & ASSET_PACK_COMPRESSED)
+	{
+		pack->readEntry(entry, file.buffer);
+		file.data = file.buffer.data();
+		file.size = file.buffer.size();
+	}
+	else
+	{
+		// in place
+		file.mapping = pack->getMappedFile();
+		file.data = pack->getEntryData(entry);
+		file.size = (size_t)pack->getEntry(entry).size;
+	}
+}
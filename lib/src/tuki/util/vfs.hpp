@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include "singleton.hpp"
+#include "mapped_file.hpp"
+
+class AssetPack;
+
+/* The contents of a file read through the Vfs
+ The entries of the packs that are not compressed and the mapped files are read in place,
+ the rest is owned. It keeps the pack alive */
+class VfsFile
+{
+public:
+	VfsFile() : data(nullptr), size(0) {}
+	VfsFile(VfsFile&& o);
+	VfsFile& operator=(VfsFile&& o);
+	VfsFile(const VfsFile&) = delete;
+	VfsFile& operator=(const VfsFile&) = delete;
+
+	const unsigned char* getData()const { return data; }
+	std::size_t getSize()const { return size; }
+	std::string toString()const { return std::string((const char*)data, size); }
+	void close();
+
+private:
+	friend class Vfs;
+	const unsigned char* data;
+	std::size_t size;
+	std::vector<unsigned char> buffer;
+	std::shared_ptr<const MappedFile> mapping;
+};
+
+/* Virtual file system, the assets are loaded through it
+ - the paths use '/'. A mount point is a prefix of the paths, "" is the root
+ - a mount is a directory or an AssetPack. The last mounted are searched first
+ - the paths that are not in any mount are read from the OS as they are, so nothing needs to be
+   mounted to load loose files
+ Everything can be called from any thread */
+class Vfs : public Singleton<Vfs>
+{
+public:
+	void mountDirectory(const std::string& mountPoint, const std::string& dir);
+	// throws runtime_error if it's not a valid pack
+	void mountPack(const std::string& mountPoint, const std::string& packFile);
+	// the files that have been read keep the packs alive
+	void unmount(const std::string& mountPoint);
+	void unmountAll();
+
+	bool exists(const std::string& path)const;
+	// throw runtime_error if the file is not found
+	VfsFile read(const std::string& path)const;
+	// the same, but the loose files are mapped instead of read. For the big files that are used in place
+	VfsFile map(const std::string& path)const;
+	std::string readString(const std::string& path)const;
+
+private:
+	friend class Singleton<Vfs>;
+	Vfs();
+
+	struct Mount
+	{
+		std::string point;	// with '/' at the end, empty for the root
+		std::string dir;	// with '/' at the end, for the directories
+		std::shared_ptr<const AssetPack> pack;
+	};
+	typedef std::vector<std::shared_ptr<const Mount> > MountList;
+
+	// returns false if it's not found. With a null file it only checks if it exists
+	bool open(const std::string& path, bool mapLoose, VfsFile* file)const;
+	static bool openLoose(const std::string& fileName, bool map, VfsFile* file);
+	static void readPackEntry(const std::shared_ptr<const AssetPack>& pack, unsigned entry, VfsFile& file);
+	void addMount(const std::shared_ptr<const Mount>& mount);
+
+	// DATA //
+	// the list is replaced when mounting, so the readers only lock to take it
+	mutable std::mutex mutex;
+	std::shared_ptr<const MountList> mounts;
+};
@@ -0,0 +1,72 @@
+#include "vfs_io_system.hpp"
+
+#include "vfs.hpp"
+#include <assimp/IOStream.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// read only stream over a VfsFile
+class VfsIOStream : public Assimp::IOStream
+{
+public:
+	explicit VfsIOStream(VfsFile&& file) : file(move(file)), pos(0) {}
+
+	size_t Read(void* buffer, size_t size, size_t count) override
+	{
+		if (size == 0) return 0;
+		const size_t n = min(count, (file.getSize() - pos) / size);
+		if (n) memcpy(buffer, file.getData() + pos, n * size);
+		pos += n * size;
+		return n;
+	}
+	size_t Write(const void*, size_t, size_t) override { return 0; }
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		const size_t size = file.getSize();
+		size_t newPos;
+		if (origin == aiOrigin_SET) newPos = offset;
+		else if (origin == aiOrigin_CUR) newPos = pos + offset;
+		else
+		{
+			if (offset > size) return aiReturn_FAILURE;
+			newPos = size - offset;
+		}
+		if (newPos > size) return aiReturn_FAILURE;
+		pos = newPos;
+		return aiReturn_SUCCESS;
+	}
+	size_t Tell()const override { return pos; }
+	size_t FileSize()const override { return file.getSize(); }
+	void Flush() override {}
+
+private:
+	VfsFile file;
+	size_t pos;
+};
+
+bool VfsIOSystem::Exists(const char* fileName)const
+{
+	return Vfs::getSingleton()->exists(fileName);
+}
+
+Assimp::IOStream* VfsIOSystem::Open(const char* fileName, const char* mode)
+{
+	// only for reading
+	if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+')) return nullptr;
+	try
+	{
+		return new VfsIOStream(Vfs::getSingleton()->read(fileName));
+	}
+	catch (const runtime_error&)
+	{
+		return nullptr;
+	}
+}
+
+void VfsIOSystem::Close(Assimp::IOStream* stream)
+{
+	delete stream;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <assimp/IOSystem.hpp>
+
+// lets assimp read the files (and the ones they reference, like .mtl) through the Vfs
+// use it with Assimp::Importer::SetIOHandler
+class VfsIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* fileName)const override;
+	char getOsSeparator()const override { return '/'; }
+	Assimp::IOStream* Open(const char* fileName, const char* mode = "rb") override;
+	void Close(Assimp::IOStream* stream) override;
+};
@@ -4,6 +4,12 @@
 #include <glad/glad.h>
 #include <tuki/render/gl/render.hpp>
 #include <tuki/render/material/material.hpp>
+#include <tuki/render/texture/texture_manager.hpp>
+#include <tuki/util/mallocr/mallocr_arena.hpp>
+#include <tuki/render/gl/gpu_profiler.hpp>
+#include <tuki/render/gl/gl_trace.hpp>
+#include <tuki/render/gl/render_capture.hpp>
+#include <cstring>
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace std;
@@ -14,6 +20,13 @@ const unsigned SCREEN_HEIGHT = 600;
 static SDL_Window* window;
 static bool run;
 
+// hashed at compile time
+static constexpr NameId MODEL_VIEW_PROJ_MAT("modelViewProjMat");
+static constexpr NameId MODEL_MAT("modelMat");
+static constexpr NameId MODEL_VIEW_MAT("modelViewMat");
+static constexpr NameId NORMAL_MAT("normalMat");
+static constexpr NameId LIGHT_DIR("L");
+
 int main(int argc, char** argv)
 {
 
@@ -42,6 +55,14 @@ int main(int argc, char** argv)
 		cout << "gladLoadGL failed" << endl;
 	}
 
+	// --gl-trace: count the GL calls, press T to print the ones of the last frame
+	// --capture <file>: write the render calls for render_replay
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--gl-trace") == 0) GlTrace::install();
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) RenderCapture::begin(argv[++i]);
+	}
+
 	const GLubyte *oglVersion = glGetString(GL_VERSION);
 	std::cout << "This system supports OpenGL Version: " << oglVersion << std::endl;
 	const GLubyte *gpuVendor = glGetString(GL_VENDOR);
@@ -52,8 +73,10 @@ int main(int argc, char** argv)
 	glEnable(GL_CULL_FACE);
 	
 	MaterialManager* materialManager = MaterialManager::getSingleton();
+	TextureManager* textureManager = TextureManager::getSingleton();
 	Material material;
 	try {
+		textureManager->loadConstantTextures("config/constant_textures.json");
 		material = materialManager->loadMaterial("materials/red_material.json");
 	}
 	catch (runtime_error e){
@@ -69,6 +92,9 @@ int main(int argc, char** argv)
 	run = true;
 	while (run)
 	{
+		// the frame memory of the previous frame is not used anymore
+		LinearArena::beginFrame();
+		GpuProfiler::getSingleton()->beginFrame();
 
 		// compute delta time
 		curTime = (float)SDL_GetTicks();
@@ -82,6 +108,12 @@ int main(int argc, char** argv)
 				event.type == SDL_QUIT) {
 				run = false;
 			}
+			if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_t && GlTrace::isInstalled())
+			{
+				cout << GlTrace::getLastFrameCalls() << " GL calls, "
+					<< GlTrace::getLastFrameDriverMs() << " ms in the driver" << endl;
+				cout << GlTrace::statsToString(GlTrace::getLastFrameStats());
+			}
 		}
 		
 		glClear(GL_COLOR_BUFFER_BIT);
@@ -93,18 +125,23 @@ int main(int argc, char** argv)
 		glm::mat4 modelViewMat = viewMat * modelMat;
 		glm::mat4 modelViewProj = projMat * modelViewMat;
 		glm::mat3 normalMat = glm::inverse(glm::transpose(modelViewMat));
-		shaderProg.uploadUniform("modelViewProjMat", modelViewProj);
-		shaderProg.uploadUniform("modelMat", modelMat);
-		shaderProg.uploadUniform("modelViewMat", modelViewMat);
-		shaderProg.uploadUniform("normalMat", normalMat);
-		shaderProg.uploadUniform("L", glm::vec3(0, 0, 1));
+		shaderProg.uploadUniform(MODEL_VIEW_PROJ_MAT, modelViewProj);
+		shaderProg.uploadUniform(MODEL_MAT, modelMat);
+		shaderProg.uploadUniform(MODEL_VIEW_MAT, modelViewMat);
+		shaderProg.uploadUniform(NORMAL_MAT, normalMat);
+		shaderProg.uploadUniform(LIGHT_DIR, glm::vec3(0, 0, 1));
 		material.use();
 		meshGpu.bind();
-		glDrawElements(GL_TRIANGLES, meshGpu.getNumElements(), GL_UNSIGNED_INT, 0);
+		RenderApi::draw(meshGpu);
 
+		textureManager->update();
+		GpuProfiler::getSingleton()->endFrame();
+		GlTrace::endFrame();
+		RenderCapture::endFrame();
 		SDL_GL_SwapWindow(window);
 
 	}
+	RenderCapture::end();
 
 	return 0;
 
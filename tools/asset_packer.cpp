@@ -0,0 +1,105 @@
+#include <tuki/util/asset_pack.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <dirent.h>
+	#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+static const char* USAGE =
+	"usage: asset_packer <output> <dir> [--compress]\n"
+	"  packs all the files in dir (recursively), with their paths relative to it\n"
+	"  --compress: compress the entries with zlib, except the ones that barely shrink\n"
+	"mount the pack with Vfs::mountPack\n";
+
+// paths relative to the root, with '/'
+static void listFiles(const string& root, const string& relDir, vector<string>& paths)
+{
+	const string dir = relDir.empty() ? root : root + "/" + relDir;
+	const string prefix = relDir.empty() ? "" : relDir + "/";
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dir + "/*").c_str(), &data);
+	if (h == INVALID_HANDLE_VALUE) throw runtime_error("could not open the directory " + dir);
+	do
+	{
+		const string name = data.cFileName;
+		if (name == "." || name == "..") continue;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) listFiles(root, prefix + name, paths);
+		else paths.push_back(prefix + name);
+	} while (FindNextFileA(h, &data));
+	FindClose(h);
+#else
+	DIR* d = opendir(dir.c_str());
+	if (!d) throw runtime_error("could not open the directory " + dir);
+	while (dirent* e = readdir(d))
+	{
+		const string name = e->d_name;
+		if (name == "." || name == "..") continue;
+		struct stat st;
+		if (stat((dir + "/" + name).c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) listFiles(root, prefix + name, paths);
+		else if (S_ISREG(st.st_mode)) paths.push_back(prefix + name);
+	}
+	closedir(d);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cout << USAGE;
+		return 1;
+	}
+	const string output = argv[1];
+	string root = argv[2];
+	while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')) root.pop_back();
+	bool compress = false;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--compress") == 0) compress = true;
+		else
+		{
+			cout << USAGE;
+			return 1;
+		}
+	}
+
+	try
+	{
+		vector<string> paths;
+		listFiles(root, "", paths);
+		// the same pack for the same files
+		sort(paths.begin(), paths.end());
+		vector<string> files(paths.size());
+		for (size_t i = 0; i < paths.size(); i++) files[i] = root + "/" + paths[i];
+
+		AssetPack::cook(paths, files, output, compress);
+		AssetPack pack(output);
+		uint64_t originalSize = 0, storedSize = 0;
+		unsigned numCompressed = 0;
+		for (unsigned i = 0; i < pack.getNumEntries(); i++)
+		{
+			const AssetPackEntry& e = pack.getEntry(i);
+			originalSize += e.originalSize;
+			storedSize += e.size;
+			if (e.flags & ASSET_PACK_COMPRESSED) numCompressed++;
+		}
+		cout << output << ": " << pack.getNumEntries() << " files (" << numCompressed << " compressed), "
+			<< originalSize << " -> " << storedSize << " bytes" << endl;
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
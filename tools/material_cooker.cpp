@@ -0,0 +1,99 @@
+#include <tuki/render/material/material.hpp>
+#include <tuki/render/material/material_pack.hpp>
+#include <tuki/render/gl/null_gl.hpp>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+static const char* USAGE =
+	"usage: material_cooker <output> <inputs...> [--bench <runs>]\n"
+	"  inputs: material and material template JSON files, the paths are relative to the assets root\n"
+	"  --bench: compare the load time of the JSON files and the pack\n"
+	"run it from the assets root, the paths of the files are the ones used to find them in the pack\n";
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsedMs(Clock::time_point t0)
+{
+	return chrono::duration<double, milli>(Clock::now() - t0).count();
+}
+
+static void bench(const vector<string>& inputs, const string& output, unsigned runs)
+{
+	// the templates are already loaded by the cooker, only the materials are timed
+	MaterialManager* man = MaterialManager::getSingleton();
+	vector<string> materialPaths;
+	for (const string& input : inputs)
+	{
+		if (man->getMaterialTemplate(input).getId() == 0xFFFF)
+			materialPaths.push_back(input);
+	}
+
+	double jsonMs = 0, packMs = 0;
+	vector<Material> materials;
+	materials.reserve(materialPaths.size());
+	for (unsigned r = 0; r < runs; r++)
+	{
+		Clock::time_point t0 = Clock::now();
+		for (const string& path : materialPaths)
+			materials.push_back(man->loadMaterial(path));
+		jsonMs += elapsedMs(t0);
+		for (const Material& mat : materials) man->releaseMaterial(mat);
+		materials.clear();
+
+		t0 = Clock::now();
+		MaterialPack pack(output);
+		packMs += elapsedMs(t0);
+		pack.free();
+	}
+	cout << materialPaths.size() << " materials, " << runs << " runs" << endl;
+	cout << "JSON files: " << jsonMs / runs << " ms" << endl;
+	cout << "pack:       " << packMs / runs << " ms" << endl;
+	cout << "speedup: " << jsonMs / packMs << "x" << endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cout << USAGE;
+		return 1;
+	}
+	const string output = argv[1];
+	vector<string> inputs;
+	unsigned benchRuns = 0;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) benchRuns = atoi(argv[++i]);
+		else if (argv[i][0] == '-')
+		{
+			cout << USAGE;
+			return 1;
+		}
+		else inputs.push_back(argv[i]);
+	}
+
+	// the shaders are referenced by path, they don't need to be compiled
+	NullGl::install();
+
+	try
+	{
+		MaterialPack::cook(inputs, output);
+		MaterialPack pack(output);
+		cout << output << ": " << pack.getTemplates().size() << " templates, "
+			<< pack.getMaterials().size() << " materials" << endl;
+		pack.free();
+
+		if (benchRuns) bench(inputs, output, benchRuns);
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <tuki/render/mesh/mesh.hpp>
+#include <tuki/render/mesh/mesh_file.hpp>
+#include <tuki/render/mesh/mesh_optimizer.hpp>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+static const char* USAGE =
+	"usage: mesh_cooker <input> <output> [--no-optimize] [--bench <runs>]\n"
+	"  input: any mesh format supported by assimp\n"
+	"  --no-optimize: keep the original order of the triangles and vertices\n"
+	"  --bench: compare the load time of the input and the cooked file\n";
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsedMs(Clock::time_point t0)
+{
+	return chrono::duration<double, milli>(Clock::now() - t0).count();
+}
+
+// reading all the data, as the upload to the GPU would do
+static float touchMeshData(const IMesh& mesh)
+{
+	float sum = 0;
+	for (unsigned a = 0; a < (unsigned)AttribLocation::NUM_ATTRIBS; a++)
+	{
+		const float* data = mesh.getAttribData((AttribLocation)a);
+		if (!data) continue;
+		const unsigned n = mesh.getNumVertices() * ATTRIB_NUM_COMPONENTS[a];
+		for (unsigned i = 0; i < n; i++) sum += data[i];
+	}
+	const unsigned* indices = mesh.getIndices();
+	for (unsigned i = 0; indices && i < mesh.getNumIndices(); i++) sum += indices[i];
+	return sum;
+}
+
+static void bench(const char* input, const char* output, unsigned runs)
+{
+	double objMs = 0, cookedMs = 0;
+	float checksum = 0;
+	for (unsigned r = 0; r < runs; r++)
+	{
+		Clock::time_point t0 = Clock::now();
+		Mesh mesh = Mesh::load(input, false);
+		checksum += touchMeshData(mesh);
+		objMs += elapsedMs(t0);
+		mesh.free();
+
+		t0 = Clock::now();
+		MappedMesh mapped(output);
+		checksum += touchMeshData(mapped);
+		cookedMs += elapsedMs(t0);
+	}
+	cout << "import (assimp): " << objMs / runs << " ms" << endl;
+	cout << "cooked (mmap):   " << cookedMs / runs << " ms" << endl;
+	cout << "speedup: " << objMs / cookedMs << "x  (checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cout << USAGE;
+		return 1;
+	}
+	const char* input = argv[1];
+	const char* output = argv[2];
+	bool optimize = true;
+	unsigned benchRuns = 0;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--no-optimize") == 0) optimize = false;
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) benchRuns = atoi(argv[++i]);
+		else
+		{
+			cout << USAGE;
+			return 1;
+		}
+	}
+
+	try
+	{
+		MeshOptimizerReport report;
+		Mesh mesh = Mesh::load(input, optimize, optimize ? &report : nullptr);
+		MeshFile::save(mesh, output, optimize ? MeshFileFlags::OPTIMIZED : MeshFileFlags::NONE);
+		cout << output << ": " << mesh.getNumVertices() << " vertices, "
+			<< mesh.getNumIndices() / 3 << " triangles" << endl;
+		if (optimize)
+		{
+			cout << "ACMR: " << report.before.acmr << " -> " << report.after.acmr
+				<< "  ATVR: " << report.before.atvr << " -> " << report.after.atvr << endl;
+		}
+		mesh.free();
+
+		if (benchRuns) bench(input, output, benchRuns);
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
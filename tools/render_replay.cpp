@@ -0,0 +1,159 @@
+#include <tuki/render/gl/render.hpp>
+#include <tuki/render/gl/render_replayer.hpp>
+#include <tuki/render/gl/gl_trace.hpp>
+#include <tuki/render/gl/null_gl.hpp>
+#include <glad/glad.h>
+#include <SDL.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+static const char* USAGE =
+	"usage: render_replay <capture> [--repeat <n>] [--null-gl] [--gl-trace]\n"
+	"  capture: file written by RenderCapture\n"
+	"  --repeat: replay the frames n times, the resources that are alive at the end are kept for the next pass\n"
+	"  --null-gl: don't create a context, only the CPU side of the calls is measured\n"
+	"  --gl-trace: print the GL calls of the last frame\n";
+
+typedef chrono::high_resolution_clock Clock;
+
+static SDL_Window* createHiddenContext()
+{
+	if (SDL_Init(SDL_INIT_VIDEO) != 0) return nullptr;
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_Window* window = SDL_CreateWindow("render_replay", 0, 0, 800, 600,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (!window) return nullptr;
+	if (!SDL_GL_CreateContext(window) || !gladLoadGL()) return nullptr;
+	return window;
+}
+
+static string formatMs(double ms)
+{
+	stringstream ss;
+	ss << fixed << setprecision(3) << ms << " ms";
+	return ss.str();
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		cout << USAGE;
+		return 1;
+	}
+	const char* captureFile = argv[1];
+	unsigned repeat = 1;
+	bool nullGl = false;
+	bool glTrace = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--null-gl") == 0) nullGl = true;
+		else if (strcmp(argv[i], "--gl-trace") == 0) glTrace = true;
+		else
+		{
+			cout << USAGE;
+			return 1;
+		}
+	}
+
+	ifstream in(captureFile, ios::binary);
+	if (!in)
+	{
+		cerr << "could not open " << captureFile << endl;
+		return 1;
+	}
+	const vector<char> file((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	vector<CaptureRecord> records;
+	try
+	{
+		records = parseRenderCapture(file);
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	// frames: [frameBegins[i], frameBegins[i+1]), the records after the last frame run at the end
+	vector<size_t> frameBegins(1, 0);
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (records[i].cmd == CaptureCmd::FRAME_END) frameBegins.push_back(i + 1);
+	}
+	const size_t numFrames = frameBegins.size() - 1;
+	cout << records.size() << " records, " << numFrames << " frames" << endl;
+
+	if (nullGl) NullGl::install();
+	else if (!createHiddenContext())
+	{
+		cerr << "could not create a GL context (" << SDL_GetError() << "), try --null-gl" << endl;
+		return 1;
+	}
+	if (glTrace) GlTrace::install();
+
+	RenderReplayer replayer;
+	vector<double> frameMs;
+	try
+	{
+		for (unsigned pass = 0; pass < repeat; pass++)
+		{
+			if (pass > 0) replayer.beginRepeat();
+			for (size_t f = 0; f < numFrames; f++)
+			{
+				const Clock::time_point t0 = Clock::now();
+				for (size_t i = frameBegins[f]; i < frameBegins[f + 1]; i++) replayer.execute(records[i]);
+				glFinish();
+				frameMs.push_back(chrono::duration<double, milli>(Clock::now() - t0).count());
+				GlTrace::endFrame();
+			}
+		}
+		for (size_t i = frameBegins.back(); i < records.size(); i++) replayer.execute(records[i]);
+		replayer.freeAll();
+	}
+	catch (const exception& e)
+	{
+		cerr << "replay failed: " << e.what() << endl;
+		return 1;
+	}
+	catch (const string& linkError)
+	{
+		cerr << "replay failed: " << linkError << endl;
+		return 1;
+	}
+
+	if (frameMs.empty()) return 0;
+	// the first pass includes creating the resources, it's not measured if there are more
+	if (repeat > 1) frameMs.erase(frameMs.begin(), frameMs.begin() + numFrames);
+	vector<double> sorted = frameMs;
+	sort(sorted.begin(), sorted.end());
+	double total = 0;
+	for (double ms : sorted) total += ms;
+	const size_t n = sorted.size();
+	cout << "frames: " << n << ", total " << formatMs(total) << endl;
+	cout << "frame: min " << formatMs(sorted.front())
+		<< ", median " << formatMs(sorted[n / 2])
+		<< ", mean " << formatMs(total / n)
+		<< ", p90 " << formatMs(sorted[min(n - 1, (size_t)(0.9 * n))])
+		<< ", max " << formatMs(sorted.back()) << endl;
+	cout << "per frame: " << (double)replayer.numDraws / (repeat * numFrames) << " draws, "
+		<< (double)replayer.numMaterials / (repeat * numFrames) << " materials" << endl;
+	if (glTrace)
+	{
+		cout << GlTrace::getLastFrameCalls() << " GL calls in the last frame" << endl;
+		cout << GlTrace::statsToString(GlTrace::getLastFrameStats());
+	}
+	return 0;
+}